@@ -0,0 +1,272 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include "planner.h"
+#include "threadpool.h"
+
+using namespace std;
+
+/**
+ * The queries estimated to cost at most this much are cheap: they never wait to be admitted
+ */
+const double CHEAP_QUERY_COST = SHORT_QUERY_ROWS * (SEQUENTIAL_ROW_COST + FILTER_ROW_COST);
+
+enum QueryClass {
+    CHEAP_QUERY,    // admitted at once, e.g.: the point lookups and the small ranges
+    EXPENSIVE_QUERY // queued until there is a free slot and enough memory for it
+};
+
+class AdmissionController;
+
+/**
+ * The admission of a query, which holds its slot and memory grant until it's destroyed (or
+ * released). The token of the ticket has the deadline of the query, counted from its arrival
+ * e.g.: AdmissionTicket ticket = controller.admit(estimate);
+ *       CancellationScope scope(ticket.getToken());
+ */
+class AdmissionTicket {
+private:
+    AdmissionController * controller; // NULL once released
+    QueryClass query_class;
+    size_t memory_grant;
+    CancellationToken token;
+
+    friend class AdmissionController;
+
+    AdmissionTicket(AdmissionController * controller, QueryClass query_class, size_t memory_grant, const CancellationToken & token);
+    AdmissionTicket(const AdmissionTicket &);
+    AdmissionTicket & operator=(const AdmissionTicket &);
+
+public:
+    /**
+     * Take the admission of another ticket, which no longer releases it
+     * @constructor
+     */
+    AdmissionTicket(AdmissionTicket && other);
+
+    /**
+     * @destructor
+     */
+    ~AdmissionTicket();
+
+    /**
+     * Give back the slot and the memory grant, e.g.: once the rows are read
+     */
+    void release();
+
+    QueryClass getQueryClass() const;
+
+    /**
+     * @return HIGH_PRIORITY for the cheap queries, so their tasks run first
+     */
+    TaskPriority getPriority() const;
+
+    size_t getMemoryGrant() const;
+    CancellationToken getToken() const;
+};
+
+/**
+ * Admit the queries by their estimated cost, so the cheap ones keep a low latency while heavy
+ * queries run. The cheap queries are admitted at once. The expensive ones run at most
+ * max_expensive_queries at a time, with a memory grant out of a shared limit, and wait in
+ * arrival order otherwise. A query queued past its deadline is rejected, and the deadline
+ * then cancels the running query cooperatively, e.g.: its scans check the token on each block
+ * e.g.: with 2 slots, 3 heavy NESTED joins and a point lookup arriving at once, the lookup and
+ *       2 joins run while the third join waits for one of them to end
+ */
+class AdmissionController {
+private:
+    unsigned max_expensive_queries;
+    size_t memory_limit;
+    double cheap_cost;
+    double query_timeout; // seconds, 0 for no deadline
+
+    mutable mutex admission_mutex;
+    condition_variable released;
+    deque<unsigned long long> queue; // the expensive queries waiting, by arrival number
+    unsigned long long next_arrival;
+    unsigned running_queries[2]; // by QueryClass
+    size_t granted_memory;
+
+    AdmissionController(const AdmissionController &);
+    AdmissionController & operator=(const AdmissionController &);
+
+    friend class AdmissionTicket;
+
+    /**
+     * Give back the slot and the memory grant of a ticket
+     */
+    void release(QueryClass query_class, size_t memory_grant);
+
+    /**
+     * @return true if an expensive query with a memory grant can start now, with the lock held
+     */
+    bool hasRoomFor(size_t memory_grant) const;
+
+public:
+    static const size_t DEFAULT_MEMORY_LIMIT = 256 * 1024 * 1024;
+
+    /**
+     * @param max_expensive_queries - the expensive queries running at the same time, 0 for
+     *                                the number of threads of the shared ThreadPool
+     * @param memory_limit - the bytes granted to all the expensive queries running
+     * @param cheap_cost - the largest cost of a cheap query
+     * @constructor
+     */
+    AdmissionController(unsigned max_expensive_queries = 0, size_t memory_limit = DEFAULT_MEMORY_LIMIT,
+                        double cheap_cost = CHEAP_QUERY_COST);
+
+    /**
+     * Give each query admitted from now on a deadline
+     * @param seconds - from the arrival of the query, 0 for no deadline
+     */
+    void setQueryTimeout(double seconds);
+
+    QueryClass classify(const QueryEstimate & estimate) const;
+
+    /**
+     * Wait until the query can run. The memory grant is the estimated memory, up to the limit
+     * @throw invalid_argument if the deadline passed while the query was queued
+     */
+    AdmissionTicket admit(const QueryEstimate & estimate);
+
+    unsigned getRunningQueries(QueryClass query_class) const;
+    unsigned getQueuedQueries() const;
+    size_t getGrantedMemory() const;
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+AdmissionTicket::AdmissionTicket(AdmissionController * controller, QueryClass query_class, size_t memory_grant,
+                                 const CancellationToken & token) : token(token) {
+    this->controller = controller;
+    this->query_class = query_class;
+    this->memory_grant = memory_grant;
+}
+
+AdmissionTicket::AdmissionTicket(AdmissionTicket && other) : token(other.token) {
+    this->controller = other.controller;
+    this->query_class = other.query_class;
+    this->memory_grant = other.memory_grant;
+    other.controller = NULL;
+}
+
+AdmissionTicket::~AdmissionTicket() {
+    release();
+}
+
+void AdmissionTicket::release() {
+    if (controller != NULL) {
+        controller->release(query_class, memory_grant);
+        controller = NULL;
+    }
+}
+
+QueryClass AdmissionTicket::getQueryClass() const {
+    return query_class;
+}
+
+TaskPriority AdmissionTicket::getPriority() const {
+    return query_class == CHEAP_QUERY ? HIGH_PRIORITY : NORMAL_PRIORITY;
+}
+
+size_t AdmissionTicket::getMemoryGrant() const {
+    return memory_grant;
+}
+
+CancellationToken AdmissionTicket::getToken() const {
+    return token;
+}
+
+AdmissionController::AdmissionController(unsigned max_expensive_queries, size_t memory_limit, double cheap_cost) {
+    if (max_expensive_queries == 0) {
+        max_expensive_queries = ThreadPool::getShared().getNumberOfThreads();
+    }
+    this->max_expensive_queries = max_expensive_queries;
+    this->memory_limit = memory_limit;
+    this->cheap_cost = cheap_cost;
+    this->query_timeout = 0;
+    this->next_arrival = 0;
+    this->running_queries[CHEAP_QUERY] = 0;
+    this->running_queries[EXPENSIVE_QUERY] = 0;
+    this->granted_memory = 0;
+}
+
+void AdmissionController::setQueryTimeout(double seconds) {
+    unique_lock<mutex> lock(admission_mutex);
+    query_timeout = seconds;
+}
+
+QueryClass AdmissionController::classify(const QueryEstimate & estimate) const {
+    return estimate.cost <= cheap_cost ? CHEAP_QUERY : EXPENSIVE_QUERY;
+}
+
+bool AdmissionController::hasRoomFor(size_t memory_grant) const {
+    return running_queries[EXPENSIVE_QUERY] < max_expensive_queries && granted_memory + memory_grant <= memory_limit;
+}
+
+AdmissionTicket AdmissionController::admit(const QueryEstimate & estimate) {
+    CancellationToken token;
+    QueryClass query_class = classify(estimate);
+    size_t memory_grant = query_class == CHEAP_QUERY ? 0 : (size_t) min(max(0.0, estimate.memory), (double) memory_limit);
+
+    unique_lock<mutex> lock(admission_mutex);
+    if (query_timeout > 0) {
+        token.setDeadline(query_timeout);
+    }
+    if (query_class == EXPENSIVE_QUERY) {
+        //First in, first out: a query needing a large grant isn't overtaken by the smaller ones
+        unsigned long long arrival = next_arrival++;
+        queue.push_back(arrival);
+        while (queue.front() != arrival || !hasRoomFor(memory_grant)) {
+            if (token.isCancelled()) {
+                queue.erase(find(queue.begin(), queue.end(), arrival));
+                released.notify_all();
+                throw std::invalid_argument("The query missed its deadline while waiting to be admitted");
+            }
+            if (query_timeout > 0) {
+                released.wait_for(lock, chrono::milliseconds(10));
+            } else {
+                released.wait(lock);
+            }
+        }
+        queue.pop_front();
+        granted_memory += memory_grant;
+        //The next query may fit too
+        released.notify_all();
+    }
+    running_queries[query_class]++;
+    return AdmissionTicket(this, query_class, memory_grant, token);
+}
+
+void AdmissionController::release(QueryClass query_class, size_t memory_grant) {
+    unique_lock<mutex> lock(admission_mutex);
+    running_queries[query_class]--;
+    granted_memory -= memory_grant;
+    released.notify_all();
+}
+
+unsigned AdmissionController::getRunningQueries(QueryClass query_class) const {
+    unique_lock<mutex> lock(admission_mutex);
+    return running_queries[query_class];
+}
+
+unsigned AdmissionController::getQueuedQueries() const {
+    unique_lock<mutex> lock(admission_mutex);
+    return queue.size();
+}
+
+size_t AdmissionController::getGrantedMemory() const {
+    unique_lock<mutex> lock(admission_mutex);
+    return granted_memory;
+}
+
+#endif //ADMISSION_H
@@ -0,0 +1,254 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <new>
+#include <limits>
+#include <cstddef>
+#include <stdlib.h>
+#include <stdint.h>
+
+//On C++17 the arena is also a std::pmr::memory_resource, for the std::pmr containers
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define HAS_MEMORY_RESOURCE
+#endif
+#endif
+
+using namespace std;
+
+/**
+ * A bump allocator for the temporary memory of a query, e.g.: the nodes of its hash tables.
+ * An allocation moves a pointer on the current chunk, and nothing is freed until the arena
+ * is reset or destroyed, when all the chunks are released at once
+ * e.g.: Arena arena;
+ *       unordered_map<long long, long long, hash<long long>, equal_to<long long>,
+ *                     ArenaAllocator<pair<const long long, long long> > > map(0, hash<long long>(),
+ *                     equal_to<long long>(), ArenaAllocator<pair<const long long, long long> >(&arena));
+ *
+ * The chunks double in size up to MAX_CHUNK_SIZE, and the allocations larger than half a
+ * chunk get a chunk of their own. An arena is used by one thread at a time, the threads of a
+ * query each fill their own
+ * @see ArenaAllocator
+ */
+class Arena
+#ifdef HAS_MEMORY_RESOURCE
+    : public std::pmr::memory_resource
+#endif
+{
+private:
+    vector<char *> chunks;
+    char * current; // the free bytes of the last chunk
+    size_t remaining;
+    size_t chunk_size; // of the next chunk
+    size_t first_chunk_size;
+    size_t bytes_allocated;
+    size_t bytes_reserved;
+
+    Arena(const Arena &);
+    Arena & operator=(const Arena &);
+
+    char * newChunk(size_t size);
+
+#ifdef HAS_MEMORY_RESOURCE
+    void * do_allocate(size_t size, size_t alignment) override;
+    void do_deallocate(void * pointer, size_t size, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override;
+#endif
+
+public:
+    static const size_t FIRST_CHUNK_SIZE = 4096;
+    static const size_t MAX_CHUNK_SIZE = 1 << 20;
+
+    /**
+     * No memory is reserved until the first allocation
+     * @constructor
+     */
+    Arena(size_t first_chunk_size = FIRST_CHUNK_SIZE);
+
+    /**
+     * Release all the chunks
+     * @destructor
+     */
+    ~Arena();
+
+    /**
+     * @param alignment - a power of 2
+     * @throw bad_alloc if the chunk can't be allocated
+     * @return size bytes, valid until the arena is reset or destroyed
+     */
+    void * allocate(size_t size, size_t alignment = alignof(max_align_t));
+
+    /**
+     * Release all the chunks at once. The memory allocated before is no longer valid
+     */
+    void reset();
+
+    /**
+     * @return the bytes returned by allocate since the last reset
+     */
+    size_t getBytesAllocated() const;
+
+    /**
+     * @return the bytes of the chunks held by the arena
+     */
+    size_t getBytesReserved() const;
+};
+
+/**
+ * A standard allocator taking its memory from an Arena, for the containers of a query.
+ * deallocate does nothing, the memory is released with the arena, so the arena must outlive
+ * the containers using it
+ */
+template <class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    Arena * arena;
+
+    /**
+     * @constructor
+     */
+    explicit ArenaAllocator(Arena * arena);
+
+    /**
+     * The same arena, for another type, e.g.: the nodes of a container
+     * @constructor
+     */
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> & other);
+
+    /**
+     * @throw bad_alloc if n values of T don't fit in a size_t, or the arena is out of memory
+     */
+    T * allocate(size_t n);
+    void deallocate(T * pointer, size_t n);
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T> & a, const ArenaAllocator<U> & b);
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T> & a, const ArenaAllocator<U> & b);
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+Arena::Arena(size_t first_chunk_size) {
+    this->current = NULL;
+    this->remaining = 0;
+    this->first_chunk_size = first_chunk_size > 0 ? first_chunk_size : FIRST_CHUNK_SIZE;
+    this->chunk_size = this->first_chunk_size;
+    this->bytes_allocated = 0;
+    this->bytes_reserved = 0;
+}
+
+Arena::~Arena() {
+    reset();
+}
+
+char * Arena::newChunk(size_t size) {
+    char * chunk = (char *) malloc(size);
+    if (chunk == NULL) {
+        throw std::bad_alloc();
+    }
+    chunks.push_back(chunk);
+    bytes_reserved += size;
+    return chunk;
+}
+
+void * Arena::allocate(size_t size, size_t alignment) {
+    if (size > numeric_limits<size_t>::max() - alignment) {
+        throw std::bad_alloc();
+    }
+    //The padding to align the current pointer
+    size_t padding = (alignment - (uintptr_t) current % alignment) % alignment;
+    if (current != NULL && padding + size <= remaining) {
+        char * pointer = current + padding;
+        current += padding + size;
+        remaining -= padding + size;
+        bytes_allocated += size;
+        return pointer;
+    }
+
+    //A large allocation would waste most of a shared chunk
+    if (size + alignment > chunk_size / 2) {
+        char * chunk = newChunk(size + alignment);
+        bytes_allocated += size;
+        return chunk + (alignment - (uintptr_t) chunk % alignment) % alignment;
+    }
+
+    current = newChunk(chunk_size);
+    remaining = chunk_size;
+    chunk_size = min(chunk_size * 2, max((size_t) MAX_CHUNK_SIZE, first_chunk_size));
+    return allocate(size, alignment);
+}
+
+void Arena::reset() {
+    for (vector<char *>::iterator it = chunks.begin(); it != chunks.end(); it++) {
+        free(*it);
+    }
+    chunks.clear();
+    current = NULL;
+    remaining = 0;
+    chunk_size = first_chunk_size;
+    bytes_allocated = 0;
+    bytes_reserved = 0;
+}
+
+size_t Arena::getBytesAllocated() const {
+    return bytes_allocated;
+}
+
+size_t Arena::getBytesReserved() const {
+    return bytes_reserved;
+}
+
+#ifdef HAS_MEMORY_RESOURCE
+void * Arena::do_allocate(size_t size, size_t alignment) {
+    return allocate(size, alignment);
+}
+
+void Arena::do_deallocate(void *, size_t, size_t) {
+}
+
+bool Arena::do_is_equal(const std::pmr::memory_resource & other) const noexcept {
+    return this == &other;
+}
+#endif
+
+template <class T>
+ArenaAllocator<T>::ArenaAllocator(Arena * arena) : arena(arena) {
+}
+
+template <class T>
+template <class U>
+ArenaAllocator<T>::ArenaAllocator(const ArenaAllocator<U> & other) : arena(other.arena) {
+}
+
+template <class T>
+T * ArenaAllocator<T>::allocate(size_t n) {
+    if (n > numeric_limits<size_t>::max() / sizeof(T)) {
+        throw std::bad_alloc();
+    }
+    return (T *) arena->allocate(n * sizeof(T), alignof(T));
+}
+
+template <class T>
+void ArenaAllocator<T>::deallocate(T *, size_t) {
+}
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T> & a, const ArenaAllocator<U> & b) {
+    return a.arena == b.arena;
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T> & a, const ArenaAllocator<U> & b) {
+    return a.arena != b.arena;
+}
+
+#endif //ARENA_H
@@ -0,0 +1,547 @@
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <stdexcept>
+#include <algorithm>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+//io_uring is called through its system calls, so it only needs the kernel headers
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define HAS_IO_URING
+#endif
+#endif
+#endif
+
+using namespace std;
+
+/**
+ * A read (or a write) of a range of a file. The caller fills the request and keeps it, and
+ * its buffer, until the AsyncIo waited for it
+ */
+struct IoRequest {
+    int fd;
+    long long offset;
+    char * buffer;
+    size_t size;
+    bool write;
+    long long result; // the bytes read or written, or -errno
+    bool done; // set by the AsyncIo, with its lock held
+
+    IoRequest() : fd(-1), offset(0), buffer(NULL), size(0), write(false), result(0), done(false) {}
+    IoRequest(int fd, long long offset, char * buffer, size_t size, bool write = false)
+            : fd(fd), offset(offset), buffer(buffer), size(size), write(write), result(0), done(false) {}
+};
+
+/**
+ * Read and write files without waiting for each request: the requests are submitted
+ * together, at most getQueueDepth of them on their way to the disk at a time, so a random
+ * lookup of many rows waits for the slowest read instead of the sum of them
+ * e.g.: vector<IoRequest> requests;
+ *       requests.push_back(IoRequest(fd, 0, &buffer[0], 4096));
+ *       requests.push_back(IoRequest(fd, 1 << 20, &buffer[4096], 4096));
+ *       AsyncIo::getShared().run(requests);
+ * @see IoUring
+ * @see ThreadedIo
+ */
+class AsyncIo {
+protected:
+    unsigned queue_depth;
+
+public:
+    static const unsigned DEFAULT_QUEUE_DEPTH = 32;
+
+    AsyncIo(unsigned queue_depth) : queue_depth(max(1u, queue_depth)) {}
+    virtual ~AsyncIo() {}
+
+    /**
+     * Start the requests, waiting only if there are already getQueueDepth of them running
+     */
+    virtual void submit(IoRequest * requests, size_t count) = 0;
+
+    /**
+     * Wait for the requests submitted to be done
+     */
+    virtual void wait(IoRequest * requests, size_t count) = 0;
+
+    virtual string getName() const = 0;
+
+    unsigned getQueueDepth() const;
+
+    /**
+     * Submit the requests and wait for all of them
+     * @throw invalid_argument if a request failed or read less than its size, e.g.: past the
+     *        end of the file
+     */
+    void run(vector<IoRequest> & requests);
+
+    /**
+     * Check the requests done, transferring on this thread the bytes left by the requests
+     * interrupted or done in part
+     * @throw invalid_argument if a request failed or read less than its size
+     */
+    static void finish(vector<IoRequest> & requests);
+
+    /**
+     * @param use_io_uring - false for the thread fallback even if io_uring is available
+     * @return io_uring if the kernel supports it, the thread fallback otherwise
+     */
+    static AsyncIo * create(unsigned queue_depth = DEFAULT_QUEUE_DEPTH, bool use_io_uring = true);
+
+    /**
+     * @return the AsyncIo shared by all the tables
+     */
+    static AsyncIo & getShared();
+};
+
+/**
+ * The fallback of the systems without io_uring: each request is a pread (or a pwrite) of one
+ * of getQueueDepth threads, which wait for the disk instead of the threads of the queries
+ */
+class ThreadedIo : public AsyncIo {
+private:
+    vector<thread> threads;
+    deque<IoRequest *> queue;
+    mutex io_mutex;
+    condition_variable request_available;
+    condition_variable request_done;
+    unsigned in_flight;
+    bool stopping;
+
+    ThreadedIo(const ThreadedIo &);
+    ThreadedIo & operator=(const ThreadedIo &);
+
+    void work();
+
+public:
+    /**
+     * @param queue_depth - the number of threads
+     * @constructor
+     */
+    ThreadedIo(unsigned queue_depth = DEFAULT_QUEUE_DEPTH);
+
+    /**
+     * Wait for the requests submitted
+     * @destructor
+     */
+    ~ThreadedIo();
+
+    void submit(IoRequest * requests, size_t count);
+    void wait(IoRequest * requests, size_t count);
+    string getName() const;
+};
+
+/**
+ * Run a request until all of its bytes are transferred (or it fails), on the calling thread
+ * @return the bytes transferred, or -errno
+ */
+long long runIoRequest(const IoRequest & request);
+
+#ifdef HAS_IO_URING
+/**
+ * The requests go to the kernel through the submission ring of an io_uring instance, shared
+ * with it by mmap, and come back on its completion ring: a batch of reads costs a single
+ * system call. The thread waiting for the completions releases the lock meanwhile, so the
+ * other threads keep submitting, and the completions it reaps may be of any thread
+ */
+class IoUring : public AsyncIo {
+private:
+    int ring_fd;
+    void * sq_ring;
+    void * cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    io_uring_sqe * sqes;
+    size_t sqes_size;
+
+    unsigned * sq_head;
+    unsigned * sq_tail;
+    unsigned * sq_mask;
+    unsigned * sq_array;
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned * cq_mask;
+    io_uring_cqe * cqes;
+
+    mutex ring_mutex;
+    condition_variable completed;
+    unsigned in_flight;
+    bool reaping; // a thread is waiting for the kernel, without the lock
+
+    IoUring(const IoUring &);
+    IoUring & operator=(const IoUring &);
+
+    /**
+     * Move the completions of the ring to their requests, with the lock held
+     * @return the number of completions
+     */
+    unsigned reap();
+
+    /**
+     * Wait for a completion, with the lock held (and released meanwhile)
+     */
+    void waitForCompletion(unique_lock<mutex> & lock);
+
+public:
+    /**
+     * @throw invalid_argument if the kernel doesn't support io_uring (e.g.: disabled by a
+     *        sandbox) or its read and write operations. Before 5.6 the ring is set up but
+     *        every read fails with EINVAL, so the operations are probed
+     * @constructor
+     */
+    IoUring(unsigned queue_depth = DEFAULT_QUEUE_DEPTH);
+
+    /**
+     * Wait for the requests submitted, then release the rings
+     * @destructor
+     */
+    ~IoUring();
+
+    void submit(IoRequest * requests, size_t count);
+    void wait(IoRequest * requests, size_t count);
+    string getName() const;
+};
+#endif
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+unsigned AsyncIo::getQueueDepth() const {
+    return queue_depth;
+}
+
+void AsyncIo::run(vector<IoRequest> & requests) {
+    if (requests.empty()) {
+        return;
+    }
+    submit(&requests[0], requests.size());
+    wait(&requests[0], requests.size());
+    finish(requests);
+}
+
+void AsyncIo::finish(vector<IoRequest> & requests) {
+    for (vector<IoRequest>::iterator it = requests.begin(); it != requests.end(); it++) {
+        //A request interrupted (or transferring part of its bytes) ends on this thread
+        if (it->result == -EINTR || it->result == -EAGAIN || (it->result > 0 && (size_t) it->result < it->size)) {
+            size_t transferred = max(0LL, it->result);
+            IoRequest rest(it->fd, it->offset + transferred, it->buffer + transferred, it->size - transferred, it->write);
+            long long result = runIoRequest(rest);
+            it->result = result < 0 ? result : transferred + result;
+        }
+        if (it->result < 0) {
+            throw std::invalid_argument(string("The I/O request failed: ") + strerror((int) -it->result));
+        }
+        if ((size_t) it->result != it->size) {
+            throw std::invalid_argument("The I/O request transferred " + to_string(it->result) + " of " +
+                                        to_string(it->size) + " bytes");
+        }
+    }
+}
+
+AsyncIo * AsyncIo::create(unsigned queue_depth, bool use_io_uring) {
+#ifdef HAS_IO_URING
+    if (use_io_uring) {
+        try {
+            return new IoUring(queue_depth);
+        } catch (const std::invalid_argument &) {
+            //Fall back to the threads
+        }
+    }
+#endif
+    return new ThreadedIo(queue_depth);
+}
+
+AsyncIo & AsyncIo::getShared() {
+    static unique_ptr<AsyncIo> shared_io(create());
+    return *shared_io;
+}
+
+long long runIoRequest(const IoRequest & request) {
+    size_t transferred = 0;
+    while (transferred < request.size) {
+        ssize_t bytes = request.write ?
+                pwrite(request.fd, request.buffer + transferred, request.size - transferred, request.offset + transferred) :
+                pread(request.fd, request.buffer + transferred, request.size - transferred, request.offset + transferred);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (bytes == 0) {
+            //The end of the file
+            break;
+        }
+        transferred += bytes;
+    }
+    return transferred;
+}
+
+ThreadedIo::ThreadedIo(unsigned queue_depth) : AsyncIo(queue_depth) {
+    this->in_flight = 0;
+    this->stopping = false;
+    for (unsigned i = 0; i < this->queue_depth; i++) {
+        threads.push_back(thread(&ThreadedIo::work, this));
+    }
+}
+
+ThreadedIo::~ThreadedIo() {
+    {
+        unique_lock<mutex> lock(io_mutex);
+        stopping = true;
+    }
+    request_available.notify_all();
+    for (unsigned i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+}
+
+void ThreadedIo::work() {
+    unique_lock<mutex> lock(io_mutex);
+    while (true) {
+        request_available.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            return;
+        }
+        IoRequest * request = queue.front();
+        queue.pop_front();
+
+        lock.unlock();
+        long long result = runIoRequest(*request);
+        lock.lock();
+
+        request->result = result;
+        request->done = true;
+        in_flight--;
+        request_done.notify_all();
+    }
+}
+
+void ThreadedIo::submit(IoRequest * requests, size_t count) {
+    unique_lock<mutex> lock(io_mutex);
+    for (size_t i = 0; i < count; i++) {
+        //Like the submission ring of io_uring, the queue holds at most queue_depth requests
+        request_done.wait(lock, [this]() { return in_flight < queue_depth; });
+        requests[i].done = false;
+        queue.push_back(&requests[i]);
+        in_flight++;
+        request_available.notify_one();
+    }
+}
+
+void ThreadedIo::wait(IoRequest * requests, size_t count) {
+    unique_lock<mutex> lock(io_mutex);
+    for (size_t i = 0; i < count; i++) {
+        request_done.wait(lock, [&requests, i]() { return requests[i].done; });
+    }
+}
+
+string ThreadedIo::getName() const {
+    return "pread on " + to_string(threads.size()) + " threads";
+}
+
+#ifdef HAS_IO_URING
+IoUring::IoUring(unsigned queue_depth) : AsyncIo(queue_depth) {
+    this->in_flight = 0;
+    this->reaping = false;
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = syscall(__NR_io_uring_setup, this->queue_depth, &params);
+    if (ring_fd < 0) {
+        throw std::invalid_argument(string("Unable to set up io_uring: ") + strerror(errno));
+    }
+    this->queue_depth = params.sq_entries;
+
+    //The probe itself is only known since 5.6, along with IORING_OP_READ and IORING_OP_WRITE
+    const unsigned probe_ops = 256;
+    vector<char> probe_buffer(sizeof(io_uring_probe) + probe_ops * sizeof(io_uring_probe_op), 0);
+    io_uring_probe * probe = (io_uring_probe *) &probe_buffer[0];
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, probe_ops) < 0 ||
+        probe->ops_len <= IORING_OP_READ || probe->ops_len <= IORING_OP_WRITE ||
+        !(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) ||
+        !(probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)) {
+        close(ring_fd);
+        throw std::invalid_argument("The kernel doesn't support the reads and writes of io_uring");
+    }
+
+    //The submission and the completion rings may share a single mapping
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = max(sq_ring_size, cq_ring_size);
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    cq_ring = single_mmap ? sq_ring : mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                           ring_fd, IORING_OFF_CQ_RING);
+    void * sqes_mapping = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes_mapping == MAP_FAILED) {
+        if (sq_ring != MAP_FAILED) {
+            munmap(sq_ring, sq_ring_size);
+        }
+        if (!single_mmap && cq_ring != MAP_FAILED) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        if (sqes_mapping != MAP_FAILED) {
+            munmap(sqes_mapping, sqes_size);
+        }
+        close(ring_fd);
+        throw std::invalid_argument("Unable to map the rings of io_uring");
+    }
+    sqes = (io_uring_sqe *) sqes_mapping;
+
+    char * sq = (char *) sq_ring;
+    sq_head = (unsigned *) (sq + params.sq_off.head);
+    sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    sq_array = (unsigned *) (sq + params.sq_off.array);
+    char * cq = (char *) cq_ring;
+    cq_head = (unsigned *) (cq + params.cq_off.head);
+    cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe *) (cq + params.cq_off.cqes);
+}
+
+IoUring::~IoUring() {
+    {
+        unique_lock<mutex> lock(ring_mutex);
+        while (in_flight > 0) {
+            waitForCompletion(lock);
+        }
+    }
+    munmap(sqes, sqes_size);
+    if (cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    munmap(sq_ring, sq_ring_size);
+    close(ring_fd);
+}
+
+unsigned IoUring::reap() {
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    unsigned reaped = 0;
+    for (; head != tail; head++) {
+        io_uring_cqe & cqe = cqes[head & *cq_mask];
+        IoRequest * request = (IoRequest *) (uintptr_t) cqe.user_data;
+        request->result = cqe.res;
+        request->done = true;
+        reaped++;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    in_flight -= reaped;
+    return reaped;
+}
+
+void IoUring::waitForCompletion(unique_lock<mutex> & lock) {
+    if (reap() > 0) {
+        completed.notify_all();
+        return;
+    }
+    if (reaping) {
+        //Another thread waits for the kernel, and reaps the completions of everyone
+        completed.wait(lock);
+        return;
+    }
+    reaping = true;
+    lock.unlock();
+    int entered = syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    int error = errno;
+    lock.lock();
+    reaping = false;
+    reap();
+    completed.notify_all();
+    if (entered < 0 && error != EINTR) {
+        throw std::invalid_argument(string("Unable to wait for io_uring: ") + strerror(error));
+    }
+}
+
+void IoUring::submit(IoRequest * requests, size_t count) {
+    unique_lock<mutex> lock(ring_mutex);
+    size_t submitted = 0;
+    while (submitted < count) {
+        while (in_flight >= queue_depth) {
+            waitForCompletion(lock);
+        }
+
+        //Fill the free entries of the submission ring, then submit them with a single call
+        unsigned tail = *sq_tail;
+        unsigned entries = 0;
+        while (submitted < count && in_flight + entries < queue_depth) {
+            IoRequest & request = requests[submitted++];
+            request.done = false;
+            unsigned index = (tail + entries) & *sq_mask;
+            io_uring_sqe & sqe = sqes[index];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe.fd = request.fd;
+            sqe.off = request.offset;
+            sqe.addr = (uintptr_t) request.buffer;
+            sqe.len = request.size;
+            sqe.user_data = (uintptr_t) &request;
+            sq_array[index] = index;
+            entries++;
+        }
+        __atomic_store_n(sq_tail, tail + entries, __ATOMIC_RELEASE);
+        in_flight += entries;
+
+        //The entries of other threads, left on the ring while this one waited, are submitted too
+        unsigned pending;
+        while ((pending = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)) > 0) {
+            int consumed = syscall(__NR_io_uring_enter, ring_fd, pending, 0, 0, NULL, 0);
+            if (consumed < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EBUSY) {
+                    //The kernel is short of resources, which a completion may free. Without
+                    //requests on their way there is nothing to wait for, so retry
+                    if (in_flight > pending) {
+                        waitForCompletion(lock);
+                    } else {
+                        lock.unlock();
+                        this_thread::yield();
+                        lock.lock();
+                    }
+                    continue;
+                }
+                throw std::invalid_argument(string("Unable to submit to io_uring: ") + strerror(errno));
+            }
+        }
+    }
+}
+
+void IoUring::wait(IoRequest * requests, size_t count) {
+    unique_lock<mutex> lock(ring_mutex);
+    for (size_t i = 0; i < count; i++) {
+        while (!requests[i].done) {
+            waitForCompletion(lock);
+        }
+    }
+}
+
+string IoUring::getName() const {
+    return "io_uring";
+}
+#endif
+
+#endif //ASYNCIO_H
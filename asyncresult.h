@@ -0,0 +1,325 @@
+#ifndef ASYNCRESULT_H
+#define ASYNCRESULT_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include "asyncio.h"
+
+//The coroutines need C++20, the callbacks of AsyncResult::then work on any standard
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define HAS_COROUTINES
+#endif
+#endif
+
+using namespace std;
+
+/**
+ * A value computed later, e.g.: a row on its way from the disk. The thread computing it
+ * calls setValue (or setError) once, and the thread waiting for it either blocks on get,
+ * registers a callback with then, or (with C++20) suspends a coroutine with co_await
+ * e.g.: table.getRowByIdAsync(7).then([](AsyncResult<vector<string> > row) { print(row.get()); });
+ *       vector<string> row = co_await table.getRowByIdAsync(7);
+ *
+ * An AsyncResult is also the return type of the coroutines awaiting other results, e.g.:
+ * AsyncResult<string> getName(Table & table, long long _id) {
+ *     vector<string> row = co_await table.getRowByIdAsync(_id);
+ *     co_return row.at(1);
+ * }
+ * The copies of an AsyncResult share its value
+ */
+template <typename T>
+class AsyncResult {
+private:
+    struct State {
+        mutex state_mutex;
+        condition_variable done;
+        bool ready;
+        shared_ptr<T> value;
+        exception_ptr error;
+        function<void()> continuation; // called once ready, on the thread setting the value
+
+        State() : ready(false) {}
+    };
+
+    shared_ptr<State> state;
+
+    /**
+     * Mark the result ready, then call its continuation, if any
+     */
+    void complete(unique_lock<mutex> & lock);
+
+public:
+    /**
+     * A result not ready yet
+     * @constructor
+     */
+    AsyncResult();
+
+    void setValue(T value);
+    void setError(exception_ptr error);
+
+    bool isReady() const;
+
+    /**
+     * Wait for the result
+     * @throw the error of the result, if any
+     */
+    T get() const;
+
+    /**
+     * Call a function once the result is ready: at once if it's ready, otherwise on the
+     * thread setting it, e.g.: the thread completing the reads. The function must be quick
+     * and must not throw. A result has a single continuation (or awaiting coroutine)
+     */
+    void then(function<void(AsyncResult<T>)> callback);
+
+#ifdef HAS_COROUTINES
+    bool await_ready() const;
+
+    /**
+     * Resume the coroutine once the result is ready, on the thread setting it
+     * @return false if the result is already ready, so the coroutine goes on
+     */
+    bool await_suspend(coroutine_handle<> handle);
+
+    T await_resume() const;
+
+    /**
+     * A coroutine returning an AsyncResult starts at once, and sets the result with its
+     * co_return (or its exception)
+     */
+    struct promise_type {
+        AsyncResult<T> result;
+
+        AsyncResult<T> get_return_object() { return result; }
+        suspend_never initial_suspend() noexcept { return suspend_never(); }
+        suspend_never final_suspend() noexcept { return suspend_never(); }
+        void return_value(T value) { result.setValue(move(value)); }
+        void unhandled_exception() { result.setError(current_exception()); }
+    };
+#endif
+};
+
+/**
+ * Complete the reads of the callers that can't wait for them, e.g.: the thread of an event
+ * loop. The reads of each operation are submitted to an AsyncIo by a single thread, which
+ * then waits for them and calls the completion of the operation, so thousands of lookups in
+ * flight take this thread and the I/O of the AsyncIo rather than a thread each. The
+ * operations are submitted up to the queue depth of the AsyncIo, and completed in order
+ */
+class IoCompletionQueue {
+private:
+    struct Operation {
+        vector<IoRequest> requests;
+        function<void(exception_ptr)> complete; // with the error of the reads, if any
+    };
+
+    AsyncIo & io;
+    thread pump;
+    mutex queue_mutex;
+    condition_variable operation_available;
+    deque<unique_ptr<Operation> > waiting; // not submitted yet
+    deque<unique_ptr<Operation> > in_flight;
+    size_t in_flight_requests;
+    bool stopping;
+
+    IoCompletionQueue(const IoCompletionQueue &);
+    IoCompletionQueue & operator=(const IoCompletionQueue &);
+
+    void run();
+
+public:
+    /**
+     * @constructor
+     */
+    IoCompletionQueue(AsyncIo & io);
+
+    /**
+     * Complete the operations submitted, then stop the thread
+     * @destructor
+     */
+    ~IoCompletionQueue();
+
+    /**
+     * Queue the requests without waiting. The completion is called on the thread of the
+     * queue once all of them are done, and must not throw
+     */
+    void submit(vector<IoRequest> & requests, function<void(exception_ptr)> complete);
+
+    AsyncIo & getAsyncIo();
+
+    /**
+     * @return the queue of AsyncIo::getShared
+     */
+    static IoCompletionQueue & getShared();
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+template <typename T>
+AsyncResult<T>::AsyncResult() : state(make_shared<State>()) {
+}
+
+template <typename T>
+void AsyncResult<T>::complete(unique_lock<mutex> & lock) {
+    state->ready = true;
+    function<void()> continuation;
+    swap(continuation, state->continuation);
+    state->done.notify_all();
+    lock.unlock();
+    if (continuation) {
+        continuation();
+    }
+}
+
+template <typename T>
+void AsyncResult<T>::setValue(T value) {
+    unique_lock<mutex> lock(state->state_mutex);
+    state->value = make_shared<T>(move(value));
+    complete(lock);
+}
+
+template <typename T>
+void AsyncResult<T>::setError(exception_ptr error) {
+    unique_lock<mutex> lock(state->state_mutex);
+    state->error = error;
+    complete(lock);
+}
+
+template <typename T>
+bool AsyncResult<T>::isReady() const {
+    unique_lock<mutex> lock(state->state_mutex);
+    return state->ready;
+}
+
+template <typename T>
+T AsyncResult<T>::get() const {
+    unique_lock<mutex> lock(state->state_mutex);
+    state->done.wait(lock, [this]() { return state->ready; });
+    if (state->error) {
+        rethrow_exception(state->error);
+    }
+    return *state->value;
+}
+
+template <typename T>
+void AsyncResult<T>::then(function<void(AsyncResult<T>)> callback) {
+    AsyncResult<T> result(*this);
+    unique_lock<mutex> lock(state->state_mutex);
+    if (!state->ready) {
+        state->continuation = [callback, result]() { callback(result); };
+        return;
+    }
+    lock.unlock();
+    callback(result);
+}
+
+#ifdef HAS_COROUTINES
+template <typename T>
+bool AsyncResult<T>::await_ready() const {
+    return isReady();
+}
+
+template <typename T>
+bool AsyncResult<T>::await_suspend(coroutine_handle<> handle) {
+    unique_lock<mutex> lock(state->state_mutex);
+    if (state->ready) {
+        return false;
+    }
+    state->continuation = [handle]() { handle.resume(); };
+    return true;
+}
+
+template <typename T>
+T AsyncResult<T>::await_resume() const {
+    return get();
+}
+#endif
+
+IoCompletionQueue::IoCompletionQueue(AsyncIo & io) : io(io) {
+    this->in_flight_requests = 0;
+    this->stopping = false;
+    this->pump = thread(&IoCompletionQueue::run, this);
+}
+
+IoCompletionQueue::~IoCompletionQueue() {
+    {
+        unique_lock<mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    operation_available.notify_all();
+    pump.join();
+}
+
+void IoCompletionQueue::submit(vector<IoRequest> & requests, function<void(exception_ptr)> complete) {
+    unique_ptr<Operation> operation(new Operation());
+    operation->requests.swap(requests);
+    operation->complete = complete;
+    {
+        unique_lock<mutex> lock(queue_mutex);
+        waiting.push_back(move(operation));
+    }
+    operation_available.notify_all();
+}
+
+void IoCompletionQueue::run() {
+    unique_lock<mutex> lock(queue_mutex);
+    while (true) {
+        operation_available.wait(lock, [this]() { return stopping || !waiting.empty() || !in_flight.empty(); });
+        if (waiting.empty() && in_flight.empty()) {
+            return;
+        }
+
+        //Keep the AsyncIo busy: submit the operations waiting while they fit on its queue
+        while (!waiting.empty() && (in_flight.empty() ||
+                                    in_flight_requests + waiting.front()->requests.size() <= io.getQueueDepth())) {
+            Operation * operation = waiting.front().get();
+            in_flight_requests += operation->requests.size();
+            in_flight.push_back(move(waiting.front()));
+            waiting.pop_front();
+            lock.unlock();
+            if (!operation->requests.empty()) {
+                io.submit(&operation->requests[0], operation->requests.size());
+            }
+            lock.lock();
+        }
+
+        //Then complete the oldest one
+        Operation * operation = in_flight.front().get();
+        lock.unlock();
+        exception_ptr error;
+        if (!operation->requests.empty()) {
+            io.wait(&operation->requests[0], operation->requests.size());
+            try {
+                AsyncIo::finish(operation->requests);
+            } catch (...) {
+                error = current_exception();
+            }
+        }
+        operation->complete(error);
+        lock.lock();
+        in_flight_requests -= operation->requests.size();
+        in_flight.pop_front();
+    }
+}
+
+AsyncIo & IoCompletionQueue::getAsyncIo() {
+    return io;
+}
+
+IoCompletionQueue & IoCompletionQueue::getShared() {
+    static IoCompletionQueue shared_queue(AsyncIo::getShared());
+    return shared_queue;
+}
+
+#endif //ASYNCRESULT_H
@@ -0,0 +1,268 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include "schema.h"
+
+using namespace std;
+
+/**
+ * The values of one column for all the rows of a Batch. The values are stored
+ * contiguously on the vector matching the column type, so the loops over a column
+ * are type specialized and can be vectorized
+ * - INT32: int32_values
+ * - INT64, FOREIGN_KEY: int64_values
+ * - FLOAT: float_values
+ * - DOUBLE: double_values
+ * - CHAR: char_values, width bytes for each value, padded with '\0'
+ */
+struct ColumnVector {
+    string name;
+    SchemaType type;
+    unsigned width; // bytes of a CHAR value
+
+    vector<int32_t> int32_values;
+    vector<int64_t> int64_values;
+    vector<float> float_values;
+    vector<double> double_values;
+    vector<char> char_values;
+
+    ColumnVector();
+    ColumnVector(string name, SchemaType type, unsigned width = 0);
+
+    /**
+     * Resize the vector used by the column type
+     */
+    void resize(unsigned size);
+
+    /**
+     * @return a pointer to the CHAR value of a row
+     */
+    const char * getChars(unsigned row) const;
+
+    /**
+     * @return the value of a row, in the same format returned by Table::getRow
+     */
+    string getString(unsigned row) const;
+
+    /**
+     * @return the value of a row without loss, e.g.: all the digits of a DOUBLE, to find
+     *         the rows after it. The same as getString for the integers and the CHARs
+     */
+    string getExactString(unsigned row) const;
+
+    /**
+     * @return the value of a row of an integer column (INT32, INT64 or FOREIGN_KEY)
+     */
+    long long getInteger(unsigned row) const;
+
+    /**
+     * @return the value of a row of a numeric column, converted to double
+     */
+    double getNumber(unsigned row) const;
+
+    /**
+     * @return true for INT32, INT64 and FOREIGN_KEY
+     */
+    bool isInteger() const;
+};
+
+/**
+ * A group of up to CAPACITY rows stored column by column, exchanged by the query
+ * operators. Instead of removing the rows discarded by a filter, the batch keeps a
+ * selection vector with the position of the rows still active
+ * e.g.: a batch with 4 rows where the row 1 was filtered out has selection = [0, 2, 3]
+ */
+struct Batch {
+    static const unsigned CAPACITY = 1024;
+
+    unsigned size; // number of rows, selected or not
+    vector<ColumnVector> columns;
+    vector<long long> positions; // registry position of each row, if read from a table
+    vector<uint32_t> selection;
+
+    Batch();
+
+    /**
+     * Create one column for each schema column and remove all the rows
+     */
+    void init(vector<SchemaCol> * schema_cols);
+
+    /**
+     * @return true if the batch columns have the same types as the schema columns
+     */
+    bool hasColumns(vector<SchemaCol> * schema_cols) const;
+
+    /**
+     * Set the number of rows and select all of them
+     */
+    void resize(unsigned size);
+
+    /**
+     * Select all the rows
+     */
+    void selectAll();
+
+    unsigned getSelectedCount() const;
+
+    /**
+     * Reverse the order of the rows, keeping the same rows selected
+     */
+    void reverse();
+
+    /**
+     * Convert the selected rows to strings and push them to the rows vector
+     */
+    void appendRows(vector<vector<string> > & rows) const;
+};
+
+ColumnVector::ColumnVector() : type(INT64), width(0) {
+}
+
+ColumnVector::ColumnVector(string name, SchemaType type, unsigned width) : name(name), type(type), width(width) {
+}
+
+void ColumnVector::resize(unsigned size) {
+    switch (type) {
+        case INT32: int32_values.resize(size); break;
+        case INT64:
+        case FOREIGN_KEY: int64_values.resize(size); break;
+        case FLOAT: float_values.resize(size); break;
+        case DOUBLE: double_values.resize(size); break;
+        case CHAR: char_values.resize((size_t) size * width); break;
+    }
+}
+
+const char * ColumnVector::getChars(unsigned row) const {
+    return &char_values[(size_t) row * width];
+}
+
+string ColumnVector::getString(unsigned row) const {
+    switch (type) {
+        case INT32: return to_string(int32_values[row]);
+        case INT64:
+        case FOREIGN_KEY: return to_string((long long) int64_values[row]);
+        case FLOAT: return formatDouble(float_values[row]);
+        case DOUBLE: return formatDouble(double_values[row]);
+        case CHAR: return string(getChars(row), strnlen(getChars(row), width));
+    }
+    return string();
+}
+
+string ColumnVector::getExactString(unsigned row) const {
+    //17 significant digits tell any two doubles apart, and a float is exact as a double
+    char text[32];
+    switch (type) {
+        case FLOAT: return string(text, snprintf(text, sizeof(text), "%.17g", (double) float_values[row]));
+        case DOUBLE: return string(text, snprintf(text, sizeof(text), "%.17g", double_values[row]));
+        default: return getString(row);
+    }
+}
+
+long long ColumnVector::getInteger(unsigned row) const {
+    return type == INT32 ? int32_values[row] : int64_values[row];
+}
+
+double ColumnVector::getNumber(unsigned row) const {
+    switch (type) {
+        case INT32: return int32_values[row];
+        case INT64:
+        case FOREIGN_KEY: return int64_values[row];
+        case FLOAT: return float_values[row];
+        case DOUBLE: return double_values[row];
+        default: return atof(getString(row).c_str());
+    }
+}
+
+bool ColumnVector::isInteger() const {
+    return type == INT32 || type == INT64 || type == FOREIGN_KEY;
+}
+
+Batch::Batch() : size(0) {
+}
+
+void Batch::init(vector<SchemaCol> * schema_cols) {
+    columns.clear();
+    for (vector<SchemaCol>::iterator it = schema_cols->begin(); it != schema_cols->end(); it++) {
+        columns.push_back(ColumnVector(it->key, it->type, it->getSize()));
+    }
+    resize(0);
+}
+
+bool Batch::hasColumns(vector<SchemaCol> * schema_cols) const {
+    if (columns.size() != schema_cols->size()) {
+        return false;
+    }
+    for (unsigned i = 0; i < columns.size(); i++) {
+        if (columns[i].type != schema_cols->at(i).type || columns[i].name != schema_cols->at(i).key ||
+            (columns[i].type == CHAR && columns[i].width != schema_cols->at(i).getSize())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Batch::resize(unsigned size) {
+    this->size = size;
+    for (vector<ColumnVector>::iterator it = columns.begin(); it != columns.end(); it++) {
+        it->resize(size);
+    }
+    positions.resize(size);
+    selectAll();
+}
+
+void Batch::selectAll() {
+    selection.resize(size);
+    for (unsigned i = 0; i < size; i++) {
+        selection[i] = i;
+    }
+}
+
+unsigned Batch::getSelectedCount() const {
+    return selection.size();
+}
+
+void Batch::reverse() {
+    for (vector<ColumnVector>::iterator it = columns.begin(); it != columns.end(); it++) {
+        switch (it->type) {
+            case INT32: std::reverse(it->int32_values.begin(), it->int32_values.begin() + size); break;
+            case INT64:
+            case FOREIGN_KEY: std::reverse(it->int64_values.begin(), it->int64_values.begin() + size); break;
+            case FLOAT: std::reverse(it->float_values.begin(), it->float_values.begin() + size); break;
+            case DOUBLE: std::reverse(it->double_values.begin(), it->double_values.begin() + size); break;
+            case CHAR: {
+                vector<char> reversed(it->char_values.size());
+                for (unsigned row = 0; row < size; row++) {
+                    memcpy(&reversed[(size_t) (size - 1 - row) * it->width], it->getChars(row), it->width);
+                }
+                it->char_values.swap(reversed);
+                break;
+            }
+        }
+    }
+    std::reverse(positions.begin(), positions.begin() + size);
+
+    //The selection stays in ascending order
+    vector<uint32_t> reversed_selection(selection.size());
+    for (unsigned i = 0; i < selection.size(); i++) {
+        reversed_selection[selection.size() - 1 - i] = size - 1 - selection[i];
+    }
+    selection.swap(reversed_selection);
+}
+
+void Batch::appendRows(vector<vector<string> > & rows) const {
+    for (vector<uint32_t>::const_iterator it = selection.begin(); it != selection.end(); it++) {
+        rows.push_back(vector<string>());
+        vector<string> & row = rows.back();
+        row.reserve(columns.size());
+        for (vector<ColumnVector>::const_iterator column = columns.begin(); column != columns.end(); column++) {
+            row.push_back(column->getString(*it));
+        }
+    }
+}
+
+#endif //BATCH_H
@@ -0,0 +1,520 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <stdint.h>
+#include "simdkernels.h"
+
+using namespace std;
+
+/**
+ * The operations between the BITMAP_WORDS words of two bitmap containers, written to out.
+ * There are a scalar and an AVX2 implementation, as for the SimdKernels: the AVX2 one is
+ * compiled with a target attribute and only used when the CPU supports it
+ * @see getBitmapKernels
+ */
+struct BitmapKernels {
+    const char * name;
+
+    void (*andWords)(const uint64_t * a, const uint64_t * b, uint64_t * out);
+    void (*orWords)(const uint64_t * a, const uint64_t * b, uint64_t * out);
+    void (*andNotWords)(const uint64_t * a, const uint64_t * b, uint64_t * out);
+};
+
+/**
+ * @return the scalar kernels, available on any CPU
+ */
+const BitmapKernels & getScalarBitmapKernels();
+
+/**
+ * @return the AVX2 kernels, or NULL if they were not compiled or the CPU does not support them
+ */
+const BitmapKernels * getAvx2BitmapKernels();
+
+/**
+ * @return the fastest kernels supported by the CPU, detected on the first call
+ */
+const BitmapKernels & getBitmapKernels();
+
+/**
+ * A compressed set of 32 bits row ids, following the Roaring bitmap layout.
+ * The ids are split by their 16 high bits and each group of 65536 ids is stored by a
+ * container, which is either:
+ * - an ARRAY container: the sorted 16 low bits of up to ARRAY_MAX_SIZE ids
+ * - a BITMAP container: 65536 bits (1024 words of 64 bits)
+ * e.g.: {1, 2, 65537} is | key 0: array [1, 2] | key 1: array [1] |
+ *
+ * The operations between two bitmap containers are done word by word, with the
+ * BitmapKernels supported by the CPU
+ */
+class RoaringBitmap {
+public:
+    static const unsigned ARRAY_MAX_SIZE = 4096;
+    static const unsigned BITMAP_WORDS = 1024;
+
+private:
+    struct Container {
+        bool is_bitmap;
+        unsigned cardinality;
+        vector<uint16_t> array; // used when !is_bitmap
+        vector<uint64_t> words; // used when is_bitmap
+
+        Container();
+        bool contains(uint16_t low) const;
+        void add(uint16_t low);
+
+        /**
+         * Convert to the cheapest representation given the cardinality
+         */
+        void optimize();
+        void toBitmap();
+        void toArray();
+    };
+
+    vector<uint16_t> keys; // sorted
+    vector<Container> containers;
+
+    enum Operation { AND_OPERATION, OR_OPERATION, AND_NOT_OPERATION };
+
+    static void wordsOperation(Operation operation, const uint64_t * a, const uint64_t * b, uint64_t * out);
+    static unsigned countWords(const uint64_t * words);
+    static Container containerOperation(Operation operation, const Container & a, const Container & b);
+    static RoaringBitmap operation(Operation operation, const RoaringBitmap & a, const RoaringBitmap & b);
+
+public:
+    /**
+     * @return a bitmap containing the ids from 0 to size - 1
+     */
+    static RoaringBitmap range(uint32_t size);
+
+    void add(uint32_t id);
+    bool contains(uint32_t id) const;
+    unsigned long long getCardinality() const;
+    bool isEmpty() const;
+
+    /**
+     * @return the ids, in ascending order
+     */
+    vector<uint32_t> toVector() const;
+
+    RoaringBitmap operator&(const RoaringBitmap & other) const;
+    RoaringBitmap operator|(const RoaringBitmap & other) const;
+
+    /**
+     * @return the ids of this bitmap that are not on the other one
+     */
+    RoaringBitmap andNot(const RoaringBitmap & other) const;
+
+    /**
+     * @return the ids from 0 to size - 1 that are not on this bitmap
+     */
+    RoaringBitmap flip(uint32_t size) const;
+
+    void write(ostream & stream) const;
+    void read(istream & stream);
+};
+
+/*****************************************
+ ************ SCALAR KERNELS *************
+ *****************************************/
+
+//One loop per operation so each of them is auto-vectorized
+void scalarAndWords(const uint64_t * a, const uint64_t * b, uint64_t * out) {
+    for (unsigned i = 0; i < RoaringBitmap::BITMAP_WORDS; i++) out[i] = a[i] & b[i];
+}
+
+void scalarOrWords(const uint64_t * a, const uint64_t * b, uint64_t * out) {
+    for (unsigned i = 0; i < RoaringBitmap::BITMAP_WORDS; i++) out[i] = a[i] | b[i];
+}
+
+void scalarAndNotWords(const uint64_t * a, const uint64_t * b, uint64_t * out) {
+    for (unsigned i = 0; i < RoaringBitmap::BITMAP_WORDS; i++) out[i] = a[i] & ~b[i];
+}
+
+/*****************************************
+ ************* AVX2 KERNELS **************
+ *****************************************/
+
+#ifdef NAIVEDB_AVX2_KERNELS
+NAIVEDB_AVX2 void avx2AndWords(const uint64_t * a, const uint64_t * b, uint64_t * out) {
+    for (unsigned i = 0; i < RoaringBitmap::BITMAP_WORDS; i += 4) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *> (out + i), _mm256_and_si256(va, vb));
+    }
+}
+
+NAIVEDB_AVX2 void avx2OrWords(const uint64_t * a, const uint64_t * b, uint64_t * out) {
+    for (unsigned i = 0; i < RoaringBitmap::BITMAP_WORDS; i += 4) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *> (out + i), _mm256_or_si256(va, vb));
+    }
+}
+
+NAIVEDB_AVX2 void avx2AndNotWords(const uint64_t * a, const uint64_t * b, uint64_t * out) {
+    for (unsigned i = 0; i < RoaringBitmap::BITMAP_WORDS; i += 4) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *> (out + i), _mm256_andnot_si256(vb, va));
+    }
+}
+#endif
+
+const BitmapKernels & getScalarBitmapKernels() {
+    static const BitmapKernels kernels = {"scalar", scalarAndWords, scalarOrWords, scalarAndNotWords};
+    return kernels;
+}
+
+const BitmapKernels * getAvx2BitmapKernels() {
+#ifdef NAIVEDB_AVX2_KERNELS
+    static const BitmapKernels kernels = {"avx2", avx2AndWords, avx2OrWords, avx2AndNotWords};
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported ? &kernels : NULL;
+#else
+    return NULL;
+#endif
+}
+
+const BitmapKernels & getBitmapKernels() {
+    static const BitmapKernels & kernels = getAvx2BitmapKernels() != NULL ? *getAvx2BitmapKernels() : getScalarBitmapKernels();
+    return kernels;
+}
+
+RoaringBitmap::Container::Container() {
+    is_bitmap = false;
+    cardinality = 0;
+}
+
+bool RoaringBitmap::Container::contains(uint16_t low) const {
+    if (is_bitmap) {
+        return (words[low >> 6] >> (low & 63)) & 1;
+    }
+    return binary_search(array.begin(), array.end(), low);
+}
+
+void RoaringBitmap::Container::add(uint16_t low) {
+    if (is_bitmap) {
+        uint64_t mask = 1ULL << (low & 63);
+        if (!(words[low >> 6] & mask)) {
+            words[low >> 6] |= mask;
+            cardinality++;
+        }
+        return;
+    }
+
+    vector<uint16_t>::iterator it = lower_bound(array.begin(), array.end(), low);
+    if (it == array.end() || *it != low) {
+        array.insert(it, low);
+        cardinality++;
+        if (cardinality > ARRAY_MAX_SIZE) {
+            toBitmap();
+        }
+    }
+}
+
+void RoaringBitmap::Container::optimize() {
+    if (is_bitmap && cardinality <= ARRAY_MAX_SIZE) {
+        toArray();
+    } else if (!is_bitmap && cardinality > ARRAY_MAX_SIZE) {
+        toBitmap();
+    }
+}
+
+void RoaringBitmap::Container::toBitmap() {
+    if (is_bitmap) {
+        return;
+    }
+    words.assign(BITMAP_WORDS, 0);
+    for (vector<uint16_t>::iterator it = array.begin(); it != array.end(); it++) {
+        words[*it >> 6] |= 1ULL << (*it & 63);
+    }
+    vector<uint16_t>().swap(array);
+    is_bitmap = true;
+}
+
+void RoaringBitmap::Container::toArray() {
+    if (!is_bitmap) {
+        return;
+    }
+    array.clear();
+    array.reserve(cardinality);
+    for (unsigned i = 0; i < BITMAP_WORDS; i++) {
+        uint64_t word = words[i];
+        while (word) {
+            array.push_back(i * 64 + __builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+    vector<uint64_t>().swap(words);
+    is_bitmap = false;
+}
+
+void RoaringBitmap::wordsOperation(Operation operation, const uint64_t * a, const uint64_t * b, uint64_t * out) {
+    const BitmapKernels & kernels = getBitmapKernels();
+    switch (operation) {
+        case AND_OPERATION: kernels.andWords(a, b, out); break;
+        case OR_OPERATION: kernels.orWords(a, b, out); break;
+        default: kernels.andNotWords(a, b, out); break;
+    }
+}
+
+unsigned RoaringBitmap::countWords(const uint64_t * words) {
+    unsigned count = 0;
+    for (unsigned i = 0; i < BITMAP_WORDS; i++) {
+        count += __builtin_popcountll(words[i]);
+    }
+    return count;
+}
+
+RoaringBitmap::Container RoaringBitmap::containerOperation(Operation operation, const Container & a, const Container & b) {
+    Container result;
+
+    if (a.is_bitmap && b.is_bitmap) {
+        result.is_bitmap = true;
+        result.words.resize(BITMAP_WORDS);
+        wordsOperation(operation, &a.words[0], &b.words[0], &result.words[0]);
+        result.cardinality = countWords(&result.words[0]);
+
+    } else if (!a.is_bitmap && !b.is_bitmap) {
+        back_insert_iterator<vector<uint16_t> > out(result.array);
+        switch (operation) {
+            case AND_OPERATION: set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out); break;
+            case OR_OPERATION: set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out); break;
+            default: set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out); break;
+        }
+        result.cardinality = result.array.size();
+
+    } else if (operation == AND_OPERATION) {
+        //Keep the array values that are on the bitmap
+        const Container & array = a.is_bitmap ? b : a;
+        const Container & bitmap = a.is_bitmap ? a : b;
+        for (vector<uint16_t>::const_iterator it = array.array.begin(); it != array.array.end(); it++) {
+            if (bitmap.contains(*it)) {
+                result.array.push_back(*it);
+            }
+        }
+        result.cardinality = result.array.size();
+
+    } else if (operation == OR_OPERATION) {
+        const Container & array = a.is_bitmap ? b : a;
+        result = a.is_bitmap ? a : b;
+        for (vector<uint16_t>::const_iterator it = array.array.begin(); it != array.array.end(); it++) {
+            result.add(*it);
+        }
+
+    } else if (!a.is_bitmap) {
+        //array AND NOT bitmap
+        for (vector<uint16_t>::const_iterator it = a.array.begin(); it != a.array.end(); it++) {
+            if (!b.contains(*it)) {
+                result.array.push_back(*it);
+            }
+        }
+        result.cardinality = result.array.size();
+
+    } else {
+        //bitmap AND NOT array
+        result = a;
+        for (vector<uint16_t>::const_iterator it = b.array.begin(); it != b.array.end(); it++) {
+            uint64_t mask = 1ULL << (*it & 63);
+            if (result.words[*it >> 6] & mask) {
+                result.words[*it >> 6] &= ~mask;
+                result.cardinality--;
+            }
+        }
+    }
+
+    result.optimize();
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operation(Operation operation, const RoaringBitmap & a, const RoaringBitmap & b) {
+    RoaringBitmap result;
+    unsigned i = 0;
+    unsigned j = 0;
+
+    //Merge the sorted keys of both bitmaps
+    while (i < a.keys.size() || j < b.keys.size()) {
+        bool has_a = i < a.keys.size() && (j >= b.keys.size() || a.keys[i] <= b.keys[j]);
+        bool has_b = j < b.keys.size() && (i >= a.keys.size() || b.keys[j] <= a.keys[i]);
+
+        if (has_a && has_b) {
+            Container container = containerOperation(operation, a.containers[i], b.containers[j]);
+            if (container.cardinality > 0) {
+                result.keys.push_back(a.keys[i]);
+                result.containers.push_back(container);
+            }
+            i++;
+            j++;
+        } else if (has_a) {
+            //Only on a: kept by OR and AND NOT
+            if (operation != AND_OPERATION) {
+                result.keys.push_back(a.keys[i]);
+                result.containers.push_back(a.containers[i]);
+            }
+            i++;
+        } else {
+            //Only on b: kept by OR
+            if (operation == OR_OPERATION) {
+                result.keys.push_back(b.keys[j]);
+                result.containers.push_back(b.containers[j]);
+            }
+            j++;
+        }
+    }
+
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::range(uint32_t size) {
+    RoaringBitmap result;
+    for (uint64_t start = 0; start < size; start += 65536) {
+        Container container;
+        container.is_bitmap = true;
+        container.words.assign(BITMAP_WORDS, 0);
+
+        unsigned count = min((uint64_t) 65536, size - start);
+        for (unsigned word = 0; word < count / 64; word++) {
+            container.words[word] = ~0ULL;
+        }
+        if (count % 64) {
+            container.words[count / 64] = (1ULL << (count % 64)) - 1;
+        }
+        container.cardinality = count;
+        container.optimize();
+
+        result.keys.push_back(start >> 16);
+        result.containers.push_back(container);
+    }
+    return result;
+}
+
+void RoaringBitmap::add(uint32_t id) {
+    uint16_t key = id >> 16;
+    vector<uint16_t>::iterator it = lower_bound(keys.begin(), keys.end(), key);
+    unsigned index = it - keys.begin();
+
+    if (it == keys.end() || *it != key) {
+        keys.insert(it, key);
+        containers.insert(containers.begin() + index, Container());
+    }
+    containers[index].add(id & 0xFFFF);
+}
+
+bool RoaringBitmap::contains(uint32_t id) const {
+    uint16_t key = id >> 16;
+    vector<uint16_t>::const_iterator it = lower_bound(keys.begin(), keys.end(), key);
+    if (it == keys.end() || *it != key) {
+        return false;
+    }
+    return containers[it - keys.begin()].contains(id & 0xFFFF);
+}
+
+unsigned long long RoaringBitmap::getCardinality() const {
+    unsigned long long cardinality = 0;
+    for (vector<Container>::const_iterator it = containers.begin(); it != containers.end(); it++) {
+        cardinality += it->cardinality;
+    }
+    return cardinality;
+}
+
+bool RoaringBitmap::isEmpty() const {
+    return getCardinality() == 0;
+}
+
+vector<uint32_t> RoaringBitmap::toVector() const {
+    vector<uint32_t> ids;
+    ids.reserve(getCardinality());
+
+    for (unsigned i = 0; i < keys.size(); i++) {
+        uint32_t high = (uint32_t) keys[i] << 16;
+        const Container & container = containers[i];
+
+        if (container.is_bitmap) {
+            for (unsigned word_index = 0; word_index < BITMAP_WORDS; word_index++) {
+                uint64_t word = container.words[word_index];
+                while (word) {
+                    ids.push_back(high | (word_index * 64 + __builtin_ctzll(word)));
+                    word &= word - 1;
+                }
+            }
+        } else {
+            for (vector<uint16_t>::const_iterator it = container.array.begin(); it != container.array.end(); it++) {
+                ids.push_back(high | *it);
+            }
+        }
+    }
+    return ids;
+}
+
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap & other) const {
+    return operation(AND_OPERATION, *this, other);
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap & other) const {
+    return operation(OR_OPERATION, *this, other);
+}
+
+RoaringBitmap RoaringBitmap::andNot(const RoaringBitmap & other) const {
+    return operation(AND_NOT_OPERATION, *this, other);
+}
+
+RoaringBitmap RoaringBitmap::flip(uint32_t size) const {
+    return range(size).andNot(*this);
+}
+
+void RoaringBitmap::write(ostream & stream) const {
+    // | NUMBER_OF_CONTAINERS | KEY | IS_BITMAP | CARDINALITY | VALUES | KEY | ...
+    unsigned number_of_containers = keys.size();
+    stream.write(reinterpret_cast<const char *> (&number_of_containers), sizeof(number_of_containers));
+
+    for (unsigned i = 0; i < number_of_containers; i++) {
+        const Container & container = containers[i];
+        char is_bitmap = container.is_bitmap;
+        stream.write(reinterpret_cast<const char *> (&keys[i]), sizeof(keys[i]));
+        stream.write(&is_bitmap, sizeof(is_bitmap));
+        stream.write(reinterpret_cast<const char *> (&container.cardinality), sizeof(container.cardinality));
+
+        if (container.is_bitmap) {
+            stream.write(reinterpret_cast<const char *> (&container.words[0]), BITMAP_WORDS * sizeof(uint64_t));
+        } else if (container.cardinality > 0) {
+            stream.write(reinterpret_cast<const char *> (&container.array[0]), container.cardinality * sizeof(uint16_t));
+        }
+    }
+}
+
+void RoaringBitmap::read(istream & stream) {
+    keys.clear();
+    containers.clear();
+
+    unsigned number_of_containers = 0;
+    stream.read(reinterpret_cast<char *> (&number_of_containers), sizeof(number_of_containers));
+
+    for (unsigned i = 0; i < number_of_containers && stream; i++) {
+        uint16_t key;
+        char is_bitmap;
+        Container container;
+        stream.read(reinterpret_cast<char *> (&key), sizeof(key));
+        stream.read(&is_bitmap, sizeof(is_bitmap));
+        stream.read(reinterpret_cast<char *> (&container.cardinality), sizeof(container.cardinality));
+
+        container.is_bitmap = is_bitmap;
+        if (container.is_bitmap) {
+            container.words.resize(BITMAP_WORDS);
+            stream.read(reinterpret_cast<char *> (&container.words[0]), BITMAP_WORDS * sizeof(uint64_t));
+        } else {
+            container.array.resize(container.cardinality);
+            if (container.cardinality > 0) {
+                stream.read(reinterpret_cast<char *> (&container.array[0]), container.cardinality * sizeof(uint16_t));
+            }
+        }
+
+        keys.push_back(key);
+        containers.push_back(container);
+    }
+}
+
+#endif //BITMAP_H
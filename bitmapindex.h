@@ -0,0 +1,344 @@
+#ifndef BITMAPINDEX_H
+#define BITMAPINDEX_H
+
+#include <fstream>
+#include <map>
+#include <limits>
+#include <stdio.h>
+#include "schema.h"
+#include "predicate.h"
+#include "bitmap.h"
+
+using namespace std;
+
+/**
+ * A bitmap index of a table column. The row ids (the position of the rows on the table
+ * header) are stored on one RoaringBitmap for each:
+ * - distinct value of the column, e.g.: for a gender column | 'f' -> {0, 3} | 'm' -> {1, 2} |
+ * - value range, for numeric columns with more than MAX_DISTINCT_VALUES distinct values.
+ *   The NUMBER_OF_BUCKETS ranges are built with the same number of rows each
+ *   e.g.: | [-inf, 10) -> {1, 5} | [10, 50) -> {0, 3} | [50, +inf) -> {2, 4} |
+ *
+ * A range index may return rows that don't match the predicate, which must be checked
+ * again after reading the rows
+ *
+ * The index is persisted on a file and updated by Table::insert
+ */
+class BitmapIndex {
+private:
+    string path;
+    int column_position;
+    SchemaCol column;
+    unsigned long long number_of_rows;
+    bool dirty;
+
+    bool is_range;
+    map<string, RoaringBitmap> value_bitmaps;
+    vector<double> bucket_bounds; // the lower bound of each bucket (the first one is -inf)
+    vector<RoaringBitmap> bucket_bitmaps;
+
+    /**
+     * @return the position of the bucket holding the value
+     */
+    unsigned getBucket(double value) const;
+
+    /**
+     * Check a predicate against every value of [lower_bound, upper_bound)
+     * @param all_match - set to true if every value of the range matches
+     * @return true if any value of the range may match
+     */
+    static bool rangeMayMatch(Comparator comparator, double value, double lower_bound, double upper_bound, bool & all_match);
+
+public:
+    static const unsigned MAX_DISTINCT_VALUES = 256;
+    static const unsigned NUMBER_OF_BUCKETS = 64;
+
+    /**
+     * @param path - the file where the index is persisted
+     * @param column_position - the position of the indexed column on the schema
+     * @param column - the indexed column
+     * @constructor
+     */
+    BitmapIndex(string path, int column_position, SchemaCol column);
+
+    int getColumnPosition() const;
+    unsigned long long getNumberOfRows() const;
+
+    /**
+     * @return true if the index stores value ranges instead of distinct values
+     */
+    bool isRange() const;
+
+    /**
+     * Build the index from scratch
+     * @param values - the column values, where values.at(i) is the value of the row i
+     */
+    void build(const vector<string> & values);
+
+    /**
+     * Add the value of a new row
+     */
+    void add(uint32_t row_index, const string & value);
+
+    /**
+     * Get the rows matching a predicate on the indexed column
+     * @param exact - set to false if the result may have rows not matching the predicate
+     * @return the ids of the rows that may match
+     */
+    RoaringBitmap lookup(const Predicate & predicate, bool & exact) const;
+
+    /**
+     * Load the index from the file
+     * @return false if there is no index file
+     */
+    bool load();
+
+    /**
+     * Write the index to the file, if it was changed since it was loaded
+     */
+    void save();
+
+    /**
+     * Delete the index and its file
+     */
+    void drop();
+};
+
+BitmapIndex::BitmapIndex(string path, int column_position, SchemaCol column) {
+    this->path = path;
+    this->column_position = column_position;
+    this->column = column;
+    this->number_of_rows = 0;
+    this->dirty = false;
+    this->is_range = false;
+}
+
+int BitmapIndex::getColumnPosition() const {
+    return column_position;
+}
+
+unsigned long long BitmapIndex::getNumberOfRows() const {
+    return number_of_rows;
+}
+
+bool BitmapIndex::isRange() const {
+    return is_range;
+}
+
+unsigned BitmapIndex::getBucket(double value) const {
+    vector<double>::const_iterator it = upper_bound(bucket_bounds.begin() + 1, bucket_bounds.end(), value);
+    return (it - bucket_bounds.begin()) - 1;
+}
+
+void BitmapIndex::build(const vector<string> & values) {
+    value_bitmaps.clear();
+    bucket_bounds.clear();
+    bucket_bitmaps.clear();
+    number_of_rows = 0;
+    is_range = false;
+    dirty = true;
+
+    for (uint32_t i = 0; i < values.size(); i++) {
+        value_bitmaps[column.normalize(values.at(i))].add(i);
+        if (column.type != CHAR && value_bitmaps.size() > MAX_DISTINCT_VALUES) {
+            is_range = true;
+            break;
+        }
+    }
+
+    if (!is_range) {
+        number_of_rows = values.size();
+        return;
+    }
+    value_bitmaps.clear();
+
+    //Pick the bounds so each bucket has the same number of rows
+    vector<double> sorted_values;
+    sorted_values.reserve(values.size());
+    for (vector<string>::const_iterator it = values.begin(); it != values.end(); it++) {
+        sorted_values.push_back(atof(it->c_str()));
+    }
+    sort(sorted_values.begin(), sorted_values.end());
+
+    bucket_bounds.push_back(-numeric_limits<double>::infinity());
+    for (unsigned bucket = 1; bucket < NUMBER_OF_BUCKETS; bucket++) {
+        double bound = sorted_values.at(bucket * sorted_values.size() / NUMBER_OF_BUCKETS);
+        if (bound > bucket_bounds.back()) {
+            bucket_bounds.push_back(bound);
+        }
+    }
+    bucket_bitmaps.resize(bucket_bounds.size());
+
+    for (uint32_t i = 0; i < values.size(); i++) {
+        add(i, values.at(i));
+    }
+}
+
+void BitmapIndex::add(uint32_t row_index, const string & value) {
+    if (is_range) {
+        bucket_bitmaps[getBucket(atof(value.c_str()))].add(row_index);
+    } else {
+        value_bitmaps[column.normalize(value)].add(row_index);
+    }
+    number_of_rows = max(number_of_rows, (unsigned long long) row_index + 1);
+    dirty = true;
+}
+
+bool BitmapIndex::rangeMayMatch(Comparator comparator, double value, double lower_bound, double upper_bound, bool & all_match) {
+    switch (comparator) {
+        case EQUAL:
+            all_match = false;
+            return lower_bound <= value && value < upper_bound;
+        case NOT_EQUAL:
+            all_match = value < lower_bound || value >= upper_bound;
+            return true;
+        case LESS:
+            all_match = upper_bound <= value;
+            return lower_bound < value;
+        case LESS_EQUAL:
+            all_match = upper_bound <= value;
+            return lower_bound <= value;
+        case GREATER:
+            all_match = lower_bound > value;
+            return upper_bound > value;
+        case GREATER_EQUAL:
+            all_match = lower_bound >= value;
+            return upper_bound > value;
+        default:
+            all_match = false;
+            return true;
+    }
+}
+
+RoaringBitmap BitmapIndex::lookup(const Predicate & predicate, bool & exact) const {
+    RoaringBitmap result;
+    exact = true;
+
+    if (!is_range) {
+        if (predicate.comparator == EQUAL || predicate.comparator == IN) {
+            for (vector<string>::const_iterator it = predicate.values.begin(); it != predicate.values.end(); it++) {
+                map<string, RoaringBitmap>::const_iterator value_bitmap = value_bitmaps.find(column.normalize(*it));
+                if (value_bitmap != value_bitmaps.end()) {
+                    result = result | value_bitmap->second;
+                }
+            }
+        } else {
+            for (map<string, RoaringBitmap>::const_iterator it = value_bitmaps.begin(); it != value_bitmaps.end(); it++) {
+                if (predicate.matches(it->first, column.type)) {
+                    result = result | it->second;
+                }
+            }
+        }
+        return result;
+    }
+
+    for (unsigned bucket = 0; bucket < bucket_bounds.size(); bucket++) {
+        double lower_bound = bucket_bounds[bucket];
+        double upper_bound = bucket + 1 < bucket_bounds.size() ? bucket_bounds[bucket + 1] : numeric_limits<double>::infinity();
+
+        bool may_match = false;
+        bool all_match = predicate.comparator != IN;
+        for (vector<string>::const_iterator it = predicate.values.begin(); it != predicate.values.end(); it++) {
+            bool value_all_match;
+            if (rangeMayMatch(predicate.comparator == IN ? EQUAL : predicate.comparator, atof(it->c_str()), lower_bound, upper_bound, value_all_match)) {
+                may_match = true;
+                all_match = all_match && value_all_match;
+            }
+        }
+
+        if (may_match) {
+            result = result | bucket_bitmaps[bucket];
+            exact = exact && all_match;
+        }
+    }
+    return result;
+}
+
+bool BitmapIndex::load() {
+    ifstream file;
+    file.open(path.c_str(), ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // | NUMBER_OF_ROWS | IS_RANGE | NUMBER_OF_BITMAPS | KEY_OR_BOUND | BITMAP | KEY_OR_BOUND | ...
+    value_bitmaps.clear();
+    bucket_bounds.clear();
+    bucket_bitmaps.clear();
+
+    char range;
+    unsigned number_of_bitmaps = 0;
+    file.read(reinterpret_cast<char *> (&number_of_rows), sizeof(number_of_rows));
+    file.read(&range, sizeof(range));
+    file.read(reinterpret_cast<char *> (&number_of_bitmaps), sizeof(number_of_bitmaps));
+    is_range = range;
+
+    for (unsigned i = 0; i < number_of_bitmaps && file; i++) {
+        RoaringBitmap bitmap;
+        if (is_range) {
+            double bound;
+            file.read(reinterpret_cast<char *> (&bound), sizeof(bound));
+            bitmap.read(file);
+            bucket_bounds.push_back(bound);
+            bucket_bitmaps.push_back(bitmap);
+        } else {
+            unsigned key_size;
+            file.read(reinterpret_cast<char *> (&key_size), sizeof(key_size));
+            string key(key_size, '\0');
+            if (key_size > 0) {
+                file.read(&key[0], key_size);
+            }
+            bitmap.read(file);
+            value_bitmaps[key] = bitmap;
+        }
+    }
+
+    bool success = !file.fail();
+    file.close();
+    dirty = false;
+
+    return success;
+}
+
+void BitmapIndex::save() {
+    if (!dirty) {
+        return;
+    }
+
+    ofstream file;
+    file.open(path.c_str(), ios::binary | ios::trunc);
+
+    char range = is_range;
+    unsigned number_of_bitmaps = is_range ? bucket_bitmaps.size() : value_bitmaps.size();
+    file.write(reinterpret_cast<char *> (&number_of_rows), sizeof(number_of_rows));
+    file.write(&range, sizeof(range));
+    file.write(reinterpret_cast<char *> (&number_of_bitmaps), sizeof(number_of_bitmaps));
+
+    if (is_range) {
+        for (unsigned i = 0; i < bucket_bitmaps.size(); i++) {
+            file.write(reinterpret_cast<char *> (&bucket_bounds[i]), sizeof(bucket_bounds[i]));
+            bucket_bitmaps[i].write(file);
+        }
+    } else {
+        for (map<string, RoaringBitmap>::iterator it = value_bitmaps.begin(); it != value_bitmaps.end(); it++) {
+            unsigned key_size = it->first.size();
+            file.write(reinterpret_cast<char *> (&key_size), sizeof(key_size));
+            file.write(it->first.c_str(), key_size);
+            it->second.write(file);
+        }
+    }
+
+    file.close();
+    dirty = false;
+}
+
+void BitmapIndex::drop() {
+    value_bitmaps.clear();
+    bucket_bounds.clear();
+    bucket_bitmaps.clear();
+    number_of_rows = 0;
+    dirty = false;
+    remove(path.c_str());
+}
+
+#endif //BITMAPINDEX_H
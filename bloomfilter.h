@@ -0,0 +1,324 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include "queryable.h"
+
+using namespace std;
+
+/**
+ * A fixed size Bloom filter. A negative answer of BloomFilter::mayContain is always
+ * correct, a positive one may be a false positive.
+ * The k hashes are derived from two 64 bits hashes (Kirsch-Mitzenmacher double hashing)
+ */
+class BloomFilter {
+private:
+    vector<uint64_t> bits;
+    unsigned number_of_hashes;
+
+    /**
+     * 64 bits FNV-1a hash of the value followed by a final avalanche step
+     */
+    static uint64_t hash(const string & value, uint64_t seed);
+
+public:
+    /**
+     * @param number_of_bits - the filter size, rounded up to a multiple of 64
+     * @param number_of_hashes - the number of bits set for each value
+     * @constructor
+     */
+    BloomFilter(unsigned number_of_bits = 0, unsigned number_of_hashes = 0);
+
+    void add(const string & value);
+
+    /**
+     * @return false if the value was certainly never added
+     */
+    bool mayContain(const string & value) const;
+
+    /**
+     * @return false if none of the values was ever added
+     */
+    bool mayContainAny(const vector<string> & values) const;
+
+    /**
+     * Remove all the values of the filter
+     */
+    void clear();
+
+    /**
+     * @return the size of the filter once written to a file, in bytes
+     */
+    unsigned getSizeInBytes() const;
+
+    void write(ostream & stream) const;
+    void read(istream & stream);
+};
+
+/**
+ * One BloomFilter for each block of ROWS_PER_BLOCK rows of a table column.
+ * The filters have the same size, so they are stored one after the other on the file,
+ * after the number of rows they cover
+ * e.g.: | NUMBER_OF_ROWS | FILTER_BLOCK_0 | FILTER_BLOCK_1 | ... and the filter of the
+ * block b is at sizeof(NUMBER_OF_ROWS) + b * filter_size
+ *
+ * The filters are kept in memory and only the blocks changed since the last
+ * BlockBloomFilter::save are written back
+ */
+class BlockBloomFilter {
+private:
+    string path;
+    int column_position;
+    vector<BloomFilter> filters;
+    vector<bool> dirty;
+    unsigned long long number_of_rows; // the rows added to the filters
+
+    BloomFilter createFilter() const;
+
+public:
+    static const unsigned BITS_PER_ROW = 10; // ~1% of false positives
+    static const unsigned NUMBER_OF_HASHES = 7;
+
+    /**
+     * @param path - the file where the filters are persisted
+     * @param column_position - the position of the filtered column on the schema
+     * @constructor
+     */
+    BlockBloomFilter(string path, int column_position);
+
+    int getColumnPosition() const;
+    string getPath() const;
+
+    /**
+     * Add a value of the row row_index (the position of the row on the header)
+     */
+    void add(long long row_index, const string & value);
+
+    /**
+     * @return false if no row of the block contains any of the values
+     */
+    bool mayContainAny(long long block, const vector<string> & values) const;
+
+    /**
+     * @return the number of blocks covered by the filters
+     */
+    long long getNumberOfBlocks() const;
+
+    /**
+     * @return the number of rows covered by the filters, the last block may be partly filled
+     */
+    unsigned long long getNumberOfRows() const;
+
+    /**
+     * Keep only the filters of the first number_of_blocks blocks, e.g.: to rebuild a
+     * partly filled last block with the rows inserted since the file was saved
+     */
+    void truncate(long long number_of_blocks);
+
+    /**
+     * Load the filters from the file, if any
+     * @return false if the file is missing or does not hold the filters of its rows
+     */
+    bool load();
+
+    /**
+     * Write the changed blocks to the file
+     */
+    void save();
+
+    /**
+     * Delete the filters and the file
+     */
+    void drop();
+};
+
+BloomFilter::BloomFilter(unsigned number_of_bits, unsigned number_of_hashes) {
+    this->bits.resize((number_of_bits + 63) / 64, 0);
+    this->number_of_hashes = number_of_hashes;
+}
+
+uint64_t BloomFilter::hash(const string & value, uint64_t seed) {
+    uint64_t h = 14695981039346656037ULL ^ seed;
+    for (string::const_iterator it = value.begin(); it != value.end(); it++) {
+        h ^= (unsigned char) (*it);
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void BloomFilter::add(const string & value) {
+    if (bits.empty()) {
+        return;
+    }
+    uint64_t h1 = hash(value, 0);
+    uint64_t h2 = hash(value, h1) | 1;
+    uint64_t number_of_bits = bits.size() * 64;
+
+    for (unsigned i = 0; i < number_of_hashes; i++) {
+        uint64_t bit = (h1 + i * h2) % number_of_bits;
+        bits[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+bool BloomFilter::mayContain(const string & value) const {
+    if (bits.empty()) {
+        return true;
+    }
+    uint64_t h1 = hash(value, 0);
+    uint64_t h2 = hash(value, h1) | 1;
+    uint64_t number_of_bits = bits.size() * 64;
+
+    for (unsigned i = 0; i < number_of_hashes; i++) {
+        uint64_t bit = (h1 + i * h2) % number_of_bits;
+        if (!(bits[bit / 64] & (1ULL << (bit % 64)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BloomFilter::mayContainAny(const vector<string> & values) const {
+    for (vector<string>::const_iterator it = values.begin(); it != values.end(); it++) {
+        if (mayContain(*it)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BloomFilter::clear() {
+    std::fill(bits.begin(), bits.end(), 0);
+}
+
+unsigned BloomFilter::getSizeInBytes() const {
+    return bits.size() * sizeof(uint64_t);
+}
+
+void BloomFilter::write(ostream & stream) const {
+    stream.write(reinterpret_cast<const char *> (&bits[0]), getSizeInBytes());
+}
+
+void BloomFilter::read(istream & stream) {
+    stream.read(reinterpret_cast<char *> (&bits[0]), getSizeInBytes());
+}
+
+BlockBloomFilter::BlockBloomFilter(string path, int column_position) {
+    this->path = path;
+    this->column_position = column_position;
+    this->number_of_rows = 0;
+}
+
+BloomFilter BlockBloomFilter::createFilter() const {
+    return BloomFilter(ROWS_PER_BLOCK * BITS_PER_ROW, NUMBER_OF_HASHES);
+}
+
+int BlockBloomFilter::getColumnPosition() const {
+    return column_position;
+}
+
+string BlockBloomFilter::getPath() const {
+    return path;
+}
+
+void BlockBloomFilter::add(long long row_index, const string & value) {
+    long long block = row_index / ROWS_PER_BLOCK;
+    while ((long long) filters.size() <= block) {
+        filters.push_back(createFilter());
+        dirty.push_back(true);
+    }
+    filters[block].add(value);
+    dirty[block] = true;
+    number_of_rows = max(number_of_rows, (unsigned long long) row_index + 1);
+}
+
+bool BlockBloomFilter::mayContainAny(long long block, const vector<string> & values) const {
+    if (block >= (long long) filters.size()) {
+        // Not covered by the filters (e.g.: rows inserted by another Table instance)
+        return true;
+    }
+    return filters[block].mayContainAny(values);
+}
+
+long long BlockBloomFilter::getNumberOfBlocks() const {
+    return filters.size();
+}
+
+unsigned long long BlockBloomFilter::getNumberOfRows() const {
+    return number_of_rows;
+}
+
+void BlockBloomFilter::truncate(long long number_of_blocks) {
+    if (number_of_blocks < (long long) filters.size()) {
+        filters.resize(number_of_blocks);
+        dirty.resize(number_of_blocks);
+        number_of_rows = min(number_of_rows, (unsigned long long) number_of_blocks * ROWS_PER_BLOCK);
+    }
+}
+
+bool BlockBloomFilter::load() {
+    filters.clear();
+    dirty.clear();
+    number_of_rows = 0;
+
+    ifstream file;
+    file.open(path.c_str(), ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file.read(reinterpret_cast<char *> (&number_of_rows), sizeof(number_of_rows));
+    if (!file) {
+        number_of_rows = 0;
+        return false;
+    }
+
+    while (file.good()) {
+        BloomFilter filter = createFilter();
+        filter.read(file);
+        if (!file) {
+            break;
+        }
+        filters.push_back(filter);
+        dirty.push_back(false);
+    }
+    file.close();
+
+    return (unsigned long long) filters.size() == (number_of_rows + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+}
+
+void BlockBloomFilter::save() {
+    fstream file;
+    file.open(path.c_str(), ios::binary | ios::in | ios::out);
+    if (!file.is_open()) {
+        // The file does not exist yet
+        file.clear();
+        file.open(path.c_str(), ios::binary | ios::out);
+    }
+
+    file.write(reinterpret_cast<char *> (&number_of_rows), sizeof(number_of_rows));
+    for (long long block = 0; block < (long long) filters.size(); block++) {
+        if (dirty[block]) {
+            file.seekp(sizeof(number_of_rows) + block * filters[block].getSizeInBytes());
+            filters[block].write(file);
+            dirty[block] = false;
+        }
+    }
+    file.close();
+}
+
+void BlockBloomFilter::drop() {
+    filters.clear();
+    dirty.clear();
+    number_of_rows = 0;
+    remove(path.c_str());
+}
+
+#endif //BLOOMFILTER_H
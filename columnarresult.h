@@ -0,0 +1,656 @@
+#ifndef COLUMNARRESULT_H
+#define COLUMNARRESULT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "schema.h"
+#include "batch.h"
+#include "stringview.h"
+
+using namespace std;
+
+/**
+ * The encodings of a column of a batch
+ * @see ColumnarResult
+ */
+enum ColumnEncoding {
+    PLAIN_ENCODING = 0, // the value of each row
+    DICTIONARY_ENCODING = 1, // the distinct values, then the code of each row (strings only)
+    RUN_LENGTH_ENCODING = 2 // the value of each run of equal values, and the row where it ends
+};
+
+/**
+ * A query result in a compact binary format, read in place: the values are decoded when they
+ * are read, so a result received from a socket is used without parsing or copying its rows
+ * e.g.: string bytes = cursor.serialize();
+ *       Cursor copy = Cursor::deserialize(bytes);
+ *
+ * The rows are split in batches of BATCH_ROWS, stored column by column. Each column has a type
+ * for all its values. The batches of a scan keep the types of their columns (INT32, INT64,
+ * FLOAT, DOUBLE or CHAR), and their values are copied from the column vectors. The rows as
+ * strings get INT64 or DOUBLE if each value converted to the number and back gives the same
+ * text (e.g.: "007" stays a CHAR), CHAR otherwise. Each column of a batch then takes its
+ * smallest encoding, e.g.: RUN_LENGTH_ENCODING for a sorted or grouped column and
+ * DICTIONARY_ENCODING for a column of a few distinct names
+ *
+ * | "CRF1" | columns | name, type, ... | continuation | rows | batch: column: encoding, size, data |
+ * The integers are little endian. The data of a column of a batch of n rows is:
+ * - PLAIN numbers: the n values, on 4 bytes (INT32 and FLOAT) or 8 bytes (INT64 and DOUBLE)
+ * - PLAIN strings: the end offset of each value, then their bytes
+ * - DICTIONARY strings: the number of values d, the code width w, the n codes of w bytes, the
+ *   end offset of each value, then their bytes
+ * - RUN_LENGTH numbers: the number of runs r, the end row of each run, then their values
+ * - RUN_LENGTH strings: the number of runs r, the end row of each run, the end offset of each
+ *   value, then their bytes
+ * @see Cursor::serialize
+ */
+class ColumnarResult {
+private:
+    /**
+     * A column of a batch, pointing into the buffer
+     */
+    struct Chunk {
+        ColumnEncoding encoding;
+        uint32_t count; // the values of the chunk: a run, a dictionary entry or a row each
+        unsigned code_width;
+        const char * codes;
+        const char * run_ends;
+        const char * values; // the numbers, or the end offsets of the strings
+        const char * bytes; // of the strings
+        size_t bytes_size;
+    };
+
+    shared_ptr<const string> buffer;
+    size_t offset;
+    vector<string> column_names;
+    vector<SchemaType> column_types;
+    string continuation;
+    long long number_of_rows;
+    vector<vector<Chunk> > chunks; // by batch, then by column
+
+    /**
+     * @return the chunk of a value, and the index of the value on it
+     * @throw out_of_range if there is no such row or column
+     */
+    const Chunk & locate(long long row, int column, uint32_t & index) const;
+
+    /**
+     * @throw invalid_argument if the column is not of numbers
+     * @return the bits of a number of the column
+     */
+    uint64_t getNumber(long long row, int column) const;
+
+    static SchemaType findType(const vector<vector<string> > & rows, int column);
+
+    /**
+     * @return the bytes of a number of the type: 4 or 8
+     */
+    static unsigned getValueWidth(SchemaType type);
+
+    static void encodeHeader(const vector<string> & column_names, const vector<SchemaType> & column_types,
+                             const string & continuation, long long number_of_rows, string & output);
+
+    /**
+     * Append a column of a batch of numbers, the bits of each value on the low width bytes
+     */
+    static void encodeNumbers(const vector<uint64_t> & values, unsigned width, string & output);
+    static void encodeStrings(const vector<StringView> & values, string & output);
+
+public:
+    static const unsigned BATCH_ROWS = 4096;
+
+    /**
+     * Read the column names and find the chunks of a result, without decoding its values
+     * @param buffer - the bytes of the result, kept by the result
+     * @param offset - the position of the result on the bytes
+     * @throw invalid_argument if the bytes are not a valid result
+     * @constructor
+     */
+    ColumnarResult(shared_ptr<const string> buffer, size_t offset = 0);
+
+    /**
+     * Append rows to the bytes, in the format of a result
+     */
+    static void encode(const vector<string> & column_names, const vector<vector<string> > & rows,
+                       const string & continuation, string & output);
+
+    /**
+     * Append the selected rows of the batches to the bytes, in the format of a result. The values
+     * are copied from the column vectors, with the types of the columns of the first batch
+     */
+    static void encode(const vector<string> & column_names, const vector<Batch> & batches,
+                       const string & continuation, string & output);
+
+    const vector<string> & getColumnNames() const;
+
+    /**
+     * @return INT32, INT64, FLOAT, DOUBLE or CHAR
+     */
+    SchemaType getColumnType(int column) const;
+
+    long long getCount() const;
+    string getContinuation() const;
+
+    /**
+     * @return the value as text, the same as before the encoding
+     */
+    string getString(long long row, int column) const;
+
+    /**
+     * @return the bytes of a CHAR value, on the buffer of the result
+     * @throw invalid_argument if the column is not a CHAR column
+     */
+    const char * getChars(long long row, int column, size_t & size) const;
+
+    /**
+     * @throw invalid_argument if the column is not an INT32 or an INT64 column
+     */
+    long long getInt64(long long row, int column) const;
+
+    /**
+     * @throw invalid_argument if the column is a CHAR column
+     */
+    double getDouble(long long row, int column) const;
+
+    /**
+     * @return a copy of the bytes of the result, e.g.: to send them again
+     */
+    string getBytes() const;
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+/**
+ * The little endian integers of the format
+ */
+inline void appendUInt(string & output, uint64_t value, unsigned width) {
+    for (unsigned i = 0; i < width; i++) {
+        output.push_back((char) (value >> (8 * i)));
+    }
+}
+
+/**
+ * @throw invalid_argument if there are less than the bytes between the position and the end
+ */
+inline void requireResultBytes(size_t position, size_t end, uint64_t bytes) {
+    if (end - position < bytes) {
+        throw std::invalid_argument("The result is truncated");
+    }
+}
+
+inline uint64_t readUInt(const char * data, unsigned width) {
+    uint64_t value = 0;
+    for (unsigned i = 0; i < width; i++) {
+        value |= (uint64_t) (uint8_t) data[i] << (8 * i);
+    }
+    return value;
+}
+
+SchemaType ColumnarResult::findType(const vector<vector<string> > & rows, int column) {
+    bool integers = true;
+    for (vector<vector<string> >::const_iterator it = rows.begin(); it != rows.end() && integers; it++) {
+        const string & value = it->at(column);
+        char * end;
+        errno = 0;
+        long long integer = strtoll(value.c_str(), &end, 10);
+        integers = !value.empty() && *end == '\0' && errno == 0 && to_string(integer) == value;
+    }
+    if (integers) {
+        return INT64;
+    }
+
+    for (vector<vector<string> >::const_iterator it = rows.begin(); it != rows.end(); it++) {
+        const string & value = it->at(column);
+        char * end;
+        double number = strtod(value.c_str(), &end);
+        if (value.empty() || *end != '\0' || formatDouble(number) != value) {
+            return CHAR;
+        }
+    }
+    return DOUBLE;
+}
+
+unsigned ColumnarResult::getValueWidth(SchemaType type) {
+    return type == INT32 || type == FLOAT ? 4 : 8;
+}
+
+void ColumnarResult::encodeHeader(const vector<string> & column_names, const vector<SchemaType> & column_types,
+                                  const string & continuation, long long number_of_rows, string & output) {
+    output.append("CRF1");
+    appendUInt(output, column_names.size(), 4);
+    for (size_t i = 0; i < column_names.size(); i++) {
+        appendUInt(output, column_names[i].size(), 4);
+        output.append(column_names[i]);
+        appendUInt(output, column_types[i], 1);
+    }
+    appendUInt(output, continuation.size(), 4);
+    output.append(continuation);
+    appendUInt(output, number_of_rows, 8);
+}
+
+void ColumnarResult::encodeNumbers(const vector<uint64_t> & values, unsigned width, string & output) {
+    //The runs of equal values, the end row of each one
+    vector<uint32_t> run_ends;
+    for (size_t i = 1; i <= values.size(); i++) {
+        if (i == values.size() || values[i] != values[i - 1]) {
+            run_ends.push_back(i);
+        }
+    }
+
+    //The numbers: width bytes each, or 4 more for a run
+    string data;
+    ColumnEncoding encoding = PLAIN_ENCODING;
+    if (run_ends.size() * (4 + width) + 4 < values.size() * width) {
+        encoding = RUN_LENGTH_ENCODING;
+        appendUInt(data, run_ends.size(), 4);
+        for (size_t i = 0; i < run_ends.size(); i++) {
+            appendUInt(data, run_ends[i], 4);
+        }
+        for (size_t i = 0; i < run_ends.size(); i++) {
+            appendUInt(data, values[run_ends[i] - 1], width);
+        }
+    } else {
+        for (size_t i = 0; i < values.size(); i++) {
+            appendUInt(data, values[i], width);
+        }
+    }
+
+    appendUInt(output, encoding, 1);
+    appendUInt(output, data.size(), 8);
+    output.append(data);
+}
+
+void ColumnarResult::encodeStrings(const vector<StringView> & values, string & output) {
+    size_t number_of_rows = values.size();
+    vector<uint32_t> run_ends;
+    for (size_t i = 1; i <= number_of_rows; i++) {
+        if (i == number_of_rows || values[i] != values[i - 1]) {
+            run_ends.push_back(i);
+        }
+    }
+
+    //Compare the sizes of the three encodings
+    unordered_map<string, uint32_t> dictionary;
+    vector<StringView> distinct_values;
+    vector<uint32_t> codes;
+    size_t plain_bytes = 0;
+    size_t distinct_bytes = 0;
+    size_t run_bytes = 0;
+    for (size_t i = 0; i < number_of_rows; i++) {
+        const StringView & value = values[i];
+        plain_bytes += value.size();
+        pair<unordered_map<string, uint32_t>::iterator, bool> entry = dictionary.insert(make_pair(value.toString(), (uint32_t) dictionary.size()));
+        if (entry.second) {
+            distinct_values.push_back(value);
+            distinct_bytes += value.size();
+        }
+        codes.push_back(entry.first->second);
+    }
+    for (size_t i = 0; i < run_ends.size(); i++) {
+        run_bytes += values[run_ends[i] - 1].size();
+    }
+    unsigned code_width = distinct_values.size() <= 0x100 ? 1 : distinct_values.size() <= 0x10000 ? 2 : 4;
+
+    string data;
+    ColumnEncoding encoding = PLAIN_ENCODING;
+    size_t plain_size = number_of_rows * 4 + plain_bytes;
+    size_t dictionary_size = 5 + number_of_rows * code_width + distinct_values.size() * 4 + distinct_bytes;
+    size_t run_length_size = 4 + run_ends.size() * 8 + run_bytes;
+    vector<StringView> written;
+    if (run_length_size <= dictionary_size && run_length_size < plain_size) {
+        encoding = RUN_LENGTH_ENCODING;
+        appendUInt(data, run_ends.size(), 4);
+        for (size_t i = 0; i < run_ends.size(); i++) {
+            appendUInt(data, run_ends[i], 4);
+            written.push_back(values[run_ends[i] - 1]);
+        }
+    } else if (dictionary_size < plain_size) {
+        encoding = DICTIONARY_ENCODING;
+        appendUInt(data, distinct_values.size(), 4);
+        appendUInt(data, code_width, 1);
+        for (size_t i = 0; i < number_of_rows; i++) {
+            appendUInt(data, codes[i], code_width);
+        }
+        written = distinct_values;
+    } else {
+        written = values;
+    }
+
+    uint32_t end_offset = 0;
+    for (vector<StringView>::iterator it = written.begin(); it != written.end(); it++) {
+        end_offset += it->size();
+        appendUInt(data, end_offset, 4);
+    }
+    for (vector<StringView>::iterator it = written.begin(); it != written.end(); it++) {
+        data.append(it->data(), it->size());
+    }
+
+    appendUInt(output, encoding, 1);
+    appendUInt(output, data.size(), 8);
+    output.append(data);
+}
+
+void ColumnarResult::encode(const vector<string> & column_names, const vector<vector<string> > & rows,
+                            const string & continuation, string & output) {
+    vector<SchemaType> column_types;
+    for (size_t i = 0; i < column_names.size(); i++) {
+        column_types.push_back(findType(rows, i));
+    }
+    encodeHeader(column_names, column_types, continuation, rows.size(), output);
+
+    for (size_t first_row = 0; first_row < rows.size(); first_row += BATCH_ROWS) {
+        size_t end_row = min(rows.size(), first_row + BATCH_ROWS);
+        for (size_t i = 0; i < column_names.size(); i++) {
+            if (column_types[i] == CHAR) {
+                vector<StringView> values;
+                for (size_t row = first_row; row < end_row; row++) {
+                    values.push_back(StringView(rows[row][i]));
+                }
+                encodeStrings(values, output);
+                continue;
+            }
+            vector<uint64_t> values;
+            for (size_t row = first_row; row < end_row; row++) {
+                if (column_types[i] == INT64) {
+                    values.push_back((uint64_t) strtoll(rows[row][i].c_str(), NULL, 10));
+                } else {
+                    double number = strtod(rows[row][i].c_str(), NULL);
+                    uint64_t bits;
+                    memcpy(&bits, &number, sizeof(bits));
+                    values.push_back(bits);
+                }
+            }
+            encodeNumbers(values, 8, output);
+        }
+    }
+}
+
+void ColumnarResult::encode(const vector<string> & column_names, const vector<Batch> & batches,
+                            const string & continuation, string & output) {
+    //A FOREIGN_KEY is read as an INT64
+    vector<SchemaType> column_types;
+    for (size_t i = 0; i < column_names.size(); i++) {
+        SchemaType type = batches.empty() ? CHAR : batches[0].columns.at(i).type;
+        column_types.push_back(type == FOREIGN_KEY ? INT64 : type);
+    }
+    long long number_of_rows = 0;
+    for (vector<Batch>::const_iterator it = batches.begin(); it != batches.end(); it++) {
+        number_of_rows += it->selection.size();
+    }
+    encodeHeader(column_names, column_types, continuation, number_of_rows, output);
+
+    //The selected rows of the batches, BATCH_ROWS of them at a time
+    vector<pair<const Batch *, uint32_t> > rows;
+    rows.reserve(BATCH_ROWS);
+    vector<Batch>::const_iterator batch = batches.begin();
+    size_t selected = 0;
+    while (batch != batches.end() || !rows.empty()) {
+        if (batch != batches.end() && rows.size() < BATCH_ROWS) {
+            if (selected < batch->selection.size()) {
+                rows.push_back(make_pair(&*batch, batch->selection[selected++]));
+            } else {
+                batch++;
+                selected = 0;
+            }
+            continue;
+        }
+
+        for (size_t i = 0; i < column_names.size(); i++) {
+            if (column_types[i] == CHAR) {
+                vector<StringView> values;
+                for (size_t row = 0; row < rows.size(); row++) {
+                    const ColumnVector & column = rows[row].first->columns[i];
+                    const char * chars = column.getChars(rows[row].second);
+                    values.push_back(StringView(chars, strnlen(chars, column.width)));
+                }
+                encodeStrings(values, output);
+                continue;
+            }
+            vector<uint64_t> values;
+            for (size_t row = 0; row < rows.size(); row++) {
+                const ColumnVector & column = rows[row].first->columns[i];
+                uint32_t index = rows[row].second;
+                uint32_t bits32;
+                uint64_t bits;
+                switch (column_types[i]) {
+                    case INT32: values.push_back((uint32_t) column.int32_values[index]); break;
+                    case FLOAT:
+                        memcpy(&bits32, &column.float_values[index], sizeof(bits32));
+                        values.push_back(bits32);
+                        break;
+                    case DOUBLE:
+                        memcpy(&bits, &column.double_values[index], sizeof(bits));
+                        values.push_back(bits);
+                        break;
+                    default: values.push_back((uint64_t) column.int64_values[index]); break;
+                }
+            }
+            encodeNumbers(values, getValueWidth(column_types[i]), output);
+        }
+        rows.clear();
+    }
+}
+
+ColumnarResult::ColumnarResult(shared_ptr<const string> buffer, size_t offset) {
+    this->buffer = buffer;
+    this->offset = offset;
+
+    const char * data = buffer->data();
+    size_t size = buffer->size();
+    size_t position = offset;
+    //Each field is checked before it's read, the position never passes the size
+    requireResultBytes(position, size, 8);
+    if (memcmp(data + position, "CRF1", 4) != 0) {
+        throw std::invalid_argument("The bytes are not a result");
+    }
+    position += 4;
+    uint32_t number_of_columns = readUInt(data + position, 4);
+    position += 4;
+    for (uint32_t i = 0; i < number_of_columns; i++) {
+        requireResultBytes(position, size, 4);
+        uint32_t name_size = readUInt(data + position, 4);
+        position += 4;
+        requireResultBytes(position, size, (uint64_t) name_size + 1);
+        column_names.push_back(string(data + position, name_size));
+        position += name_size;
+        SchemaType type = (SchemaType) data[position++];
+        if (type != INT32 && type != INT64 && type != FLOAT && type != DOUBLE && type != CHAR) {
+            throw std::invalid_argument("Invalid column type: " + to_string((int) type));
+        }
+        column_types.push_back(type);
+    }
+    requireResultBytes(position, size, 4);
+    uint32_t continuation_size = readUInt(data + position, 4);
+    position += 4;
+    requireResultBytes(position, size, (uint64_t) continuation_size + 8);
+    continuation = string(data + position, continuation_size);
+    position += continuation_size;
+    number_of_rows = readUInt(data + position, 8);
+    position += 8;
+
+    for (long long first_row = 0; first_row < number_of_rows; first_row += BATCH_ROWS) {
+        uint64_t rows = min((long long) BATCH_ROWS, number_of_rows - first_row);
+        chunks.push_back(vector<Chunk>(number_of_columns));
+        for (uint32_t i = 0; i < number_of_columns; i++) {
+            requireResultBytes(position, size, 9);
+            Chunk & chunk = chunks.back()[i];
+            memset(&chunk, 0, sizeof(chunk));
+            chunk.encoding = (ColumnEncoding) data[position];
+            uint64_t chunk_size = readUInt(data + position + 1, 8);
+            position += 9;
+            requireResultBytes(position, size, chunk_size);
+            size_t chunk_end = position + chunk_size;
+
+            //The same checks, within the chunk
+            size_t end = position;
+            chunk.count = rows;
+            if (chunk.encoding == DICTIONARY_ENCODING && column_types[i] == CHAR) {
+                requireResultBytes(end, chunk_end, 5);
+                chunk.count = readUInt(data + end, 4);
+                chunk.code_width = (uint8_t) data[end + 4];
+                end += 5;
+                if (chunk.code_width != 1 && chunk.code_width != 2 && chunk.code_width != 4) {
+                    throw std::invalid_argument("Invalid column chunk");
+                }
+                requireResultBytes(end, chunk_end, rows * chunk.code_width);
+                chunk.codes = data + end;
+                end += rows * chunk.code_width;
+            } else if (chunk.encoding == RUN_LENGTH_ENCODING) {
+                requireResultBytes(end, chunk_end, 4);
+                chunk.count = readUInt(data + end, 4);
+                end += 4;
+                requireResultBytes(end, chunk_end, (uint64_t) chunk.count * 4);
+                chunk.run_ends = data + end;
+                end += (uint64_t) chunk.count * 4;
+                if (chunk.count == 0 || readUInt(chunk.run_ends + (chunk.count - 1) * 4, 4) != rows) {
+                    throw std::invalid_argument("Invalid column chunk");
+                }
+            } else if (chunk.encoding != PLAIN_ENCODING) {
+                throw std::invalid_argument("Invalid column encoding: " + to_string((int) chunk.encoding));
+            }
+
+            unsigned value_size = column_types[i] == CHAR ? 4 : getValueWidth(column_types[i]);
+            requireResultBytes(end, chunk_end, (uint64_t) chunk.count * value_size);
+            chunk.values = data + end;
+            end += (uint64_t) chunk.count * value_size;
+            if (column_types[i] == CHAR) {
+                chunk.bytes = data + end;
+                chunk.bytes_size = chunk_end - end;
+                if (chunk.count > 0 && readUInt(chunk.values + (chunk.count - 1) * 4, 4) > chunk.bytes_size) {
+                    throw std::invalid_argument("Invalid column chunk");
+                }
+            }
+            position = chunk_end;
+        }
+    }
+}
+
+const ColumnarResult::Chunk & ColumnarResult::locate(long long row, int column, uint32_t & index) const {
+    if (row < 0 || row >= number_of_rows || column < 0 || column >= (int) column_names.size()) {
+        throw std::out_of_range("There is no value at row " + to_string(row) + ", column " + to_string(column));
+    }
+    const Chunk & chunk = chunks[row / BATCH_ROWS][column];
+    uint32_t batch_row = row % BATCH_ROWS;
+    if (chunk.encoding == DICTIONARY_ENCODING) {
+        index = readUInt(chunk.codes + (size_t) batch_row * chunk.code_width, chunk.code_width);
+    } else if (chunk.encoding == RUN_LENGTH_ENCODING) {
+        //The first run ending after the row
+        uint32_t first = 0;
+        uint32_t last = chunk.count;
+        while (first < last) {
+            uint32_t middle = first + (last - first) / 2;
+            if (readUInt(chunk.run_ends + (size_t) middle * 4, 4) <= batch_row) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+        index = first;
+    } else {
+        index = batch_row;
+    }
+    if (index >= chunk.count) {
+        throw std::invalid_argument("Invalid column chunk");
+    }
+    return chunk;
+}
+
+const vector<string> & ColumnarResult::getColumnNames() const {
+    return column_names;
+}
+
+SchemaType ColumnarResult::getColumnType(int column) const {
+    return column_types.at(column);
+}
+
+long long ColumnarResult::getCount() const {
+    return number_of_rows;
+}
+
+string ColumnarResult::getContinuation() const {
+    return continuation;
+}
+
+const char * ColumnarResult::getChars(long long row, int column, size_t & size) const {
+    uint32_t index;
+    const Chunk & chunk = locate(row, column, index);
+    if (column_types[column] != CHAR) {
+        throw std::invalid_argument("The column \"" + column_names[column] + "\" is not a CHAR column");
+    }
+    uint32_t start = index == 0 ? 0 : readUInt(chunk.values + ((size_t) index - 1) * 4, 4);
+    uint32_t end = readUInt(chunk.values + (size_t) index * 4, 4);
+    if (start > end || end > chunk.bytes_size) {
+        throw std::invalid_argument("Invalid column chunk");
+    }
+    size = end - start;
+    return chunk.bytes + start;
+}
+
+uint64_t ColumnarResult::getNumber(long long row, int column) const {
+    uint32_t index;
+    const Chunk & chunk = locate(row, column, index);
+    if (column_types[column] == CHAR) {
+        throw std::invalid_argument("The column \"" + column_names[column] + "\" is not a number column");
+    }
+    unsigned width = getValueWidth(column_types[column]);
+    return readUInt(chunk.values + (size_t) index * width, width);
+}
+
+long long ColumnarResult::getInt64(long long row, int column) const {
+    uint64_t bits = getNumber(row, column);
+    if (column_types[column] == INT32) {
+        return (int32_t) (uint32_t) bits;
+    }
+    if (column_types[column] != INT64) {
+        throw std::invalid_argument("The column \"" + column_names[column] + "\" is not an integer column");
+    }
+    return (long long) bits;
+}
+
+double ColumnarResult::getDouble(long long row, int column) const {
+    uint64_t bits = getNumber(row, column);
+    switch (column_types[column]) {
+        case INT32: return (int32_t) (uint32_t) bits;
+        case INT64: return (double) (long long) bits;
+        case FLOAT: {
+            uint32_t bits32 = bits;
+            float value;
+            memcpy(&value, &bits32, sizeof(value));
+            return value;
+        }
+        default: {
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+    }
+}
+
+string ColumnarResult::getString(long long row, int column) const {
+    SchemaType type = getColumnType(column);
+    if (type == INT32 || type == INT64) {
+        return to_string(getInt64(row, column));
+    }
+    if (type == FLOAT || type == DOUBLE) {
+        return formatDouble(getDouble(row, column));
+    }
+    size_t size;
+    const char * chars = getChars(row, column, size);
+    return string(chars, size);
+}
+
+string ColumnarResult::getBytes() const {
+    return buffer->substr(offset);
+}
+
+#endif //COLUMNARRESULT_H
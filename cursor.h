@@ -3,24 +3,423 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
 
 #include "schema.h"
+#include "batch.h"
+#include "stringview.h"
+#include "columnarresult.h"
 
 using namespace std;
 
+/**
+ * Iterates over the rows of a query result
+ * e.g.:
+ * Cursor cursor = table.query("SELECT name");
+ * for (cursor.moveToFirst(); !cursor.isAfterLast(); cursor.moveToNext()) {
+ *     cout << cursor.getString("name") << endl;
+ * }
+ *
+ * The rows are either strings, the batches returned by the operators of a scan, or the binary
+ * result of a deserialized cursor. The typed getters read the last two in place, so a loop
+ * over many rows resolves its column indexes once and doesn't format nor parse any string
+ * e.g.:
+ * int age = cursor.getColumnIndex("age");
+ * for (cursor.moveToFirst(); !cursor.isAfterLast(); cursor.moveToNext()) {
+ *     total += cursor.getInt32(age);
+ * }
+ * @see ColumnarResult
+ */
 class Cursor {
 private:
-    vector<vector <string> >::iterator it;
+    long long position;
     vector<vector <string> > data;
-    Schema schema;
-    
+    vector<string> column_names;
+    unordered_map<string, int> column_indexes;
+    string continuation;
+    shared_ptr<const ColumnarResult> columnar; // the rows of a deserialized cursor, instead of data
+    shared_ptr<const vector<Batch> > batches; // the rows of a scan, instead of data
+    vector<long long> batch_ends; // the number of rows up to the end of each batch
+    size_t batch_index; // the batch of the position
+    string formatted; // the number of the last getStringView
+
+    void setColumnNames(const vector<string> & column_names);
+
+    /**
+     * @return the column of the batch of the current row, and the row on it
+     * @throw out_of_range if the cursor is past the last row
+     */
+    const ColumnVector & getColumnVector(int column_index, unsigned & row);
+
 public:
-    Cursor(Schema schema, vector<vector <string> > data){};
-    void moveToFirst(){};
-    void moveToNext(){};
-    string getString(string column_name){};
-    string getString(int column_index){};
-    int getColumnIndex(string column_name){};
+    /**
+     * The columns of the cursor are the schema columns, _id included
+     * @constructor
+     */
+    Cursor(Schema schema, vector<vector <string> > data);
+
+    /**
+     * @param column_names - the name of each column of the rows
+     * @constructor
+     */
+    Cursor(vector<string> column_names, vector<vector <string> > data);
+
+    /**
+     * @param batches - the rows are the selected rows of the batches, in order
+     * @constructor
+     */
+    Cursor(vector<string> column_names, vector<Batch> batches);
+
+    void moveToFirst();
+    void moveToNext();
+
+    /**
+     * @return true if the cursor is past the last row (or the result is empty)
+     */
+    bool isAfterLast();
+
+    /**
+     * @return the number of rows
+     */
+    long long getCount();
+
+    string getString(string column_name);
+    string getString(int column_index);
+
+    /**
+     * @throw invalid_argument if the value is not an integer, or doesn't fit in 32 bits
+     */
+    int32_t getInt32(string column_name);
+    int32_t getInt32(int column_index);
+
+    /**
+     * @throw invalid_argument if the value is not an integer
+     */
+    int64_t getInt64(string column_name);
+    int64_t getInt64(int column_index);
+
+    /**
+     * @throw invalid_argument if the value is not a number
+     */
+    double getDouble(string column_name);
+    double getDouble(int column_index);
+
+    /**
+     * The value of a FLOAT column as it was stored, without going through a double
+     * @throw invalid_argument if the value is not a number
+     */
+    float getFloat(string column_name);
+    float getFloat(int column_index);
+
+    /**
+     * @return the text of the value without copying it, if the cursor keeps it (a CHAR value, or
+     *         any value of the rows as strings). It's valid until the cursor is destroyed, but
+     *         the text of a number is only kept until the next call
+     */
+    StringView getStringView(string column_name);
+    StringView getStringView(int column_index);
+
+    /**
+     * @throw invalid_argument if there is no column with the name
+     */
+    int getColumnIndex(string column_name);
+
+    vector<string> getColumnNames();
+
+    /**
+     * @return the keyset of the last row of a page, to read the next page with
+     *         Table::queryPage. Empty if there are no more pages
+     */
+    string getContinuation();
+    void setContinuation(const string & continuation);
+
+    /**
+     * @return the rows in the binary format of ColumnarResult, e.g.: to send them to a client
+     */
+    string serialize();
+
+    /**
+     * A cursor on serialized rows. The bytes are kept by the cursor, and its values are read
+     * from them without decoding the rows first
+     * @param offset - the position of the rows on the bytes, e.g.: past the header of a message
+     * @throw invalid_argument if the bytes are not a valid result
+     */
+    static Cursor deserialize(shared_ptr<const string> bytes, size_t offset = 0);
+    static Cursor deserialize(const string & bytes);
 };
 
-#endif //CURSOR_H
\ No newline at end of file
+Cursor::Cursor(Schema schema, vector<vector <string> > data) {
+    vector<SchemaCol>* schema_cols = schema.getCols();
+    vector<string> column_names;
+    for (vector<SchemaCol>::iterator it = schema_cols->begin(); it != schema_cols->end(); it++) {
+        column_names.push_back(it->key);
+    }
+    setColumnNames(column_names);
+    this->data = data;
+    this->position = 0;
+    this->batch_index = 0;
+}
+
+Cursor::Cursor(vector<string> column_names, vector<vector <string> > data) {
+    setColumnNames(column_names);
+    this->data = data;
+    this->position = 0;
+    this->batch_index = 0;
+}
+
+Cursor::Cursor(vector<string> column_names, vector<Batch> batches) {
+    setColumnNames(column_names);
+    long long rows = 0;
+    for (vector<Batch>::iterator it = batches.begin(); it != batches.end(); it++) {
+        if (!it->selection.empty()) {
+            rows += it->selection.size();
+            batch_ends.push_back(rows);
+        }
+    }
+    //The batches without rows are removed, so moveToNext goes to the next batch at most
+    batches.erase(remove_if(batches.begin(), batches.end(), [](const Batch & batch) {
+        return batch.selection.empty();
+    }), batches.end());
+    this->batches = make_shared<const vector<Batch> >(std::move(batches));
+    this->position = 0;
+    this->batch_index = 0;
+}
+
+void Cursor::setColumnNames(const vector<string> & column_names) {
+    this->column_names = column_names;
+    //A repeated name is the first column having it
+    for (unsigned i = 0; i < column_names.size(); i++) {
+        column_indexes.insert(make_pair(column_names[i], i));
+    }
+}
+
+void Cursor::moveToFirst() {
+    position = 0;
+    batch_index = 0;
+}
+
+void Cursor::moveToNext() {
+    if (position < getCount()) {
+        position++;
+        if (batches && position == batch_ends[batch_index] && batch_index + 1 < batch_ends.size()) {
+            batch_index++;
+        }
+    }
+}
+
+bool Cursor::isAfterLast() {
+    return position >= getCount();
+}
+
+long long Cursor::getCount() {
+    if (columnar) {
+        return columnar->getCount();
+    }
+    if (batches) {
+        return batch_ends.empty() ? 0 : batch_ends.back();
+    }
+    return data.size();
+}
+
+const ColumnVector & Cursor::getColumnVector(int column_index, unsigned & row) {
+    if (position >= getCount()) {
+        throw std::out_of_range("The cursor is past the last row");
+    }
+    const Batch & batch = (*batches)[batch_index];
+    row = batch.selection[position - (batch_index == 0 ? 0 : batch_ends[batch_index - 1])];
+    return batch.columns.at(column_index);
+}
+
+string Cursor::getString(string column_name) {
+    return getString(getColumnIndex(column_name));
+}
+
+string Cursor::getString(int column_index) {
+    if (columnar) {
+        return columnar->getString(position, column_index);
+    }
+    if (batches) {
+        unsigned row;
+        return getColumnVector(column_index, row).getString(row);
+    }
+    return data.at(position).at(column_index);
+}
+
+int32_t Cursor::getInt32(string column_name) {
+    return getInt32(getColumnIndex(column_name));
+}
+
+int32_t Cursor::getInt32(int column_index) {
+    if (columnar && columnar->getColumnType(column_index) == INT32) {
+        return (int32_t) columnar->getInt64(position, column_index);
+    }
+    if (batches) {
+        unsigned row;
+        const ColumnVector & column = getColumnVector(column_index, row);
+        if (column.type == INT32) {
+            return column.int32_values[row];
+        }
+    }
+    int64_t value = getInt64(column_index);
+    if (value < INT32_MIN || value > INT32_MAX) {
+        throw std::invalid_argument("The value " + to_string(value) + " of the column \"" + column_names.at(column_index) +
+                                    "\" doesn't fit in 32 bits");
+    }
+    return (int32_t) value;
+}
+
+int64_t Cursor::getInt64(string column_name) {
+    return getInt64(getColumnIndex(column_name));
+}
+
+int64_t Cursor::getInt64(int column_index) {
+    if (columnar) {
+        return columnar->getInt64(position, column_index);
+    }
+    if (batches) {
+        unsigned row;
+        const ColumnVector & column = getColumnVector(column_index, row);
+        if (!column.isInteger()) {
+            throw std::invalid_argument("The column \"" + column_names.at(column_index) + "\" is not an integer column");
+        }
+        return column.getInteger(row);
+    }
+    const string & value = data.at(position).at(column_index);
+    char * end;
+    errno = 0;
+    long long number = strtoll(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || errno == ERANGE) {
+        throw std::invalid_argument("The value \"" + value + "\" of the column \"" + column_names.at(column_index) + "\" is not an integer");
+    }
+    return number;
+}
+
+double Cursor::getDouble(string column_name) {
+    return getDouble(getColumnIndex(column_name));
+}
+
+double Cursor::getDouble(int column_index) {
+    if (columnar) {
+        return columnar->getDouble(position, column_index);
+    }
+    if (batches) {
+        unsigned row;
+        const ColumnVector & column = getColumnVector(column_index, row);
+        if (column.type == CHAR) {
+            throw std::invalid_argument("The column \"" + column_names.at(column_index) + "\" is not a numeric column");
+        }
+        return column.getNumber(row);
+    }
+    const string & value = data.at(position).at(column_index);
+    char * end;
+    double number = strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0') {
+        throw std::invalid_argument("The value \"" + value + "\" of the column \"" + column_names.at(column_index) + "\" is not a number");
+    }
+    return number;
+}
+
+float Cursor::getFloat(string column_name) {
+    return getFloat(getColumnIndex(column_name));
+}
+
+float Cursor::getFloat(int column_index) {
+    if (batches) {
+        unsigned row;
+        const ColumnVector & column = getColumnVector(column_index, row);
+        if (column.type == FLOAT) {
+            return column.float_values[row];
+        }
+    }
+    if (columnar || batches) {
+        //A FLOAT of a deserialized cursor is exact as a double
+        return (float) getDouble(column_index);
+    }
+    const string & value = data.at(position).at(column_index);
+    char * end;
+    float number = strtof(value.c_str(), &end);
+    if (value.empty() || *end != '\0') {
+        throw std::invalid_argument("The value \"" + value + "\" of the column \"" + column_names.at(column_index) + "\" is not a number");
+    }
+    return number;
+}
+
+StringView Cursor::getStringView(string column_name) {
+    return getStringView(getColumnIndex(column_name));
+}
+
+StringView Cursor::getStringView(int column_index) {
+    if (columnar) {
+        if (columnar->getColumnType(column_index) == CHAR) {
+            size_t size;
+            const char * chars = columnar->getChars(position, column_index, size);
+            return StringView(chars, size);
+        }
+        formatted = columnar->getString(position, column_index);
+        return StringView(formatted);
+    }
+    if (batches) {
+        unsigned row;
+        const ColumnVector & column = getColumnVector(column_index, row);
+        if (column.type == CHAR) {
+            return StringView(column.getChars(row), strnlen(column.getChars(row), column.width));
+        }
+        formatted = column.getString(row);
+        return StringView(formatted);
+    }
+    return StringView(data.at(position).at(column_index));
+}
+
+int Cursor::getColumnIndex(string column_name) {
+    unordered_map<string, int>::iterator it = column_indexes.find(column_name);
+    if (it != column_indexes.end()) {
+        return it->second;
+    }
+
+    throw std::invalid_argument("There is no column with the name \"" + column_name + "\" in this Cursor");
+}
+
+vector<string> Cursor::getColumnNames() {
+    return column_names;
+}
+
+string Cursor::getContinuation() {
+    return continuation;
+}
+
+void Cursor::setContinuation(const string & continuation) {
+    this->continuation = continuation;
+}
+
+string Cursor::serialize() {
+    if (columnar) {
+        return columnar->getBytes();
+    }
+    string bytes;
+    if (batches) {
+        ColumnarResult::encode(column_names, *batches, continuation, bytes);
+        return bytes;
+    }
+    ColumnarResult::encode(column_names, data, continuation, bytes);
+    return bytes;
+}
+
+Cursor Cursor::deserialize(shared_ptr<const string> bytes, size_t offset) {
+    shared_ptr<const ColumnarResult> columnar = make_shared<ColumnarResult>(bytes, offset);
+    Cursor cursor(columnar->getColumnNames(), vector<vector<string> >());
+    cursor.columnar = columnar;
+    cursor.continuation = columnar->getContinuation();
+    return cursor;
+}
+
+Cursor Cursor::deserialize(const string & bytes) {
+    return deserialize(make_shared<const string>(bytes));
+}
+
+#endif //CURSOR_H
@@ -0,0 +1,790 @@
+#ifndef HASHAGGREGATE_H
+#define HASHAGGREGATE_H
+
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <exception>
+#include <unordered_map>
+#include <memory>
+#include <stdio.h>
+#include "operators.h"
+#include "arena.h"
+#include "threadpool.h"
+#include "pipeline.h"
+
+using namespace std;
+
+/**
+ * The groups of a GROUP BY and the accumulators of each group. The group key is the
+ * binary value of the group columns, e.g.: for GROUP BY company_id (FOREIGN_KEY), name (CHAR:10)
+ * the key has 8 + 11 bytes
+ *
+ * The table keeps at most max_groups groups in memory. When there are more, all of them
+ * are written (spilled) to NUMBER_OF_PARTITIONS files, chosen by the hash of the key, and
+ * the table is emptied. Since every group goes always to the same partition, each
+ * partition can be aggregated later on its own
+ */
+class AggregationHashTable {
+private:
+    vector<int> group_columns;
+    vector<Aggregate> aggregates;
+    size_t max_groups;
+    unsigned level; // how many times the rows were partitioned, picks the hash bits of the partition
+    vector<string> spill_paths; // the last file of this table for each partition
+
+    bool has_columns;
+    vector<ColumnVector> key_columns; // the group columns, without values
+    vector<SchemaType> aggregate_types; // the type of the aggregated column (INT64 for COUNT(*))
+    vector<unsigned> aggregate_widths;
+    unsigned key_size;
+
+    typedef unordered_map<string, unsigned, hash<string>, equal_to<string>,
+                          ArenaAllocator<pair<const string, unsigned> > > GroupIndexes;
+
+    Arena arena; // the nodes of group_indexes, released at once when the groups are spilled
+    unique_ptr<GroupIndexes> group_indexes;
+    vector<string> keys;
+    vector<Accumulator> accumulators; // aggregates.size() accumulators for each group
+    vector<vector<string> > partitions; // the spill files of each partition
+    string key_buffer;
+
+    /**
+     * Copy the group and aggregate column types from a batch, on the first call
+     */
+    void setColumns(const Batch & batch);
+
+    /**
+     * @return the index of the group, which is created if new
+     */
+    unsigned findGroup(const string & key);
+
+    /**
+     * Remove all the groups and release the memory of their nodes
+     */
+    void clearGroups();
+
+    /**
+     * Write all the groups to the partition files and empty the table
+     */
+    void spill();
+
+    /**
+     * @return the partition of a key on the current level
+     */
+    unsigned getPartition(const string & key) const;
+
+public:
+    static const unsigned NUMBER_OF_PARTITIONS = 16;
+    static const unsigned PARTITION_BITS = 4;
+
+    /**
+     * After MAX_LEVEL partitionings the partitions are not spilled again, so a partition
+     * with too many groups is kept in memory
+     */
+    static const unsigned MAX_LEVEL = 4;
+
+    /**
+     * @param group_columns - the position of the group columns on the input batches
+     * @param aggregates - the aggregates, with the column positions on the input batches
+     * @param max_groups - the number of groups kept in memory
+     * @param level - the number of partitionings of the rows added to the table
+     * @constructor
+     */
+    AggregationHashTable(const vector<int> & group_columns, const vector<Aggregate> & aggregates, size_t max_groups, unsigned level = 0);
+
+    /**
+     * Aggregate the selected rows of a batch
+     */
+    void add(const Batch & batch);
+
+    /**
+     * Combine the accumulators of a group with the ones of the table
+     * @param group_accumulators - aggregates.size() accumulators
+     */
+    void merge(const string & key, const Accumulator * group_accumulators);
+
+    /**
+     * Move the groups and spill files of another table (e.g.: aggregated by another thread)
+     * to this one
+     */
+    void merge(AggregationHashTable & other);
+
+    /**
+     * Copy the group and aggregate column types from another table, if this one has none
+     */
+    void copyColumns(const AggregationHashTable & other);
+
+    /**
+     * Read and merge the groups written to a spill file, then delete the file
+     */
+    void mergeSpillFile(const string & path);
+
+    /**
+     * Write the groups still in memory to the partition files, if the table has spilled
+     * any group, so each group is in a single place
+     */
+    void finishSpill();
+
+    /**
+     * @return the spill files of each partition
+     */
+    vector<vector<string> > & getPartitions();
+
+    bool hasSpilled() const;
+    unsigned getLevel() const;
+    size_t getMaxGroups() const;
+    size_t getNumberOfGroups() const;
+
+    /**
+     * Create the output columns: the group columns followed by one column for each aggregate
+     */
+    void initOutput(Batch & batch) const;
+
+    /**
+     * Write the group columns and the aggregate results of a group on a row of a batch
+     * created by AggregationHashTable::initOutput
+     */
+    void storeGroup(size_t group, Batch & batch, unsigned row) const;
+
+    /**
+     * Add an empty group, e.g.: so a COUNT(*) without GROUP BY over no rows returns 0
+     */
+    void addEmptyGroup();
+
+    /**
+     * Delete the spill files
+     */
+    void dropSpillFiles();
+};
+
+/**
+ * Aggregate the rows of a pipeline worker on its own table
+ */
+class AggregateSink : public PipelineSink {
+private:
+    AggregationHashTable * table;
+
+public:
+    AggregateSink(AggregationHashTable * table);
+    void consume(Batch & batch, long long morsel);
+};
+
+/**
+ * Group the rows of the children and compute aggregates for each group (a GROUP BY).
+ * Each child is read by its own task on the shared ThreadPool, which aggregates its rows on a
+ * local table (a partial aggregation). The local tables are merged when all the children are done
+ * e.g.: to aggregate a table with two threads, the children are two TableScanOperators
+ * reading the first and the second half of the blocks
+ * The input may also be a Pipeline instead, with a local table for each of its workers
+ *
+ * The output has the group columns followed by the aggregates, one row for each group.
+ * Without group columns the output is a single row, as AggregateOperator
+ *
+ * The groups over the memory budget are spilled to partition files, which are read back
+ * and aggregated one at a time after all the groups in memory are returned
+ * @see AggregationHashTable
+ */
+class HashAggregateOperator : public Operator {
+private:
+    vector<Operator *> children;
+    Pipeline * pipeline;
+    vector<int> group_columns;
+    vector<Aggregate> aggregates;
+    size_t memory_budget;
+
+    bool consumed;
+    AggregationHashTable * output_table;
+    size_t output_position;
+    vector<pair<unsigned, vector<string> > > pending_partitions; // level and spill files
+    size_t memory_peak; // the largest size of the groups in memory, in bytes
+    TaskPriority priority;
+
+    /**
+     * Aggregate all the rows of the children on the output table
+     */
+    void consume();
+
+    /**
+     * Aggregate the rows of the children (or of the pipeline workers) on local tables, then
+     * merge them on the output table
+     */
+    void consumeInParallel();
+
+    /**
+     * @return the estimated size of a group in memory, in bytes
+     */
+    size_t getGroupSize() const;
+
+    /**
+     * @return the number of groups fitting the memory budget
+     */
+    size_t getMaxGroups() const;
+
+    /**
+     * @return the estimated size of the groups of a table, which filled its memory if it spilled
+     */
+    size_t getMemoryUsed(const AggregationHashTable & table) const;
+
+public:
+    static const size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+    /**
+     * @param memory_budget - the bytes used by the groups kept in memory, shared by all the threads
+     * @constructor
+     */
+    HashAggregateOperator(Operator * child, const vector<int> & group_columns, const vector<Aggregate> & aggregates,
+                          size_t memory_budget = DEFAULT_MEMORY_BUDGET);
+
+    /**
+     * @param children - the inputs, each one read by a different task
+     * @constructor
+     */
+    HashAggregateOperator(const vector<Operator *> & children, const vector<int> & group_columns, const vector<Aggregate> & aggregates,
+                          size_t memory_budget = DEFAULT_MEMORY_BUDGET);
+
+    /**
+     * @param pipeline - the input, run once by the operator with an AggregateSink for each worker
+     * @constructor
+     */
+    HashAggregateOperator(Pipeline * pipeline, const vector<int> & group_columns, const vector<Aggregate> & aggregates,
+                          size_t memory_budget = DEFAULT_MEMORY_BUDGET);
+
+    /**
+     * @destructor
+     */
+    ~HashAggregateOperator();
+
+    bool next(Batch & batch);
+
+    /**
+     * Set the priority of the tasks reading the children, NORMAL_PRIORITY by default
+     */
+    void setPriority(TaskPriority priority);
+
+    /**
+     * @return the largest number of bytes the groups used in memory, all the threads included
+     */
+    size_t getMemoryPeak() const;
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+AggregationHashTable::AggregationHashTable(const vector<int> & group_columns, const vector<Aggregate> & aggregates, size_t max_groups, unsigned level) {
+    this->group_columns = group_columns;
+    this->aggregates = aggregates;
+    this->max_groups = max(max_groups, (size_t) 1);
+    this->level = level;
+    this->has_columns = false;
+    this->key_size = 0;
+    this->aggregate_types.resize(aggregates.size(), INT64);
+    this->aggregate_widths.resize(aggregates.size(), 0);
+    this->partitions.resize(NUMBER_OF_PARTITIONS);
+    this->spill_paths.resize(NUMBER_OF_PARTITIONS);
+    this->group_indexes.reset(new GroupIndexes(0, hash<string>(), equal_to<string>(), GroupIndexes::allocator_type(&arena)));
+}
+
+void AggregationHashTable::setColumns(const Batch & batch) {
+    if (has_columns) {
+        return;
+    }
+    has_columns = true;
+
+    for (unsigned i = 0; i < group_columns.size(); i++) {
+        const ColumnVector & column = batch.columns.at(group_columns[i]);
+        key_columns.push_back(ColumnVector(column.name, column.type, column.width));
+        switch (column.type) {
+            case INT32: key_size += sizeof(int32_t); break;
+            case INT64:
+            case FOREIGN_KEY: key_size += sizeof(int64_t); break;
+            case FLOAT: key_size += sizeof(float); break;
+            case DOUBLE: key_size += sizeof(double); break;
+            case CHAR: key_size += column.width; break;
+        }
+    }
+    for (unsigned i = 0; i < aggregates.size(); i++) {
+        if (aggregates[i].column >= 0) {
+            aggregate_types[i] = batch.columns.at(aggregates[i].column).type;
+            aggregate_widths[i] = batch.columns.at(aggregates[i].column).width;
+        }
+    }
+}
+
+unsigned AggregationHashTable::findGroup(const string & key) {
+    pair<GroupIndexes::iterator, bool> inserted = group_indexes->insert(make_pair(key, (unsigned) keys.size()));
+    if (inserted.second) {
+        keys.push_back(key);
+        accumulators.resize(accumulators.size() + aggregates.size());
+    }
+    return inserted.first->second;
+}
+
+void AggregationHashTable::add(const Batch & batch) {
+    setColumns(batch);
+
+    //Without group columns there is a single group, aggregated a column at a time
+    if (group_columns.empty()) {
+        unsigned group = findGroup(string());
+        for (unsigned i = 0; i < aggregates.size(); i++) {
+            const ColumnVector * column = aggregates[i].column < 0 ? NULL : &batch.columns.at(aggregates[i].column);
+            accumulators[group * aggregates.size() + i].add(aggregates[i].function, column, batch.selection);
+        }
+        return;
+    }
+
+    vector<const ColumnVector *> group_vectors;
+    for (unsigned i = 0; i < group_columns.size(); i++) {
+        group_vectors.push_back(&batch.columns.at(group_columns[i]));
+    }
+    vector<const ColumnVector *> aggregate_vectors;
+    for (unsigned i = 0; i < aggregates.size(); i++) {
+        aggregate_vectors.push_back(aggregates[i].column < 0 ? NULL : &batch.columns.at(aggregates[i].column));
+    }
+
+    key_buffer.resize(key_size);
+    for (vector<uint32_t>::const_iterator row = batch.selection.begin(); row != batch.selection.end(); row++) {
+        //Build the key with the raw values of the group columns
+        char * key = &key_buffer[0];
+        for (unsigned i = 0; i < group_vectors.size(); i++) {
+            const ColumnVector * column = group_vectors[i];
+            switch (column->type) {
+                case INT32: memcpy(key, &column->int32_values[*row], sizeof(int32_t)); key += sizeof(int32_t); break;
+                case INT64:
+                case FOREIGN_KEY: memcpy(key, &column->int64_values[*row], sizeof(int64_t)); key += sizeof(int64_t); break;
+                case FLOAT: memcpy(key, &column->float_values[*row], sizeof(float)); key += sizeof(float); break;
+                case DOUBLE: memcpy(key, &column->double_values[*row], sizeof(double)); key += sizeof(double); break;
+                case CHAR: memcpy(key, column->getChars(*row), column->width); key += column->width; break;
+            }
+        }
+
+        Accumulator * group_accumulators = &accumulators[(size_t) findGroup(key_buffer) * aggregates.size()];
+        for (unsigned i = 0; i < aggregates.size(); i++) {
+            group_accumulators[i].add(aggregates[i].function, aggregate_vectors[i], *row);
+        }
+
+        if (keys.size() > max_groups && level < MAX_LEVEL) {
+            spill();
+        }
+    }
+}
+
+void AggregationHashTable::merge(const string & key, const Accumulator * group_accumulators) {
+    Accumulator * table_accumulators = &accumulators[(size_t) findGroup(key) * aggregates.size()];
+    for (unsigned i = 0; i < aggregates.size(); i++) {
+        table_accumulators[i].merge(aggregates[i].function, group_accumulators[i]);
+    }
+
+    if (keys.size() > max_groups && level < MAX_LEVEL) {
+        spill();
+    }
+}
+
+void AggregationHashTable::copyColumns(const AggregationHashTable & other) {
+    if (!has_columns && other.has_columns) {
+        has_columns = true;
+        key_columns = other.key_columns;
+        aggregate_types = other.aggregate_types;
+        aggregate_widths = other.aggregate_widths;
+        key_size = other.key_size;
+    }
+}
+
+void AggregationHashTable::merge(AggregationHashTable & other) {
+    copyColumns(other);
+
+    for (size_t group = 0; group < other.keys.size(); group++) {
+        merge(other.keys[group], &other.accumulators[group * aggregates.size()]);
+    }
+    other.clearGroups();
+
+    //The groups of a partition of the other table can only be on the same partition of this one
+    for (unsigned partition = 0; partition < NUMBER_OF_PARTITIONS; partition++) {
+        partitions[partition].insert(partitions[partition].end(), other.partitions[partition].begin(), other.partitions[partition].end());
+        other.partitions[partition].clear();
+    }
+}
+
+unsigned AggregationHashTable::getPartition(const string & key) const {
+    size_t hash = std::hash<string>()(key);
+    //Mix the bits, since the hash of some standard libraries is weak on the lower bits
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return (hash >> (level * PARTITION_BITS)) % NUMBER_OF_PARTITIONS;
+}
+
+void AggregationHashTable::spill() {
+    // | KEY | COUNT | INTEGER_VALUE | REAL_VALUE | STRING_SIZE | STRING | ... (for each aggregate)
+    vector<ofstream *> files(NUMBER_OF_PARTITIONS, (ofstream *) NULL);
+
+    for (size_t group = 0; group < keys.size(); group++) {
+        unsigned partition = getPartition(keys[group]);
+        if (files[partition] == NULL) {
+            //A unique file for each table and partition, appended to by the next spills until
+            //the files of the partition are moved or dropped
+            vector<string> & paths = partitions[partition];
+            bool created = find(paths.begin(), paths.end(), spill_paths[partition]) == paths.end();
+            if (created) {
+                spill_paths[partition] = createTempFile("aggregate");
+                paths.push_back(spill_paths[partition]);
+            }
+            files[partition] = new ofstream(spill_paths[partition].c_str(), ios::binary | (created ? ios::trunc : ios::app));
+        }
+
+        ofstream & file = *files[partition];
+        file.write(keys[group].data(), key_size);
+        for (unsigned i = 0; i < aggregates.size(); i++) {
+            const Accumulator & accumulator = accumulators[group * aggregates.size() + i];
+            unsigned string_size = accumulator.string_value.size();
+            file.write(reinterpret_cast<const char *> (&accumulator.count), sizeof(accumulator.count));
+            file.write(reinterpret_cast<const char *> (&accumulator.integer_value), sizeof(accumulator.integer_value));
+            file.write(reinterpret_cast<const char *> (&accumulator.real_value), sizeof(accumulator.real_value));
+            file.write(reinterpret_cast<const char *> (&string_size), sizeof(string_size));
+            file.write(accumulator.string_value.data(), string_size);
+        }
+    }
+
+    for (unsigned partition = 0; partition < NUMBER_OF_PARTITIONS; partition++) {
+        delete files[partition];
+    }
+    clearGroups();
+}
+
+void AggregationHashTable::clearGroups() {
+    //The map is destroyed before the arena is reset, since its buckets are on the arena too
+    group_indexes.reset();
+    arena.reset();
+    group_indexes.reset(new GroupIndexes(0, hash<string>(), equal_to<string>(), GroupIndexes::allocator_type(&arena)));
+    keys.clear();
+    accumulators.clear();
+}
+
+void AggregationHashTable::mergeSpillFile(const string & path) {
+    ifstream file;
+    file.open(path.c_str(), ios::binary);
+
+    string key(key_size, '\0');
+    vector<Accumulator> group_accumulators(aggregates.size());
+    while (file.peek() != EOF) {
+        file.read(&key[0], key_size);
+        for (unsigned i = 0; i < aggregates.size(); i++) {
+            Accumulator & accumulator = group_accumulators[i];
+            unsigned string_size = 0;
+            file.read(reinterpret_cast<char *> (&accumulator.count), sizeof(accumulator.count));
+            file.read(reinterpret_cast<char *> (&accumulator.integer_value), sizeof(accumulator.integer_value));
+            file.read(reinterpret_cast<char *> (&accumulator.real_value), sizeof(accumulator.real_value));
+            file.read(reinterpret_cast<char *> (&string_size), sizeof(string_size));
+            accumulator.string_value.assign(string_size, '\0');
+            if (string_size > 0) {
+                file.read(&accumulator.string_value[0], string_size);
+            }
+        }
+        if (!file) {
+            break;
+        }
+        merge(key, &group_accumulators[0]);
+    }
+
+    file.close();
+    remove(path.c_str());
+}
+
+void AggregationHashTable::finishSpill() {
+    if (hasSpilled()) {
+        spill();
+    }
+}
+
+vector<vector<string> > & AggregationHashTable::getPartitions() {
+    return partitions;
+}
+
+bool AggregationHashTable::hasSpilled() const {
+    for (unsigned partition = 0; partition < NUMBER_OF_PARTITIONS; partition++) {
+        if (!partitions[partition].empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned AggregationHashTable::getLevel() const {
+    return level;
+}
+
+size_t AggregationHashTable::getMaxGroups() const {
+    return max_groups;
+}
+
+size_t AggregationHashTable::getNumberOfGroups() const {
+    return keys.size();
+}
+
+void AggregationHashTable::initOutput(Batch & batch) const {
+    batch.columns.clear();
+    for (unsigned i = 0; i < key_columns.size(); i++) {
+        batch.columns.push_back(ColumnVector(key_columns[i].name, key_columns[i].type, key_columns[i].width));
+    }
+    for (unsigned i = 0; i < aggregates.size(); i++) {
+        SchemaType type = Accumulator::getResultType(aggregates[i].function, aggregate_types[i]);
+        batch.columns.push_back(ColumnVector(aggregates[i].name, type, type == CHAR ? aggregate_widths[i] : 0));
+    }
+    batch.positions.clear();
+    batch.resize(0);
+}
+
+void AggregationHashTable::storeGroup(size_t group, Batch & batch, unsigned row) const {
+    const char * key = keys[group].data();
+    for (unsigned i = 0; i < key_columns.size(); i++) {
+        ColumnVector & column = batch.columns[i];
+        switch (column.type) {
+            case INT32: memcpy(&column.int32_values[row], key, sizeof(int32_t)); key += sizeof(int32_t); break;
+            case INT64:
+            case FOREIGN_KEY: memcpy(&column.int64_values[row], key, sizeof(int64_t)); key += sizeof(int64_t); break;
+            case FLOAT: memcpy(&column.float_values[row], key, sizeof(float)); key += sizeof(float); break;
+            case DOUBLE: memcpy(&column.double_values[row], key, sizeof(double)); key += sizeof(double); break;
+            case CHAR: memcpy(&column.char_values[(size_t) row * column.width], key, column.width); key += column.width; break;
+        }
+    }
+    for (unsigned i = 0; i < aggregates.size(); i++) {
+        accumulators[group * aggregates.size() + i].store(aggregates[i].function, batch.columns[key_columns.size() + i], row);
+    }
+}
+
+void AggregationHashTable::addEmptyGroup() {
+    findGroup(string(key_size, '\0'));
+}
+
+void AggregationHashTable::dropSpillFiles() {
+    for (unsigned partition = 0; partition < NUMBER_OF_PARTITIONS; partition++) {
+        for (vector<string>::iterator it = partitions[partition].begin(); it != partitions[partition].end(); it++) {
+            remove(it->c_str());
+        }
+        partitions[partition].clear();
+    }
+}
+
+HashAggregateOperator::HashAggregateOperator(Operator * child, const vector<int> & group_columns, const vector<Aggregate> & aggregates,
+                                             size_t memory_budget) {
+    this->children.push_back(child);
+    this->pipeline = NULL;
+    this->group_columns = group_columns;
+    this->aggregates = aggregates;
+    this->memory_budget = memory_budget;
+    this->consumed = false;
+    this->output_table = NULL;
+    this->output_position = 0;
+    this->memory_peak = 0;
+    this->priority = NORMAL_PRIORITY;
+}
+
+HashAggregateOperator::HashAggregateOperator(const vector<Operator *> & children, const vector<int> & group_columns,
+                                             const vector<Aggregate> & aggregates, size_t memory_budget) {
+    this->children = children;
+    this->pipeline = NULL;
+    this->group_columns = group_columns;
+    this->aggregates = aggregates;
+    this->memory_budget = memory_budget;
+    this->consumed = false;
+    this->output_table = NULL;
+    this->output_position = 0;
+    this->memory_peak = 0;
+    this->priority = NORMAL_PRIORITY;
+}
+
+HashAggregateOperator::HashAggregateOperator(Pipeline * pipeline, const vector<int> & group_columns,
+                                             const vector<Aggregate> & aggregates, size_t memory_budget) {
+    this->pipeline = pipeline;
+    this->group_columns = group_columns;
+    this->aggregates = aggregates;
+    this->memory_budget = memory_budget;
+    this->consumed = false;
+    this->output_table = NULL;
+    this->output_position = 0;
+    this->memory_peak = 0;
+    this->priority = NORMAL_PRIORITY;
+}
+
+HashAggregateOperator::~HashAggregateOperator() {
+    if (output_table != NULL) {
+        output_table->dropSpillFiles();
+        delete output_table;
+    }
+    for (unsigned i = 0; i < pending_partitions.size(); i++) {
+        for (vector<string>::iterator it = pending_partitions[i].second.begin(); it != pending_partitions[i].second.end(); it++) {
+            remove(it->c_str());
+        }
+    }
+}
+
+size_t HashAggregateOperator::getGroupSize() const {
+    //The key, the accumulators and the hash map entry (twice the key, plus the pointers)
+    size_t group_size = aggregates.size() * sizeof(Accumulator) + 2 * sizeof(string) + 64;
+    for (unsigned i = 0; i < group_columns.size(); i++) {
+        group_size += 2 * sizeof(double);
+    }
+    return group_size;
+}
+
+size_t HashAggregateOperator::getMaxGroups() const {
+    return memory_budget / getGroupSize();
+}
+
+size_t HashAggregateOperator::getMemoryUsed(const AggregationHashTable & table) const {
+    return (table.hasSpilled() ? table.getMaxGroups() : table.getNumberOfGroups()) * getGroupSize();
+}
+
+AggregateSink::AggregateSink(AggregationHashTable * table) {
+    this->table = table;
+}
+
+void AggregateSink::consume(Batch & batch, long long) {
+    table->add(batch);
+}
+
+void HashAggregateOperator::setPriority(TaskPriority priority) {
+    this->priority = priority;
+}
+
+size_t HashAggregateOperator::getMemoryPeak() const {
+    return memory_peak;
+}
+
+void HashAggregateOperator::consumeInParallel() {
+    //Partial aggregation: each task has its own table and share of the budget
+    unsigned number_of_tables = pipeline != NULL ? pipeline->getMaxWorkers() : children.size();
+    vector<AggregationHashTable *> local_tables;
+    vector<exception_ptr> errors(number_of_tables);
+    for (unsigned i = 0; i < number_of_tables; i++) {
+        local_tables.push_back(new AggregationHashTable(group_columns, aggregates, getMaxGroups() / number_of_tables));
+    }
+
+    if (pipeline != NULL) {
+        vector<AggregateSink> sinks;
+        vector<PipelineSink *> sink_pointers;
+        for (unsigned i = 0; i < number_of_tables; i++) {
+            sinks.push_back(AggregateSink(local_tables[i]));
+        }
+        for (unsigned i = 0; i < number_of_tables; i++) {
+            sink_pointers.push_back(&sinks[i]);
+        }
+        pipeline->setPriority(priority);
+        try {
+            pipeline->run(sink_pointers);
+        } catch (...) {
+            errors[0] = current_exception();
+        }
+    } else {
+        TaskGraph graph;
+        for (unsigned i = 0; i < children.size(); i++) {
+            graph.add([this, i, &local_tables, &errors]() {
+                try {
+                    Batch batch;
+                    while (children[i]->next(batch)) {
+                        local_tables[i]->add(batch);
+                    }
+                } catch (...) {
+                    errors[i] = current_exception();
+                }
+            }, priority);
+        }
+        graph.wait();
+    }
+
+    size_t memory_used = 0;
+    for (unsigned i = 0; i < local_tables.size(); i++) {
+        memory_used += getMemoryUsed(*local_tables[i]);
+    }
+    memory_peak = max(memory_peak, memory_used);
+
+    for (unsigned i = 0; i < local_tables.size(); i++) {
+        if (!errors[i]) {
+            output_table->merge(*local_tables[i]);
+        }
+        local_tables[i]->dropSpillFiles();
+        delete local_tables[i];
+    }
+    for (unsigned i = 0; i < errors.size(); i++) {
+        if (errors[i]) {
+            rethrow_exception(errors[i]);
+        }
+    }
+}
+
+void HashAggregateOperator::consume() {
+    output_table = new AggregationHashTable(group_columns, aggregates, getMaxGroups());
+
+    if (pipeline == NULL && children.size() == 1) {
+        Batch batch;
+        while (children[0]->next(batch)) {
+            output_table->add(batch);
+        }
+    } else {
+        consumeInParallel();
+    }
+
+    memory_peak = max(memory_peak, getMemoryUsed(*output_table));
+    if (group_columns.empty() && output_table->getNumberOfGroups() == 0 && !output_table->hasSpilled()) {
+        output_table->addEmptyGroup();
+    }
+
+    //The groups of a spilled table are all returned partition by partition
+    output_table->finishSpill();
+    vector<vector<string> > & partitions = output_table->getPartitions();
+    for (unsigned partition = 0; partition < partitions.size(); partition++) {
+        if (!partitions[partition].empty()) {
+            pending_partitions.push_back(make_pair(output_table->getLevel() + 1, partitions[partition]));
+            partitions[partition].clear();
+        }
+    }
+}
+
+bool HashAggregateOperator::next(Batch & batch) {
+    if (!consumed) {
+        consumed = true;
+        consume();
+    }
+
+    while (output_position >= output_table->getNumberOfGroups()) {
+        if (pending_partitions.empty()) {
+            return false;
+        }
+
+        //Aggregate the next partition, which may be partitioned again if it's still too large
+        pair<unsigned, vector<string> > partition = pending_partitions.back();
+        pending_partitions.pop_back();
+
+        AggregationHashTable * partition_table = new AggregationHashTable(group_columns, aggregates, getMaxGroups(), partition.first);
+        partition_table->copyColumns(*output_table);
+        for (vector<string>::iterator it = partition.second.begin(); it != partition.second.end(); it++) {
+            partition_table->mergeSpillFile(*it);
+        }
+        memory_peak = max(memory_peak, getMemoryUsed(*partition_table));
+        partition_table->finishSpill();
+
+        vector<vector<string> > & partitions = partition_table->getPartitions();
+        for (unsigned i = 0; i < partitions.size(); i++) {
+            if (!partitions[i].empty()) {
+                pending_partitions.push_back(make_pair(partition_table->getLevel() + 1, partitions[i]));
+                partitions[i].clear();
+            }
+        }
+
+        delete output_table;
+        output_table = partition_table;
+        output_position = 0;
+    }
+
+    output_table->initOutput(batch);
+    size_t count = min((size_t) Batch::CAPACITY, output_table->getNumberOfGroups() - output_position);
+    batch.resize(count);
+    for (unsigned row = 0; row < count; row++) {
+        output_table->storeGroup(output_position + row, batch, row);
+    }
+    output_position += count;
+    return true;
+}
+
+#endif //HASHAGGREGATE_H
@@ -0,0 +1,105 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdint.h>
+#include "schema.h"
+#include "predicate.h"
+
+using namespace std;
+
+/**
+ * A hash index of a table column: the row ids (the position of the rows on the table
+ * header) of each value, e.g.: | 'bruno' -> {0, 7} | 'ana' -> {3} |
+ * It answers the = and IN predicates on the column with one lookup for each value.
+ *
+ * The index is kept in memory only, it is built by Table::addHashIndex and updated by
+ * Table::insert
+ */
+class HashIndex {
+private:
+    int column_position;
+    SchemaCol column;
+    unordered_map<string, vector<uint32_t> > value_rows;
+    unsigned long long number_of_rows;
+
+public:
+    /**
+     * @param column_position - the position of the indexed column on the schema
+     * @param column - the indexed column
+     * @constructor
+     */
+    HashIndex(int column_position, SchemaCol column);
+
+    int getColumnPosition() const;
+    unsigned long long getNumberOfRows() const;
+
+    /**
+     * @return the number of distinct values of the column
+     */
+    unsigned long long getNumberOfValues() const;
+
+    /**
+     * Add the value of a new row
+     */
+    void add(uint32_t row_index, const string & value);
+
+    /**
+     * @return true if the index can answer the predicate, i.e. it is an = or an IN
+     */
+    static bool canLookup(const Predicate & predicate);
+
+    /**
+     * Get the rows matching an = or IN predicate on the indexed column
+     * @return the ids of the matching rows, in ascending order
+     */
+    vector<uint32_t> lookup(const Predicate & predicate) const;
+};
+
+HashIndex::HashIndex(int column_position, SchemaCol column) {
+    this->column_position = column_position;
+    this->column = column;
+    this->number_of_rows = 0;
+}
+
+int HashIndex::getColumnPosition() const {
+    return column_position;
+}
+
+unsigned long long HashIndex::getNumberOfRows() const {
+    return number_of_rows;
+}
+
+unsigned long long HashIndex::getNumberOfValues() const {
+    return value_rows.size();
+}
+
+void HashIndex::add(uint32_t row_index, const string & value) {
+    value_rows[column.normalize(value)].push_back(row_index);
+    number_of_rows++;
+}
+
+bool HashIndex::canLookup(const Predicate & predicate) {
+    return predicate.comparator == EQUAL || predicate.comparator == IN;
+}
+
+vector<uint32_t> HashIndex::lookup(const Predicate & predicate) const {
+    vector<uint32_t> rows;
+    for (vector<string>::const_iterator it = predicate.values.begin(); it != predicate.values.end(); it++) {
+        unordered_map<string, vector<uint32_t> >::const_iterator found = value_rows.find(column.normalize(*it));
+        if (found != value_rows.end()) {
+            rows.insert(rows.end(), found->second.begin(), found->second.end());
+        }
+    }
+    //The rows of each value are ascending, but not the rows of different values
+    if (predicate.values.size() > 1) {
+        sort(rows.begin(), rows.end());
+        rows.erase(unique(rows.begin(), rows.end()), rows.end());
+    }
+    return rows;
+}
+
+#endif //HASHINDEX_H
@@ -5,11 +5,14 @@
 #include "schema.h"
 #include "cursor.h"
 #include "queryable.h"
+#include "operators.h"
+#include "pipeline.h"
 #include <fstream>
 #include <time.h>
 #include <string.h>
 #include <algorithm>
 #include <utility> //std::pair
+#include <unordered_map>
 #include <stdio.h>
 
 //Possible types of join
@@ -19,6 +22,12 @@ private:
 
     vector<Queryable*> tables; // Holds the Tables or Joins(TODO) used to perform this join
     vector<vector<long long>> * join_result; // this structure will hold all registries' positions matched from all tables involved.
+    long long limit; // the number of rows to match, or -1 to match all of them
+
+    /**
+     * @return true if the join already matched limit rows, so it can stop probing
+     */
+    bool isFull();
 
     /**
     * Performs the Index Nested Loop Join. This method is called inside the constructor
@@ -30,6 +39,15 @@ private:
     */
     void nestedLoopJoin(Queryable *this_table, int this_column_name, Queryable* other_table, int other_column_name);
 
+    /**
+    * Performs the Hash Join. A hash table is built with this_table (build side) and
+    * other_table is read block by block (probe side). Probe blocks whose bloom filter
+    * contains none of the build keys are not read. Both sides are pipelines run by the
+    * threads of the pool: each worker builds a local hash table, merged once the build side
+    * is done, then the workers probe the merged table. This method is called inside the constructor
+    */
+    void hashJoin(Queryable *this_table, int this_column_position, Queryable* other_table, int other_column_position);
+
 public:
 
     /**
@@ -44,16 +62,26 @@ public:
      * In this case, the result would be a vector below:
      * [ [111,555], [222,666],[222,777]]
      *
-     *
+     * @param limit - stop after matching a number of rows, or -1 to match all of them
      * @constructor
      */
-    Join(Queryable *this_table, string this_column_name, Queryable* other_table, string other_column_name, JoinType join_type, vector<long> *this_table_ids = NULL);
+    Join(Queryable *this_table, string this_column_name, Queryable* other_table, string other_column_name, JoinType join_type, vector<long> *this_table_ids = NULL, long long limit = -1);
 
     /**
      * @destructor
      */
     ~Join();
 
+    /**
+     * @return the number of rows matched by the join
+     */
+    long long getNumberOfRows();
+
+    /**
+     * @return the registry position of the matched rows of each table, one row per match
+     */
+    const vector<vector<long long> > & getResult();
+
 
      /**
      * Print the result of the join, converting the row of registries position into
@@ -65,10 +93,12 @@ public:
 };
 void Join::nestedIndexLoopJoin(Queryable *this_table, int this_column_position, vector<long> *this_table_ids, Queryable *other_table, int other_column_position){
     this->join_result = new vector<vector<long long>>;
-    for(int i=0; i<this_table_ids->size(); i++){
+    CancellationToken token = CancellationToken::getCurrent();
+    for(int i=0; i<this_table_ids->size() && !isFull(); i++){
+        token.throwIfCancelled();
         vector<string> this_row = this_table->getRow(this_table->getHeader()->at(this_table_ids->at(i)).second);
 
-        for(int j=0; j<other_table->getHeader()->size(); j++){ // Iterate over all of other table to search matches
+        for(int j=0; j<other_table->getHeader()->size() && !isFull(); j++){ // Iterate over all of other table to search matches
             vector<string> other_row = other_table->getRow(other_table->getHeader()->at(j).second);
 
             if(this_row.at(this_column_position) == other_row.at(other_column_position)){
@@ -86,12 +116,14 @@ void Join::nestedIndexLoopJoin(Queryable *this_table, int this_column_position,
 }
 void Join::nestedLoopJoin(Queryable *this_table, int this_column_position, Queryable* other_table, int other_column_position){
     this->join_result = new vector<vector<long long>>;
+    CancellationToken token = CancellationToken::getCurrent();
 
-    for(int i=0; i<this_table->getHeader()->size(); i++){ // Iterate over all of this table
+    for(int i=0; i<this_table->getHeader()->size() && !isFull(); i++){ // Iterate over all of this table
+        token.throwIfCancelled(); // a whole pass on the other table between two checks
 
         vector<string> this_row = this_table->getRow(this_table->getHeader()->at(i).second);
 
-        for(int j=0; j<other_table->getHeader()->size(); j++){ // Iterate over all of other table to search matches
+        for(int j=0; j<other_table->getHeader()->size() && !isFull(); j++){ // Iterate over all of other table to search matches
             vector<string> other_row = other_table->getRow(other_table->getHeader()->at(j).second);
 
             if(this_row.at(this_column_position) == other_row.at(other_column_position)){
@@ -107,7 +139,69 @@ void Join::nestedLoopJoin(Queryable *this_table, int this_column_position, Query
         }
     }
 }
-Join::Join(Queryable *this_table, string this_column_name, Queryable* other_table, string other_column_name, JoinType join_type, vector<long> *this_table_ids){
+void Join::hashJoin(Queryable *this_table, int this_column_position, Queryable* other_table, int other_column_position){
+    this->join_result = new vector<vector<long long>>;
+
+    //Build: column value -> registry positions of this table
+    Schema this_schema = this_table->getSchema();
+    Schema other_schema = other_table->getSchema();
+    ColumnVector this_key("", this_schema.getCols()->at(this_column_position).type);
+    ColumnVector other_key("", other_schema.getCols()->at(other_column_position).type);
+
+    bool integer_keys = this_key.isInteger() && other_key.isInteger();
+    TableScanOperator build_scan(this_table);
+    Pipeline build(build_scan);
+    vector<HashBuildSink> build_sinks(build.getMaxWorkers(), HashBuildSink(integer_keys, this_column_position));
+    vector<PipelineSink *> sinks;
+    for(unsigned i = 0; i < build_sinks.size(); i++){
+        sinks.push_back(&build_sinks[i]);
+    }
+    build.run(sinks);
+    JoinHashTable & hash_table = build_sinks[0].getHashTable();
+    for(unsigned i = 1; i < build_sinks.size(); i++){
+        hash_table.merge(build_sinks[i].getHashTable());
+    }
+
+    //Checking a bloom filter costs a few hashes per key, so when there are more keys
+    //than rows on a block it's cheaper to just read the block
+    TableScanOperator probe_scan(other_table);
+    if(hash_table.getKeys().size() <= ROWS_PER_BLOCK){
+        Predicate in_build_keys("", IN, hash_table.getKeys());
+        in_build_keys.column_position = other_column_position;
+        probe_scan.setBlockFilter(Expression(in_build_keys));
+    }
+
+    //Probe, until the limit is reached. The matches are kept in the order of the probe blocks
+    Pipeline probe(probe_scan);
+    probe.setProbe(&hash_table, other_column_position);
+    probe.setRowLimit(limit);
+    vector<CollectSink> probe_sinks(probe.getMaxWorkers());
+    vector<CollectSink *> collected;
+    sinks.clear();
+    for(unsigned i = 0; i < probe_sinks.size(); i++){
+        sinks.push_back(&probe_sinks[i]);
+        collected.push_back(&probe_sinks[i]);
+    }
+    probe.run(sinks);
+    vector<Batch> batches;
+    CollectSink::gather(collected, batches);
+
+    for(vector<Batch>::iterator batch = batches.begin(); batch != batches.end() && !isFull(); batch++){
+        for(vector<uint32_t>::iterator it = batch->selection.begin(); it != batch->selection.end() && !isFull(); it++){
+            int i = *it;
+            //When matched, insert the registries position into the vector to be returned
+            vector<long long> join_row;
+            join_row.push_back(batch->columns[0].int64_values[i]);
+            join_row.push_back(batch->columns[1].int64_values[i]);
+            this->join_result->push_back(join_row);
+        }
+    }
+}
+
+Join::Join(Queryable *this_table, string this_column_name, Queryable* other_table, string other_column_name, JoinType join_type, vector<long> *this_table_ids, long long limit){
+    this->join_result = NULL;
+    this->limit = limit;
+
     //saves the tables for future use
     tables.push_back(this_table);
     tables.push_back(other_table);
@@ -116,30 +210,50 @@ Join::Join(Queryable *this_table, string this_column_name, Queryable* other_tabl
     int this_column_position = this_table->getSchema().getColPosition(this_column_name);
     int other_column_position = other_table->getSchema().getColPosition(other_column_name);
 
-    switch(join_type)
-    {
-    case NESTED_INDEX :
-        if(this_table_ids == NULL){
-            cout << "Error : this_table_ids = NULL for Nested Index case" << endl;
+    try{
+        switch(join_type)
+        {
+        case NESTED_INDEX :
+            if(this_table_ids == NULL){
+                cout << "Error : this_table_ids = NULL for Nested Index case" << endl;
+                break;
+            }
+            nestedIndexLoopJoin(this_table, this_column_position, this_table_ids, other_table, other_column_position);
             break;
+        case NESTED  : nestedLoopJoin(this_table,this_column_position,other_table,other_column_position); break;
+        case HASH  : hashJoin(this_table,this_column_position,other_table,other_column_position); break;
+        case MERGE  : break; // TODO
         }
-        nestedIndexLoopJoin(this_table, this_column_position, this_table_ids, other_table, other_column_position);
-        break;
-    case NESTED  : nestedLoopJoin(this_table,this_column_position,other_table,other_column_position); break;
-    case HASH  : break; // TODO
-    case MERGE  : break; // TODO
+    }catch(...){
+        //e.g.: the query was cancelled
+        delete this->join_result;
+        throw;
+    }
+    if(this->join_result == NULL){
+        this->join_result = new vector<vector<long long>>;
     }
 }
 
 void Join::print(int number_of_values = -1){
+    size_t number_of_lines = join_result->size();
+    if(number_of_values >= 0 && (size_t) number_of_values < number_of_lines){
+        number_of_lines = number_of_values;
+    }
 
-    for(int line=0; line<join_result->size();line++){ //iterate over the whole matcheds registries postions
-        if(line==number_of_values) break;
+    //The rows of each table are read at once, in the order of the file
+    vector<vector<vector<string> > > table_rows;
+    for(unsigned table_order=0; table_order<tables.size(); table_order++){
+        vector<long long> registry_positions;
+        for(size_t line=0; line<number_of_lines; line++){
+            registry_positions.push_back(join_result->at(line).at(table_order));
+        }
+        table_rows.push_back(tables.at(table_order)->getRows(registry_positions));
+    }
 
+    for(size_t line=0; line<number_of_lines; line++){ //iterate over the whole matcheds registries postions
         for(int table_order=0; table_order<tables.size(); table_order++){ // iterate over the tables involved in the join
-            long long registry_position = join_result->at(line).at(table_order);
             Queryable* table = tables.at(table_order);
-            vector<string> row_partial = table->getRow(registry_position);
+            vector<string> & row_partial = table_rows[table_order][line];
 
             for(int column=0; column <table->getSchema().getCols()->size(); column++){ // iterate over the columns of one of the Tables
                 cout<<row_partial.at(column)<< " | ";
@@ -149,6 +263,18 @@ void Join::print(int number_of_values = -1){
     cout <<endl;
     }
 }
+bool Join::isFull(){
+    return limit >= 0 && (long long) join_result->size() >= limit;
+}
+
+long long Join::getNumberOfRows(){
+    return join_result->size();
+}
+
+const vector<vector<long long> > & Join::getResult(){
+    return *join_result;
+}
+
 Join::~Join() {
     delete this->join_result;
 }
@@ -0,0 +1,137 @@
+#ifndef KERNELBENCHMARK_H
+#define KERNELBENCHMARK_H
+
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include "simdkernels.h"
+#include "batch.h"
+#include "timer.h"
+
+using namespace std;
+
+class KernelBenchmark {
+
+public:
+    static const unsigned NUMBER_OF_VALUES = Batch::CAPACITY;
+    static const unsigned ITERATIONS = 20000;
+
+    vector<int32_t> int32_values;
+    vector<int64_t> int64_values;
+    vector<float> float_values;
+    vector<double> double_values;
+    vector<char> char_values;
+    unsigned char_width;
+
+    vector<uint64_t> bitmap;
+
+    /**
+     * Fill one batch of random values for each type
+     */
+    KernelBenchmark();
+
+    /*****************************************
+     *********** BENCHMARK METHODS ***********
+     *****************************************/
+
+    /**
+     * Run all the kernels, with the scalar and with the AVX2 implementations
+     */
+    void runBenchmark();
+
+    /**
+     * Run all the kernels of one implementation
+     */
+    void runKernels(const SimdKernels & kernels);
+
+    /**
+     * Print the time spent by a kernel and its throughput, in millions of values per second
+     */
+    void printResult(const SimdKernels & kernels, string kernel_name, Timer & timer);
+};
+
+KernelBenchmark::KernelBenchmark() {
+    char_width = 32;
+    bitmap.resize((NUMBER_OF_VALUES + 63) / 64);
+    char_values.resize(NUMBER_OF_VALUES * char_width, '\0');
+
+    srand(42);
+    for (unsigned i = 0; i < NUMBER_OF_VALUES; i++) {
+        int value = rand() % 1000 - 500;
+        int32_values.push_back(value);
+        int64_values.push_back(value);
+        float_values.push_back(value / 3.0f);
+        double_values.push_back(value / 3.0);
+
+        const char * names[] = {"bruno alves", "bruno", "ana", "maria"};
+        strcpy(&char_values[i * char_width], names[rand() % 4]);
+    }
+}
+
+void KernelBenchmark::runBenchmark() {
+    runKernels(getScalarKernels());
+
+    if (getAvx2Kernels() != NULL) {
+        runKernels(*getAvx2Kernels());
+    } else {
+        cout << "AVX2 kernels not supported" << endl;
+    }
+}
+
+void KernelBenchmark::runKernels(const SimdKernels & kernels) {
+    Timer timer;
+
+    timer.start();
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        kernels.compareInt32(&int32_values[0], NUMBER_OF_VALUES, GREATER, -50, &bitmap[0]);
+    }
+    printResult(kernels, "INT32 points > -50", timer);
+
+    timer.start();
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        kernels.rangeInt32(&int32_values[0], NUMBER_OF_VALUES, -50, false, 100, false, &bitmap[0]);
+    }
+    printResult(kernels, "INT32 -50 < points < 100", timer);
+
+    timer.start();
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        kernels.rangeInt64(&int64_values[0], NUMBER_OF_VALUES, -50, false, 100, false, &bitmap[0]);
+    }
+    printResult(kernels, "INT64 -50 < points < 100", timer);
+
+    timer.start();
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        kernels.rangeFloat(&float_values[0], NUMBER_OF_VALUES, -50, false, 100, false, &bitmap[0]);
+    }
+    printResult(kernels, "FLOAT -50 < points < 100", timer);
+
+    timer.start();
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        kernels.rangeDouble(&double_values[0], NUMBER_OF_VALUES, -50, false, 100, false, &bitmap[0]);
+    }
+    printResult(kernels, "DOUBLE -50 < points < 100", timer);
+
+    timer.start();
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        kernels.matchChars(&char_values[0], NUMBER_OF_VALUES, char_width, "bruno alves", 12, &bitmap[0]);
+    }
+    printResult(kernels, "CHAR name = 'bruno alves'", timer);
+
+    timer.start();
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        kernels.matchChars(&char_values[0], NUMBER_OF_VALUES, char_width, "bru", 3, &bitmap[0]);
+    }
+    printResult(kernels, "CHAR name LIKE 'bru%'", timer);
+}
+
+void KernelBenchmark::printResult(const SimdKernels & kernels, string kernel_name, Timer & timer) {
+    double elapsed_time = timer.getElapsedTime();
+    cout << kernels.name << " " << kernel_name << endl;
+    cout << "Time " << elapsed_time << " s";
+    if (elapsed_time > 0) {
+        cout << " (" << (double) NUMBER_OF_VALUES * ITERATIONS / elapsed_time / 1e6 << " M values/s)";
+    }
+    cout << endl;
+}
+
+#endif //KERNELBENCHMARK_H
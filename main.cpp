@@ -2,11 +2,17 @@
 // #include "table.h"
 #include "tablebenchmark.h"
 #include "joinbenchmark.h"
+#include "kernelbenchmark.h"
 #include <stdio.h>
 
 using namespace std;
 
 int main() {
+    //Specialized row kernels for the tables below, used when their schemas are imported
+    registerRowLayout<SchemaLayout<LayoutCol<INT32>, LayoutCol<CHAR, 255>, LayoutCol<CHAR, 255> > >("person");
+    registerRowLayout<SchemaLayout<LayoutCol<CHAR, 255> > >("company");
+    registerRowLayout<SchemaLayout<LayoutCol<FOREIGN_KEY>, LayoutCol<FOREIGN_KEY> > >("worked");
+
     //Import the csv
     Table person_table("person");
     person_table.importSchema("person_schema.txt");
@@ -35,9 +41,20 @@ int main() {
     worked_table.print(5);
     worked_table.printHeaderFile(5);
 
+    //How many people worked at each company
+    Cursor worked_count = worked_table.query("SELECT company_id, COUNT(*) GROUP BY company_id");
+    cout << "Companies: " << worked_count.getCount() << endl;
+    worked_count.moveToFirst();
+    for (int i = 0; i < 5 && !worked_count.isAfterLast(); i++, worked_count.moveToNext()) {
+        cout << worked_count.getString("company_id") << " | " << worked_count.getString("count(*)") << endl;
+    }
+
     JoinBenchmark joinbenchmark(&company_table, &person_table, &worked_table);
     joinbenchmark.runBenchmark();
 
+    KernelBenchmark kernel_benchmark;
+    kernel_benchmark.runBenchmark();
+
     vector<long> id_test;
     id_test.push_back(10);
     id_test.push_back(2);
@@ -0,0 +1,1495 @@
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+#include <stdexcept>
+#include <limits>
+#include <atomic>
+#include "batch.h"
+#include "predicate.h"
+#include "queryable.h"
+#include "simdkernels.h"
+#include "threadpool.h"
+#include "arena.h"
+
+using namespace std;
+
+/**
+ * A step of a query execution. The operators are chained, each one pulling the
+ * batches of its child, e.g.:
+ * ProjectOperator <- FilterOperator <- TableScanOperator
+ */
+class Operator {
+public:
+    virtual ~Operator() {}
+
+    /**
+     * Produce the next batch
+     * @return false when there are no more rows
+     */
+    virtual bool next(Batch & batch) = 0;
+};
+
+/*****************************************
+ ************* SCAN OPERATOR *************
+ *****************************************/
+
+/**
+ * The work of a parallel scan, split in morsels numbered from 0: a block, or Batch::CAPACITY
+ * row ids. Each thread takes the next morsel from the shared counter when it's done with
+ * the previous one, so the faster threads read more morsels
+ * @see TableScanOperator::setMorsels
+ */
+class MorselQueue {
+private:
+    atomic<long long> next_morsel;
+    long long number_of_morsels;
+
+public:
+    MorselQueue(long long number_of_morsels);
+
+    /**
+     * Take the next morsel
+     * @return false if all the morsels were taken
+     */
+    bool next(long long & morsel);
+
+    long long getNumberOfMorsels() const;
+};
+
+/**
+ * Read a table block by block, or only the rows given by TableScanOperator::setRowIds.
+ * The scan stops with an exception once the token of its query is cancelled, e.g.: by a deadline
+ * @see CancellationScope
+ */
+class TableScanOperator : public Operator {
+private:
+    Queryable * table;
+    long long block;
+    long long last_block; // -1 to read until the end of the table
+    long long end_block; // the next block + 1 of a descending scan
+    bool descending;
+    long long row_limit; // -1 to read all the rows
+    long long rows_read;
+    long long blocks_read; // the blocks with at least one row read
+    long long blocks_skipped; // the blocks excluded by TableScanOperator::blockMayMatch
+
+    Expression block_filter;
+
+    bool has_row_ids;
+    vector<uint32_t> row_ids;
+    size_t row_id_position;
+    vector<uint32_t> row_ids_buffer;
+
+    MorselQueue * morsels; // NULL if the scan is not shared with other threads
+    long long morsel; // the morsel of the last batch
+
+    CancellationToken token; // the query's, checked before reading each batch
+    vector<long long> skipped_morsels;
+
+    unsigned read_ahead; // the blocks read together
+    vector<Batch> read_ahead_batches;
+    size_t read_ahead_position; // the next batch of read_ahead_batches to return
+
+    /**
+     * Read the rows of row_ids_buffer, counting the blocks they are on
+     */
+    void readRowIdsBuffer(Batch & batch);
+
+    /**
+     * Read the next morsel of the shared queue
+     */
+    bool nextMorsel(Batch & batch);
+
+    /**
+     * Return the next block read ahead, reading the next read_ahead blocks that may match
+     * once they are all returned
+     */
+    bool nextReadAhead(Batch & batch);
+
+public:
+    TableScanOperator(Queryable * table);
+
+    /**
+     * Skip the blocks that can't match the expression according to the bloom filters
+     * of the table. The expression must be bound to the table schema
+     */
+    void setBlockFilter(const Expression & where);
+
+    /**
+     * Only read the rows with the ids (the position on the table header), in ascending order
+     */
+    void setRowIds(const vector<uint32_t> & row_ids);
+
+    /**
+     * Only read the blocks first_block to last_block - 1, e.g.: to split a table between threads
+     */
+    void setBlockRange(long long first_block, long long last_block);
+
+    /**
+     * Read the blocks (or the row ids) from the last to the first, and the rows of each
+     * batch in reverse order, e.g.: to return the rows in descending _id order
+     */
+    void setDescending(bool descending);
+
+    /**
+     * Stop after reading a number of rows, e.g.: for a LIMIT without a WHERE. The last
+     * block is only partially read
+     * @param row_limit - the number of rows to read, or -1 to read all of them
+     */
+    void setRowLimit(long long row_limit);
+
+    /**
+     * Read the blocks a few at a time, the reads of each group submitted together so the
+     * disk has several of them in flight, e.g.: with io_uring. The blocks of a group are
+     * read before the rows of the first one are returned. Ignored with a row limit or
+     * the morsels of a queue
+     * @param blocks - the blocks of a group, 1 to read each block on its own
+     * @see Queryable::readBlocks
+     */
+    void setReadAhead(unsigned blocks);
+
+    /**
+     * Share the blocks (or the row ids) with the scans of other threads: each batch is the
+     * next morsel of the queue, e.g.: the morsel 3 is the first block of the range + 3. The
+     * descending order and the row limit are ignored
+     * @param morsels - a queue of TableScanOperator::getNumberOfMorsels morsels
+     */
+    void setMorsels(MorselQueue * morsels);
+
+    /**
+     * @return the number of blocks of the range, or of batches of the row ids
+     */
+    long long getNumberOfMorsels();
+
+    /**
+     * @return the morsel of the last batch
+     */
+    long long getMorsel() const;
+
+    /**
+     * Move the morsels taken but excluded by the block filter since the last call, e.g.: to
+     * merge the batches of the morsels in order without waiting for them
+     */
+    void takeSkippedMorsels(vector<long long> & skipped);
+
+    bool next(Batch & batch);
+
+    /**
+     * Check the bloom filters and the zone maps of the predicates of the expression
+     * @return false if no row of the block can match the expression
+     */
+    static bool blockMayMatch(Queryable * table, const Expression & where, long long block);
+
+    long long getRowsRead() const;
+    long long getBlocksRead() const;
+    long long getBlocksSkipped() const;
+};
+
+/*****************************************
+ ************ FILTER OPERATOR ************
+ *****************************************/
+
+/**
+ * Remove from the selection vector the rows that don't match an expression.
+ * When most of the batch rows are selected, a predicate is evaluated on every row by
+ * the SIMD kernels, and a lower and an upper bound on the same column (e.g.:
+ * points > -50 AND points < 100) are evaluated together as a range. Otherwise each
+ * predicate is evaluated by a loop over the selection specialized for the column type
+ * and comparator, comparing the column values to a constant without branches
+ * @see SimdKernels
+ */
+class FilterOperator : public Operator {
+private:
+    Operator * child;
+    Expression where;
+
+public:
+    /**
+     * @param where - the expression, bound to the positions of the child batch columns
+     * @constructor
+     */
+    FilterOperator(Operator * child, const Expression & where);
+
+    /**
+     * Pull the child batches until one of them has selected rows
+     */
+    bool next(Batch & batch);
+
+    /**
+     * Evaluate the expression on the rows of the selection
+     * @param selection - the rows to test, replaced by the rows that match
+     */
+    static void filter(const Batch & batch, const Expression & where, vector<uint32_t> & selection);
+
+    /**
+     * @see FilterOperator::filter
+     */
+    static void filterPredicate(const Batch & batch, const Predicate & predicate, vector<uint32_t> & selection);
+
+    /**
+     * Evaluate lower AND upper, two bounds on the same column
+     * @see FilterOperator::filter
+     */
+    static void filterRange(const Batch & batch, const Predicate & lower, const Predicate & upper, vector<uint32_t> & selection);
+
+    /**
+     * Evaluate the predicate with the SIMD kernels
+     * @return false if there is no kernel for the column type and comparator
+     */
+    static bool filterWithKernels(const Batch & batch, const Predicate & predicate, vector<uint32_t> & selection);
+
+    /**
+     * @return true if the selection is dense enough to evaluate every row of the batch
+     */
+    static bool isDense(const Batch & batch, const vector<uint32_t> & selection);
+};
+
+/*****************************************
+ ************ PROJECT OPERATOR ***********
+ *****************************************/
+
+/**
+ * Keep only some of the columns of the child batches, in the given order
+ */
+class ProjectOperator : public Operator {
+private:
+    Operator * child;
+    vector<int> projection;
+    Batch input;
+
+public:
+    ProjectOperator(Operator * child, const vector<int> & projection);
+    bool next(Batch & batch);
+};
+
+/*****************************************
+ ************* LIMIT OPERATOR ************
+ *****************************************/
+
+/**
+ * Skip the offset first rows of the child and return the limit next ones. The child
+ * batches are no longer pulled once the limit is reached, so the operators below
+ * (e.g.: a TableScanOperator) stop reading
+ */
+class LimitOperator : public Operator {
+private:
+    Operator * child;
+    long long limit;
+    long long offset;
+    long long skipped;
+    long long returned;
+
+public:
+    /**
+     * @param limit - the number of rows to return, or -1 to return all of them
+     * @param offset - the number of rows to skip before the first returned row
+     * @constructor
+     */
+    LimitOperator(Operator * child, long long limit, long long offset = 0);
+    bool next(Batch & batch);
+};
+
+/*****************************************
+ *********** HASH JOIN OPERATOR **********
+ *****************************************/
+
+/**
+ * The build side of a hash join: the key of each row mapped to the row registry position.
+ * Integer keys are hashed as numbers, other keys as strings. The nodes of the rows are
+ * taken from the arena of the table, and released at once with it
+ */
+class JoinHashTable {
+private:
+    typedef unordered_multimap<long long, long long, hash<long long>, equal_to<long long>,
+                               ArenaAllocator<pair<const long long, long long> > > IntegerTable;
+    typedef unordered_multimap<string, long long, hash<string>, equal_to<string>,
+                               ArenaAllocator<pair<const string, long long> > > StringTable;
+
+    bool integer_keys;
+    Arena arena; // before the tables, so it's destroyed after them
+    IntegerTable integer_table;
+    StringTable string_table;
+    vector<string> keys;
+
+    JoinHashTable & operator=(const JoinHashTable &);
+
+public:
+    /**
+     * @param integer_keys - true if the keys of both tables are integer columns
+     * @constructor
+     */
+    JoinHashTable(bool integer_keys);
+
+    /**
+     * A copy of the rows on an arena of its own, e.g.: a table for each worker
+     * @constructor
+     */
+    JoinHashTable(const JoinHashTable & other);
+
+    /**
+     * Insert all the selected rows of the operator
+     * @param key_column - the position of the key on the operator batches
+     */
+    void build(Operator * build_side, int key_column);
+
+    /**
+     * Insert the selected rows of a batch
+     * @param key_column - the position of the key on the batch
+     */
+    void add(const Batch & batch, int key_column);
+
+    /**
+     * Insert the rows of another table, e.g.: built by another thread
+     */
+    void merge(const JoinHashTable & other);
+
+    /**
+     * @return the distinct keys, in the same format returned by Table::getRow
+     */
+    const vector<string> & getKeys() const;
+
+    /**
+     * Push the registry position of the build rows having the same key as the row, in
+     * ascending order
+     */
+    void probe(const ColumnVector & column, unsigned row, vector<long long> & matches) const;
+};
+
+/**
+ * Find the build rows matching each probe row. The output batches have two INT64
+ * columns: | build_position | probe_position |
+ */
+class HashJoinProbeOperator : public Operator {
+private:
+    Operator * probe_side;
+    const JoinHashTable * hash_table;
+    int key_column;
+
+    Batch input;
+    unsigned input_position;
+    vector<long long> matches;
+    unsigned match_position;
+    long long probe_position;
+
+public:
+    /**
+     * @param key_column - the position of the key on the probe_side batches
+     * @constructor
+     */
+    HashJoinProbeOperator(Operator * probe_side, const JoinHashTable * hash_table, int key_column);
+    bool next(Batch & batch);
+};
+
+/*****************************************
+ ********** AGGREGATE OPERATOR ***********
+ *****************************************/
+
+//Possible aggregate functions
+enum AggregateFunction { COUNT, SUM, AVG, MIN, MAX };
+
+/**
+ * e.g.: SUM(points) is { SUM, <position of points>, "sum(points)" }
+ * COUNT(*) uses the column -1
+ */
+struct Aggregate {
+    AggregateFunction function;
+    int column;
+    string name;
+
+    Aggregate(AggregateFunction function, int column, string name);
+
+    /**
+     * Parse a select item like "count(*)" or "SUM(points)"
+     * @param aggregate - set to the aggregate, named after the item, on success
+     * @return false if the item is not an aggregate function call
+     * @throw invalid_argument if the column is not on the schema
+     */
+    static bool parse(const string & item, Schema & schema, Aggregate & aggregate);
+};
+
+/**
+ * The running value of an aggregate. Integer columns are summed as integers, and the
+ * min/max of CHAR columns are kept as strings
+ */
+struct Accumulator {
+    long long count;
+    long long integer_value;
+    double real_value;
+    string string_value;
+
+    Accumulator();
+
+    /**
+     * Add the selected values of a column
+     */
+    void add(AggregateFunction function, const ColumnVector * column, const vector<uint32_t> & selection);
+
+    /**
+     * Add a single row
+     */
+    void add(AggregateFunction function, const ColumnVector * column, unsigned row);
+
+    /**
+     * Combine with the accumulator of another group of rows
+     */
+    void merge(AggregateFunction function, const Accumulator & other);
+
+    /**
+     * @return the type of the aggregate result for the column type
+     */
+    static SchemaType getResultType(AggregateFunction function, SchemaType column_type);
+
+    /**
+     * Write the result on a row of a column created with Accumulator::getResultType
+     */
+    void store(AggregateFunction function, ColumnVector & output, unsigned row) const;
+};
+
+/**
+ * Compute aggregates over all the rows of the child. The output is a single row
+ * with one column for each aggregate
+ */
+class AggregateOperator : public Operator {
+private:
+    Operator * child;
+    vector<Aggregate> aggregates;
+    bool done;
+
+public:
+    AggregateOperator(Operator * child, const vector<Aggregate> & aggregates);
+    bool next(Batch & batch);
+};
+
+/*****************************************
+ **************** KERNELS ****************
+ *****************************************/
+
+/**
+ * Copy the values of a column of count registries, stride bytes apart
+ */
+template <typename T>
+void gatherValues(const char * source, unsigned count, unsigned stride, T * out) {
+    for (unsigned i = 0; i < count; i++) {
+        memcpy(out + i, source + (size_t) i * stride, sizeof(T));
+    }
+}
+
+/**
+ * Keep the rows of the selection whose value satisfies compare(value, constant).
+ * The row is always written and the output position only moves on a match, so
+ * there is no branch on the comparison
+ * @return the number of selected rows
+ */
+template <typename T, typename C, typename Compare>
+unsigned selectValues(const T * values, C constant, uint32_t * selection, unsigned count, Compare compare) {
+    unsigned selected = 0;
+    for (unsigned i = 0; i < count; i++) {
+        uint32_t row = selection[i];
+        selection[selected] = row;
+        selected += compare(values[row], constant);
+    }
+    return selected;
+}
+
+template <typename T, typename C>
+unsigned selectComparison(Comparator comparator, const T * values, C constant, uint32_t * selection, unsigned count) {
+    switch (comparator) {
+        case EQUAL: return selectValues(values, constant, selection, count, equal_to<C>());
+        case NOT_EQUAL: return selectValues(values, constant, selection, count, not_equal_to<C>());
+        case LESS: return selectValues(values, constant, selection, count, less<C>());
+        case LESS_EQUAL: return selectValues(values, constant, selection, count, less_equal<C>());
+        case GREATER: return selectValues(values, constant, selection, count, greater<C>());
+        case GREATER_EQUAL: return selectValues(values, constant, selection, count, greater_equal<C>());
+        default: return count;
+    }
+}
+
+template <typename T, typename C>
+unsigned selectIn(const T * values, const vector<C> & constants, uint32_t * selection, unsigned count) {
+    unsigned selected = 0;
+    for (unsigned i = 0; i < count; i++) {
+        uint32_t row = selection[i];
+        bool found = false;
+        for (typename vector<C>::const_iterator it = constants.begin(); it != constants.end(); it++) {
+            found |= (C) values[row] == *it;
+        }
+        selection[selected] = row;
+        selected += found;
+    }
+    return selected;
+}
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+TableScanOperator::TableScanOperator(Queryable * table) {
+    this->table = table;
+    this->block = 0;
+    this->last_block = -1;
+    this->end_block = -1;
+    this->descending = false;
+    this->row_limit = -1;
+    this->rows_read = 0;
+    this->blocks_read = 0;
+    this->blocks_skipped = 0;
+    this->has_row_ids = false;
+    this->row_id_position = 0;
+    this->morsels = NULL;
+    this->morsel = -1;
+    this->token = CancellationToken::getCurrent();
+    this->read_ahead = 1;
+    this->read_ahead_position = 0;
+}
+
+void TableScanOperator::setBlockFilter(const Expression & where) {
+    block_filter = where;
+}
+
+void TableScanOperator::setRowIds(const vector<uint32_t> & row_ids) {
+    this->row_ids = row_ids;
+    this->row_id_position = 0;
+    this->has_row_ids = true;
+}
+
+void TableScanOperator::setBlockRange(long long first_block, long long last_block) {
+    this->block = first_block;
+    this->last_block = last_block;
+}
+
+void TableScanOperator::setDescending(bool descending) {
+    this->descending = descending;
+}
+
+void TableScanOperator::setRowLimit(long long row_limit) {
+    this->row_limit = row_limit;
+}
+
+void TableScanOperator::setReadAhead(unsigned blocks) {
+    this->read_ahead = max(1u, blocks);
+}
+
+void TableScanOperator::setMorsels(MorselQueue * morsels) {
+    this->morsels = morsels;
+}
+
+long long TableScanOperator::getNumberOfMorsels() {
+    if (has_row_ids) {
+        return (row_ids.size() + Batch::CAPACITY - 1) / Batch::CAPACITY;
+    }
+    long long end = last_block < 0 ? table->getNumberOfBlocks() : min(last_block, table->getNumberOfBlocks());
+    return max(0LL, end - block);
+}
+
+long long TableScanOperator::getMorsel() const {
+    return morsel;
+}
+
+void TableScanOperator::takeSkippedMorsels(vector<long long> & skipped) {
+    skipped.insert(skipped.end(), skipped_morsels.begin(), skipped_morsels.end());
+    skipped_morsels.clear();
+}
+
+void TableScanOperator::readRowIdsBuffer(Batch & batch) {
+    for (size_t i = 0; i < row_ids_buffer.size(); i++) {
+        if (i == 0 || row_ids_buffer[i] / ROWS_PER_BLOCK != row_ids_buffer[i - 1] / ROWS_PER_BLOCK) {
+            blocks_read++;
+        }
+    }
+    table->readRows(row_ids_buffer, batch);
+}
+
+bool TableScanOperator::nextMorsel(Batch & batch) {
+    while (morsels->next(morsel)) {
+        if (has_row_ids) {
+            size_t start = morsel * Batch::CAPACITY;
+            size_t count = min(row_ids.size() - start, (size_t) Batch::CAPACITY);
+            row_ids_buffer.assign(row_ids.begin() + start, row_ids.begin() + start + count);
+            rows_read += count;
+            readRowIdsBuffer(batch);
+            return true;
+        }
+
+        long long current_block = block + morsel;
+        if (!blockMayMatch(table, block_filter, current_block)) {
+            blocks_skipped++;
+            skipped_morsels.push_back(morsel);
+            continue;
+        }
+        table->readBlock(current_block, batch);
+        rows_read += batch.size;
+        blocks_read++;
+        return true;
+    }
+    return false;
+}
+
+bool TableScanOperator::next(Batch & batch) {
+    token.throwIfCancelled();
+    if (morsels != NULL) {
+        return nextMorsel(batch);
+    }
+    if (row_limit >= 0 && rows_read >= row_limit) {
+        return false;
+    }
+    size_t remaining_rows = row_limit < 0 ? Batch::CAPACITY : min((long long) Batch::CAPACITY, row_limit - rows_read);
+
+    if (has_row_ids) {
+        if (row_id_position >= row_ids.size()) {
+            return false;
+        }
+        //The ids of a batch are always read in ascending order
+        size_t count = min(min(row_ids.size() - row_id_position, (size_t) Batch::CAPACITY), remaining_rows);
+        size_t start = descending ? row_ids.size() - row_id_position - count : row_id_position;
+        row_ids_buffer.assign(row_ids.begin() + start, row_ids.begin() + start + count);
+        row_id_position += count;
+        rows_read += count;
+        readRowIdsBuffer(batch);
+        if (descending) {
+            batch.reverse();
+        }
+        return true;
+    }
+
+    if (read_ahead > 1 && row_limit < 0) {
+        return nextReadAhead(batch);
+    }
+
+    long long end = last_block < 0 ? table->getNumberOfBlocks() : min(last_block, table->getNumberOfBlocks());
+    if (descending && end_block < 0) {
+        end_block = end;
+    }
+    while (descending ? end_block > block : block < end) {
+        long long current_block = descending ? --end_block : block++;
+        if (!blockMayMatch(table, block_filter, current_block)) {
+            blocks_skipped++;
+            continue;
+        }
+
+        long long first_row = current_block * ROWS_PER_BLOCK;
+        long long number_of_rows = min(ROWS_PER_BLOCK, (long long) table->getHeader()->size() - first_row);
+        if (number_of_rows > (long long) remaining_rows) {
+            //Only read the first rows of the block (the last ones if descending)
+            row_ids_buffer.clear();
+            long long start = descending ? first_row + number_of_rows - remaining_rows : first_row;
+            for (long long row = start; row < start + (long long) remaining_rows; row++) {
+                row_ids_buffer.push_back(row);
+            }
+            table->readRows(row_ids_buffer, batch);
+        } else {
+            table->readBlock(current_block, batch);
+        }
+
+        rows_read += batch.size;
+        blocks_read++;
+        if (descending) {
+            batch.reverse();
+        }
+        return true;
+    }
+    return false;
+}
+
+bool TableScanOperator::nextReadAhead(Batch & batch) {
+    if (read_ahead_position == read_ahead_batches.size()) {
+        long long end = last_block < 0 ? table->getNumberOfBlocks() : min(last_block, table->getNumberOfBlocks());
+        if (descending && end_block < 0) {
+            end_block = end;
+        }
+        vector<long long> blocks;
+        while (blocks.size() < read_ahead && (descending ? end_block > block : block < end)) {
+            long long current_block = descending ? --end_block : block++;
+            if (!blockMayMatch(table, block_filter, current_block)) {
+                blocks_skipped++;
+                continue;
+            }
+            blocks.push_back(current_block);
+        }
+        if (blocks.empty()) {
+            return false;
+        }
+
+        table->readBlocks(blocks, read_ahead_batches);
+        read_ahead_position = 0;
+        for (vector<Batch>::iterator it = read_ahead_batches.begin(); it != read_ahead_batches.end(); it++) {
+            rows_read += it->size;
+            blocks_read++;
+        }
+    }
+
+    swap(batch, read_ahead_batches[read_ahead_position++]);
+    if (descending) {
+        batch.reverse();
+    }
+    return true;
+}
+
+long long TableScanOperator::getRowsRead() const {
+    return rows_read;
+}
+
+long long TableScanOperator::getBlocksRead() const {
+    return blocks_read;
+}
+
+long long TableScanOperator::getBlocksSkipped() const {
+    return blocks_skipped;
+}
+
+MorselQueue::MorselQueue(long long number_of_morsels) : next_morsel(0) {
+    this->number_of_morsels = number_of_morsels;
+}
+
+bool MorselQueue::next(long long & morsel) {
+    if (next_morsel.load(memory_order_relaxed) >= number_of_morsels) {
+        return false;
+    }
+    morsel = next_morsel.fetch_add(1, memory_order_relaxed);
+    return morsel < number_of_morsels;
+}
+
+long long MorselQueue::getNumberOfMorsels() const {
+    return number_of_morsels;
+}
+
+bool TableScanOperator::blockMayMatch(Queryable * table, const Expression & where, long long block) {
+    switch (where.type) {
+        case PREDICATE_EXPRESSION:
+            return table->blockMayMatch(block, where.predicate);
+        case AND_EXPRESSION:
+            for (vector<Expression>::const_iterator it = where.children.begin(); it != where.children.end(); it++) {
+                if (!blockMayMatch(table, *it, block)) {
+                    return false;
+                }
+            }
+            return true;
+        case OR_EXPRESSION:
+            for (vector<Expression>::const_iterator it = where.children.begin(); it != where.children.end(); it++) {
+                if (blockMayMatch(table, *it, block)) {
+                    return true;
+                }
+            }
+            return false;
+        default:
+            return true;
+    }
+}
+
+FilterOperator::FilterOperator(Operator * child, const Expression & where) {
+    this->child = child;
+    this->where = where;
+}
+
+bool FilterOperator::next(Batch & batch) {
+    while (child->next(batch)) {
+        filter(batch, where, batch.selection);
+        if (batch.getSelectedCount() > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FilterOperator::filter(const Batch & batch, const Expression & where, vector<uint32_t> & selection) {
+    switch (where.type) {
+        case PREDICATE_EXPRESSION:
+            filterPredicate(batch, where.predicate, selection);
+            break;
+
+        case AND_EXPRESSION: {
+            vector<bool> done(where.children.size(), false);
+
+            //Pair the lower and upper bounds on the same column
+            for (unsigned i = 0; i < where.children.size(); i++) {
+                const Expression & lower = where.children[i];
+                if (lower.type != PREDICATE_EXPRESSION ||
+                    (lower.predicate.comparator != GREATER && lower.predicate.comparator != GREATER_EQUAL)) {
+                    continue;
+                }
+                for (unsigned j = 0; j < where.children.size(); j++) {
+                    const Expression & upper = where.children[j];
+                    if (!done[j] && upper.type == PREDICATE_EXPRESSION &&
+                        (upper.predicate.comparator == LESS || upper.predicate.comparator == LESS_EQUAL) &&
+                        upper.predicate.column_position == lower.predicate.column_position) {
+                        filterRange(batch, lower.predicate, upper.predicate, selection);
+                        done[i] = true;
+                        done[j] = true;
+                        break;
+                    }
+                }
+            }
+
+            for (unsigned i = 0; i < where.children.size() && !selection.empty(); i++) {
+                if (!done[i]) {
+                    filter(batch, where.children[i], selection);
+                }
+            }
+            break;
+        }
+
+        case OR_EXPRESSION: {
+            //Union of the rows selected by each child, the selections stay sorted
+            vector<uint32_t> result;
+            for (vector<Expression>::const_iterator it = where.children.begin(); it != where.children.end(); it++) {
+                vector<uint32_t> child_selection = selection;
+                filter(batch, *it, child_selection);
+
+                vector<uint32_t> merged;
+                set_union(result.begin(), result.end(), child_selection.begin(), child_selection.end(), back_inserter(merged));
+                result.swap(merged);
+            }
+            selection.swap(result);
+            break;
+        }
+
+        case NOT_EXPRESSION: {
+            vector<uint32_t> child_selection = selection;
+            filter(batch, where.children.at(0), child_selection);
+
+            vector<uint32_t> result;
+            set_difference(selection.begin(), selection.end(), child_selection.begin(), child_selection.end(), back_inserter(result));
+            selection.swap(result);
+            break;
+        }
+    }
+}
+
+void FilterOperator::filterPredicate(const Batch & batch, const Predicate & predicate, vector<uint32_t> & selection) {
+    if (selection.empty()) {
+        return;
+    }
+    if (isDense(batch, selection) && filterWithKernels(batch, predicate, selection)) {
+        return;
+    }
+
+    const ColumnVector & column = batch.columns.at(predicate.column_position);
+    unsigned count = selection.size();
+    unsigned selected = count;
+
+    if (predicate.comparator == LIKE) {
+        selected = 0;
+        for (unsigned i = 0; i < count; i++) {
+            uint32_t row = selection[i];
+            selection[selected] = row;
+            selected += predicate.matches(column.getString(row), column.type);
+        }
+        selection.resize(selected);
+        return;
+    }
+
+    if (predicate.comparator == IN) {
+        if (column.isInteger()) {
+            vector<long long> constants;
+            for (vector<string>::const_iterator it = predicate.values.begin(); it != predicate.values.end(); it++) {
+                constants.push_back(atoll(it->c_str()));
+            }
+            selected = column.type == INT32
+                ? selectIn(&column.int32_values[0], constants, &selection[0], count)
+                : selectIn(&column.int64_values[0], constants, &selection[0], count);
+        } else if (column.type == FLOAT) {
+            vector<float> constants;
+            for (vector<string>::const_iterator it = predicate.values.begin(); it != predicate.values.end(); it++) {
+                constants.push_back(atof(it->c_str()));
+            }
+            selected = selectIn(&column.float_values[0], constants, &selection[0], count);
+        } else if (column.type == DOUBLE) {
+            vector<double> constants;
+            for (vector<string>::const_iterator it = predicate.values.begin(); it != predicate.values.end(); it++) {
+                constants.push_back(atof(it->c_str()));
+            }
+            selected = selectIn(&column.double_values[0], constants, &selection[0], count);
+        } else {
+            selected = 0;
+            for (unsigned i = 0; i < count; i++) {
+                uint32_t row = selection[i];
+                bool found = false;
+                for (vector<string>::const_iterator it = predicate.values.begin(); it != predicate.values.end(); it++) {
+                    found |= strncmp(column.getChars(row), it->c_str(), column.width) == 0;
+                }
+                selection[selected] = row;
+                selected += found;
+            }
+        }
+        selection.resize(selected);
+        return;
+    }
+
+    const string & value = predicate.values.at(0);
+    switch (column.type) {
+        case INT32:
+            selected = selectComparison(predicate.comparator, &column.int32_values[0], atoll(value.c_str()), &selection[0], count);
+            break;
+        case INT64:
+        case FOREIGN_KEY:
+            selected = selectComparison(predicate.comparator, &column.int64_values[0], atoll(value.c_str()), &selection[0], count);
+            break;
+        case FLOAT:
+            selected = selectComparison(predicate.comparator, &column.float_values[0], (float) atof(value.c_str()), &selection[0], count);
+            break;
+        case DOUBLE:
+            selected = selectComparison(predicate.comparator, &column.double_values[0], atof(value.c_str()), &selection[0], count);
+            break;
+        case CHAR: {
+            selected = 0;
+            for (unsigned i = 0; i < count; i++) {
+                uint32_t row = selection[i];
+                int result = strncmp(column.getChars(row), value.c_str(), column.width);
+                bool match;
+                switch (predicate.comparator) {
+                    case EQUAL: match = result == 0; break;
+                    case NOT_EQUAL: match = result != 0; break;
+                    case LESS: match = result < 0; break;
+                    case LESS_EQUAL: match = result <= 0; break;
+                    case GREATER: match = result > 0; break;
+                    default: match = result >= 0; break;
+                }
+                selection[selected] = row;
+                selected += match;
+            }
+            break;
+        }
+    }
+    selection.resize(selected);
+}
+
+bool FilterOperator::isDense(const Batch & batch, const vector<uint32_t> & selection) {
+    return selection.size() * 4 >= batch.size;
+}
+
+bool FilterOperator::filterWithKernels(const Batch & batch, const Predicate & predicate, vector<uint32_t> & selection) {
+    const ColumnVector & column = batch.columns.at(predicate.column_position);
+    const SimdKernels & kernels = getSimdKernels();
+    Comparator comparator = predicate.comparator;
+    vector<uint64_t> bitmap((batch.size + 63) / 64);
+
+    if (comparator == IN || batch.size == 0) {
+        return false;
+    }
+    const string & value = predicate.values.at(0);
+
+    if (column.type == CHAR) {
+        if (comparator == LIKE && !value.empty() && value[value.size() - 1] == '%') {
+            kernels.matchChars(&column.char_values[0], batch.size, column.width, value.c_str(), value.size() - 1, &bitmap[0]);
+        } else if (comparator == EQUAL || comparator == LIKE) {
+            //Compare the '\0' too, so 'bru' does not match 'bruno'
+            kernels.matchChars(&column.char_values[0], batch.size, column.width, value.c_str(), value.size() + 1, &bitmap[0]);
+        } else {
+            return false;
+        }
+        selectBitmap(&bitmap[0], selection);
+        return true;
+    }
+
+    if (comparator == LIKE) {
+        return false;
+    }
+
+    switch (column.type) {
+        case INT32: {
+            long long constant = atoll(value.c_str());
+            if (constant < numeric_limits<int32_t>::min() || constant > numeric_limits<int32_t>::max()) {
+                return false;
+            }
+            kernels.compareInt32(&column.int32_values[0], batch.size, comparator, (int32_t) constant, &bitmap[0]);
+            break;
+        }
+        case INT64:
+        case FOREIGN_KEY:
+            kernels.compareInt64(&column.int64_values[0], batch.size, comparator, atoll(value.c_str()), &bitmap[0]);
+            break;
+        case FLOAT:
+            kernels.compareFloat(&column.float_values[0], batch.size, comparator, (float) atof(value.c_str()), &bitmap[0]);
+            break;
+        case DOUBLE:
+            kernels.compareDouble(&column.double_values[0], batch.size, comparator, atof(value.c_str()), &bitmap[0]);
+            break;
+        default:
+            return false;
+    }
+    selectBitmap(&bitmap[0], selection);
+    return true;
+}
+
+void FilterOperator::filterRange(const Batch & batch, const Predicate & lower, const Predicate & upper, vector<uint32_t> & selection) {
+    const ColumnVector & column = batch.columns.at(lower.column_position);
+
+    if (selection.empty() || !isDense(batch, selection) || column.type == CHAR) {
+        filterPredicate(batch, lower, selection);
+        filterPredicate(batch, upper, selection);
+        return;
+    }
+
+    const SimdKernels & kernels = getSimdKernels();
+    vector<uint64_t> bitmap((batch.size + 63) / 64);
+    bool lower_inclusive = lower.comparator == GREATER_EQUAL;
+    bool upper_inclusive = upper.comparator == LESS_EQUAL;
+    const char * lower_value = lower.values.at(0).c_str();
+    const char * upper_value = upper.values.at(0).c_str();
+
+    switch (column.type) {
+        case INT32: {
+            //Clamp the bounds to the INT32 range
+            long long lower_bound = max(atoll(lower_value), (long long) numeric_limits<int32_t>::min() - 1);
+            long long upper_bound = min(atoll(upper_value), (long long) numeric_limits<int32_t>::max() + 1);
+            if (lower_bound < numeric_limits<int32_t>::min()) {
+                lower_bound = numeric_limits<int32_t>::min();
+                lower_inclusive = true;
+            }
+            if (upper_bound > numeric_limits<int32_t>::max()) {
+                upper_bound = numeric_limits<int32_t>::max();
+                upper_inclusive = true;
+            }
+            kernels.rangeInt32(&column.int32_values[0], batch.size, lower_bound, lower_inclusive, upper_bound, upper_inclusive, &bitmap[0]);
+            break;
+        }
+        case INT64:
+        case FOREIGN_KEY:
+            kernels.rangeInt64(&column.int64_values[0], batch.size, atoll(lower_value), lower_inclusive, atoll(upper_value), upper_inclusive, &bitmap[0]);
+            break;
+        case FLOAT:
+            kernels.rangeFloat(&column.float_values[0], batch.size, atof(lower_value), lower_inclusive, atof(upper_value), upper_inclusive, &bitmap[0]);
+            break;
+        default:
+            kernels.rangeDouble(&column.double_values[0], batch.size, atof(lower_value), lower_inclusive, atof(upper_value), upper_inclusive, &bitmap[0]);
+            break;
+    }
+    selectBitmap(&bitmap[0], selection);
+}
+
+ProjectOperator::ProjectOperator(Operator * child, const vector<int> & projection) {
+    this->child = child;
+    this->projection = projection;
+}
+
+bool ProjectOperator::next(Batch & batch) {
+    if (!child->next(input)) {
+        return false;
+    }
+
+    batch.size = input.size;
+    batch.positions = input.positions;
+    batch.selection = input.selection;
+    batch.columns.resize(projection.size());
+    for (unsigned i = 0; i < projection.size(); i++) {
+        batch.columns[i] = input.columns.at(projection[i]);
+    }
+    return true;
+}
+
+LimitOperator::LimitOperator(Operator * child, long long limit, long long offset) {
+    this->child = child;
+    this->limit = limit;
+    this->offset = offset;
+    this->skipped = 0;
+    this->returned = 0;
+}
+
+bool LimitOperator::next(Batch & batch) {
+    if (limit >= 0 && returned >= limit) {
+        return false;
+    }
+    while (child->next(batch)) {
+        //Skip the rows before the offset, pulling batches until one has rows left
+        if (skipped < offset) {
+            long long skip = min(offset - skipped, (long long) batch.selection.size());
+            batch.selection.erase(batch.selection.begin(), batch.selection.begin() + skip);
+            skipped += skip;
+            if (batch.selection.empty()) {
+                continue;
+            }
+        }
+        if (limit >= 0 && (long long) batch.selection.size() > limit - returned) {
+            batch.selection.resize(limit - returned);
+        }
+        returned += batch.selection.size();
+        return true;
+    }
+    return false;
+}
+
+JoinHashTable::JoinHashTable(bool integer_keys)
+    : integer_table(0, hash<long long>(), equal_to<long long>(), IntegerTable::allocator_type(&arena)),
+      string_table(0, hash<string>(), equal_to<string>(), StringTable::allocator_type(&arena)) {
+    this->integer_keys = integer_keys;
+}
+
+JoinHashTable::JoinHashTable(const JoinHashTable & other)
+    : integer_table(other.integer_table.begin(), other.integer_table.end(), 0, hash<long long>(), equal_to<long long>(),
+                    IntegerTable::allocator_type(&arena)),
+      string_table(other.string_table.begin(), other.string_table.end(), 0, hash<string>(), equal_to<string>(),
+                   StringTable::allocator_type(&arena)) {
+    this->integer_keys = other.integer_keys;
+    this->keys = other.keys;
+}
+
+void JoinHashTable::build(Operator * build_side, int key_column) {
+    Batch batch;
+    while (build_side->next(batch)) {
+        add(batch, key_column);
+    }
+}
+
+void JoinHashTable::add(const Batch & batch, int key_column) {
+    const ColumnVector & column = batch.columns.at(key_column);
+
+    for (vector<uint32_t>::const_iterator it = batch.selection.begin(); it != batch.selection.end(); it++) {
+        long long position = batch.positions[*it];
+
+        if (integer_keys) {
+            long long key = column.getInteger(*it);
+            if (integer_table.find(key) == integer_table.end()) {
+                keys.push_back(column.getString(*it));
+            }
+            integer_table.insert(make_pair(key, position));
+        } else {
+            string key = column.getString(*it);
+            if (string_table.find(key) == string_table.end()) {
+                keys.push_back(key);
+            }
+            string_table.insert(make_pair(key, position));
+        }
+    }
+}
+
+void JoinHashTable::merge(const JoinHashTable & other) {
+    for (IntegerTable::const_iterator it = other.integer_table.begin(); it != other.integer_table.end(); it++) {
+        if (integer_table.find(it->first) == integer_table.end()) {
+            keys.push_back(to_string(it->first));
+        }
+        integer_table.insert(*it);
+    }
+    for (StringTable::const_iterator it = other.string_table.begin(); it != other.string_table.end(); it++) {
+        if (string_table.find(it->first) == string_table.end()) {
+            keys.push_back(it->first);
+        }
+        string_table.insert(*it);
+    }
+}
+
+const vector<string> & JoinHashTable::getKeys() const {
+    return keys;
+}
+
+void JoinHashTable::probe(const ColumnVector & column, unsigned row, vector<long long> & matches) const {
+    //The rows of the same key may be inserted in any order by the threads building the table
+    size_t first_match = matches.size();
+    if (integer_keys) {
+        auto range = integer_table.equal_range(column.getInteger(row));
+        for (auto it = range.first; it != range.second; it++) {
+            matches.push_back(it->second);
+        }
+    } else {
+        auto range = string_table.equal_range(column.getString(row));
+        for (auto it = range.first; it != range.second; it++) {
+            matches.push_back(it->second);
+        }
+    }
+    if (matches.size() - first_match > 1) {
+        sort(matches.begin() + first_match, matches.end());
+    }
+}
+
+HashJoinProbeOperator::HashJoinProbeOperator(Operator * probe_side, const JoinHashTable * hash_table, int key_column) {
+    this->probe_side = probe_side;
+    this->hash_table = hash_table;
+    this->key_column = key_column;
+    this->input_position = 0;
+    this->match_position = 0;
+    this->probe_position = 0;
+}
+
+bool HashJoinProbeOperator::next(Batch & batch) {
+    if (batch.columns.size() != 2) {
+        batch.columns.clear();
+        batch.columns.push_back(ColumnVector("build_position", INT64));
+        batch.columns.push_back(ColumnVector("probe_position", INT64));
+    }
+    batch.resize(Batch::CAPACITY);
+    vector<int64_t> & build_positions = batch.columns[0].int64_values;
+    vector<int64_t> & probe_positions = batch.columns[1].int64_values;
+
+    unsigned count = 0;
+    while (count < Batch::CAPACITY) {
+        if (match_position < matches.size()) {
+            //Output the pending matches of the current probe row
+            build_positions[count] = matches[match_position++];
+            probe_positions[count] = probe_position;
+            count++;
+            continue;
+        }
+        if (input_position >= input.selection.size()) {
+            if (!probe_side->next(input)) {
+                break;
+            }
+            input_position = 0;
+            continue;
+        }
+
+        unsigned row = input.selection[input_position++];
+        matches.clear();
+        match_position = 0;
+        hash_table->probe(input.columns.at(key_column), row, matches);
+        probe_position = input.positions[row];
+    }
+
+    batch.resize(count);
+    return count > 0;
+}
+
+Aggregate::Aggregate(AggregateFunction function, int column, string name) : function(function), column(column), name(name) {
+}
+
+bool Aggregate::parse(const string & item, Schema & schema, Aggregate & aggregate) {
+    size_t open = item.find('(');
+    size_t close = item.rfind(')');
+    if (open == string::npos || close == string::npos || close < open) {
+        return false;
+    }
+
+    string function_name = item.substr(0, open);
+    function_name.erase(remove(function_name.begin(), function_name.end(), ' '), function_name.end());
+    transform(function_name.begin(), function_name.end(), function_name.begin(), ::tolower);
+
+    AggregateFunction function;
+    if (function_name == "count") {
+        function = COUNT;
+    } else if (function_name == "sum") {
+        function = SUM;
+    } else if (function_name == "avg") {
+        function = AVG;
+    } else if (function_name == "min") {
+        function = MIN;
+    } else if (function_name == "max") {
+        function = MAX;
+    } else {
+        return false;
+    }
+
+    string argument = item.substr(open + 1, close - open - 1);
+    argument.erase(remove(argument.begin(), argument.end(), ' '), argument.end());
+    int column = -1;
+    if (argument != "*" || function != COUNT) {
+        column = schema.getColPosition(argument);
+    }
+
+    aggregate = Aggregate(function, column, item);
+    return true;
+}
+
+Accumulator::Accumulator() : count(0), integer_value(0), real_value(0) {
+}
+
+/**
+ * Sum of the selected values of a column
+ */
+template <typename T, typename R>
+R sumValues(const T * values, const vector<uint32_t> & selection) {
+    R sum = 0;
+    for (unsigned i = 0; i < selection.size(); i++) {
+        sum += values[selection[i]];
+    }
+    return sum;
+}
+
+/**
+ * Min (or max) of the selected values of a column. The selection must not be empty
+ */
+template <typename T>
+T extremeValue(const T * values, const vector<uint32_t> & selection, bool is_min) {
+    T result = values[selection[0]];
+    if (is_min) {
+        for (unsigned i = 1; i < selection.size(); i++) {
+            result = min(result, values[selection[i]]);
+        }
+    } else {
+        for (unsigned i = 1; i < selection.size(); i++) {
+            result = max(result, values[selection[i]]);
+        }
+    }
+    return result;
+}
+
+void Accumulator::add(AggregateFunction function, const ColumnVector * column, const vector<uint32_t> & selection) {
+    if (selection.empty()) {
+        return;
+    }
+    if (function == COUNT || column == NULL) {
+        count += selection.size();
+        return;
+    }
+
+    Accumulator batch_accumulator;
+    batch_accumulator.count = selection.size();
+
+    if (function == SUM || function == AVG) {
+        switch (column->type) {
+            case INT32: batch_accumulator.integer_value = sumValues<int32_t, long long>(&column->int32_values[0], selection); break;
+            case INT64:
+            case FOREIGN_KEY: batch_accumulator.integer_value = sumValues<int64_t, long long>(&column->int64_values[0], selection); break;
+            case FLOAT: batch_accumulator.real_value = sumValues<float, double>(&column->float_values[0], selection); break;
+            case DOUBLE: batch_accumulator.real_value = sumValues<double, double>(&column->double_values[0], selection); break;
+            case CHAR: throw std::invalid_argument("Can't sum the CHAR column \"" + column->name + "\"");
+        }
+    } else {
+        bool is_min = function == MIN;
+        switch (column->type) {
+            case INT32: batch_accumulator.integer_value = extremeValue(&column->int32_values[0], selection, is_min); break;
+            case INT64:
+            case FOREIGN_KEY: batch_accumulator.integer_value = extremeValue(&column->int64_values[0], selection, is_min); break;
+            case FLOAT: batch_accumulator.real_value = extremeValue(&column->float_values[0], selection, is_min); break;
+            case DOUBLE: batch_accumulator.real_value = extremeValue(&column->double_values[0], selection, is_min); break;
+            case CHAR:
+                batch_accumulator.count = 0;
+                for (vector<uint32_t>::const_iterator it = selection.begin(); it != selection.end(); it++) {
+                    batch_accumulator.add(function, column, *it);
+                }
+                break;
+        }
+    }
+
+    merge(function, batch_accumulator);
+}
+
+void Accumulator::add(AggregateFunction function, const ColumnVector * column, unsigned row) {
+    if (function == COUNT || column == NULL) {
+        count++;
+        return;
+    }
+
+    //Update the value in place, the same as merging the accumulator of a single row
+    bool first = count == 0;
+    bool is_sum = function == SUM || function == AVG;
+    if (column->isInteger()) {
+        long long value = column->getInteger(row);
+        if (is_sum) {
+            integer_value += value;
+        } else if (first || (function == MIN ? value < integer_value : value > integer_value)) {
+            integer_value = value;
+        }
+    } else if (column->type == CHAR) {
+        if (is_sum) {
+            throw std::invalid_argument("Can't sum the CHAR column \"" + column->name + "\"");
+        }
+        const char * value = column->getChars(row);
+        size_t length = strnlen(value, column->width);
+        int comparison = string_value.compare(0, string::npos, value, length);
+        if (first || (function == MIN ? comparison > 0 : comparison < 0)) {
+            string_value.assign(value, length);
+        }
+    } else {
+        double value = column->getNumber(row);
+        if (is_sum) {
+            real_value += value;
+        } else if (first || (function == MIN ? value < real_value : value > real_value)) {
+            real_value = value;
+        }
+    }
+    count++;
+}
+
+void Accumulator::merge(AggregateFunction function, const Accumulator & other) {
+    if (other.count == 0) {
+        return;
+    }
+    bool first = count == 0;
+    count += other.count;
+
+    switch (function) {
+        case COUNT:
+            break;
+        case SUM:
+        case AVG:
+            integer_value += other.integer_value;
+            real_value += other.real_value;
+            break;
+        case MIN:
+            integer_value = first ? other.integer_value : min(integer_value, other.integer_value);
+            real_value = first ? other.real_value : min(real_value, other.real_value);
+            string_value = first ? other.string_value : min(string_value, other.string_value);
+            break;
+        case MAX:
+            integer_value = first ? other.integer_value : max(integer_value, other.integer_value);
+            real_value = first ? other.real_value : max(real_value, other.real_value);
+            string_value = first ? other.string_value : max(string_value, other.string_value);
+            break;
+    }
+}
+
+SchemaType Accumulator::getResultType(AggregateFunction function, SchemaType column_type) {
+    if (function == COUNT) {
+        return INT64;
+    } else if (function == AVG || column_type == FLOAT || column_type == DOUBLE) {
+        return DOUBLE;
+    } else if (column_type == CHAR) {
+        return CHAR;
+    }
+    return INT64;
+}
+
+void Accumulator::store(AggregateFunction function, ColumnVector & output, unsigned row) const {
+    switch (output.type) {
+        case INT64:
+            output.int64_values[row] = function == COUNT ? count : integer_value;
+            break;
+        case DOUBLE:
+            if (function == AVG) {
+                output.double_values[row] = count == 0 ? 0 : (integer_value + real_value) / count;
+            } else {
+                output.double_values[row] = real_value;
+            }
+            break;
+        case CHAR:
+            strncpy(&output.char_values[(size_t) row * output.width], string_value.c_str(), output.width);
+            output.char_values[(size_t) row * output.width + output.width - 1] = '\0';
+            break;
+        default:
+            break;
+    }
+}
+
+AggregateOperator::AggregateOperator(Operator * child, const vector<Aggregate> & aggregates) {
+    this->child = child;
+    this->aggregates = aggregates;
+    this->done = false;
+}
+
+bool AggregateOperator::next(Batch & batch) {
+    if (done) {
+        return false;
+    }
+    done = true;
+
+    vector<Accumulator> accumulators(aggregates.size());
+    Batch input;
+    vector<SchemaType> column_types(aggregates.size(), INT64);
+    vector<unsigned> column_widths(aggregates.size(), 0);
+
+    while (child->next(input)) {
+        for (unsigned i = 0; i < aggregates.size(); i++) {
+            const ColumnVector * column = aggregates[i].column < 0 ? NULL : &input.columns.at(aggregates[i].column);
+            if (column != NULL) {
+                column_types[i] = column->type;
+                column_widths[i] = column->width;
+            }
+            accumulators[i].add(aggregates[i].function, column, input.selection);
+        }
+    }
+
+    batch.columns.clear();
+    for (unsigned i = 0; i < aggregates.size(); i++) {
+        SchemaType type = Accumulator::getResultType(aggregates[i].function, column_types[i]);
+        batch.columns.push_back(ColumnVector(aggregates[i].name, type, type == CHAR ? column_widths[i] : 0));
+    }
+    batch.positions.clear();
+    batch.resize(1);
+    for (unsigned i = 0; i < aggregates.size(); i++) {
+        accumulators[i].store(aggregates[i].function, batch.columns[i], 0);
+    }
+    return true;
+}
+
+#endif //OPERATORS_H
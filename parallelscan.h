@@ -0,0 +1,326 @@
+#ifndef PARALLELSCAN_H
+#define PARALLELSCAN_H
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "operators.h"
+#include "threadpool.h"
+
+using namespace std;
+
+/**
+ * Scan a table with several tasks of the shared ThreadPool. The blocks (or the row ids) of a
+ * TableScanOperator are split in morsels handed out by a shared counter, and each task filters
+ * and projects the rows of its morsels before passing them to the operator's consumer
+ * e.g.: with 2 tasks and 5 blocks, the task A may read the blocks 0, 2 and 3 while the
+ *       task B reads the slower blocks 1 and 4
+ *
+ * The batches are returned in the morsel order (the header order of the scan) if ordered,
+ * or as soon as they are ready otherwise. When WINDOW_PER_THREAD batches for each task are
+ * buffered ahead of the consumer, the tasks return to the pool instead of waiting for a slow
+ * consumer, and are submitted again once the consumer takes the batches. They stop early when
+ * the operator is destroyed, e.g.: once a LIMIT is reached
+ */
+class ParallelScanOperator : public Operator {
+private:
+    /**
+     * The state shared with the tasks, which may outlive the operator while they are queued
+     */
+    struct SharedState {
+        vector<TableScanOperator> scans; // one for each task, sharing the morsels
+        MorselQueue morsels;
+        Expression where;
+        vector<int> projection;
+        bool ordered;
+        size_t window;
+
+        mutex ready_mutex;
+        condition_variable produced; // a batch is ready, or a task is done
+        condition_variable idle; // no task is running
+        map<long long, Batch> ready; // by morsel. An ordered scan also keeps the empty ones
+        long long next_morsel; // the next morsel returned by an ordered scan
+        vector<unsigned> parked_tasks; // waiting for the consumer to take the batches
+        unsigned running_tasks;
+        unsigned finished_tasks;
+        bool stopped;
+        exception_ptr error;
+
+        SharedState(long long number_of_morsels) : morsels(number_of_morsels) {}
+    };
+
+    shared_ptr<SharedState> state;
+    ThreadPool & pool;
+    TaskPriority priority;
+    unsigned number_of_tasks;
+    bool started;
+
+    /**
+     * Read, filter and project morsels until there are no more, the window is full or the
+     * scan is stopped
+     */
+    static void work(shared_ptr<SharedState> state, unsigned task);
+
+    /**
+     * Submit a task to the pool
+     */
+    void submit(unsigned task);
+
+public:
+    static const unsigned WINDOW_PER_THREAD = 2;
+
+    /**
+     * @param scan - the blocks (or the row ids) to read and their block filter, copied for
+     *               each task. Its descending order and row limit are ignored
+     * @param where - the filter of the rows, bound to the table schema
+     * @param projection - the columns returned, or empty to return all of them
+     * @param ordered - true to return the batches in the header order
+     * @param number_of_threads - the number of tasks, 0 for one for each thread of the pool
+     * @param priority - the priority of the tasks on the pool
+     * @constructor
+     */
+    ParallelScanOperator(const TableScanOperator & scan, const Expression & where, const vector<int> & projection,
+                         bool ordered, unsigned number_of_threads = 0, TaskPriority priority = NORMAL_PRIORITY,
+                         ThreadPool & pool = ThreadPool::getShared());
+
+    /**
+     * Stop the tasks
+     * @destructor
+     */
+    ~ParallelScanOperator();
+
+    bool next(Batch & batch);
+
+    /**
+     * Stop the tasks and wait for the running ones, e.g.: to read the counters after a LIMIT.
+     * The batches not returned yet are discarded
+     */
+    void stop();
+
+    unsigned getNumberOfThreads() const;
+
+    /**
+     * The counters of all the tasks, once the scan is over or stopped
+     * @see TableScanOperator
+     */
+    long long getRowsRead() const;
+    long long getBlocksRead() const;
+    long long getBlocksSkipped() const;
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+ParallelScanOperator::ParallelScanOperator(const TableScanOperator & scan, const Expression & where, const vector<int> & projection,
+                                           bool ordered, unsigned number_of_threads, TaskPriority priority, ThreadPool & pool)
+        : pool(pool) {
+    TableScanOperator prototype(scan);
+    this->state = make_shared<SharedState>(prototype.getNumberOfMorsels());
+    this->priority = priority;
+    this->started = false;
+
+    if (number_of_threads == 0) {
+        number_of_threads = pool.getNumberOfThreads();
+    }
+    this->number_of_tasks = max(1LL, min((long long) number_of_threads, state->morsels.getNumberOfMorsels()));
+
+    state->where = where;
+    state->projection = projection;
+    state->ordered = ordered;
+    state->window = WINDOW_PER_THREAD * number_of_tasks;
+    state->next_morsel = 0;
+    state->running_tasks = 0;
+    state->finished_tasks = 0;
+    state->stopped = false;
+    prototype.setMorsels(&state->morsels);
+    state->scans.assign(number_of_tasks, prototype);
+}
+
+ParallelScanOperator::~ParallelScanOperator() {
+    stop();
+}
+
+void ParallelScanOperator::submit(unsigned task) {
+    shared_ptr<SharedState> shared_state = state;
+    pool.submit([shared_state, task]() { work(shared_state, task); }, priority);
+}
+
+void ParallelScanOperator::work(shared_ptr<SharedState> state, unsigned task) {
+    {
+        unique_lock<mutex> lock(state->ready_mutex);
+        if (state->stopped) {
+            return;
+        }
+        state->running_tasks++;
+    }
+
+    TableScanOperator & scan = state->scans[task];
+    Batch batch;
+    vector<long long> skipped;
+    bool has_batch = true;
+    while (has_batch) {
+        Batch output;
+        long long morsel = -1;
+        try {
+            has_batch = scan.next(batch);
+            if (has_batch) {
+                if (!state->where.isAlwaysTrue()) {
+                    FilterOperator::filter(batch, state->where, batch.selection);
+                }
+                if (state->projection.empty()) {
+                    swap(output, batch);
+                } else {
+                    output.size = batch.size;
+                    output.positions.swap(batch.positions);
+                    output.selection.swap(batch.selection);
+                    output.columns.resize(state->projection.size());
+                    for (unsigned i = 0; i < state->projection.size(); i++) {
+                        output.columns[i] = batch.columns.at(state->projection[i]);
+                    }
+                }
+                morsel = scan.getMorsel();
+            }
+            scan.takeSkippedMorsels(skipped);
+        } catch (...) {
+            unique_lock<mutex> lock(state->ready_mutex);
+            if (!state->error) {
+                state->error = current_exception();
+            }
+            state->stopped = true;
+            state->running_tasks--;
+            state->produced.notify_all();
+            state->idle.notify_all();
+            return;
+        }
+
+        unique_lock<mutex> lock(state->ready_mutex);
+        if (state->ordered) {
+            //The skipped morsels are done, the consumer doesn't wait for them
+            for (vector<long long>::iterator it = skipped.begin(); it != skipped.end(); it++) {
+                state->ready[*it] = Batch();
+            }
+        }
+        skipped.clear();
+        if (has_batch && (state->ordered || output.getSelectedCount() > 0)) {
+            state->ready[morsel] = move(output);
+        }
+
+        if (!has_batch) {
+            state->finished_tasks++;
+        } else if (!state->stopped && state->ready.size() >= state->window) {
+            //The morsels taken are all in ready, so the consumer can reach them without this task
+            state->parked_tasks.push_back(task);
+            has_batch = false;
+        }
+        if (state->stopped) {
+            has_batch = false;
+        }
+        if (!has_batch) {
+            state->running_tasks--;
+            state->idle.notify_all();
+        }
+        state->produced.notify_one();
+    }
+}
+
+bool ParallelScanOperator::next(Batch & batch) {
+    if (!started) {
+        started = true;
+        for (unsigned i = 0; i < number_of_tasks; i++) {
+            submit(i);
+        }
+    }
+
+    bool worker_thread = pool.isWorkerThread();
+    unique_lock<mutex> lock(state->ready_mutex);
+    while (true) {
+        if (state->error) {
+            rethrow_exception(state->error);
+        }
+        if (state->stopped) {
+            return false;
+        }
+
+        map<long long, Batch>::iterator first = state->ready.begin();
+        if (first != state->ready.end() && (!state->ordered || first->first == state->next_morsel)) {
+            Batch output = move(first->second);
+            state->ready.erase(first);
+            state->next_morsel++;
+
+            //Resume the parked tasks once there is room in the window again
+            vector<unsigned> resumed;
+            if (state->ready.size() < state->window) {
+                resumed.swap(state->parked_tasks);
+            }
+            if (!resumed.empty()) {
+                lock.unlock();
+                for (vector<unsigned>::iterator it = resumed.begin(); it != resumed.end(); it++) {
+                    submit(*it);
+                }
+                lock.lock();
+            }
+
+            if (output.getSelectedCount() == 0) {
+                continue;
+            }
+            batch = move(output);
+            return true;
+        }
+        if (state->ready.empty() && state->finished_tasks == number_of_tasks) {
+            return false;
+        }
+        if (worker_thread) {
+            //The consumer is a task of the pool, e.g.: Table::queryAsync, so it runs the
+            //tasks of the scan instead of holding one of the threads they need
+            lock.unlock();
+            bool ran = pool.runPendingTask();
+            lock.lock();
+            if (!ran && state->ready.empty()) {
+                state->produced.wait_for(lock, chrono::milliseconds(1));
+            }
+        } else {
+            state->produced.wait(lock);
+        }
+    }
+}
+
+void ParallelScanOperator::stop() {
+    unique_lock<mutex> lock(state->ready_mutex);
+    state->stopped = true;
+    //The queued tasks return as soon as they run, only the running ones are waited for
+    state->idle.wait(lock, [this]() { return state->running_tasks == 0; });
+}
+
+unsigned ParallelScanOperator::getNumberOfThreads() const {
+    return number_of_tasks;
+}
+
+long long ParallelScanOperator::getRowsRead() const {
+    long long rows_read = 0;
+    for (vector<TableScanOperator>::const_iterator it = state->scans.begin(); it != state->scans.end(); it++) {
+        rows_read += it->getRowsRead();
+    }
+    return rows_read;
+}
+
+long long ParallelScanOperator::getBlocksRead() const {
+    long long blocks_read = 0;
+    for (vector<TableScanOperator>::const_iterator it = state->scans.begin(); it != state->scans.end(); it++) {
+        blocks_read += it->getBlocksRead();
+    }
+    return blocks_read;
+}
+
+long long ParallelScanOperator::getBlocksSkipped() const {
+    long long blocks_skipped = 0;
+    for (vector<TableScanOperator>::const_iterator it = state->scans.begin(); it != state->scans.end(); it++) {
+        blocks_skipped += it->getBlocksSkipped();
+    }
+    return blocks_skipped;
+}
+
+#endif //PARALLELSCAN_H
@@ -0,0 +1,463 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <vector>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <chrono>
+#include "operators.h"
+#include "threadpool.h"
+
+using namespace std;
+
+/**
+ * The end of a pipeline on one worker, e.g.: the local hash table of an aggregation. A sink
+ * is only used by one task at a time, so it needs no locks, and the sinks of all the workers
+ * are merged once the pipeline is done
+ */
+class PipelineSink {
+public:
+    virtual ~PipelineSink() {}
+
+    /**
+     * @param morsel - the morsel the rows come from, e.g.: to merge the sinks in the header order
+     */
+    virtual void consume(Batch & batch, long long morsel) = 0;
+};
+
+/**
+ * Keep the batches of a worker with their morsel
+ */
+class CollectSink : public PipelineSink {
+private:
+    vector<pair<long long, Batch> > batches;
+
+public:
+    void consume(Batch & batch, long long morsel);
+
+    /**
+     * Move the batches of all the sinks, in the morsel order. The batches of the same morsel
+     * keep their order
+     */
+    static void gather(const vector<CollectSink *> & sinks, vector<Batch> & batches);
+};
+
+/**
+ * Build the local hash table of a worker, the build side of a hash join
+ */
+class HashBuildSink : public PipelineSink {
+private:
+    JoinHashTable hash_table;
+    int key_column;
+
+public:
+    /**
+     * @param key_column - the position of the key on the batches
+     * @constructor
+     */
+    HashBuildSink(bool integer_keys, int key_column);
+
+    void consume(Batch & batch, long long morsel);
+    JoinHashTable & getHashTable();
+};
+
+/**
+ * Run the morsels of a table scan through the same steps on several workers, morsel by
+ * morsel: each worker takes the next morsel from the shared counter, then filters, probes a
+ * hash table and projects its rows before passing them to its own sink
+ * e.g.: for a join, | scan | filter | probe | project | -> CollectSink on each worker
+ *
+ * The number of workers is elastic: a worker about to take a morsel stops if its pipeline
+ * has more workers than its fair share of the pool, and starts another worker if it has
+ * fewer, so the pipelines running at the same time share the threads evenly
+ * @see ThreadPool::getFairShare
+ */
+class Pipeline {
+private:
+    /**
+     * The steps of a worker, reused for each of its morsels
+     */
+    struct Worker {
+        TableScanOperator scan;
+        Batch morsel_batch; // the rows of the current morsel
+        bool has_morsel_batch;
+        vector<unique_ptr<Operator> > operators; // from the morsel to the sink
+        Operator * output;
+
+        Worker(const TableScanOperator & scan) : scan(scan), has_morsel_batch(false), output(NULL) {}
+    };
+
+    /**
+     * Return the rows of the current morsel of a worker once
+     */
+    class MorselOperator : public Operator {
+    private:
+        Worker * worker;
+    public:
+        MorselOperator(Worker * worker) : worker(worker) {}
+        bool next(Batch & batch);
+    };
+
+    ThreadPool & pool;
+    TableScanOperator prototype;
+    unique_ptr<MorselQueue> morsels;
+    Expression where;
+    const JoinHashTable * hash_table;
+    int probe_column;
+    vector<int> projection;
+    long long row_limit;
+    TaskPriority priority;
+    unsigned max_workers;
+
+    vector<unique_ptr<Worker> > workers;
+    vector<PipelineSink *> sinks;
+    mutex pipeline_mutex;
+    condition_variable finished;
+    vector<unsigned> free_workers; // the workers not running, by index
+    unsigned running_workers; // submitted and not done
+    unsigned peak_workers;
+    long long rows_out;
+    double seconds;
+    bool stopped;
+    exception_ptr error;
+
+    /**
+     * Run the morsels of a worker until there are no more, the pipeline stops or it has
+     * more workers than its fair share
+     */
+    void work(unsigned worker);
+
+    /**
+     * Start a free worker, with the lock held
+     * @return false if there was no free worker
+     */
+    bool startWorker();
+
+    /**
+     * Create the operators of a worker
+     */
+    void buildWorker(Worker & worker);
+
+public:
+    /**
+     * @param scan - the blocks (or the row ids) to read and their block filter. Its descending
+     *               order and row limit are ignored
+     * @param max_workers - 0 for the number of threads of the pool
+     * @constructor
+     */
+    Pipeline(const TableScanOperator & scan, unsigned max_workers = 0, ThreadPool & pool = ThreadPool::getShared());
+
+    /**
+     * Filter the rows, with an expression bound to the table schema
+     */
+    void setFilter(const Expression & where);
+
+    /**
+     * Replace each row by its matches on a hash table, as the | build_position | probe_position |
+     * batches of a HashJoinProbeOperator
+     * @param key_column - the position of the key on the table schema
+     */
+    void setProbe(const JoinHashTable * hash_table, int key_column);
+
+    /**
+     * Only keep some columns, after the filter and the probe
+     */
+    void setProjection(const vector<int> & projection);
+
+    /**
+     * Stop taking morsels once a number of rows reached the sinks. The morsels taken are all
+     * done, so the rows of the first morsels are complete
+     * @param row_limit - the number of rows, or -1 for all of them
+     */
+    void setRowLimit(long long row_limit);
+
+    void setPriority(TaskPriority priority);
+
+    /**
+     * @return the number of sinks to pass to Pipeline::run, one for each worker
+     */
+    unsigned getMaxWorkers() const;
+
+    /**
+     * Run all the morsels and wait for the workers
+     * @param sinks - one for each worker
+     * @throw the first exception of a worker
+     */
+    void run(const vector<PipelineSink *> & sinks);
+
+    /**
+     * @return the largest number of workers running at the same time
+     */
+    unsigned getPeakWorkers() const;
+
+    /**
+     * @return the wall time of Pipeline::run, in seconds
+     */
+    double getSeconds() const;
+
+    /**
+     * @return the selected rows passed to the sinks
+     */
+    long long getRowsOut() const;
+
+    /**
+     * The counters of the scans of all the workers
+     * @see TableScanOperator
+     */
+    long long getRowsRead() const;
+    long long getBlocksRead() const;
+    long long getBlocksSkipped() const;
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+void CollectSink::consume(Batch & batch, long long morsel) {
+    batches.push_back(make_pair(morsel, Batch()));
+    swap(batches.back().second, batch);
+}
+
+void CollectSink::gather(const vector<CollectSink *> & sinks, vector<Batch> & batches) {
+    //A morsel is done by a single worker, so its batches are all on the same sink
+    multimap<long long, Batch *> by_morsel;
+    for (vector<CollectSink *>::const_iterator sink = sinks.begin(); sink != sinks.end(); sink++) {
+        for (vector<pair<long long, Batch> >::iterator it = (*sink)->batches.begin(); it != (*sink)->batches.end(); it++) {
+            by_morsel.insert(make_pair(it->first, &it->second));
+        }
+    }
+    for (multimap<long long, Batch *>::iterator it = by_morsel.begin(); it != by_morsel.end(); it++) {
+        batches.push_back(Batch());
+        swap(batches.back(), *it->second);
+    }
+    for (vector<CollectSink *>::const_iterator sink = sinks.begin(); sink != sinks.end(); sink++) {
+        (*sink)->batches.clear();
+    }
+}
+
+HashBuildSink::HashBuildSink(bool integer_keys, int key_column) : hash_table(integer_keys), key_column(key_column) {
+}
+
+void HashBuildSink::consume(Batch & batch, long long) {
+    hash_table.add(batch, key_column);
+}
+
+JoinHashTable & HashBuildSink::getHashTable() {
+    return hash_table;
+}
+
+bool Pipeline::MorselOperator::next(Batch & batch) {
+    if (!worker->has_morsel_batch) {
+        return false;
+    }
+    worker->has_morsel_batch = false;
+    swap(batch, worker->morsel_batch);
+    return true;
+}
+
+Pipeline::Pipeline(const TableScanOperator & scan, unsigned max_workers, ThreadPool & pool) : pool(pool), prototype(scan) {
+    this->morsels.reset(new MorselQueue(prototype.getNumberOfMorsels()));
+    this->hash_table = NULL;
+    this->probe_column = -1;
+    this->row_limit = -1;
+    this->priority = NORMAL_PRIORITY;
+    if (max_workers == 0) {
+        max_workers = pool.getNumberOfThreads();
+    }
+    this->max_workers = max(1LL, min((long long) max_workers, morsels->getNumberOfMorsels()));
+    this->running_workers = 0;
+    this->peak_workers = 0;
+    this->rows_out = 0;
+    this->seconds = 0;
+    this->stopped = false;
+    prototype.setMorsels(morsels.get());
+}
+
+void Pipeline::setFilter(const Expression & where) {
+    this->where = where;
+}
+
+void Pipeline::setProbe(const JoinHashTable * hash_table, int key_column) {
+    this->hash_table = hash_table;
+    this->probe_column = key_column;
+}
+
+void Pipeline::setProjection(const vector<int> & projection) {
+    this->projection = projection;
+}
+
+void Pipeline::setRowLimit(long long row_limit) {
+    this->row_limit = row_limit;
+}
+
+void Pipeline::setPriority(TaskPriority priority) {
+    this->priority = priority;
+}
+
+unsigned Pipeline::getMaxWorkers() const {
+    return max_workers;
+}
+
+void Pipeline::buildWorker(Worker & worker) {
+    Operator * output = new MorselOperator(&worker);
+    worker.operators.push_back(unique_ptr<Operator>(output));
+    if (!where.isAlwaysTrue()) {
+        output = new FilterOperator(output, where);
+        worker.operators.push_back(unique_ptr<Operator>(output));
+    }
+    if (hash_table != NULL) {
+        output = new HashJoinProbeOperator(output, hash_table, probe_column);
+        worker.operators.push_back(unique_ptr<Operator>(output));
+    }
+    if (!projection.empty()) {
+        output = new ProjectOperator(output, projection);
+        worker.operators.push_back(unique_ptr<Operator>(output));
+    }
+    worker.output = output;
+}
+
+bool Pipeline::startWorker() {
+    if (free_workers.empty()) {
+        return false;
+    }
+    unsigned worker = free_workers.back();
+    free_workers.pop_back();
+    running_workers++;
+    peak_workers = max(peak_workers, running_workers);
+    pool.submit([this, worker]() { work(worker); }, priority);
+    return true;
+}
+
+void Pipeline::work(unsigned index) {
+    Worker & worker = *workers[index];
+    PipelineSink * sink = sinks[index];
+    bool more = true;
+    while (more) {
+        try {
+            more = worker.scan.next(worker.morsel_batch);
+            if (more) {
+                long long morsel = worker.scan.getMorsel();
+                worker.has_morsel_batch = true;
+                Batch batch;
+                long long rows = 0;
+                while (worker.output->next(batch)) {
+                    rows += batch.getSelectedCount();
+                    sink->consume(batch, morsel);
+                }
+                if (rows > 0) {
+                    unique_lock<mutex> lock(pipeline_mutex);
+                    rows_out += rows;
+                }
+            }
+        } catch (...) {
+            unique_lock<mutex> lock(pipeline_mutex);
+            if (!error) {
+                error = current_exception();
+            }
+            stopped = true;
+            more = false;
+        }
+
+        //Between two morsels the worker may stop, or start another worker
+        unique_lock<mutex> lock(pipeline_mutex);
+        if (row_limit >= 0 && rows_out >= row_limit) {
+            stopped = true;
+        }
+        unsigned fair_share = pool.getFairShare();
+        if (stopped || running_workers > fair_share) {
+            more = false;
+        } else if (more && running_workers < fair_share) {
+            startWorker();
+        }
+        if (!more) {
+            //Notified with the lock held, the pipeline may be destroyed as soon as it's released
+            free_workers.push_back(index);
+            running_workers--;
+            finished.notify_all();
+        }
+    }
+}
+
+void Pipeline::run(const vector<PipelineSink *> & sinks) {
+    if (sinks.size() < max_workers) {
+        throw std::invalid_argument("A pipeline needs a sink for each worker");
+    }
+    this->sinks = sinks;
+
+    workers.clear();
+    free_workers.clear();
+    for (unsigned i = 0; i < max_workers; i++) {
+        workers.push_back(unique_ptr<Worker>(new Worker(prototype)));
+        buildWorker(*workers.back());
+        free_workers.push_back(max_workers - 1 - i);
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    pool.beginQuery();
+    bool worker_thread = pool.isWorkerThread();
+    unique_lock<mutex> lock(pipeline_mutex);
+    unsigned initial_workers = min(max_workers, pool.getFairShare());
+    for (unsigned i = 0; i < initial_workers; i++) {
+        startWorker();
+    }
+    while (running_workers > 0) {
+        if (worker_thread) {
+            //Help the pool instead of holding one of its threads
+            lock.unlock();
+            bool ran = pool.runPendingTask();
+            lock.lock();
+            if (!ran && running_workers > 0) {
+                finished.wait_for(lock, chrono::milliseconds(1));
+            }
+        } else {
+            finished.wait(lock);
+        }
+    }
+    pool.endQuery();
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+unsigned Pipeline::getPeakWorkers() const {
+    return peak_workers;
+}
+
+double Pipeline::getSeconds() const {
+    return seconds;
+}
+
+long long Pipeline::getRowsOut() const {
+    return rows_out;
+}
+
+long long Pipeline::getRowsRead() const {
+    long long rows_read = 0;
+    for (vector<unique_ptr<Worker> >::const_iterator it = workers.begin(); it != workers.end(); it++) {
+        rows_read += (*it)->scan.getRowsRead();
+    }
+    return rows_read;
+}
+
+long long Pipeline::getBlocksRead() const {
+    long long blocks_read = 0;
+    for (vector<unique_ptr<Worker> >::const_iterator it = workers.begin(); it != workers.end(); it++) {
+        blocks_read += (*it)->scan.getBlocksRead();
+    }
+    return blocks_read;
+}
+
+long long Pipeline::getBlocksSkipped() const {
+    long long blocks_skipped = 0;
+    for (vector<unique_ptr<Worker> >::const_iterator it = workers.begin(); it != workers.end(); it++) {
+        blocks_skipped += (*it)->scan.getBlocksSkipped();
+    }
+    return blocks_skipped;
+}
+
+#endif //PIPELINE_H
@@ -0,0 +1,236 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <stdint.h>
+#include "predicate.h"
+#include "queryable.h"
+
+using namespace std;
+
+/**
+ * The costs of the cost model, relative to reading and decoding one row of a block
+ * read sequentially
+ */
+const double SEQUENTIAL_ROW_COST = 1.0;
+const double RANDOM_ROW_COST = 4.0; // a row read by its position, e.g.: from an index
+const double FILTER_ROW_COST = 0.2; // evaluating the WHERE on one row
+const double SEARCH_STEP_COST = 0.1; // one step of a binary search on the header
+const double INDEX_PROBE_COST = 1.0; // one lookup of a hash or bitmap index
+const double BLOCK_CHECK_COST = 0.05; // checking the zone map and bloom filters of a block
+const double SORT_ROW_COST = 0.5; // per row and per log2(rows)
+const double AGGREGATE_ROW_COST = 0.5;
+
+/**
+ * The queries estimated to read at most this number of rows are short: their tasks are
+ * scheduled before the ones of the other queries
+ */
+const double SHORT_QUERY_ROWS = 8 * 1024;
+
+/**
+ * The selectivity of a predicate when there is nothing better to estimate it
+ */
+const double DEFAULT_EQUAL_SELECTIVITY = 0.1;
+const double DEFAULT_RANGE_SELECTIVITY = 1.0 / 3;
+const double DEFAULT_LIKE_SELECTIVITY = 0.1;
+
+/**
+ * The ways of reading the rows that may match a WHERE
+ */
+enum AccessPathType {
+    FULL_SCAN,          // every block of the table
+    ZONE_MAP_SCAN,      // the blocks not excluded by the zone maps and bloom filters
+    HEADER_SEARCH,      // the _id range, found by a binary search on the header
+    HASH_INDEX_LOOKUP,  // the rows of the = or IN values on a hash index
+    BITMAP_INDEX_SCAN   // the rows of the intersection (and union) of the bitmap indexes
+};
+
+/**
+ * An access path with its estimated cost. Either the row ids or the block range
+ * [first_block, last_block) are read
+ */
+struct AccessPath {
+    AccessPathType type;
+    string detail; // e.g.: the index column or the _id range
+    double cost;
+    double rows_read; // estimated number of rows read from the table
+
+    bool has_row_ids;
+    vector<uint32_t> row_ids; // ascending
+    long long first_block;
+    long long last_block;
+
+    bool exact; // true if every row read matches the WHERE, so it doesn't need a filter
+
+    AccessPath(AccessPathType type = FULL_SCAN, string detail = "");
+
+    /**
+     * @return e.g.: "Hash index lookup on name (cost=12.4 rows=3)"
+     */
+    string toString() const;
+};
+
+/**
+ * The estimates of a whole query, e.g.: to admit it
+ * @see AdmissionController
+ */
+struct QueryEstimate {
+    double cost; // of all the steps, as shown by EXPLAIN
+    double rows_read; // from the tables
+    double memory; // the bytes kept by the sorts, the aggregations and the hash tables
+
+    QueryEstimate();
+};
+
+/**
+ * What is known about the values of a column, to estimate the selectivity of predicates
+ */
+struct ColumnEstimate {
+    bool has_range;
+    double minimum;
+    double maximum;
+    double distinct_values; // 0 if unknown
+    vector<double> histogram; // the bounds of an equi-depth histogram, empty if unknown
+
+    ColumnEstimate();
+};
+
+/**
+ * Estimate the number of rows of each step of a plan
+ */
+class CostModel {
+public:
+    /**
+     * @param columns - the estimates of each column of the table, _id included
+     * @return the fraction of the rows matching the expression, which must be bound
+     */
+    static double estimateSelectivity(const Expression & where, const vector<ColumnEstimate> & columns);
+
+    /**
+     * @return the fraction of the values of a column matching a predicate
+     */
+    static double estimateSelectivity(const Predicate & predicate, const ColumnEstimate & column);
+
+    /**
+     * @return the fraction of the values below the value (or at most the value), from the
+     *         histogram or else the fraction of [minimum, maximum]
+     */
+    static double estimateFractionBelow(const ColumnEstimate & column, double value);
+
+    /**
+     * Format a cost or a number of rows, e.g.: 12.4
+     */
+    static string format(double value);
+};
+
+AccessPath::AccessPath(AccessPathType type, string detail) : type(type), detail(detail), cost(0), rows_read(0),
+                                                          has_row_ids(false), first_block(0), last_block(-1), exact(false) {
+}
+
+string AccessPath::toString() const {
+    const char * names[] = {"Full scan", "Zone map scan", "Header binary search", "Hash index lookup", "Bitmap index scan"};
+    string text = names[type];
+    if (!detail.empty()) {
+        text += " " + detail;
+    }
+    return text + " (cost=" + CostModel::format(cost) + " rows=" + CostModel::format(rows_read) + ")";
+}
+
+QueryEstimate::QueryEstimate() : cost(0), rows_read(0), memory(0) {
+}
+
+ColumnEstimate::ColumnEstimate() : has_range(false), minimum(0), maximum(0), distinct_values(0) {
+}
+
+double CostModel::estimateSelectivity(const Expression & where, const vector<ColumnEstimate> & columns) {
+    switch (where.type) {
+        case PREDICATE_EXPRESSION: {
+            int column = where.predicate.column_position;
+            if (column < 0 || column >= (int) columns.size()) {
+                return DEFAULT_RANGE_SELECTIVITY;
+            }
+            return estimateSelectivity(where.predicate, columns[column]);
+        }
+        case NOT_EXPRESSION:
+            return 1 - estimateSelectivity(where.children.at(0), columns);
+        case AND_EXPRESSION: {
+            //The conditions are assumed to be independent
+            double selectivity = 1;
+            for (vector<Expression>::const_iterator it = where.children.begin(); it != where.children.end(); it++) {
+                selectivity *= estimateSelectivity(*it, columns);
+            }
+            return selectivity;
+        }
+        case OR_EXPRESSION: {
+            double none = 1;
+            for (vector<Expression>::const_iterator it = where.children.begin(); it != where.children.end(); it++) {
+                none *= 1 - estimateSelectivity(*it, columns);
+            }
+            return 1 - none;
+        }
+    }
+    return 1;
+}
+
+double CostModel::estimateSelectivity(const Predicate & predicate, const ColumnEstimate & column) {
+    double equal = column.distinct_values > 0 ? 1 / column.distinct_values : DEFAULT_EQUAL_SELECTIVITY;
+    double value = predicate.values.empty() ? 0 : atof(predicate.values[0].c_str());
+    bool out_of_range = column.has_range && (value < column.minimum || value > column.maximum);
+
+    switch (predicate.comparator) {
+        case EQUAL:
+            return out_of_range ? 0 : equal;
+        case NOT_EQUAL:
+            return out_of_range ? 1 : 1 - equal;
+        case IN:
+            return min(1.0, equal * predicate.values.size());
+        case LESS:
+        case LESS_EQUAL:
+            return column.has_range ? estimateFractionBelow(column, value) : DEFAULT_RANGE_SELECTIVITY;
+        case GREATER:
+        case GREATER_EQUAL:
+            return column.has_range ? 1 - estimateFractionBelow(column, value) : DEFAULT_RANGE_SELECTIVITY;
+        case LIKE:
+            return DEFAULT_LIKE_SELECTIVITY;
+    }
+    return 1;
+}
+
+double CostModel::estimateFractionBelow(const ColumnEstimate & column, double value) {
+    const vector<double> & histogram = column.histogram;
+    if (histogram.size() >= 2) {
+        if (value <= histogram.front()) {
+            return 0;
+        }
+        if (value >= histogram.back()) {
+            return 1;
+        }
+        //Each bucket holds the same fraction of the values, uniform inside the bucket
+        size_t bucket = upper_bound(histogram.begin(), histogram.end(), value) - histogram.begin() - 1;
+        double width = histogram[bucket + 1] - histogram[bucket];
+        double inside = width > 0 ? (value - histogram[bucket]) / width : 0.5;
+        return (bucket + inside) / (histogram.size() - 1);
+    }
+    if (value <= column.minimum) {
+        return 0;
+    }
+    if (value >= column.maximum) {
+        return 1;
+    }
+    //The values are assumed to be uniform between the minimum and the maximum
+    return (value - column.minimum) / (column.maximum - column.minimum);
+}
+
+string CostModel::format(double value) {
+    ostringstream stream;
+    stream.setf(ios::fixed);
+    stream.precision(value < 100 ? 1 : 0);
+    stream << value;
+    return stream.str();
+}
+
+#endif //PLANNER_H
@@ -0,0 +1,305 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+#include "schema.h"
+
+using namespace std;
+
+//Possible comparators of a WHERE clause
+enum Comparator { EQUAL, NOT_EQUAL, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL, IN, LIKE };
+
+/**
+ * A single condition of a WHERE clause, comparing a column to one or more constants
+ * e.g.: age > 10 is { "age", GREATER, {"10"} }
+ * e.g.2: name IN ('bruno', 'ana') is { "name", IN, {"bruno", "ana"} }
+ * e.g.3: name LIKE 'bru%' is { "name", LIKE, {"bru%"} }. Only prefix patterns are
+ *        supported: a '%' that is not the last character is compared literally
+ *
+ * The values are compared using the column type, so 10 < 9 is false for an INT32 column
+ * even though "10" < "9" as strings
+ */
+struct Predicate {
+    string column;
+    Comparator comparator;
+    vector<string> values;
+
+    //Set by Predicate::bind
+    int column_position;
+    SchemaType column_type;
+
+    Predicate();
+    Predicate(string column, Comparator comparator, string value);
+    Predicate(string column, Comparator comparator, vector<string> values);
+
+    /**
+     * Convert a comparator string (=, !=, <>, <, <=, >, >=, in, like) to the Comparator enum
+     * @throw invalid_argument if the comparator is unknown
+     */
+    static Comparator parseComparator(string comparator);
+
+    /**
+     * Resolve the column position and type on the schema
+     * @throw invalid_argument if the column is not on the schema
+     */
+    void bind(Schema & schema);
+
+    /**
+     * Check whether a row satisfies the predicate. The predicate must be bound
+     * @see Predicate::bind
+     */
+    bool matches(const vector<string> & row) const;
+
+    /**
+     * Check whether a value of the given column type satisfies the predicate.
+     * The value is expected in the same format returned by Table::getRow
+     */
+    bool matches(const string & value, SchemaType type) const;
+
+    /**
+     * Compare two values using the column type
+     * @return a negative number if a < b, 0 if a == b and a positive number if a > b
+     */
+    static int compare(const string & a, const string & b, SchemaType type);
+
+    /**
+     * @return the predicate as it is written on a query, e.g.: name IN ('bruno', 'ana')
+     */
+    string toString() const;
+};
+
+//Possible nodes of a WHERE expression
+enum ExpressionType { PREDICATE_EXPRESSION, AND_EXPRESSION, OR_EXPRESSION, NOT_EXPRESSION };
+
+/**
+ * A boolean combination of predicates
+ * e.g.: age > 10 AND (name = 'bruno' OR NOT points < 0) is
+ * AND(age > 10, OR(name = 'bruno', NOT(points < 0)))
+ *
+ * An AND expression without children (the default one) is always true
+ */
+struct Expression {
+    ExpressionType type;
+    Predicate predicate; // Only used by PREDICATE_EXPRESSION
+    vector<Expression> children;
+
+    /**
+     * Create an expression that is always true
+     * @constructor
+     */
+    Expression();
+    Expression(Predicate predicate);
+    Expression(ExpressionType type, vector<Expression> children);
+
+    /**
+     * @return an AND expression of all the predicates
+     */
+    static Expression allOf(const vector<Predicate> & predicates);
+
+    /**
+     * @return true if the expression has no condition
+     */
+    bool isAlwaysTrue() const;
+
+    /**
+     * Bind all the predicates of the expression
+     * @see Predicate::bind
+     */
+    void bind(Schema & schema);
+
+    /**
+     * Check whether a row satisfies the expression. The expression must be bound
+     */
+    bool matches(const vector<string> & row) const;
+
+    /**
+     * @return the expression as it is written on a query, e.g.: (age > 10 OR NOT name = 'ana')
+     */
+    string toString() const;
+};
+
+Predicate::Predicate() : comparator(EQUAL), column_position(-1), column_type(INT64) {
+}
+
+Predicate::Predicate(string column, Comparator comparator, string value) : column(column), comparator(comparator), column_position(-1), column_type(INT64) {
+    values.push_back(value);
+}
+
+Predicate::Predicate(string column, Comparator comparator, vector<string> values) : column(column), comparator(comparator), values(values), column_position(-1), column_type(INT64) {
+}
+
+void Predicate::bind(Schema & schema) {
+    column_position = schema.getColPosition(column);
+    column_type = schema.getCols()->at(column_position).type;
+}
+
+bool Predicate::matches(const vector<string> & row) const {
+    return matches(row.at(column_position), column_type);
+}
+
+Comparator Predicate::parseComparator(string comparator) {
+    std::transform(comparator.begin(), comparator.end(), comparator.begin(), ::tolower);
+
+    if (comparator == "=" || comparator == "==") {
+        return EQUAL;
+    } else if (comparator == "!=" || comparator == "<>") {
+        return NOT_EQUAL;
+    } else if (comparator == "<") {
+        return LESS;
+    } else if (comparator == "<=") {
+        return LESS_EQUAL;
+    } else if (comparator == ">") {
+        return GREATER;
+    } else if (comparator == ">=") {
+        return GREATER_EQUAL;
+    } else if (comparator == "in") {
+        return IN;
+    } else if (comparator == "like") {
+        return LIKE;
+    }
+
+    throw std::invalid_argument("Unknown comparator \"" + comparator + "\"");
+}
+
+int Predicate::compare(const string & a, const string & b, SchemaType type) {
+    switch (type) {
+        case INT32:
+        case INT64:
+        case FOREIGN_KEY: {
+            long long a_number = atoll(a.c_str());
+            long long b_number = atoll(b.c_str());
+            return a_number < b_number ? -1 : (a_number > b_number ? 1 : 0);
+        }
+        case FLOAT:
+        case DOUBLE: {
+            double a_number = atof(a.c_str());
+            double b_number = atof(b.c_str());
+            return a_number < b_number ? -1 : (a_number > b_number ? 1 : 0);
+        }
+        default:
+            return a.compare(b);
+    }
+}
+
+bool Predicate::matches(const string & value, SchemaType type) const {
+    if (comparator == IN) {
+        for (vector<string>::const_iterator it = values.begin(); it != values.end(); it++) {
+            if (compare(value, *it, type) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (comparator == LIKE) {
+        const string & pattern = values.at(0);
+        if (!pattern.empty() && pattern[pattern.size() - 1] == '%') {
+            return value.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0;
+        }
+        return value == pattern;
+    }
+
+    int result = compare(value, values.at(0), type);
+
+    switch (comparator) {
+        case EQUAL: return result == 0;
+        case NOT_EQUAL: return result != 0;
+        case LESS: return result < 0;
+        case LESS_EQUAL: return result <= 0;
+        case GREATER: return result > 0;
+        case GREATER_EQUAL: return result >= 0;
+        default: return false;
+    }
+}
+
+string Predicate::toString() const {
+    const char * comparators[] = {"=", "!=", "<", "<=", ">", ">=", "IN", "LIKE"};
+    string text = column + " " + comparators[comparator] + " ";
+    bool quoted = column_position < 0 || column_type == CHAR;
+
+    if (comparator == IN) {
+        text += "(";
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+        text += (i > 0 ? ", " : "") + (quoted ? "'" + values[i] + "'" : values[i]);
+    }
+    return comparator == IN ? text + ")" : text;
+}
+
+Expression::Expression() : type(AND_EXPRESSION) {
+}
+
+Expression::Expression(Predicate predicate) : type(PREDICATE_EXPRESSION), predicate(predicate) {
+}
+
+Expression::Expression(ExpressionType type, vector<Expression> children) : type(type), children(children) {
+}
+
+Expression Expression::allOf(const vector<Predicate> & predicates) {
+    vector<Expression> children;
+    for (vector<Predicate>::const_iterator it = predicates.begin(); it != predicates.end(); it++) {
+        children.push_back(Expression(*it));
+    }
+    return Expression(AND_EXPRESSION, children);
+}
+
+bool Expression::isAlwaysTrue() const {
+    return type == AND_EXPRESSION && children.empty();
+}
+
+void Expression::bind(Schema & schema) {
+    if (type == PREDICATE_EXPRESSION) {
+        predicate.bind(schema);
+    }
+    for (vector<Expression>::iterator it = children.begin(); it != children.end(); it++) {
+        it->bind(schema);
+    }
+}
+
+bool Expression::matches(const vector<string> & row) const {
+    switch (type) {
+        case PREDICATE_EXPRESSION:
+            return predicate.matches(row);
+        case AND_EXPRESSION:
+            for (vector<Expression>::const_iterator it = children.begin(); it != children.end(); it++) {
+                if (!it->matches(row)) {
+                    return false;
+                }
+            }
+            return true;
+        case OR_EXPRESSION:
+            for (vector<Expression>::const_iterator it = children.begin(); it != children.end(); it++) {
+                if (it->matches(row)) {
+                    return true;
+                }
+            }
+            return false;
+        case NOT_EXPRESSION:
+            return !children.at(0).matches(row);
+    }
+    return false;
+}
+
+string Expression::toString() const {
+    switch (type) {
+        case PREDICATE_EXPRESSION:
+            return predicate.toString();
+        case NOT_EXPRESSION:
+            return "NOT " + children.at(0).toString();
+        default: {
+            if (children.empty()) {
+                return "true";
+            }
+            string text;
+            for (size_t i = 0; i < children.size(); i++) {
+                text += (i > 0 ? (type == AND_EXPRESSION ? " AND " : " OR ") : "") + children[i].toString();
+            }
+            return children.size() > 1 ? "(" + text + ")" : text;
+        }
+    }
+}
+
+#endif //PREDICATE_H
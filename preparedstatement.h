@@ -0,0 +1,141 @@
+#ifndef PREPAREDSTATEMENT_H
+#define PREPAREDSTATEMENT_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include "queryparser.h"
+#include "cursor.h"
+#include "sortoperator.h"
+#include "planner.h"
+
+using namespace std;
+
+class Table;
+
+/**
+ * A query parsed and planned once, to be run many times with different values. The
+ * values are the ? of the WHERE, numbered from 0 in the query order. A query without
+ * JOIN nor aggregates keeps the access path of its first execution: the next ones only
+ * look up the rows of the new values on it
+ * e.g.:
+ * PreparedStatement statement = person_table.prepare("SELECT name WHERE _id = ?");
+ * for (long long _id = 0; _id < 10; _id++) {
+ *     statement.bind(0, _id);
+ *     Cursor cursor = statement.execute();
+ * }
+ * @see Table::prepare
+ */
+class PreparedStatement {
+private:
+    Table * table;
+    Table * joined_table;
+    SelectStatement statement;
+    vector<bool> bound;
+
+    //The plan, set by Table::prepare
+    bool point_lookup; // the WHERE is only _id = value, read with Table::getRowById
+    bool scan; // without JOIN, aggregates nor EXPLAIN: the WHERE is bound and read with Table::scanBatches
+    vector<int> projection;
+    vector<SortKey> sort_keys;
+    vector<string> column_names; // of the cursors
+
+    //Set by the first execution of a scan
+    bool has_access_path;
+    AccessPathType access_path;
+
+    friend class Table;
+
+public:
+    /**
+     * @see Table::prepare
+     * @constructor
+     */
+    PreparedStatement(Table * table, Table * joined_table, const SelectStatement & statement);
+
+    /**
+     * @return the number of ? of the query
+     */
+    unsigned getNumberOfParameters();
+
+    /**
+     * Set the value of the i-th ?. The value is kept for the next executions
+     * @throw out_of_range if there are not i + 1 parameters
+     */
+    void bind(unsigned i, const string & value);
+    void bind(unsigned i, int value);
+    void bind(unsigned i, long long value);
+    void bind(unsigned i, double value);
+
+    /**
+     * @return true if the query is run as a single Table::getRowById
+     */
+    bool isPointLookup();
+
+    /**
+     * The index of a column on the cursors of the statement, resolved once instead of by name
+     * for each row
+     * e.g.: int name = statement.getColumnIndex("name");
+     * @throw invalid_argument if the results have no column with the name
+     * @see Cursor::getString
+     */
+    int getColumnIndex(const string & column_name);
+
+    /**
+     * Run the query with the bound values
+     * @throw invalid_argument if a parameter is not bound
+     * @return the cursor associated with the query
+     */
+    Cursor execute();
+};
+
+PreparedStatement::PreparedStatement(Table * table, Table * joined_table, const SelectStatement & statement) {
+    this->table = table;
+    this->joined_table = joined_table;
+    this->statement = statement;
+    this->bound.assign(statement.parameters.size(), false);
+    this->point_lookup = false;
+    this->scan = false;
+    this->has_access_path = false;
+    this->access_path = FULL_SCAN;
+}
+
+unsigned PreparedStatement::getNumberOfParameters() {
+    return statement.parameters.size();
+}
+
+void PreparedStatement::bind(unsigned i, const string & value) {
+    statement.setParameter(i, value);
+    bound[i] = true;
+}
+
+void PreparedStatement::bind(unsigned i, int value) {
+    bind(i, (long long) value);
+}
+
+void PreparedStatement::bind(unsigned i, long long value) {
+    bind(i, to_string(value));
+}
+
+void PreparedStatement::bind(unsigned i, double value) {
+    ostringstream stream;
+    stream.precision(17);
+    stream << value;
+    bind(i, stream.str());
+}
+
+bool PreparedStatement::isPointLookup() {
+    return point_lookup;
+}
+
+int PreparedStatement::getColumnIndex(const string & column_name) {
+    for (unsigned i = 0; i < column_names.size(); i++) {
+        if (column_names[i] == column_name) {
+            return i;
+        }
+    }
+    throw std::invalid_argument("There is no column with the name \"" + column_name + "\" in the results of the statement");
+}
+
+#endif //PREPAREDSTATEMENT_H
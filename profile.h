@@ -0,0 +1,286 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include "operators.h"
+
+using namespace std;
+
+/**
+ * What an operator did while a query ran, as reported by EXPLAIN ANALYZE. The time and the
+ * rows in include the inputs of the operator, its children
+ * e.g.: Filter age > 10 (time=0.52 ms self=0.10 ms rows in=2048 out=12 batches=2)
+ *         Table scan (time=0.42 ms self=0.42 ms rows in=0 out=2048 batches=2 blocks read=2 ...)
+ */
+struct OperatorProfile {
+    string name;
+    double seconds; // the wall time spent on the operator and its children
+    long long batches; // the batches returned
+    long long rows_in; // the rows returned by the children
+    long long rows_out; // the selected rows of the batches returned
+    long long bytes_read; // the bytes of the registries read, only by the table scans
+    long long blocks_read;
+    long long blocks_skipped; // the blocks excluded by the zone maps and bloom filters
+    size_t memory_peak; // the largest number of bytes kept by the operator, e.g.: the sorted records
+    vector<OperatorProfile> children;
+
+    OperatorProfile(string name = "");
+
+    /**
+     * @return the time spent on the operator itself, without its children
+     */
+    double getSelfSeconds() const;
+
+    /**
+     * Add one line for the operator and for each of its children, indented by their depth
+     */
+    void toTree(vector<string> & lines, unsigned depth = 0) const;
+
+    /**
+     * @return e.g.: {"operator": "Filter age > 10", "time_ms": 0.52, ..., "children": [...]}
+     */
+    string toJson() const;
+};
+
+/**
+ * Count the batches and rows returned by an operator and the time it took, e.g.: to profile
+ * the filter of a scan, FilterOperator <- TableScanOperator becomes
+ * ProfileOperator <- FilterOperator <- ProfileOperator <- TableScanOperator
+ */
+class ProfileOperator : public Operator {
+private:
+    Operator * child;
+    vector<ProfileOperator *> inputs; // the profiled children of the child
+    OperatorProfile profile;
+
+public:
+    /**
+     * @param child - the profiled operator
+     * @param name - e.g.: "Filter age > 10"
+     * @param inputs - the ProfileOperators of the children of the profiled operator
+     * @constructor
+     */
+    ProfileOperator(Operator * child, string name, const vector<ProfileOperator *> & inputs);
+
+    bool next(Batch & batch);
+
+    /**
+     * @return the counters of the profiled operator, without its children
+     */
+    OperatorProfile & getProfile();
+
+    /**
+     * @return the counters of the profiled operator and of its children
+     */
+    OperatorProfile getTree() const;
+};
+
+/**
+ * Wrap the operators of a query on ProfileOperators, only if the query is profiled
+ * e.g.:
+ * Profiler profiler(profile != NULL);
+ * Operator * scan = profiler.wrap(&scan_operator, "Table scan");
+ * FilterOperator filter_operator(scan, where);
+ * Operator * filter = profiler.wrap(&filter_operator, "Filter", scan);
+ */
+class Profiler {
+private:
+    bool enabled;
+    vector<ProfileOperator *> operators;
+
+    Profiler(const Profiler &);
+    Profiler & operator=(const Profiler &);
+
+    /**
+     * @return the ProfileOperator returned by Profiler::wrap, or NULL
+     */
+    ProfileOperator * find(Operator * wrapped) const;
+
+public:
+    /**
+     * @param enabled - false to return the operators unchanged
+     * @constructor
+     */
+    Profiler(bool enabled);
+
+    /**
+     * @destructor
+     */
+    ~Profiler();
+
+    bool isEnabled() const;
+
+    /**
+     * @param inputs - the children of the operator, as returned by Profiler::wrap
+     * @return a ProfileOperator of the operator, or the operator itself if not enabled
+     */
+    Operator * wrap(Operator * op, string name, const vector<Operator *> & inputs = vector<Operator *>());
+    Operator * wrap(Operator * op, string name, Operator * input);
+
+    /**
+     * @return the counters of an operator returned by Profiler::wrap, e.g.: to add the blocks
+     *         read by a scan, or NULL if not enabled
+     */
+    OperatorProfile * getProfile(Operator * wrapped);
+
+    /**
+     * @return the counters of the operators from the root to the table scans
+     */
+    OperatorProfile getTree(Operator * root) const;
+
+    /**
+     * @return a wall clock time, in seconds
+     */
+    static double getWallTime();
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+OperatorProfile::OperatorProfile(string name) : name(name), seconds(0), batches(0), rows_in(0), rows_out(0), bytes_read(0),
+                                                blocks_read(0), blocks_skipped(0), memory_peak(0) {
+}
+
+double OperatorProfile::getSelfSeconds() const {
+    //The children of a parallel operator run at the same time, so they may add up to more
+    double children_seconds = 0;
+    for (vector<OperatorProfile>::const_iterator it = children.begin(); it != children.end(); it++) {
+        children_seconds = max(children_seconds, it->seconds);
+    }
+    return max(0.0, seconds - children_seconds);
+}
+
+void OperatorProfile::toTree(vector<string> & lines, unsigned depth) const {
+    ostringstream line;
+    line.setf(ios::fixed);
+    line.precision(3);
+    line << string(2 * depth, ' ') << name << " (time=" << seconds * 1000 << " ms self=" << getSelfSeconds() * 1000
+         << " ms rows in=" << rows_in << " out=" << rows_out << " batches=" << batches;
+    if (blocks_read > 0 || blocks_skipped > 0) {
+        line << " blocks read=" << blocks_read << " skipped=" << blocks_skipped << " bytes read=" << bytes_read;
+    }
+    if (memory_peak > 0) {
+        line << " memory peak=" << memory_peak << " bytes";
+    }
+    line << ")";
+    lines.push_back(line.str());
+
+    for (vector<OperatorProfile>::const_iterator it = children.begin(); it != children.end(); it++) {
+        it->toTree(lines, depth + 1);
+    }
+}
+
+string OperatorProfile::toJson() const {
+    string escaped_name;
+    for (string::const_iterator it = name.begin(); it != name.end(); it++) {
+        if (*it == '"' || *it == '\\') {
+            escaped_name += '\\';
+        }
+        escaped_name += *it;
+    }
+
+    ostringstream json;
+    json.setf(ios::fixed);
+    json.precision(3);
+    json << "{\"operator\": \"" << escaped_name << "\", \"time_ms\": " << seconds * 1000 << ", \"self_time_ms\": "
+         << getSelfSeconds() * 1000 << ", \"batches\": " << batches << ", \"rows_in\": " << rows_in << ", \"rows_out\": "
+         << rows_out << ", \"bytes_read\": " << bytes_read << ", \"blocks_read\": " << blocks_read << ", \"blocks_skipped\": "
+         << blocks_skipped << ", \"memory_peak\": " << memory_peak << ", \"children\": [";
+    for (vector<OperatorProfile>::const_iterator it = children.begin(); it != children.end(); it++) {
+        json << (it != children.begin() ? ", " : "") << it->toJson();
+    }
+    json << "]}";
+    return json.str();
+}
+
+ProfileOperator::ProfileOperator(Operator * child, string name, const vector<ProfileOperator *> & inputs) : profile(name) {
+    this->child = child;
+    this->inputs = inputs;
+}
+
+bool ProfileOperator::next(Batch & batch) {
+    double start = Profiler::getWallTime();
+    bool has_batch = child->next(batch);
+    profile.seconds += Profiler::getWallTime() - start;
+    if (has_batch) {
+        profile.batches++;
+        profile.rows_out += batch.getSelectedCount();
+    }
+    return has_batch;
+}
+
+OperatorProfile & ProfileOperator::getProfile() {
+    return profile;
+}
+
+OperatorProfile ProfileOperator::getTree() const {
+    OperatorProfile tree = profile;
+    for (vector<ProfileOperator *>::const_iterator it = inputs.begin(); it != inputs.end(); it++) {
+        tree.children.push_back((*it)->getTree());
+        tree.rows_in += tree.children.back().rows_out;
+    }
+    return tree;
+}
+
+Profiler::Profiler(bool enabled) {
+    this->enabled = enabled;
+}
+
+Profiler::~Profiler() {
+    for (vector<ProfileOperator *>::iterator it = operators.begin(); it != operators.end(); it++) {
+        delete *it;
+    }
+}
+
+bool Profiler::isEnabled() const {
+    return enabled;
+}
+
+ProfileOperator * Profiler::find(Operator * wrapped) const {
+    for (vector<ProfileOperator *>::const_iterator it = operators.begin(); it != operators.end(); it++) {
+        if (*it == wrapped) {
+            return *it;
+        }
+    }
+    return NULL;
+}
+
+Operator * Profiler::wrap(Operator * op, string name, const vector<Operator *> & inputs) {
+    if (!enabled) {
+        return op;
+    }
+    vector<ProfileOperator *> profiled_inputs;
+    for (vector<Operator *>::const_iterator it = inputs.begin(); it != inputs.end(); it++) {
+        ProfileOperator * input = find(*it);
+        if (input != NULL) {
+            profiled_inputs.push_back(input);
+        }
+    }
+    operators.push_back(new ProfileOperator(op, name, profiled_inputs));
+    return operators.back();
+}
+
+Operator * Profiler::wrap(Operator * op, string name, Operator * input) {
+    return wrap(op, name, vector<Operator *>(1, input));
+}
+
+OperatorProfile * Profiler::getProfile(Operator * wrapped) {
+    ProfileOperator * profile_operator = find(wrapped);
+    return profile_operator == NULL ? NULL : &profile_operator->getProfile();
+}
+
+OperatorProfile Profiler::getTree(Operator * root) const {
+    ProfileOperator * profile_operator = find(root);
+    return profile_operator == NULL ? OperatorProfile() : profile_operator->getTree();
+}
+
+double Profiler::getWallTime() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif //PROFILE_H
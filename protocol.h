@@ -0,0 +1,320 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "cursor.h"
+
+using namespace std;
+
+/**
+ * The messages between a QueryServer and its clients. Each message is a frame: its length
+ * (the type and the payload, 4 bytes), its type (1 byte) and its payload
+ * e.g.: | length | QUERY_MESSAGE | "person" | "" | "SELECT name WHERE _id = 7" |
+ *
+ * The integers are little endian and the strings are their length (4 bytes) followed by
+ * their bytes. A client sends a request and reads its response, and may send the next
+ * requests before that: the responses of a connection come in the order of its requests
+ */
+enum MessageType {
+    QUERY_MESSAGE = 1, // the table, the joined table (empty if none) and the statement
+    PING_MESSAGE = 2,
+    RESULT_MESSAGE = 3, // the rows, serialized by the Cursor
+    ERROR_MESSAGE = 4, // the message of the exception
+    PONG_MESSAGE = 5
+};
+
+const size_t FRAME_LENGTH_SIZE = 4;
+const uint32_t MAX_FRAME_SIZE = 1u << 30; // of the responses, which hold whole results
+const uint32_t MAX_REQUEST_SIZE = 4u << 20; // of the requests read by the server, by default
+
+/**
+ * Append the fields of a message to its frame
+ * e.g.: MessageWriter writer(QUERY_MESSAGE);
+ *       writer.writeString("person");
+ *       sendFrame(fd, writer.finish());
+ */
+class MessageWriter {
+private:
+    string frame;
+
+public:
+    /**
+     * @constructor
+     */
+    MessageWriter(MessageType type);
+
+    void writeUInt8(uint8_t value);
+    void writeUInt32(uint32_t value);
+    void writeUInt64(uint64_t value);
+    void writeString(const string & value);
+    void writeBytes(const void * bytes, size_t size);
+
+    /**
+     * Set the length of the frame
+     * @return the frame, ready to be sent
+     */
+    string & finish();
+};
+
+/**
+ * Read the fields of a message, in the order they were written
+ * @see MessageWriter
+ */
+class MessageReader {
+private:
+    const char * data;
+    size_t size;
+    size_t position;
+
+    /**
+     * @throw invalid_argument if there are less than the bytes left
+     */
+    void require(size_t bytes);
+
+public:
+    /**
+     * @param message - the type and the payload of a frame, without its length
+     * @constructor
+     */
+    MessageReader(const char * message, size_t size);
+    MessageReader(const string & message);
+
+    MessageType readType();
+    uint8_t readUInt8();
+    uint32_t readUInt32();
+    uint64_t readUInt64();
+    string readString();
+
+    /**
+     * @return the next bytes, without copying them. They belong to the message
+     */
+    const char * readBytes(size_t size);
+
+    bool isAtEnd() const;
+};
+
+/**
+ * @return the size of the frame at the start of the bytes (its length included), or 0 if
+ *         they don't hold the whole frame yet
+ * @throw invalid_argument if the frame is empty or its length is larger than max_length
+ */
+size_t getFrameSize(const char * data, size_t size, uint32_t max_length = MAX_FRAME_SIZE);
+
+string encodeQuery(const string & table, const string & joined_table, const string & statement);
+string encodeResult(Cursor & cursor);
+string encodeError(const string & message);
+
+/**
+ * @param message - a RESULT_MESSAGE, moved to the cursor, which reads its rows in place
+ * @see Cursor::deserialize
+ */
+Cursor decodeResult(string & message);
+
+/**
+ * Send a whole frame on a blocking socket
+ * @throw invalid_argument if the connection fails
+ */
+void sendFrame(int fd, const string & frame);
+
+/**
+ * Wait for a whole frame on a blocking socket
+ * @return the message of the frame, without its length
+ * @throw invalid_argument if the connection is closed or fails
+ */
+string receiveFrame(int fd);
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+MessageWriter::MessageWriter(MessageType type) : frame(FRAME_LENGTH_SIZE, '\0') {
+    writeUInt8(type);
+}
+
+void MessageWriter::writeUInt8(uint8_t value) {
+    frame.push_back((char) value);
+}
+
+void MessageWriter::writeUInt32(uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        frame.push_back((char) (value >> (8 * i)));
+    }
+}
+
+void MessageWriter::writeUInt64(uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        frame.push_back((char) (value >> (8 * i)));
+    }
+}
+
+void MessageWriter::writeString(const string & value) {
+    writeUInt32(value.size());
+    frame.append(value);
+}
+
+void MessageWriter::writeBytes(const void * bytes, size_t size) {
+    frame.append((const char *) bytes, size);
+}
+
+string & MessageWriter::finish() {
+    uint32_t length = frame.size() - FRAME_LENGTH_SIZE;
+    for (int i = 0; i < 4; i++) {
+        frame[i] = (char) (length >> (8 * i));
+    }
+    return frame;
+}
+
+MessageReader::MessageReader(const char * message, size_t size) {
+    this->data = message;
+    this->size = size;
+    this->position = 0;
+}
+
+MessageReader::MessageReader(const string & message) {
+    this->data = message.data();
+    this->size = message.size();
+    this->position = 0;
+}
+
+void MessageReader::require(size_t bytes) {
+    if (size - position < bytes) {
+        throw std::invalid_argument("The message is truncated");
+    }
+}
+
+MessageType MessageReader::readType() {
+    return (MessageType) readUInt8();
+}
+
+uint8_t MessageReader::readUInt8() {
+    require(1);
+    return (uint8_t) data[position++];
+}
+
+uint32_t MessageReader::readUInt32() {
+    require(4);
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= (uint32_t) (uint8_t) data[position++] << (8 * i);
+    }
+    return value;
+}
+
+uint64_t MessageReader::readUInt64() {
+    require(8);
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (uint64_t) (uint8_t) data[position++] << (8 * i);
+    }
+    return value;
+}
+
+string MessageReader::readString() {
+    uint32_t length = readUInt32();
+    return string(readBytes(length), length);
+}
+
+const char * MessageReader::readBytes(size_t size) {
+    require(size);
+    const char * bytes = data + position;
+    position += size;
+    return bytes;
+}
+
+bool MessageReader::isAtEnd() const {
+    return position == size;
+}
+
+size_t getFrameSize(const char * data, size_t size, uint32_t max_length) {
+    if (size < FRAME_LENGTH_SIZE) {
+        return 0;
+    }
+    MessageReader reader(data, FRAME_LENGTH_SIZE);
+    uint32_t length = reader.readUInt32();
+    if (length == 0 || length > max_length) {
+        throw std::invalid_argument("Invalid frame length: " + to_string(length));
+    }
+    return size < FRAME_LENGTH_SIZE + length ? 0 : FRAME_LENGTH_SIZE + length;
+}
+
+string encodeQuery(const string & table, const string & joined_table, const string & statement) {
+    MessageWriter writer(QUERY_MESSAGE);
+    writer.writeString(table);
+    writer.writeString(joined_table);
+    writer.writeString(statement);
+    return writer.finish();
+}
+
+string encodeResult(Cursor & cursor) {
+    MessageWriter writer(RESULT_MESSAGE);
+    string rows = cursor.serialize();
+    writer.writeBytes(rows.data(), rows.size());
+    return writer.finish();
+}
+
+string encodeError(const string & message) {
+    MessageWriter writer(ERROR_MESSAGE);
+    writer.writeString(message);
+    return writer.finish();
+}
+
+Cursor decodeResult(string & message) {
+    shared_ptr<string> bytes = make_shared<string>();
+    bytes->swap(message);
+    return Cursor::deserialize(bytes, 1);
+}
+
+void sendFrame(int fd, const string & frame) {
+    size_t sent = 0;
+    while (sent < frame.size()) {
+        ssize_t count = send(fd, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::invalid_argument(string("Unable to send the message: ") + strerror(errno));
+        }
+        sent += count;
+    }
+}
+
+string receiveFrame(int fd) {
+    string frame;
+    size_t frame_size = 0;
+    char buffer[64 * 1024];
+    while (frame_size == 0 || frame.size() < frame_size) {
+        //Read the length first, then no further than the frame, the next one may follow
+        size_t wanted = frame_size == 0 ? FRAME_LENGTH_SIZE - frame.size() : min(sizeof(buffer), frame_size - frame.size());
+        ssize_t count = recv(fd, buffer, wanted, 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            throw std::invalid_argument(string("Unable to receive the message: ") + strerror(errno));
+        }
+        if (count == 0) {
+            throw std::invalid_argument("The connection was closed");
+        }
+        frame.append(buffer, count);
+        if (frame_size == 0 && frame.size() == FRAME_LENGTH_SIZE) {
+            MessageReader reader(frame);
+            uint32_t length = reader.readUInt32();
+            if (length == 0 || length > MAX_FRAME_SIZE) {
+                throw std::invalid_argument("Invalid frame length: " + to_string(length));
+            }
+            frame_size = FRAME_LENGTH_SIZE + length;
+            frame.reserve(frame_size);
+        }
+    }
+    return frame.substr(FRAME_LENGTH_SIZE);
+}
+
+#endif //PROTOCOL_H
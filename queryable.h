@@ -2,6 +2,8 @@
 #define QUERYABLE_H
 
 #include "schema.h"
+#include "batch.h"
+#include "predicate.h"
 
 /**
  * Stores the header of a registry. The header is saved for each registry
@@ -28,13 +30,72 @@ struct HeaderFile {
 
 typedef vector<pair<decltype(HeaderFile::_id), decltype(HeaderFile::registry_position)> > header_t;
 
+/**
+ * The rows of a table are grouped in blocks of ROWS_PER_BLOCK consecutive registries
+ * (following the header order), e.g.: the block 1 holds the rows header->at(1024) to
+ * header->at(2047). Per-block metadata (e.g.: bloom filters) allows a scan to skip whole
+ * blocks without reading them
+ */
+const long long ROWS_PER_BLOCK = 1024;
+
 
 class Queryable {
 public:
   virtual vector<string> getRow(long long registry_position) =0;
   virtual vector<string> getRowById(long long _id) =0;
+
+  /**
+   * Read the rows of many registries at once, e.g.: the rows matched by a join
+   * @param registry_positions - in any order, repeated positions included
+   * @return the rows, in the same order as the positions
+   */
+  virtual vector<vector<string> > getRows(const vector<long long> & registry_positions) =0;
   virtual Schema getSchema() =0;
   virtual header_t* getHeader() =0;
+
+  /**
+   * @return the number of blocks of ROWS_PER_BLOCK rows
+   */
+  virtual long long getNumberOfBlocks() =0;
+
+  /**
+   * Read all the rows of a block
+   * @param rows - filled with the rows of the block, in the header order
+   * @param positions - filled with the registry position of each row
+   */
+  virtual void readBlock(long long block, vector<vector<string> > & rows, vector<long long> & positions) =0;
+
+  /**
+   * Read all the rows of a block, column by column
+   * @param batch - filled with the rows of the block, in the header order
+   */
+  virtual void readBlock(long long block, Batch & batch) =0;
+
+  /**
+   * Read several blocks with their reads submitted together, e.g.: the blocks a scan reads
+   * ahead, so the disk works on all of them at once
+   * @param batches - resized to the number of blocks, each one filled like readBlock
+   */
+  virtual void readBlocks(const vector<long long> & blocks, vector<Batch> & batches) =0;
+
+  /**
+   * Read the rows with the given ids (the position of the rows on the header)
+   * @param row_ids - the ids, in ascending order
+   * @param batch - filled with the rows, in the same order as the ids
+   */
+  virtual void readRows(const vector<uint32_t> & row_ids, Batch & batch) =0;
+
+  /**
+   * @return false if no row of the block has any of the values on the column. A true
+   *         result may be a false positive
+   */
+  virtual bool blockMayContain(int column_position, long long block, const vector<string> & values) =0;
+
+  /**
+   * @return false if no row of the block can match the predicate, e.g.: from the bloom
+   *         filters or the zone maps. A true result may be a false positive
+   */
+  virtual bool blockMayMatch(long long block, const Predicate & predicate) =0;
 };
 
 #endif 
\ No newline at end of file
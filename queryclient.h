@@ -0,0 +1,171 @@
+#ifndef QUERYCLIENT_H
+#define QUERYCLIENT_H
+
+#include <string>
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "protocol.h"
+
+using namespace std;
+
+/**
+ * A connection to a QueryServer. It only needs protocol.h and cursor.h, not the tables
+ * e.g.: QueryClient client;
+ *       client.connectUnix("query_server.sock");
+ *       Cursor cursor = client.query("person", "SELECT name WHERE _id = 7");
+ *
+ * The calls block until the server responds. A client is used by one thread at a time, the
+ * threads of a process each open their own
+ * @see QueryServer
+ */
+class QueryClient {
+private:
+    int fd;
+
+    QueryClient(const QueryClient &);
+    QueryClient & operator=(const QueryClient &);
+
+    void connectTo(int fd, const sockaddr * address, socklen_t address_size);
+
+    /**
+     * Send a request and wait for its response
+     * @throw invalid_argument with the message of the server if it responds with an error
+     */
+    string request(const string & frame, MessageType response_type);
+
+public:
+    /**
+     * @constructor
+     */
+    QueryClient();
+
+    /**
+     * Close the connection
+     * @destructor
+     */
+    ~QueryClient();
+
+    /**
+     * @throw invalid_argument if the server can't be reached
+     */
+    void connectUnix(const string & path);
+
+    /**
+     * @param host - an IPv4 address, e.g.: 127.0.0.1
+     * @throw invalid_argument if the server can't be reached
+     */
+    void connectTcp(const string & host, int port);
+
+    /**
+     * Run a query on a table of the server
+     * @param joined_table - the name of the table of a JOIN, if any
+     * @throw invalid_argument if the query fails on the server, or the connection fails
+     * @see Table::query
+     */
+    Cursor query(const string & table, const string & statement, const string & joined_table = "");
+
+    /**
+     * Wait for the server to respond, e.g.: to measure the round trip of a request
+     */
+    void ping();
+
+    void close();
+    bool isConnected();
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+QueryClient::QueryClient() {
+    this->fd = -1;
+}
+
+QueryClient::~QueryClient() {
+    close();
+}
+
+void QueryClient::connectTo(int fd, const sockaddr * address, socklen_t address_size) {
+    if (fd < 0) {
+        throw std::invalid_argument(string("Unable to create the socket: ") + strerror(errno));
+    }
+    close();
+    if (connect(fd, address, address_size) < 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::invalid_argument(string("Unable to connect to the server: ") + strerror(error));
+    }
+    this->fd = fd;
+}
+
+void QueryClient::connectUnix(const string & path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("The path of the socket is too long: " + path);
+    }
+    strcpy(address.sun_path, path.c_str());
+    connectTo(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0), (sockaddr *) &address, sizeof(address));
+}
+
+void QueryClient::connectTcp(const string & host, int port) {
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+        throw std::invalid_argument("Invalid IPv4 address: " + host);
+    }
+    connectTo(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0), (sockaddr *) &address, sizeof(address));
+
+    //The requests are small and each one waits for its response
+    int no_delay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+}
+
+string QueryClient::request(const string & frame, MessageType response_type) {
+    if (fd < 0) {
+        throw std::invalid_argument("The client is not connected");
+    }
+    sendFrame(fd, frame);
+    string response = receiveFrame(fd);
+    MessageReader reader(response);
+    MessageType type = reader.readType();
+    if (type == ERROR_MESSAGE) {
+        throw std::invalid_argument(reader.readString());
+    }
+    if (type != response_type) {
+        throw std::invalid_argument("Unexpected response type: " + to_string((int) type));
+    }
+    return response;
+}
+
+Cursor QueryClient::query(const string & table, const string & statement, const string & joined_table) {
+    string response = request(encodeQuery(table, joined_table, statement), RESULT_MESSAGE);
+    return decodeResult(response);
+}
+
+void QueryClient::ping() {
+    request(MessageWriter(PING_MESSAGE).finish(), PONG_MESSAGE);
+}
+
+void QueryClient::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool QueryClient::isConnected() {
+    return fd >= 0;
+}
+
+#endif //QUERYCLIENT_H
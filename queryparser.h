@@ -0,0 +1,696 @@
+#ifndef QUERYPARSER_H
+#define QUERYPARSER_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <ctype.h>
+#include "predicate.h"
+
+using namespace std;
+
+/*****************************************
+ *************** TOKENIZER ***************
+ *****************************************/
+
+enum TokenType { IDENTIFIER_TOKEN, NUMBER_TOKEN, STRING_TOKEN, SYMBOL_TOKEN, END_TOKEN };
+
+/**
+ * A word of a query. The identifiers (keywords included) are case insensitive and stored
+ * in lower case, the quoted literals keep their case and are stored without the quotes
+ */
+struct Token {
+    TokenType type;
+    string text;
+    size_t position; // on the query string, for the error messages
+
+    Token(TokenType type, string text, size_t position);
+};
+
+/**
+ * Split a query into tokens:
+ * - identifiers: letters, digits and _, starting by a letter or _, e.g.: company_id
+ * - numbers, with an optional sign and decimal point, e.g.: -1.5
+ * - string literals between single quotes, where '' is a quote, e.g.: 'Bruno''s'
+ * - symbols: ( ) , . * = != <> < <= > >= and ?, the parameters of a prepared statement
+ * The last token is always an END_TOKEN
+ */
+class QueryTokenizer {
+public:
+    /**
+     * @throw invalid_argument on an unexpected character or an unterminated literal
+     */
+    static vector<Token> tokenize(const string & query);
+
+    /**
+     * Write the tokens back as a query, with one space between the tokens, so queries
+     * differing only on spaces or on the case of the keywords have the same text
+     * e.g.: "select  NAME where age>10" -> "select name where age > 10"
+     */
+    static string normalize(const vector<Token> & tokens);
+};
+
+/*****************************************
+ ****************** AST ******************
+ *****************************************/
+
+/**
+ * The JOIN ... ON clause: JOIN table ON left_column = right_column, where the right
+ * column is the one qualified by the joined table name, e.g.:
+ * JOIN company ON company_id = company._id -> { "company", "company_id", "company._id" }
+ */
+struct JoinClause {
+    string table;
+    string left_column;
+    string right_column;
+};
+
+/**
+ * A parsed SELECT. The FROM is omitted because the query runs on a table instance
+ * e.g.: SELECT name, count(*) WHERE age > 10 AND NOT name IN ('Bruno', 'Ana') GROUP BY name
+ *       ORDER BY count(*) DESC LIMIT 10
+ * -> select: {"name", "count(*)"}
+ *    where: AND(age > 10, NOT(name IN {Bruno, Ana}))
+ *    group_by: {"name"}, order_by: {"count(*) desc"}, limit: 10
+ */
+struct SelectStatement {
+    bool explain; // EXPLAIN SELECT ...: describe the plan instead of running the query
+    bool explain_analyze; // EXPLAIN ANALYZE SELECT ...: run the query and describe what each operator did
+    bool explain_json; // EXPLAIN ANALYZE FORMAT JSON SELECT ...: the description as a JSON document
+    vector<string> select; // columns, * or aggregates like "sum(points)". Empty is the same as *
+    bool has_join;
+    JoinClause join;
+    Expression where; // not bound
+    vector<string> group_by;
+    vector<string> order_by; // a column or a select item, followed by " desc" when descending
+    long long limit; // -1 if there is no LIMIT
+    long long offset;
+
+    // The place of each ? on the WHERE, in the query order: the child indexes from the
+    // root of the expression followed by the index of the predicate value
+    vector<vector<unsigned> > parameters;
+
+    SelectStatement();
+
+    /**
+     * Replace the value of the i-th ? of the WHERE
+     * @throw out_of_range if there are not i + 1 parameters
+     */
+    void setParameter(unsigned i, const string & value);
+};
+
+/*****************************************
+ **************** PARSER *****************
+ *****************************************/
+
+/**
+ * Recursive descent parser of the query grammar:
+ *
+ * statement   := [EXPLAIN [ANALYZE [FORMAT (TREE | JSON)]]] SELECT select_list [JOIN identifier ON column = column] [WHERE or_expr]
+ *                [GROUP BY column {, column}] [ORDER BY order_item {, order_item}]
+ *                [LIMIT number [OFFSET number]]
+ * select_list := select_item {, select_item}
+ * select_item := * | column | identifier ( * | column )
+ * or_expr     := and_expr {OR and_expr}
+ * and_expr    := not_expr {AND not_expr}
+ * not_expr    := NOT not_expr | ( or_expr ) | column condition
+ * condition   := comparator value | [NOT] IN ( value {, value} ) | [NOT] BETWEEN value AND value
+ *              | [NOT] LIKE value
+ * order_item  := (column | select_item) [ASC | DESC]
+ * column      := identifier [. identifier]
+ * value       := number | string | identifier | ?
+ *
+ * e.g.: SelectStatement statement = QueryParser("SELECT * WHERE _id = 10").parse();
+ */
+class QueryParser {
+private:
+    vector<Token> tokens;
+    size_t position;
+    vector<bool> parameter_values; // true for each value of the WHERE that is a ?, in order
+
+    const Token & peek() const;
+    Token advance();
+
+    /**
+     * @return true, and move to the next token, if the current one is the keyword or symbol
+     */
+    bool accept(const string & text);
+
+    /**
+     * @throw invalid_argument if the current token isn't the keyword or symbol
+     */
+    void expect(const string & text);
+
+    /**
+     * @throw invalid_argument with the position and the text of the current token
+     */
+    void fail(const string & expected) const;
+
+    /**
+     * @return true if the current token is a reserved word, so it isn't a column
+     */
+    bool atKeyword() const;
+
+    static bool isComparator(const string & symbol);
+
+    string parseColumn();
+    string parseSelectItem();
+    string parseValue();
+    long long parseCount();
+    Expression parseOr();
+    Expression parseAnd();
+    Expression parseNot();
+    Expression parseCondition();
+
+    /**
+     * Push the path of the ? values of the expression, visiting the values in the query order
+     * @param value - the number of values visited so far
+     */
+    void findParameters(const Expression & expression, vector<unsigned> & path, size_t & value,
+                        vector<vector<unsigned> > & parameters) const;
+
+public:
+    /**
+     * @throw invalid_argument if the query can't be tokenized
+     * @constructor
+     */
+    QueryParser(const string & query);
+
+    /**
+     * @constructor
+     */
+    QueryParser(const vector<Token> & tokens);
+
+    /**
+     * @throw invalid_argument if the query doesn't follow the grammar
+     */
+    SelectStatement parse();
+};
+
+Token::Token(TokenType type, string text, size_t position) : type(type), text(text), position(position) {
+}
+
+vector<Token> QueryTokenizer::tokenize(const string & query) {
+    vector<Token> tokens;
+    size_t i = 0;
+    while (i < query.size()) {
+        char character = query[i];
+        size_t start = i;
+
+        if (isspace(character)) {
+            i++;
+
+        } else if (isalpha(character) || character == '_') {
+            while (i < query.size() && (isalnum(query[i]) || query[i] == '_')) {
+                i++;
+            }
+            string word = query.substr(start, i - start);
+            transform(word.begin(), word.end(), word.begin(), ::tolower);
+            tokens.push_back(Token(IDENTIFIER_TOKEN, word, start));
+
+        } else if (isdigit(character) || ((character == '-' || character == '.') && i + 1 < query.size() &&
+                                          (isdigit(query[i + 1]) || query[i + 1] == '.'))) {
+            i++;
+            while (i < query.size() && (isdigit(query[i]) || query[i] == '.')) {
+                i++;
+            }
+            tokens.push_back(Token(NUMBER_TOKEN, query.substr(start, i - start), start));
+
+        } else if (character == '\'') {
+            string literal;
+            i++;
+            while (true) {
+                if (i >= query.size()) {
+                    throw std::invalid_argument("Unterminated string at position " + to_string(start));
+                }
+                if (query[i] == '\'') {
+                    if (i + 1 < query.size() && query[i + 1] == '\'') {
+                        literal += '\'';
+                        i += 2;
+                        continue;
+                    }
+                    i++;
+                    break;
+                }
+                literal += query[i++];
+            }
+            tokens.push_back(Token(STRING_TOKEN, literal, start));
+
+        } else {
+            string symbol(1, character);
+            if (i + 1 < query.size()) {
+                string pair = query.substr(i, 2);
+                if (pair == "!=" || pair == "<>" || pair == "<=" || pair == ">=") {
+                    symbol = pair;
+                }
+            }
+            if (symbol.size() == 1 && string("(),.*=<>?").find(character) == string::npos) {
+                throw std::invalid_argument("Unexpected character '" + symbol + "' at position " + to_string(start));
+            }
+            i += symbol.size();
+            tokens.push_back(Token(SYMBOL_TOKEN, symbol, start));
+        }
+    }
+    tokens.push_back(Token(END_TOKEN, "", query.size()));
+    return tokens;
+}
+
+string QueryTokenizer::normalize(const vector<Token> & tokens) {
+    string query;
+    for (vector<Token>::const_iterator it = tokens.begin(); it != tokens.end() && it->type != END_TOKEN; it++) {
+        if (!query.empty()) {
+            query += ' ';
+        }
+        if (it->type == STRING_TOKEN) {
+            query += '\'';
+            for (string::const_iterator character = it->text.begin(); character != it->text.end(); character++) {
+                query += *character == '\'' ? "''" : string(1, *character);
+            }
+            query += '\'';
+        } else {
+            query += it->text;
+        }
+    }
+    return query;
+}
+
+SelectStatement::SelectStatement() : explain(false), explain_analyze(false), explain_json(false), has_join(false), limit(-1), offset(0) {
+}
+
+void SelectStatement::setParameter(unsigned i, const string & value) {
+    const vector<unsigned> & path = parameters.at(i);
+    Expression * expression = &where;
+    for (size_t j = 0; j + 1 < path.size(); j++) {
+        expression = &expression->children[path[j]];
+    }
+    expression->predicate.values[path.back()] = value;
+}
+
+QueryParser::QueryParser(const string & query) {
+    this->tokens = QueryTokenizer::tokenize(query);
+    this->position = 0;
+}
+
+QueryParser::QueryParser(const vector<Token> & tokens) {
+    this->tokens = tokens;
+    this->position = 0;
+}
+
+const Token & QueryParser::peek() const {
+    return tokens[position];
+}
+
+Token QueryParser::advance() {
+    Token token = tokens[position];
+    if (token.type != END_TOKEN) {
+        position++;
+    }
+    return token;
+}
+
+bool QueryParser::accept(const string & text) {
+    const Token & token = peek();
+    if ((token.type == IDENTIFIER_TOKEN || token.type == SYMBOL_TOKEN) && token.text == text) {
+        advance();
+        return true;
+    }
+    return false;
+}
+
+void QueryParser::expect(const string & text) {
+    if (!accept(text)) {
+        fail("\"" + text + "\"");
+    }
+}
+
+void QueryParser::fail(const string & expected) const {
+    const Token & token = peek();
+    string found = token.type == END_TOKEN ? "the end of the query" : "\"" + token.text + "\"";
+    throw std::invalid_argument("Syntax error at position " + to_string(token.position) + ": expected " + expected +
+                                ", found " + found);
+}
+
+bool QueryParser::atKeyword() const {
+    static const char * keywords[] = {"explain", "select", "join", "on", "where", "group", "order", "by", "limit", "offset",
+                                      "and", "or", "not", "in", "between", "like", "asc", "desc"};
+    const Token & token = peek();
+    if (token.type != IDENTIFIER_TOKEN) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        if (token.text == keywords[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool QueryParser::isComparator(const string & symbol) {
+    return symbol == "=" || symbol == "!=" || symbol == "<>" || symbol == "<" || symbol == "<=" || symbol == ">" || symbol == ">=";
+}
+
+SelectStatement QueryParser::parse() {
+    SelectStatement statement;
+
+    statement.explain = accept("explain");
+    statement.explain_analyze = statement.explain && accept("analyze");
+    if (statement.explain_analyze && accept("format")) {
+        statement.explain_json = accept("json");
+        if (!statement.explain_json && !accept("tree")) {
+            fail("TREE or JSON");
+        }
+    }
+    expect("select");
+    do {
+        statement.select.push_back(parseSelectItem());
+    } while (accept(","));
+
+    if (accept("join")) {
+        if (peek().type != IDENTIFIER_TOKEN || atKeyword()) {
+            fail("a table name");
+        }
+        statement.has_join = true;
+        statement.join.table = advance().text;
+        expect("on");
+        string first = parseColumn();
+        expect("=");
+        string second = parseColumn();
+
+        //The right column is the one of the joined table
+        if (first.compare(0, statement.join.table.size() + 1, statement.join.table + ".") == 0) {
+            swap(first, second);
+        }
+        statement.join.left_column = first;
+        statement.join.right_column = second;
+    }
+
+    if (accept("where")) {
+        statement.where = parseOr();
+        vector<unsigned> path;
+        size_t value = 0;
+        findParameters(statement.where, path, value, statement.parameters);
+    }
+
+    if (accept("group")) {
+        expect("by");
+        do {
+            statement.group_by.push_back(parseColumn());
+        } while (accept(","));
+    }
+
+    if (accept("order")) {
+        expect("by");
+        do {
+            string item = parseSelectItem();
+            if (accept("desc")) {
+                item += " desc";
+            } else {
+                accept("asc");
+            }
+            statement.order_by.push_back(item);
+        } while (accept(","));
+    }
+
+    if (accept("limit")) {
+        statement.limit = parseCount();
+        if (accept("offset")) {
+            statement.offset = parseCount();
+        }
+    }
+
+    if (peek().type != END_TOKEN) {
+        fail("the end of the query");
+    }
+    return statement;
+}
+
+string QueryParser::parseColumn() {
+    if (peek().type != IDENTIFIER_TOKEN || atKeyword()) {
+        fail("a column");
+    }
+    string column = advance().text;
+    if (accept(".")) {
+        if (peek().type != IDENTIFIER_TOKEN) {
+            fail("a column");
+        }
+        column += "." + advance().text;
+    }
+    return column;
+}
+
+string QueryParser::parseSelectItem() {
+    if (accept("*")) {
+        return "*";
+    }
+    string column = parseColumn();
+    if (!accept("(")) {
+        return column;
+    }
+    //An aggregate, e.g.: count(*) or sum(points)
+    string argument = accept("*") ? "*" : parseColumn();
+    expect(")");
+    return column + "(" + argument + ")";
+}
+
+string QueryParser::parseValue() {
+    const Token & token = peek();
+    if (token.type == NUMBER_TOKEN || token.type == STRING_TOKEN || (token.type == IDENTIFIER_TOKEN && !atKeyword())) {
+        parameter_values.push_back(false);
+        return advance().text;
+    }
+    if (accept("?")) {
+        parameter_values.push_back(true);
+        return "?";
+    }
+    fail("a value");
+    return "";
+}
+
+void QueryParser::findParameters(const Expression & expression, vector<unsigned> & path, size_t & value,
+                                 vector<vector<unsigned> > & parameters) const {
+    if (expression.type == PREDICATE_EXPRESSION) {
+        for (unsigned i = 0; i < expression.predicate.values.size(); i++, value++) {
+            if (parameter_values[value]) {
+                parameters.push_back(path);
+                parameters.back().push_back(i);
+            }
+        }
+    }
+    for (unsigned i = 0; i < expression.children.size(); i++) {
+        path.push_back(i);
+        findParameters(expression.children[i], path, value, parameters);
+        path.pop_back();
+    }
+}
+
+long long QueryParser::parseCount() {
+    if (peek().type != NUMBER_TOKEN || peek().text.find_first_not_of("0123456789") != string::npos) {
+        fail("a non negative integer");
+    }
+    return atoll(advance().text.c_str());
+}
+
+Expression QueryParser::parseOr() {
+    vector<Expression> children;
+    children.push_back(parseAnd());
+    while (accept("or")) {
+        children.push_back(parseAnd());
+    }
+    return children.size() == 1 ? children[0] : Expression(OR_EXPRESSION, children);
+}
+
+Expression QueryParser::parseAnd() {
+    vector<Expression> children;
+    children.push_back(parseNot());
+    while (accept("and")) {
+        children.push_back(parseNot());
+    }
+    return children.size() == 1 ? children[0] : Expression(AND_EXPRESSION, children);
+}
+
+Expression QueryParser::parseNot() {
+    if (accept("not")) {
+        return Expression(NOT_EXPRESSION, vector<Expression>(1, parseNot()));
+    }
+    if (accept("(")) {
+        Expression expression = parseOr();
+        expect(")");
+        return expression;
+    }
+    return parseCondition();
+}
+
+Expression QueryParser::parseCondition() {
+    string column = parseColumn();
+    bool negated = accept("not");
+
+    Expression condition;
+    if (accept("in")) {
+        expect("(");
+        vector<string> values;
+        do {
+            values.push_back(parseValue());
+        } while (accept(","));
+        expect(")");
+        condition = Expression(Predicate(column, IN, values));
+
+    } else if (accept("between")) {
+        //BETWEEN low AND high is the same as >= low AND <= high
+        vector<Expression> bounds;
+        bounds.push_back(Expression(Predicate(column, GREATER_EQUAL, parseValue())));
+        expect("and");
+        bounds.push_back(Expression(Predicate(column, LESS_EQUAL, parseValue())));
+        condition = Expression(AND_EXPRESSION, bounds);
+
+    } else if (accept("like")) {
+        condition = Expression(Predicate(column, LIKE, parseValue()));
+
+    } else if (!negated && peek().type == SYMBOL_TOKEN && isComparator(peek().text)) {
+        Comparator comparator = Predicate::parseComparator(advance().text);
+        condition = Expression(Predicate(column, comparator, parseValue()));
+
+    } else {
+        fail(negated ? "IN, BETWEEN or LIKE" : "a comparison");
+    }
+
+    return negated ? Expression(NOT_EXPRESSION, vector<Expression>(1, condition)) : condition;
+}
+
+/*****************************************
+ ************ STATEMENT CACHE ************
+ *****************************************/
+
+/**
+ * The parsed statements of the last queries, so running the same query again doesn't
+ * parse it. A query is first looked up by its text and then by its normalized text,
+ * e.g.: "SELECT * WHERE _id=1" and "select * where _id = 1" share the statement
+ *
+ * When the cache is full, the least recently used text is evicted.
+ *
+ * The cache is shared by the threads querying a table, so the map is guarded by a mutex.
+ * A query is parsed outside the lock, two threads may parse the same text at once
+ * @see QueryTokenizer::normalize
+ */
+class StatementCache {
+private:
+    struct Entry {
+        SelectStatement statement;
+        list<string>::iterator recency; // the place of the text on the recency list
+    };
+
+    size_t capacity;
+    unordered_map<string, Entry> statements; // query text -> statement
+    list<string> recency; // the query texts, the most recently used first
+    long long hits;
+    long long misses;
+    mutex statements_mutex;
+
+public:
+    static const size_t DEFAULT_CAPACITY = 1024;
+
+    /**
+     * @param capacity - the number of texts kept
+     * @constructor
+     */
+    StatementCache(size_t capacity = DEFAULT_CAPACITY);
+
+    /**
+     * @throw invalid_argument if the query is not in the cache and is not valid
+     * @return the parsed query
+     */
+    SelectStatement get(const string & query);
+
+    long long getHits();
+    long long getMisses();
+
+private:
+    /**
+     * Called with the statements_mutex locked
+     * @return the statement of the text, moved to the front of the recency list, or NULL
+     */
+    const SelectStatement * find(const string & query);
+
+    /**
+     * Called with the statements_mutex locked
+     */
+    void put(const string & query, const SelectStatement & statement);
+};
+
+StatementCache::StatementCache(size_t capacity) {
+    this->capacity = max((size_t) 1, capacity);
+    this->hits = 0;
+    this->misses = 0;
+}
+
+SelectStatement StatementCache::get(const string & query) {
+    {
+        unique_lock<mutex> lock(statements_mutex);
+        const SelectStatement * statement = find(query);
+        if (statement != NULL) {
+            hits++;
+            return *statement;
+        }
+    }
+
+    vector<Token> tokens = QueryTokenizer::tokenize(query);
+    string normalized = QueryTokenizer::normalize(tokens);
+    {
+        unique_lock<mutex> lock(statements_mutex);
+        const SelectStatement * found = find(normalized);
+        if (found != NULL) {
+            hits++;
+            SelectStatement statement = *found;
+            put(query, statement);
+            return statement;
+        }
+        misses++;
+    }
+
+    SelectStatement statement = QueryParser(tokens).parse();
+    unique_lock<mutex> lock(statements_mutex);
+    put(normalized, statement);
+    put(query, statement);
+    return statement;
+}
+
+const SelectStatement * StatementCache::find(const string & query) {
+    unordered_map<string, Entry>::iterator it = statements.find(query);
+    if (it == statements.end()) {
+        return NULL;
+    }
+    recency.splice(recency.begin(), recency, it->second.recency);
+    return &it->second.statement;
+}
+
+void StatementCache::put(const string & query, const SelectStatement & statement) {
+    unordered_map<string, Entry>::iterator it = statements.find(query);
+    if (it != statements.end()) {
+        it->second.statement = statement;
+        recency.splice(recency.begin(), recency, it->second.recency);
+        return;
+    }
+    if (statements.size() >= capacity) {
+        statements.erase(recency.back());
+        recency.pop_back();
+    }
+    recency.push_front(query);
+    Entry & entry = statements[query];
+    entry.statement = statement;
+    entry.recency = recency.begin();
+}
+
+long long StatementCache::getHits() {
+    unique_lock<mutex> lock(statements_mutex);
+    return hits;
+}
+
+long long StatementCache::getMisses() {
+    unique_lock<mutex> lock(statements_mutex);
+    return misses;
+}
+
+#endif //QUERYPARSER_H
@@ -0,0 +1,554 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <stdexcept>
+#include <exception>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "table.h"
+#include "protocol.h"
+
+using namespace std;
+
+/**
+ * Serve the queries of other processes on the tables of this one, so the tables are opened
+ * once: their headers, indexes and caches are shared by all the clients instead of loaded by
+ * each of them. The clients connect to a Unix socket or a loopback TCP port and send the
+ * messages of protocol.h
+ * e.g.: QueryServer server;
+ *       server.addTable("person", &person_table);
+ *       server.listenUnix("query_server.sock");
+ *       server.start();
+ *
+ * A single thread runs an epoll event loop: it accepts the connections, reads their requests
+ * and writes their responses without blocking. The queries run on the shared ThreadPool
+ * (Table::queryAsync), and their responses are handed back to the loop. Each connection has a
+ * single query running at a time: the loop stops reading a connection while its query runs, so
+ * a client sending faster than its queries run is held back by its socket
+ * @see QueryClient
+ */
+class QueryServer {
+private:
+    struct Connection {
+        int fd;
+        string input; // the bytes read, compacted once the frames of a read are handled
+        size_t input_handled; // the bytes of the frames handled, at the start of the input
+        string output; // the bytes of the responses, not sent yet
+        size_t output_sent;
+        bool busy; // a query of the connection is running
+        bool closed; // by the client: closed once the responses of its requests are sent
+        bool broken; // the socket failed: closed at once, the responses are dropped
+        uint32_t events; // the epoll events of the connection
+
+        Connection() : fd(-1), input_handled(0), output_sent(0), busy(false), closed(false), broken(false), events(0) {}
+    };
+
+    //The epoll data of the event fd and of the listening sockets, the connections come after
+    static const uint64_t WAKE_UP_EVENT = 0;
+    static const uint64_t FIRST_CONNECTION_EVENT = 1 << 16;
+
+    map<string, Table *> tables;
+    int epoll_fd;
+    int wake_up_fd; // an eventfd, written when a response is ready or the server stops
+    vector<int> listening_fds;
+    vector<string> socket_paths; // removed when the server is destroyed
+    map<uint64_t, Connection> connections;
+    uint64_t next_connection;
+
+    thread loop;
+    atomic<bool> stopping;
+    exception_ptr loop_error; // the error that stopped the loop, rethrown by stop
+    mutex responses_mutex;
+    condition_variable queries_done;
+    vector<pair<uint64_t, string> > responses; // by connection, handed over by the queries
+    unsigned running_queries;
+    atomic<long long> queries_served;
+    uint32_t max_request_size;
+
+    QueryServer(const QueryServer &);
+    QueryServer & operator=(const QueryServer &);
+
+    /**
+     * Add a socket to the epoll instance
+     */
+    void watch(int fd, uint64_t event_data, uint32_t events);
+
+    void listenOn(int fd, const sockaddr * address, socklen_t address_size);
+
+    /**
+     * Run the event loop until the server stops, keeping the error that stops it earlier
+     */
+    void run();
+    void serve();
+    void accept(int listening_fd);
+    void read(Connection & connection);
+    void write(Connection & connection);
+
+    /**
+     * Handle the next request of a connection, if it's complete and the connection is idle
+     */
+    void dispatch(uint64_t id, Connection & connection);
+
+    /**
+     * Hand the response of a query over to the loop thread, from the thread running the query
+     */
+    void respond(uint64_t id, const string & response);
+
+    /**
+     * Watch the connection for reading (unless it's busy) and for writing (if there are bytes
+     * not sent yet), or close it if the client is gone. A query still running then responds
+     * to a connection that no longer exists, and its response is dropped
+     */
+    void update(uint64_t id, Connection & connection);
+
+    void close(uint64_t id);
+
+public:
+    static const int LISTEN_BACKLOG = 128;
+
+    /**
+     * @throw invalid_argument if the epoll instance can't be created
+     * @constructor
+     */
+    QueryServer();
+
+    /**
+     * Stop the server, then close its sockets. An error of the event loop is only reported
+     * by stop
+     * @destructor
+     */
+    ~QueryServer();
+
+    /**
+     * Serve the queries on a table. The tables are added before the server starts, and must
+     * outlive it
+     */
+    void addTable(const string & name, Table * table);
+
+    /**
+     * Accept the connections on a Unix socket, replacing the file of the path. The sockets
+     * are added before the server starts
+     * @throw invalid_argument if the socket can't be bound, e.g.: the path is too long
+     */
+    void listenUnix(const string & path);
+
+    /**
+     * Set the largest request accepted, MAX_REQUEST_SIZE by default. A connection sending a
+     * larger one gets an error and is closed, before the bytes of the request are read. The
+     * size is set before the server starts
+     */
+    void setMaxRequestSize(uint32_t max_request_size);
+
+    /**
+     * Accept the connections on a TCP port of the loopback interface only
+     * @param port - the port, or 0 for one picked by the system
+     * @throw invalid_argument if the socket can't be bound
+     * @return the port
+     */
+    int listenTcp(int port = 0);
+
+    /**
+     * Run the event loop on a thread of the server
+     */
+    void start();
+
+    /**
+     * Stop the event loop, close the connections and wait for the queries running
+     * @throw invalid_argument if the event loop failed, e.g.: epoll_wait returned an error.
+     *        The loop stops on its first error, without serving the connections anymore
+     */
+    void stop();
+
+    long long getQueriesServed();
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+QueryServer::QueryServer() : stopping(false), queries_served(0) {
+    this->next_connection = FIRST_CONNECTION_EVENT;
+    this->running_queries = 0;
+    this->max_request_size = MAX_REQUEST_SIZE;
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    this->wake_up_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_up_fd < 0) {
+        throw std::invalid_argument(string("Unable to create the event loop: ") + strerror(errno));
+    }
+    watch(wake_up_fd, WAKE_UP_EVENT, EPOLLIN);
+}
+
+QueryServer::~QueryServer() {
+    try {
+        stop();
+    } catch (const exception & e) {
+        //The error of the loop was not asked for, and a destructor can't throw it
+    }
+    for (vector<int>::iterator it = listening_fds.begin(); it != listening_fds.end(); it++) {
+        ::close(*it);
+    }
+    for (vector<string>::iterator it = socket_paths.begin(); it != socket_paths.end(); it++) {
+        unlink(it->c_str());
+    }
+    ::close(wake_up_fd);
+    ::close(epoll_fd);
+}
+
+void QueryServer::addTable(const string & name, Table * table) {
+    tables[name] = table;
+}
+
+void QueryServer::watch(int fd, uint64_t event_data, uint32_t events) {
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.u64 = event_data;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        throw std::invalid_argument(string("Unable to watch the socket: ") + strerror(errno));
+    }
+}
+
+void QueryServer::listenOn(int fd, const sockaddr * address, socklen_t address_size) {
+    if (bind(fd, address, address_size) < 0 || listen(fd, LISTEN_BACKLOG) < 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::invalid_argument(string("Unable to listen on the socket: ") + strerror(error));
+    }
+    listening_fds.push_back(fd);
+    watch(fd, listening_fds.size(), EPOLLIN);
+}
+
+void QueryServer::listenUnix(const string & path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("The path of the socket is too long: " + path);
+    }
+    strcpy(address.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::invalid_argument(string("Unable to create the socket: ") + strerror(errno));
+    }
+    unlink(path.c_str());
+    listenOn(fd, (sockaddr *) &address, sizeof(address));
+    socket_paths.push_back(path);
+}
+
+void QueryServer::setMaxRequestSize(uint32_t max_request_size) {
+    this->max_request_size = max_request_size;
+}
+
+int QueryServer::listenTcp(int port) {
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::invalid_argument(string("Unable to create the socket: ") + strerror(errno));
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    listenOn(fd, (sockaddr *) &address, sizeof(address));
+
+    socklen_t address_size = sizeof(address);
+    getsockname(fd, (sockaddr *) &address, &address_size);
+    return ntohs(address.sin_port);
+}
+
+void QueryServer::start() {
+    stopping = false;
+    loop_error = exception_ptr();
+    loop = thread(&QueryServer::run, this);
+}
+
+void QueryServer::stop() {
+    stopping = true;
+    uint64_t one = 1;
+    if (::write(wake_up_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        throw std::invalid_argument(string("Unable to wake up the event loop: ") + strerror(errno));
+    }
+    if (loop.joinable()) {
+        loop.join();
+    }
+
+    //The queries running hand their responses to the server, so it waits for them
+    unique_lock<mutex> lock(responses_mutex);
+    queries_done.wait(lock, [this]() { return running_queries == 0; });
+    responses.clear();
+    lock.unlock();
+
+    if (loop_error) {
+        exception_ptr error = loop_error;
+        loop_error = exception_ptr();
+        rethrow_exception(error);
+    }
+}
+
+long long QueryServer::getQueriesServed() {
+    return queries_served;
+}
+
+void QueryServer::run() {
+    //An exception leaving the thread would terminate the process
+    try {
+        serve();
+    } catch (...) {
+        loop_error = current_exception();
+    }
+}
+
+void QueryServer::serve() {
+    const int MAX_EVENTS = 64;
+    epoll_event events[MAX_EVENTS];
+    while (!stopping) {
+        int number_of_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (number_of_events < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::invalid_argument(string("Unable to wait for the sockets: ") + strerror(errno));
+        }
+
+        for (int i = 0; i < number_of_events; i++) {
+            uint64_t event_data = events[i].data.u64;
+            if (event_data == WAKE_UP_EVENT) {
+                uint64_t count;
+                while (::read(wake_up_fd, &count, sizeof(count)) > 0) {}
+
+                vector<pair<uint64_t, string> > ready;
+                {
+                    unique_lock<mutex> lock(responses_mutex);
+                    ready.swap(responses);
+                }
+                for (vector<pair<uint64_t, string> >::iterator it = ready.begin(); it != ready.end(); it++) {
+                    map<uint64_t, Connection>::iterator connection = connections.find(it->first);
+                    if (connection == connections.end()) {
+                        continue;
+                    }
+                    connection->second.output.append(it->second);
+                    connection->second.busy = false;
+                    write(connection->second);
+                    dispatch(it->first, connection->second);
+                    update(it->first, connection->second);
+                }
+            } else if (event_data < FIRST_CONNECTION_EVENT) {
+                accept(listening_fds.at(event_data - 1));
+            } else {
+                map<uint64_t, Connection>::iterator connection = connections.find(event_data);
+                if (connection == connections.end()) {
+                    continue;
+                }
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    //The client is gone, its responses can't be sent anymore
+                    connection->second.broken = true;
+                }
+                if (!connection->second.broken && (events[i].events & EPOLLIN)) {
+                    read(connection->second);
+                    dispatch(event_data, connection->second);
+                }
+                if (!connection->second.broken && (events[i].events & EPOLLOUT)) {
+                    write(connection->second);
+                }
+                update(event_data, connection->second);
+            }
+        }
+    }
+
+    vector<uint64_t> open_connections;
+    for (map<uint64_t, Connection>::iterator it = connections.begin(); it != connections.end(); it++) {
+        open_connections.push_back(it->first);
+    }
+    for (vector<uint64_t>::iterator it = open_connections.begin(); it != open_connections.end(); it++) {
+        close(*it);
+    }
+}
+
+void QueryServer::accept(int listening_fd) {
+    while (true) {
+        int fd = accept4(listening_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            //EAGAIN once there are no more connections waiting
+            return;
+        }
+        int no_delay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        uint64_t id = next_connection++;
+        Connection & connection = connections[id];
+        connection.fd = fd;
+        connection.events = EPOLLIN;
+        watch(fd, id, connection.events);
+    }
+}
+
+void QueryServer::read(Connection & connection) {
+    char buffer[64 * 1024];
+    while (true) {
+        ssize_t count = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (count > 0) {
+            connection.input.append(buffer, count);
+            continue;
+        }
+        if (count == 0) {
+            connection.closed = true;
+            return;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            connection.broken = true;
+        }
+        return;
+    }
+}
+
+void QueryServer::write(Connection & connection) {
+    while (connection.output_sent < connection.output.size()) {
+        ssize_t count = send(connection.fd, connection.output.data() + connection.output_sent,
+                             connection.output.size() - connection.output_sent, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                connection.broken = true;
+            }
+            return;
+        }
+        connection.output_sent += count;
+    }
+    connection.output.clear();
+    connection.output_sent = 0;
+}
+
+void QueryServer::dispatch(uint64_t id, Connection & connection) {
+    while (!connection.busy && connection.input_handled < connection.input.size()) {
+        const char * frame = connection.input.data() + connection.input_handled;
+        size_t frame_size;
+        try {
+            frame_size = getFrameSize(frame, connection.input.size() - connection.input_handled, max_request_size);
+        } catch (const exception & e) {
+            //The bytes that follow can't be framed anymore
+            connection.output.append(encodeError(e.what()));
+            connection.input.clear();
+            connection.input_handled = 0;
+            connection.closed = true;
+            return;
+        }
+        if (frame_size == 0) {
+            break;
+        }
+        connection.input_handled += frame_size;
+
+        string response;
+        try {
+            MessageReader reader(frame + FRAME_LENGTH_SIZE, frame_size - FRAME_LENGTH_SIZE);
+            MessageType type = reader.readType();
+            if (type == PING_MESSAGE) {
+                response = MessageWriter(PONG_MESSAGE).finish();
+            } else if (type == QUERY_MESSAGE) {
+                string table_name = reader.readString();
+                string joined_table_name = reader.readString();
+                string statement = reader.readString();
+                map<string, Table *>::iterator table = tables.find(table_name);
+                map<string, Table *>::iterator joined_table = tables.find(joined_table_name);
+                if (table == tables.end()) {
+                    throw std::invalid_argument("There is no table with the name \"" + table_name + "\"");
+                }
+                if (!joined_table_name.empty() && joined_table == tables.end()) {
+                    throw std::invalid_argument("There is no table with the name \"" + joined_table_name + "\"");
+                }
+
+                connection.busy = true;
+                {
+                    unique_lock<mutex> lock(responses_mutex);
+                    running_queries++;
+                }
+                AsyncResult<Cursor> result = table->second->queryAsync(statement, joined_table_name.empty() ? NULL : joined_table->second);
+                result.then([this, id](AsyncResult<Cursor> result) {
+                    try {
+                        Cursor cursor = result.get();
+                        respond(id, encodeResult(cursor));
+                    } catch (const exception & e) {
+                        respond(id, encodeError(e.what()));
+                    }
+                });
+                break;
+            } else {
+                throw std::invalid_argument("Unknown message type: " + to_string((int) type));
+            }
+        } catch (const exception & e) {
+            response = encodeError(e.what());
+        }
+        connection.output.append(response);
+        write(connection);
+    }
+
+    //The frames handled are removed at once, not one by one
+    connection.input.erase(0, connection.input_handled);
+    connection.input_handled = 0;
+}
+
+void QueryServer::respond(uint64_t id, const string & response) {
+    queries_served++;
+    {
+        unique_lock<mutex> lock(responses_mutex);
+        responses.push_back(make_pair(id, response));
+        running_queries--;
+        //Notified with the lock held, the server may be destroyed as soon as it's released
+        queries_done.notify_all();
+        //Fails only if the counter is full, when the loop is woken up already
+        uint64_t one = 1;
+        ssize_t written = ::write(wake_up_fd, &one, sizeof(one));
+        (void) written;
+    }
+}
+
+void QueryServer::update(uint64_t id, Connection & connection) {
+    bool sending = connection.output_sent < connection.output.size();
+    if (connection.broken || (connection.closed && !connection.busy && !sending)) {
+        close(id);
+        return;
+    }
+
+    uint32_t events = (connection.busy || connection.closed ? 0u : (uint32_t) EPOLLIN) | (sending ? (uint32_t) EPOLLOUT : 0u);
+    if (events != connection.events) {
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.u64 = id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+}
+
+void QueryServer::close(uint64_t id) {
+    map<uint64_t, Connection>::iterator connection = connections.find(id);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->second.fd, NULL);
+    ::close(connection->second.fd);
+    connections.erase(connection);
+}
+
+#endif //QUERYSERVER_H
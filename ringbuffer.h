@@ -0,0 +1,315 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <stddef.h>
+
+using namespace std;
+
+/**
+ * The bytes between the indexes of a ring, so they are never on the same cache line. Padding
+ * rather than alignas, since the rings are also allocated with new before C++17
+ */
+const size_t RING_CACHE_LINE = 64;
+
+/**
+ * Wait for a ring without holding a lock: spin first, then yield the thread, then sleep, so a
+ * stage waiting for a slow neighbour doesn't take its core
+ */
+class RingBackoff {
+private:
+    unsigned attempts;
+
+public:
+    RingBackoff() : attempts(0) {}
+
+    void wait();
+};
+
+/**
+ * A bounded lock-free queue between one producer thread and one consumer thread. The capacity
+ * is rounded up to a power of two. A full ring makes the producer wait (backpressure) and an
+ * empty ring makes the consumer wait, until the producer closes it
+ * e.g.: the stage reading a file passing chunks of lines to the stage parsing them
+ */
+template <typename T>
+class SpscRing {
+private:
+    vector<T> slots;
+    size_t mask;
+    //The indexes only grow, on their own cache lines so the two threads don't share one
+    atomic<size_t> head; // the next slot to pop, written by the consumer
+    char head_padding[RING_CACHE_LINE];
+    atomic<size_t> tail; // the next slot to push, written by the producer
+    char tail_padding[RING_CACHE_LINE];
+    atomic<bool> closed;
+
+    SpscRing(const SpscRing &);
+    SpscRing & operator=(const SpscRing &);
+
+public:
+    /**
+     * @constructor
+     */
+    SpscRing(size_t capacity);
+
+    /**
+     * @return false if the ring is full
+     */
+    bool tryPush(T & value);
+
+    /**
+     * @return false if the ring is empty
+     */
+    bool tryPop(T & value);
+
+    /**
+     * Wait for a free slot, then move the value to it
+     * @return false if the ring was closed meanwhile, e.g.: the consumer stopped
+     */
+    bool push(T & value);
+
+    /**
+     * Wait for a value
+     * @return false once the ring is closed and empty
+     */
+    bool pop(T & value);
+
+    /**
+     * No more values will be pushed: the waiting producers give up and the consumer gets the
+     * values left
+     */
+    void close();
+
+    size_t getCapacity() const;
+};
+
+/**
+ * A bounded lock-free queue shared by several producers and consumers: each slot has a sequence
+ * number telling whether it's ready to be written or read on the current lap of the ring
+ * e.g.: the parser threads of a CSV conversion passing their rows to the encoder
+ */
+template <typename T>
+class MpmcRing {
+private:
+    struct Slot {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    vector<Slot> slots;
+    size_t mask;
+    atomic<size_t> head;
+    char head_padding[RING_CACHE_LINE];
+    atomic<size_t> tail;
+    char tail_padding[RING_CACHE_LINE];
+    atomic<bool> closed;
+
+    MpmcRing(const MpmcRing &);
+    MpmcRing & operator=(const MpmcRing &);
+
+public:
+    /**
+     * @constructor
+     */
+    MpmcRing(size_t capacity);
+
+    bool tryPush(T & value);
+    bool tryPop(T & value);
+    bool push(T & value);
+
+    /**
+     * @return false once the ring is closed and empty
+     */
+    bool pop(T & value);
+
+    /**
+     * No more values will be pushed, once all the producers are done
+     */
+    void close();
+
+    size_t getCapacity() const;
+};
+
+/**
+ * @return the smallest power of two of at least the capacity, and at least 2
+ */
+size_t getRingCapacity(size_t capacity);
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+void RingBackoff::wait() {
+    attempts++;
+    if (attempts < 64) {
+        return;
+    }
+    if (attempts < 1024) {
+        this_thread::yield();
+        return;
+    }
+    this_thread::sleep_for(chrono::microseconds(50));
+}
+
+size_t getRingCapacity(size_t capacity) {
+    size_t ring_capacity = 2;
+    while (ring_capacity < capacity) {
+        ring_capacity *= 2;
+    }
+    return ring_capacity;
+}
+
+template <typename T>
+SpscRing<T>::SpscRing(size_t capacity) : slots(getRingCapacity(capacity)), head(0), tail(0), closed(false) {
+    this->mask = slots.size() - 1;
+}
+
+template <typename T>
+bool SpscRing<T>::tryPush(T & value) {
+    size_t position = tail.load(memory_order_relaxed);
+    if (position - head.load(memory_order_acquire) == slots.size()) {
+        return false;
+    }
+    slots[position & mask] = move(value);
+    tail.store(position + 1, memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool SpscRing<T>::tryPop(T & value) {
+    size_t position = head.load(memory_order_relaxed);
+    if (position == tail.load(memory_order_acquire)) {
+        return false;
+    }
+    value = move(slots[position & mask]);
+    head.store(position + 1, memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool SpscRing<T>::push(T & value) {
+    RingBackoff backoff;
+    while (!closed.load(memory_order_acquire)) {
+        if (tryPush(value)) {
+            return true;
+        }
+        backoff.wait();
+    }
+    return false;
+}
+
+template <typename T>
+bool SpscRing<T>::pop(T & value) {
+    RingBackoff backoff;
+    while (!tryPop(value)) {
+        if (closed.load(memory_order_acquire)) {
+            //The last values may be pushed right before the ring is closed
+            return tryPop(value);
+        }
+        backoff.wait();
+    }
+    return true;
+}
+
+template <typename T>
+void SpscRing<T>::close() {
+    closed.store(true, memory_order_release);
+}
+
+template <typename T>
+size_t SpscRing<T>::getCapacity() const {
+    return slots.size();
+}
+
+template <typename T>
+MpmcRing<T>::MpmcRing(size_t capacity) : slots(getRingCapacity(capacity)), head(0), tail(0), closed(false) {
+    this->mask = slots.size() - 1;
+    for (size_t i = 0; i < slots.size(); i++) {
+        slots[i].sequence.store(i, memory_order_relaxed);
+    }
+}
+
+template <typename T>
+bool MpmcRing<T>::tryPush(T & value) {
+    size_t position = tail.load(memory_order_relaxed);
+    while (true) {
+        Slot & slot = slots[position & mask];
+        size_t sequence = slot.sequence.load(memory_order_acquire);
+        //The slot is free on this lap when its sequence is the position
+        long long lap = (long long) sequence - (long long) position;
+        if (lap == 0) {
+            if (tail.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+                slot.value = move(value);
+                slot.sequence.store(position + 1, memory_order_release);
+                return true;
+            }
+        } else if (lap < 0) {
+            return false;
+        } else {
+            position = tail.load(memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+bool MpmcRing<T>::tryPop(T & value) {
+    size_t position = head.load(memory_order_relaxed);
+    while (true) {
+        Slot & slot = slots[position & mask];
+        size_t sequence = slot.sequence.load(memory_order_acquire);
+        //The slot holds a value of this lap when its sequence is the position + 1
+        long long lap = (long long) sequence - (long long) (position + 1);
+        if (lap == 0) {
+            if (head.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+                value = move(slot.value);
+                slot.sequence.store(position + slots.size(), memory_order_release);
+                return true;
+            }
+        } else if (lap < 0) {
+            return false;
+        } else {
+            position = head.load(memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+bool MpmcRing<T>::push(T & value) {
+    RingBackoff backoff;
+    while (!closed.load(memory_order_acquire)) {
+        if (tryPush(value)) {
+            return true;
+        }
+        backoff.wait();
+    }
+    return false;
+}
+
+template <typename T>
+bool MpmcRing<T>::pop(T & value) {
+    RingBackoff backoff;
+    while (!tryPop(value)) {
+        if (closed.load(memory_order_acquire)) {
+            return tryPop(value);
+        }
+        backoff.wait();
+    }
+    return true;
+}
+
+template <typename T>
+void MpmcRing<T>::close() {
+    closed.store(true, memory_order_release);
+}
+
+template <typename T>
+size_t MpmcRing<T>::getCapacity() const {
+    return slots.size();
+}
+
+#endif //RINGBUFFER_H
@@ -0,0 +1,368 @@
+#ifndef ROWLAYOUT_H
+#define ROWLAYOUT_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <sstream>
+#include <cstdlib>
+#include <string.h>
+#include <stdint.h>
+#include <type_traits>
+#include "schema.h"
+#include "queryable.h"
+#include "batch.h"
+
+using namespace std;
+
+/**
+ * Row layouts known at compile time. A layout mirrors a Schema, column by column, and
+ * generates encode/decode/compare functions where the type of each column and its offset
+ * on the registry are constants, so there is no branch on the column type
+ * e.g.: for a schema like | _id:int64 | dre:int32 | name:char:255 |
+ *
+ * typedef SchemaLayout<LayoutCol<INT32>, LayoutCol<CHAR, 255> > PersonLayout;
+ * registerRowLayout<PersonLayout>("person");
+ *
+ * Once registered, every Table whose schema has the same column types and sizes uses
+ * the specialized functions (found with findRowKernels), the other tables use the
+ * generic code
+ */
+
+/**
+ * The size of the RegistryHeader written before each row
+ * @see Table::insert
+ */
+const unsigned REGISTRY_HEADER_SIZE = sizeof(RegistryHeader::table_name) + sizeof(RegistryHeader::registry_size) +
+                                      sizeof(RegistryHeader::time_stamp);
+
+/**
+ * A column of a layout, same as a SchemaCol without the key
+ */
+template <SchemaType TYPE, unsigned ARRAY_SIZE = 0>
+struct LayoutCol {
+    static const SchemaType type = TYPE;
+    static const unsigned array_size = ARRAY_SIZE;
+
+    /**
+     * @see SchemaCol::getSize
+     */
+    static const unsigned size = (TYPE == INT32 || TYPE == FLOAT ? sizeof(float) :
+                                  TYPE == CHAR ? sizeof(char) : sizeof(double)) * (ARRAY_SIZE + 1);
+};
+
+/**
+ * Encode, decode and compare the values of one column type. The formats are the same
+ * as Table::convertAndSave and Table::decodeRow
+ */
+template <SchemaType TYPE>
+struct ColumnCodec;
+
+/**
+ * The numeric types, stored on the registry as a T
+ */
+template <typename T>
+struct NumericCodec {
+    static void decode(const char * source, unsigned, vector<string> & row) {
+        T value;
+        memcpy(&value, source, sizeof(value));
+        row.push_back(is_floating_point<T>::value ? formatDouble(value) : to_string((long long) value));
+    }
+
+    static void gather(const char * source, unsigned count, unsigned stride, T * out) {
+        for (unsigned i = 0; i < count; i++) {
+            memcpy(out + i, source + (size_t) i * stride, sizeof(T));
+        }
+    }
+
+    static int compare(const char * a, const char * b, unsigned) {
+        T value_a, value_b;
+        memcpy(&value_a, a, sizeof(value_a));
+        memcpy(&value_b, b, sizeof(value_b));
+        return (value_a > value_b) - (value_a < value_b);
+    }
+};
+
+template <>
+struct ColumnCodec<INT32> : NumericCodec<int> {
+    static void encode(const string & value, char * destination, unsigned) {
+        int number = atoi(value.c_str());
+        memcpy(destination, &number, sizeof(number));
+    }
+
+    static int32_t * getValues(ColumnVector & column) {
+        return &column.int32_values[0];
+    }
+};
+
+template <>
+struct ColumnCodec<INT64> : NumericCodec<int64_t> {
+    static void encode(const string & value, char * destination, unsigned) {
+        long long number = stoll(value);
+        memcpy(destination, &number, sizeof(number));
+    }
+
+    static int64_t * getValues(ColumnVector & column) {
+        return &column.int64_values[0];
+    }
+};
+
+template <>
+struct ColumnCodec<FOREIGN_KEY> : ColumnCodec<INT64> {
+};
+
+template <>
+struct ColumnCodec<FLOAT> : NumericCodec<float> {
+    static void encode(const string & value, char * destination, unsigned) {
+        float number = atof(value.c_str());
+        memcpy(destination, &number, sizeof(number));
+    }
+
+    static float * getValues(ColumnVector & column) {
+        return &column.float_values[0];
+    }
+};
+
+template <>
+struct ColumnCodec<DOUBLE> : NumericCodec<double> {
+    static void encode(const string & value, char * destination, unsigned) {
+        double number = atof(value.c_str());
+        memcpy(destination, &number, sizeof(number));
+    }
+
+    static double * getValues(ColumnVector & column) {
+        return &column.double_values[0];
+    }
+};
+
+template <>
+struct ColumnCodec<CHAR> {
+    static void encode(const string & value, char * destination, unsigned size) {
+        strncpy(destination, value.c_str(), size);
+        destination[size - 1] = '\0';
+    }
+
+    static void decode(const char * source, unsigned size, vector<string> & row) {
+        // The value may fill the whole column without the null terminator
+        row.push_back(string(source, strnlen(source, size)));
+    }
+
+    static int compare(const char * a, const char * b, unsigned size) {
+        return strncmp(a, b, size);
+    }
+};
+
+/**
+ * The columns of a registry body (the registry without the RegistryHeader), in order.
+ * Each function handles the first column and calls the layout of the remaining columns
+ * with the pointer moved by the (constant) column size
+ */
+template <typename... Cols>
+struct RowLayout;
+
+template <>
+struct RowLayout<> {
+    static const unsigned SIZE = 0;
+    static const unsigned NUMBER_OF_COLS = 0;
+
+    static bool matches(const vector<SchemaCol> * schema_cols, unsigned column) {
+        return column == schema_cols->size();
+    }
+
+    static void encode(const string *, char *) {
+    }
+
+    static void decode(const char *, vector<string> &) {
+    }
+
+    template <unsigned STRIDE>
+    static void gather(const char *, unsigned, ColumnVector *, unsigned) {
+    }
+
+    static int compare(const char *, const char *, unsigned) {
+        return 0;
+    }
+};
+
+template <typename Col, typename... Rest>
+struct RowLayout<Col, Rest...> {
+    typedef RowLayout<Rest...> Tail;
+
+    static const unsigned SIZE = Col::size + Tail::SIZE;
+    static const unsigned NUMBER_OF_COLS = 1 + Tail::NUMBER_OF_COLS;
+
+    /**
+     * @return true if the schema columns, starting at column, have the layout types and sizes
+     */
+    static bool matches(const vector<SchemaCol> * schema_cols, unsigned column) {
+        if (column >= schema_cols->size()) {
+            return false;
+        }
+        SchemaCol schema_col = schema_cols->at(column);
+        return schema_col.type == Col::type && schema_col.getSize() == Col::size && Tail::matches(schema_cols, column + 1);
+    }
+
+    /**
+     * Write NUMBER_OF_COLS values to the body, which must have SIZE bytes
+     */
+    static void encode(const string * values, char * body) {
+        memset(body, 0, Col::size);
+        ColumnCodec<Col::type>::encode(*values, body, Col::size);
+        Tail::encode(values + 1, body + Col::size);
+    }
+
+    /**
+     * Push the values of the body to the row
+     */
+    static void decode(const char * body, vector<string> & row) {
+        ColumnCodec<Col::type>::decode(body, Col::size, row);
+        Tail::decode(body + Col::size, row);
+    }
+
+    /**
+     * Copy the values of count bodies, STRIDE bytes apart, to the rows first_row to
+     * first_row + count - 1 of the columns
+     */
+    template <unsigned STRIDE>
+    static void gather(const char * body, unsigned count, ColumnVector * columns, unsigned first_row) {
+        gatherColumn<STRIDE>(body, count, *columns, first_row, (ColumnCodec<Col::type> *) NULL);
+        Tail::template gather<STRIDE>(body + Col::size, count, columns + 1, first_row);
+    }
+
+    template <unsigned STRIDE, typename Codec>
+    static void gatherColumn(const char * body, unsigned count, ColumnVector & column, unsigned first_row, Codec *) {
+        Codec::gather(body, count, STRIDE, Codec::getValues(column) + first_row);
+    }
+
+    template <unsigned STRIDE>
+    static void gatherColumn(const char * body, unsigned count, ColumnVector & column, unsigned first_row, ColumnCodec<CHAR> *) {
+        for (unsigned i = 0; i < count; i++) {
+            memcpy(&column.char_values[(size_t) (first_row + i) * Col::size], body + (size_t) i * STRIDE, Col::size);
+        }
+    }
+
+    /**
+     * Compare a column of two bodies
+     * @return < 0, 0 or > 0 if the value of a is less, equal or greater than the value of b
+     */
+    static int compare(const char * a, const char * b, unsigned column) {
+        if (column == 0) {
+            return ColumnCodec<Col::type>::compare(a, b, Col::size);
+        }
+        return Tail::compare(a + Col::size, b + Col::size, column - 1);
+    }
+};
+
+/**
+ * The layout of a Schema, where the _id column is added automatically
+ * @see Schema::Schema
+ */
+template <typename... Cols>
+using SchemaLayout = RowLayout<LayoutCol<INT64>, Cols...>;
+
+/**
+ * The functions generated for a layout, called through pointers by the tables using it.
+ * The registries are | RegistryHeader | body | and contiguous registries are registry_size
+ * bytes apart
+ */
+struct RowKernels {
+    string name;
+    unsigned registry_size;
+
+    bool (*matches)(const vector<SchemaCol> * schema_cols);
+
+    /**
+     * @param row - the values of every column, _id included
+     * @param body - where the row is written, registry_size - REGISTRY_HEADER_SIZE bytes
+     */
+    void (*encode)(const vector<string> & row, char * body);
+
+    /**
+     * @param registry - points to the beginning of the registry (the RegistryHeader)
+     * @see Table::decodeRow
+     */
+    void (*decode)(const char * registry, vector<string> & row);
+
+    /**
+     * @param buffer - points to the beginning of the first of count contiguous registries
+     * @see Table::decodeRegistries
+     */
+    void (*decodeRegistries)(const char * buffer, unsigned count, Batch & batch, unsigned first_row);
+
+    /**
+     * Compare a column of two registries
+     */
+    int (*compare)(const char * registry_a, const char * registry_b, unsigned column);
+};
+
+/**
+ * The RowKernels functions for a layout
+ */
+template <typename Layout>
+struct LayoutKernels {
+    static const unsigned REGISTRY_SIZE = REGISTRY_HEADER_SIZE + Layout::SIZE;
+
+    static bool matches(const vector<SchemaCol> * schema_cols) {
+        return Layout::matches(schema_cols, 0);
+    }
+
+    static void encode(const vector<string> & row, char * body) {
+        Layout::encode(&row[0], body);
+    }
+
+    static void decode(const char * registry, vector<string> & row) {
+        row.reserve(row.size() + Layout::NUMBER_OF_COLS);
+        Layout::decode(registry + REGISTRY_HEADER_SIZE, row);
+    }
+
+    static void decodeRegistries(const char * buffer, unsigned count, Batch & batch, unsigned first_row) {
+        Layout::template gather<REGISTRY_SIZE>(buffer + REGISTRY_HEADER_SIZE, count, &batch.columns[0], first_row);
+    }
+
+    static int compare(const char * registry_a, const char * registry_b, unsigned column) {
+        return Layout::compare(registry_a + REGISTRY_HEADER_SIZE, registry_b + REGISTRY_HEADER_SIZE, column);
+    }
+};
+
+/**
+ * @return the registered kernels, in the registration order. A deque keeps the kernels
+ *         found by the tables valid when new layouts are registered
+ */
+deque<RowKernels> & getRowKernelsRegistry() {
+    static deque<RowKernels> registry;
+    return registry;
+}
+
+/**
+ * Register the kernels of a layout. The tables check the registry when their schema is
+ * set, so the layouts must be registered before
+ * @param name - used for debugging only
+ */
+template <typename Layout>
+void registerRowLayout(string name) {
+    RowKernels kernels;
+    kernels.name = name;
+    kernels.registry_size = LayoutKernels<Layout>::REGISTRY_SIZE;
+    kernels.matches = &LayoutKernels<Layout>::matches;
+    kernels.encode = &LayoutKernels<Layout>::encode;
+    kernels.decode = &LayoutKernels<Layout>::decode;
+    kernels.decodeRegistries = &LayoutKernels<Layout>::decodeRegistries;
+    kernels.compare = &LayoutKernels<Layout>::compare;
+    getRowKernelsRegistry().push_back(kernels);
+}
+
+/**
+ * @return the kernels of the first registered layout matching the schema columns, or
+ *         NULL if there is none
+ */
+const RowKernels * findRowKernels(const vector<SchemaCol> * schema_cols) {
+    deque<RowKernels> & registry = getRowKernelsRegistry();
+    for (deque<RowKernels>::const_iterator it = registry.begin(); it != registry.end(); it++) {
+        if (it->matches(schema_cols)) {
+            return &(*it);
+        }
+    }
+    return NULL;
+}
+
+#endif //ROWLAYOUT_H
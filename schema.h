@@ -5,6 +5,9 @@
 #include <fstream>
 #include <map>
 #include <algorithm>
+#include <cstdlib>
+#include <string.h>
+#include <strings.h>
 #include "util.h"
 
 using namespace std;
@@ -41,6 +44,33 @@ struct SchemaCol {
                 return 0;
         }
     }
+
+    /**
+     * Convert a raw value to the format it has once saved and read back from the
+     * table file, e.g.: "007" is "7" for an INT32 and a CHAR:3 value is cut at 3 chars
+     * @see Table::convertAndSave
+     */
+    string normalize(const string & value) const {
+        ostringstream stream;
+        switch (type) {
+            case INT32:
+                stream << atoi(value.c_str());
+                break;
+            case INT64:
+            case FOREIGN_KEY:
+                stream << atoll(value.c_str());
+                break;
+            case FLOAT:
+                stream << (float) atof(value.c_str());
+                break;
+            case DOUBLE:
+                stream << atof(value.c_str());
+                break;
+            case CHAR:
+                return value.substr(0, min((size_t) array_size, strnlen(value.c_str(), value.size())));
+        }
+        return stream.str();
+    }
 };
 
 /**
@@ -101,7 +131,8 @@ public:
      SchemaCol * getCol(string key);
      
      /**
-     * Get the order of the specified collumn
+     * Get the order of the specified collumn. The names are compared ignoring the case, as
+     * the query parser lowercases the identifiers
      * @return the specific column order, starting with 0
      */
      int getColPosition(string key);
@@ -198,7 +229,7 @@ SchemaCol * Schema::getCol(string key){
 
 int Schema::getColPosition(string key){
     for(int i=0; i<cols.size(); i++){
-        if(cols.at(i).key == key){
+        if(strcasecmp(cols.at(i).key.c_str(), key.c_str()) == 0){
             return i;
         }
     }
@@ -0,0 +1,104 @@
+#include "../queryclient.h"
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * Send queries to a query server from several clients at once, then print the throughput and
+ * the latencies. The {id} of the statement is replaced by a random _id for each query
+ * e.g.: ./query_loadgen --unix query_server.sock --clients 8 --queries 1000 --ids 1000 \
+ *                       person "SELECT name WHERE _id = {id}"
+ */
+int main(int argc, char ** argv) {
+    string socket_path;
+    int port = -1;
+    int number_of_clients = 4;
+    int queries_per_client = 1000;
+    long long number_of_ids = 1000;
+    vector<string> arguments;
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+        if (argument == "--unix" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (argument == "--port" && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (argument == "--clients" && i + 1 < argc) {
+            number_of_clients = max(1, atoi(argv[++i]));
+        } else if (argument == "--queries" && i + 1 < argc) {
+            queries_per_client = max(1, atoi(argv[++i]));
+        } else if (argument == "--ids" && i + 1 < argc) {
+            number_of_ids = max(1LL, atoll(argv[++i]));
+        } else {
+            arguments.push_back(argument);
+        }
+    }
+    if (arguments.size() != 2 || (socket_path.empty() && port < 0)) {
+        cerr << "Usage: " << argv[0] << " [--unix path | --port port] [--clients n] [--queries n] [--ids n] table statement" << endl;
+        return 1;
+    }
+    string table = arguments[0];
+    string statement = arguments[1];
+
+    vector<vector<double> > latencies(number_of_clients); // in microseconds, by client
+    vector<long long> rows(number_of_clients, 0);
+    vector<string> errors(number_of_clients);
+    vector<thread> clients;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < number_of_clients; i++) {
+        clients.push_back(thread([&, i]() {
+            try {
+                QueryClient client;
+                if (!socket_path.empty()) {
+                    client.connectUnix(socket_path);
+                } else {
+                    client.connectTcp("127.0.0.1", port);
+                }
+                mt19937_64 random(i + 1);
+                for (int j = 0; j < queries_per_client; j++) {
+                    string query = statement;
+                    size_t id_position = query.find("{id}");
+                    if (id_position != string::npos) {
+                        query.replace(id_position, 4, to_string(random() % number_of_ids));
+                    }
+                    chrono::steady_clock::time_point sent = chrono::steady_clock::now();
+                    Cursor cursor = client.query(table, query);
+                    latencies[i].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - sent).count());
+                    rows[i] += cursor.getCount();
+                }
+            } catch (const exception & e) {
+                errors[i] = e.what();
+            }
+        }));
+    }
+    for (vector<thread>::iterator it = clients.begin(); it != clients.end(); it++) {
+        it->join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<double> all_latencies;
+    long long total_rows = 0;
+    for (int i = 0; i < number_of_clients; i++) {
+        all_latencies.insert(all_latencies.end(), latencies[i].begin(), latencies[i].end());
+        total_rows += rows[i];
+        if (!errors[i].empty()) {
+            cerr << "Client " << i << ": " << errors[i] << endl;
+        }
+    }
+    if (all_latencies.empty()) {
+        return 1;
+    }
+    sort(all_latencies.begin(), all_latencies.end());
+
+    cout << all_latencies.size() << " queries (" << total_rows << " rows) in " << seconds << "s: "
+         << all_latencies.size() / seconds << " queries/s" << endl;
+    cout << "Latency (us): p50 " << all_latencies[all_latencies.size() / 2]
+         << " | p99 " << all_latencies[all_latencies.size() * 99 / 100]
+         << " | max " << all_latencies.back() << endl;
+    return all_latencies.size() == (size_t) number_of_clients * queries_per_client ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+#include "../queryserver.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * Serve the queries on tables over a Unix socket and/or a loopback TCP port, until SIGINT or
+ * SIGTERM
+ * e.g.: ./query_server --unix query_server.sock --port 7070 person company worked
+ *
+ * A table with rows in its .dat files is opened as it is, otherwise it's converted from
+ * <name>.csv. Its schema is imported from <name>_schema.txt
+ */
+int main(int argc, char ** argv) {
+    string socket_path;
+    int port = -1;
+    vector<string> table_names;
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+        if (argument == "--unix" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (argument == "--port" && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else {
+            table_names.push_back(argument);
+        }
+    }
+    if (table_names.empty() || (socket_path.empty() && port < 0)) {
+        cerr << "Usage: " << argv[0] << " [--unix path] [--port port] table..." << endl;
+        return 1;
+    }
+
+    //Block the signals before any thread starts, so the threads inherit the mask and the
+    //signals are left to sigwait
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    //The tables outlive the server
+    vector<unique_ptr<Table> > tables;
+    QueryServer server;
+    try {
+        for (vector<string>::iterator it = table_names.begin(); it != table_names.end(); it++) {
+            Table * table = new Table(*it);
+            tables.push_back(unique_ptr<Table>(table));
+            table->importSchema(*it + "_schema.txt");
+            if (table->getHeader()->empty()) {
+                table->convertFromCSV(*it + ".csv");
+            }
+            server.addTable(*it, table);
+            cout << *it << ": " << table->getHeader()->size() << " rows" << endl;
+        }
+        if (!socket_path.empty()) {
+            server.listenUnix(socket_path);
+            cout << "Listening on " << socket_path << endl;
+        }
+        if (port >= 0) {
+            port = server.listenTcp(port);
+            cout << "Listening on 127.0.0.1:" << port << endl;
+        }
+    } catch (const exception & e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    server.start();
+    int signal;
+    sigwait(&signals, &signal);
+    server.stop();
+    cout << "Served " << server.getQueriesServed() << " queries" << endl;
+    return 0;
+}
@@ -0,0 +1,384 @@
+#ifndef SIMDKERNELS_H
+#define SIMDKERNELS_H
+
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+#include "predicate.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define NAIVEDB_AVX2_KERNELS 1
+#define NAIVEDB_AVX2 __attribute__((target("avx2")))
+//The helpers of the kernels are inlined even without optimizations, as the intrinsics are
+#define NAIVEDB_AVX2_INLINE __attribute__((target("avx2"), always_inline)) inline
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+/**
+ * Kernels comparing a column of a batch to constants. The result is a selection
+ * bitmap: the bit i (bitmap[i / 64] >> (i % 64)) is set if the row i matches.
+ * The bitmap must have (count + 63) / 64 words and is cleared by the kernels
+ *
+ * There are two implementations, a scalar one and an AVX2 one. The AVX2 kernels are
+ * compiled with a target attribute, so no -mavx2 flag is needed, and only used when
+ * the CPU supports them
+ * @see getSimdKernels
+ */
+struct SimdKernels {
+    const char * name;
+
+    void (*compareInt32)(const int32_t * values, unsigned count, Comparator comparator, int32_t constant, uint64_t * bitmap);
+    void (*compareInt64)(const int64_t * values, unsigned count, Comparator comparator, int64_t constant, uint64_t * bitmap);
+    void (*compareFloat)(const float * values, unsigned count, Comparator comparator, float constant, uint64_t * bitmap);
+    void (*compareDouble)(const double * values, unsigned count, Comparator comparator, double constant, uint64_t * bitmap);
+
+    /**
+     * Select lower < value < upper, where each < is <= if the bound is inclusive
+     */
+    void (*rangeInt32)(const int32_t * values, unsigned count, int32_t lower, bool lower_inclusive, int32_t upper, bool upper_inclusive, uint64_t * bitmap);
+    void (*rangeInt64)(const int64_t * values, unsigned count, int64_t lower, bool lower_inclusive, int64_t upper, bool upper_inclusive, uint64_t * bitmap);
+    void (*rangeFloat)(const float * values, unsigned count, float lower, bool lower_inclusive, float upper, bool upper_inclusive, uint64_t * bitmap);
+    void (*rangeDouble)(const double * values, unsigned count, double lower, bool lower_inclusive, double upper, bool upper_inclusive, uint64_t * bitmap);
+
+    /**
+     * Select the CHAR values (width bytes each, '\0' padded) whose first length bytes
+     * are equal to the pattern. Use the pattern '\0' terminator (length = strlen + 1) for
+     * an equality and length = strlen for a prefix
+     */
+    void (*matchChars)(const char * values, unsigned count, unsigned width, const char * pattern, unsigned length, uint64_t * bitmap);
+};
+
+/**
+ * @return the scalar kernels, available on any CPU
+ */
+const SimdKernels & getScalarKernels();
+
+/**
+ * @return the AVX2 kernels, or NULL if they were not compiled or the CPU does not support them
+ */
+const SimdKernels * getAvx2Kernels();
+
+/**
+ * @return the fastest kernels supported by the CPU, detected on the first call
+ */
+const SimdKernels & getSimdKernels();
+
+/**
+ * Keep the rows of the selection whose bit is set on the bitmap
+ */
+void selectBitmap(const uint64_t * bitmap, vector<uint32_t> & selection);
+
+/*****************************************
+ ************ SCALAR KERNELS *************
+ *****************************************/
+
+template <typename T>
+void scalarCompare(const T * values, unsigned count, Comparator comparator, T constant, uint64_t * bitmap) {
+    memset(bitmap, 0, ((count + 63) / 64) * sizeof(uint64_t));
+    for (unsigned i = 0; i < count; i++) {
+        bool match;
+        switch (comparator) {
+            case EQUAL: match = values[i] == constant; break;
+            case NOT_EQUAL: match = values[i] != constant; break;
+            case LESS: match = values[i] < constant; break;
+            case LESS_EQUAL: match = values[i] <= constant; break;
+            case GREATER: match = values[i] > constant; break;
+            case GREATER_EQUAL: match = values[i] >= constant; break;
+            default: match = false; break;
+        }
+        bitmap[i >> 6] |= (uint64_t) match << (i & 63);
+    }
+}
+
+template <typename T>
+void scalarRange(const T * values, unsigned count, T lower, bool lower_inclusive, T upper, bool upper_inclusive, uint64_t * bitmap) {
+    memset(bitmap, 0, ((count + 63) / 64) * sizeof(uint64_t));
+    for (unsigned i = 0; i < count; i++) {
+        bool above = lower_inclusive ? values[i] >= lower : values[i] > lower;
+        bool below = upper_inclusive ? values[i] <= upper : values[i] < upper;
+        bitmap[i >> 6] |= (uint64_t) (above && below) << (i & 63);
+    }
+}
+
+void scalarMatchChars(const char * values, unsigned count, unsigned width, const char * pattern, unsigned length, uint64_t * bitmap) {
+    memset(bitmap, 0, ((count + 63) / 64) * sizeof(uint64_t));
+    if (length > width) {
+        return;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        bool match = memcmp(values + (size_t) i * width, pattern, length) == 0;
+        bitmap[i >> 6] |= (uint64_t) match << (i & 63);
+    }
+}
+
+/*****************************************
+ ************* AVX2 KERNELS **************
+ *****************************************/
+
+#ifdef NAIVEDB_AVX2_KERNELS
+
+/**
+ * The AVX2 operations for each type. The comparisons return one bit per lane
+ */
+struct Avx2Int32 {
+    typedef int32_t value_type;
+    typedef __m256i vector_type;
+    static const unsigned LANES = 8;
+
+    NAIVEDB_AVX2_INLINE static __m256i set(int32_t value) { return _mm256_set1_epi32(value); }
+    NAIVEDB_AVX2_INLINE static __m256i load(const int32_t * values) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *> (values)); }
+    NAIVEDB_AVX2_INLINE static unsigned equal(__m256i a, __m256i b) { return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b))); }
+    NAIVEDB_AVX2_INLINE static unsigned greater(__m256i a, __m256i b) { return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, b))); }
+};
+
+struct Avx2Int64 {
+    typedef int64_t value_type;
+    typedef __m256i vector_type;
+    static const unsigned LANES = 4;
+
+    NAIVEDB_AVX2_INLINE static __m256i set(int64_t value) { return _mm256_set1_epi64x(value); }
+    NAIVEDB_AVX2_INLINE static __m256i load(const int64_t * values) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *> (values)); }
+    NAIVEDB_AVX2_INLINE static unsigned equal(__m256i a, __m256i b) { return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b))); }
+    NAIVEDB_AVX2_INLINE static unsigned greater(__m256i a, __m256i b) { return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(a, b))); }
+};
+
+struct Avx2Float {
+    typedef float value_type;
+    typedef __m256 vector_type;
+    static const unsigned LANES = 8;
+
+    NAIVEDB_AVX2_INLINE static __m256 set(float value) { return _mm256_set1_ps(value); }
+    NAIVEDB_AVX2_INLINE static __m256 load(const float * values) { return _mm256_loadu_ps(values); }
+    NAIVEDB_AVX2_INLINE static unsigned equal(__m256 a, __m256 b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)); }
+    NAIVEDB_AVX2_INLINE static unsigned greater(__m256 a, __m256 b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ)); }
+};
+
+struct Avx2Double {
+    typedef double value_type;
+    typedef __m256d vector_type;
+    static const unsigned LANES = 4;
+
+    NAIVEDB_AVX2_INLINE static __m256d set(double value) { return _mm256_set1_pd(value); }
+    NAIVEDB_AVX2_INLINE static __m256d load(const double * values) { return _mm256_loadu_pd(values); }
+    NAIVEDB_AVX2_INLINE static unsigned equal(__m256d a, __m256d b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_EQ_OQ)); }
+    NAIVEDB_AVX2_INLINE static unsigned greater(__m256d a, __m256d b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ)); }
+};
+
+/**
+ * One bit per lane for value COMPARATOR constant. The <=, >= and != are the negation
+ * of >, < and ==, which is only wrong for NaN floats
+ */
+template <typename Traits, Comparator COMPARATOR>
+NAIVEDB_AVX2_INLINE unsigned avx2Bits(typename Traits::vector_type value, typename Traits::vector_type constant) {
+    const unsigned all_lanes = (1u << Traits::LANES) - 1;
+    switch (COMPARATOR) {
+        case EQUAL: return Traits::equal(value, constant);
+        case NOT_EQUAL: return ~Traits::equal(value, constant) & all_lanes;
+        case LESS: return Traits::greater(constant, value);
+        case LESS_EQUAL: return ~Traits::greater(value, constant) & all_lanes;
+        case GREATER: return Traits::greater(value, constant);
+        default: return ~Traits::greater(constant, value) & all_lanes;
+    }
+}
+
+template <typename Traits, Comparator COMPARATOR>
+NAIVEDB_AVX2 void avx2CompareLoop(const typename Traits::value_type * values, unsigned count, typename Traits::value_type constant, uint64_t * bitmap) {
+    typename Traits::vector_type constant_vector = Traits::set(constant);
+    unsigned i = 0;
+
+    //A word of the bitmap is filled in a register, then stored once
+    for (; i + 64 <= count; i += 64) {
+        uint64_t word = 0;
+        for (unsigned lane = 0; lane < 64; lane += Traits::LANES) {
+            word |= (uint64_t) avx2Bits<Traits, COMPARATOR>(Traits::load(values + i + lane), constant_vector) << lane;
+        }
+        bitmap[i >> 6] = word;
+    }
+    //LANES divides 64, so the lanes of an iteration never cross two words
+    for (; i + Traits::LANES <= count; i += Traits::LANES) {
+        unsigned bits = avx2Bits<Traits, COMPARATOR>(Traits::load(values + i), constant_vector);
+        bitmap[i >> 6] |= (uint64_t) bits << (i & 63);
+    }
+    for (; i < count; i++) {
+        bool match;
+        switch (COMPARATOR) {
+            case EQUAL: match = values[i] == constant; break;
+            case NOT_EQUAL: match = values[i] != constant; break;
+            case LESS: match = values[i] < constant; break;
+            case LESS_EQUAL: match = values[i] <= constant; break;
+            case GREATER: match = values[i] > constant; break;
+            default: match = values[i] >= constant; break;
+        }
+        bitmap[i >> 6] |= (uint64_t) match << (i & 63);
+    }
+}
+
+template <typename Traits>
+NAIVEDB_AVX2 void avx2Compare(const typename Traits::value_type * values, unsigned count, Comparator comparator, typename Traits::value_type constant, uint64_t * bitmap) {
+    memset(bitmap, 0, ((count + 63) / 64) * sizeof(uint64_t));
+    switch (comparator) {
+        case EQUAL: avx2CompareLoop<Traits, EQUAL>(values, count, constant, bitmap); break;
+        case NOT_EQUAL: avx2CompareLoop<Traits, NOT_EQUAL>(values, count, constant, bitmap); break;
+        case LESS: avx2CompareLoop<Traits, LESS>(values, count, constant, bitmap); break;
+        case LESS_EQUAL: avx2CompareLoop<Traits, LESS_EQUAL>(values, count, constant, bitmap); break;
+        case GREATER: avx2CompareLoop<Traits, GREATER>(values, count, constant, bitmap); break;
+        case GREATER_EQUAL: avx2CompareLoop<Traits, GREATER_EQUAL>(values, count, constant, bitmap); break;
+        default: break;
+    }
+}
+
+template <typename Traits, Comparator LOWER, Comparator UPPER>
+NAIVEDB_AVX2 void avx2RangeLoop(const typename Traits::value_type * values, unsigned count, typename Traits::value_type lower,
+                                typename Traits::value_type upper, uint64_t * bitmap) {
+    typename Traits::vector_type lower_vector = Traits::set(lower);
+    typename Traits::vector_type upper_vector = Traits::set(upper);
+    unsigned i = 0;
+
+    for (; i + 64 <= count; i += 64) {
+        uint64_t word = 0;
+        for (unsigned lane = 0; lane < 64; lane += Traits::LANES) {
+            typename Traits::vector_type value = Traits::load(values + i + lane);
+            word |= (uint64_t) (avx2Bits<Traits, LOWER>(value, lower_vector) & avx2Bits<Traits, UPPER>(value, upper_vector)) << lane;
+        }
+        bitmap[i >> 6] = word;
+    }
+    for (; i + Traits::LANES <= count; i += Traits::LANES) {
+        typename Traits::vector_type value = Traits::load(values + i);
+        unsigned bits = avx2Bits<Traits, LOWER>(value, lower_vector) & avx2Bits<Traits, UPPER>(value, upper_vector);
+        bitmap[i >> 6] |= (uint64_t) bits << (i & 63);
+    }
+    for (; i < count; i++) {
+        bool above = LOWER == GREATER_EQUAL ? values[i] >= lower : values[i] > lower;
+        bool below = UPPER == LESS_EQUAL ? values[i] <= upper : values[i] < upper;
+        bitmap[i >> 6] |= (uint64_t) (above && below) << (i & 63);
+    }
+}
+
+template <typename Traits>
+NAIVEDB_AVX2 void avx2Range(const typename Traits::value_type * values, unsigned count, typename Traits::value_type lower, bool lower_inclusive,
+                            typename Traits::value_type upper, bool upper_inclusive, uint64_t * bitmap) {
+    memset(bitmap, 0, ((count + 63) / 64) * sizeof(uint64_t));
+    if (lower_inclusive && upper_inclusive) {
+        avx2RangeLoop<Traits, GREATER_EQUAL, LESS_EQUAL>(values, count, lower, upper, bitmap);
+    } else if (lower_inclusive) {
+        avx2RangeLoop<Traits, GREATER_EQUAL, LESS>(values, count, lower, upper, bitmap);
+    } else if (upper_inclusive) {
+        avx2RangeLoop<Traits, GREATER, LESS_EQUAL>(values, count, lower, upper, bitmap);
+    } else {
+        avx2RangeLoop<Traits, GREATER, LESS>(values, count, lower, upper, bitmap);
+    }
+}
+
+/**
+ * Compare 8 values at a time: their first 8 bytes are gathered in two vectors and compared
+ * with the start of the pattern, and only the candidates are compared with the rest of it,
+ * with a 32 bytes load. Loads past the buffer are avoided by comparing the last values with
+ * memcmp
+ */
+NAIVEDB_AVX2 void avx2MatchChars(const char * values, unsigned count, unsigned width, const char * pattern, unsigned length, uint64_t * bitmap) {
+    if (length > 32) {
+        scalarMatchChars(values, count, width, pattern, length, bitmap);
+        return;
+    }
+    memset(bitmap, 0, ((count + 63) / 64) * sizeof(uint64_t));
+    if (length > width) {
+        return;
+    }
+
+    char padded_pattern[32] = {0};
+    memcpy(padded_pattern, pattern, length);
+    __m256i pattern_vector = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (padded_pattern));
+    uint32_t length_mask = length == 32 ? 0xFFFFFFFFu : (1u << length) - 1;
+
+    //The bytes 0-3 and 4-7 of the pattern (the ones past its length are ignored), on each lane
+    __m256i prefix_vectors[2];
+    __m256i prefix_mask_vectors[2];
+    for (unsigned half = 0; half < 2; half++) {
+        int32_t prefix;
+        memcpy(&prefix, padded_pattern + 4 * half, sizeof(prefix));
+        unsigned prefix_length = min(max(length, 4 * half) - 4 * half, 4u);
+        uint32_t prefix_mask = prefix_length == 4 ? 0xFFFFFFFFu : (1u << (8 * prefix_length)) - 1;
+        prefix_vectors[half] = _mm256_set1_epi32(prefix & prefix_mask);
+        prefix_mask_vectors[half] = _mm256_set1_epi32(prefix_mask);
+    }
+    __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(width));
+
+    size_t buffer_size = (size_t) count * width;
+    unsigned i = 0;
+    for (; i + 8 <= count && (size_t) (i + 7) * width + 32 <= buffer_size; i += 8) {
+        const char * first_value = values + (size_t) i * width;
+        __m256i starts = _mm256_i32gather_epi32(reinterpret_cast<const int *> (first_value), offsets, 1);
+        __m256i equal_starts = _mm256_cmpeq_epi32(_mm256_and_si256(starts, prefix_mask_vectors[0]), prefix_vectors[0]);
+        unsigned candidates = _mm256_movemask_ps(_mm256_castsi256_ps(equal_starts));
+        if (candidates != 0 && length > 4) {
+            __m256i nexts = _mm256_i32gather_epi32(reinterpret_cast<const int *> (first_value + 4), offsets, 1);
+            __m256i equal_nexts = _mm256_cmpeq_epi32(_mm256_and_si256(nexts, prefix_mask_vectors[1]), prefix_vectors[1]);
+            candidates &= _mm256_movemask_ps(_mm256_castsi256_ps(equal_nexts));
+        }
+        if (length > 8) {
+            for (unsigned lanes = candidates; lanes != 0; lanes &= lanes - 1) {
+                unsigned lane = __builtin_ctz(lanes);
+                __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (first_value + (size_t) lane * width));
+                uint32_t equal_bytes = _mm256_movemask_epi8(_mm256_cmpeq_epi8(value, pattern_vector));
+                if ((equal_bytes & length_mask) != length_mask) {
+                    candidates &= ~(1u << lane);
+                }
+            }
+        }
+        bitmap[i >> 6] |= (uint64_t) candidates << (i & 63);
+    }
+    for (; i < count; i++) {
+        bool match = memcmp(values + (size_t) i * width, pattern, length) == 0;
+        bitmap[i >> 6] |= (uint64_t) match << (i & 63);
+    }
+}
+
+#endif //NAIVEDB_AVX2_KERNELS
+
+/*****************************************
+ *************** DISPATCH ****************
+ *****************************************/
+
+const SimdKernels & getScalarKernels() {
+    static const SimdKernels kernels = {
+        "scalar",
+        scalarCompare<int32_t>, scalarCompare<int64_t>, scalarCompare<float>, scalarCompare<double>,
+        scalarRange<int32_t>, scalarRange<int64_t>, scalarRange<float>, scalarRange<double>,
+        scalarMatchChars
+    };
+    return kernels;
+}
+
+const SimdKernels * getAvx2Kernels() {
+#ifdef NAIVEDB_AVX2_KERNELS
+    static const SimdKernels kernels = {
+        "avx2",
+        avx2Compare<Avx2Int32>, avx2Compare<Avx2Int64>, avx2Compare<Avx2Float>, avx2Compare<Avx2Double>,
+        avx2Range<Avx2Int32>, avx2Range<Avx2Int64>, avx2Range<Avx2Float>, avx2Range<Avx2Double>,
+        avx2MatchChars
+    };
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported ? &kernels : NULL;
+#else
+    return NULL;
+#endif
+}
+
+const SimdKernels & getSimdKernels() {
+    static const SimdKernels & kernels = getAvx2Kernels() != NULL ? *getAvx2Kernels() : getScalarKernels();
+    return kernels;
+}
+
+void selectBitmap(const uint64_t * bitmap, vector<uint32_t> & selection) {
+    unsigned selected = 0;
+    for (unsigned i = 0; i < selection.size(); i++) {
+        uint32_t row = selection[i];
+        selection[selected] = row;
+        selected += (bitmap[row >> 6] >> (row & 63)) & 1;
+    }
+    selection.resize(selected);
+}
+
+#endif //SIMDKERNELS_H
@@ -0,0 +1,581 @@
+#ifndef SORTOPERATOR_H
+#define SORTOPERATOR_H
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <strings.h>
+#include "operators.h"
+#include "threadpool.h"
+
+using namespace std;
+
+/**
+ * A column of an ORDER BY, e.g.: "points DESC" is { <position of points>, true }
+ */
+struct SortKey {
+    int column;
+    bool descending;
+
+    SortKey(int column, bool descending = false);
+
+    /**
+     * Parse an ORDER BY item like "points", "points asc" or "points DESC"
+     * @param column_names - the name of each column the item may refer to
+     * @throw invalid_argument if the column is not on the list
+     */
+    static SortKey parse(const string & item, const vector<string> & column_names);
+};
+
+/**
+ * Sort the rows of the child (an ORDER BY). Each row is stored as a record with a
+ * normalized binary key followed by the row values, so comparing two keys with memcmp
+ * gives the ORDER BY order:
+ * - integers are stored big-endian with the sign bit flipped
+ * - floats and doubles are stored big-endian, with all the bits flipped if negative and
+ *   only the sign bit flipped otherwise
+ * - CHAR values are stored as they are, '\0' padded
+ * - the bytes of a DESC column are inverted
+ * The key ends with the position of the row on the child output, so equal rows keep
+ * their order (the sort is stable)
+ *
+ * The records are sorted in memory while they fit the memory budget. Otherwise the
+ * sorted records are written to a file (a run) every time the budget is full, and the
+ * runs are merged at the end (an external merge sort, with a k-way merge of the runs).
+ * The large sorts in memory are split in chunks sorted by the tasks of the shared ThreadPool,
+ * which are then merged two by two, also in parallel
+ *
+ * With a limit, only the limit first rows are returned. If they fit the budget they are
+ * kept on a bounded heap (a top-N) instead of sorting all the rows
+ */
+class SortOperator : public Operator {
+private:
+    Operator * child;
+    vector<SortKey> sort_keys;
+    long long limit;
+    size_t memory_budget;
+
+    bool consumed;
+    bool has_columns;
+    vector<ColumnVector> columns; // the child columns, without values
+    unsigned key_size;
+    unsigned record_size; // key, registry position and row values
+    unsigned long long number_of_rows;
+
+    vector<char> records;
+    vector<uint32_t> order; // the record indexes, sorted (or a heap on the top-N)
+    vector<string> run_paths;
+
+    //The merge of the runs
+    vector<ifstream *> run_files;
+    vector<vector<char> > run_records; // the current record of each run
+    vector<unsigned> run_heap; // the runs with records left, smallest record first
+
+    size_t output_position;
+    long long returned;
+    size_t memory_peak; // the largest size of the records and their order, in bytes
+
+    /**
+     * Copy the column types from the first batch and compute the record size
+     */
+    void setColumns(const Batch & batch);
+
+    /**
+     * Write the sort key of a row
+     */
+    void encodeKey(const Batch & batch, unsigned row, char * record);
+
+    /**
+     * Write the registry position and the values of a row, after the key
+     */
+    void encodeValues(const Batch & batch, unsigned row, char * record);
+
+    /**
+     * Read the registry position and the values of a record to a row of the batch
+     */
+    void decodeValues(const char * record, Batch & batch, unsigned row);
+
+    /**
+     * Read all the rows of the child, sorting them in memory or in runs
+     */
+    void consume();
+
+    /**
+     * Sort the records in memory, in parallel if there are at least 2 * PARALLEL_SORT_ROWS
+     */
+    void sortRecords();
+
+    /**
+     * Update the memory peak with the records in memory
+     */
+    void updateMemoryPeak();
+
+    /**
+     * Write the records in memory to a new run, in order, and clear them
+     */
+    void spillRun();
+
+    /**
+     * Read the next record of a run
+     * @return false if the run is over
+     */
+    bool readRun(unsigned run);
+
+    /**
+     * @return true if the record a is before the record b
+     */
+    bool isBefore(const char * a, const char * b) const;
+
+public:
+    static const size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+    static const size_t PARALLEL_SORT_ROWS = 16 * 1024; // the smallest chunk of a parallel sort
+
+    /**
+     * @param sort_keys - the ORDER BY columns, with the positions on the child batches
+     * @param limit - the number of rows to return, or -1 to return all of them
+     * @param memory_budget - the bytes of the records kept in memory
+     * @constructor
+     */
+    SortOperator(Operator * child, const vector<SortKey> & sort_keys, long long limit = -1,
+                 size_t memory_budget = DEFAULT_MEMORY_BUDGET);
+
+    /**
+     * @destructor
+     */
+    ~SortOperator();
+
+    bool next(Batch & batch);
+
+    /**
+     * @return true if the rows of a table scan are already in the ORDER BY order. The rows
+     *         of a table are read in the header order, which is the _id order
+     */
+    static bool isHeaderOrder(const vector<SortKey> & sort_keys);
+
+    /**
+     * @return the largest number of bytes the records used in memory
+     */
+    size_t getMemoryPeak() const;
+
+    /**
+     * @return the number of runs written to disk, 0 if the rows were sorted in memory
+     */
+    unsigned getNumberOfRuns() const;
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+SortKey::SortKey(int column, bool descending) : column(column), descending(descending) {
+}
+
+SortKey SortKey::parse(const string & item, const vector<string> & column_names) {
+    vector<string> words;
+    stringstream stream(item);
+    string word;
+    while (stream >> word) {
+        words.push_back(word);
+    }
+    if (words.empty() || words.size() > 2) {
+        throw std::invalid_argument("Invalid ORDER BY item \"" + item + "\"");
+    }
+
+    bool descending = false;
+    if (words.size() == 2) {
+        string direction = words[1];
+        transform(direction.begin(), direction.end(), direction.begin(), ::tolower);
+        if (direction != "asc" && direction != "desc") {
+            throw std::invalid_argument("Invalid ORDER BY direction \"" + words[1] + "\"");
+        }
+        descending = direction == "desc";
+    }
+
+    //The names are compared ignoring the case, as Schema::getColPosition does
+    for (unsigned i = 0; i < column_names.size(); i++) {
+        if (strcasecmp(column_names[i].c_str(), words[0].c_str()) == 0) {
+            return SortKey(i, descending);
+        }
+    }
+    throw std::invalid_argument("There is no column \"" + words[0] + "\" to order by");
+}
+
+SortOperator::SortOperator(Operator * child, const vector<SortKey> & sort_keys, long long limit, size_t memory_budget) {
+    this->child = child;
+    this->sort_keys = sort_keys;
+    this->limit = limit;
+    this->memory_budget = memory_budget;
+    this->consumed = false;
+    this->has_columns = false;
+    this->key_size = 0;
+    this->record_size = 0;
+    this->number_of_rows = 0;
+    this->output_position = 0;
+    this->returned = 0;
+    this->memory_peak = 0;
+}
+
+SortOperator::~SortOperator() {
+    for (unsigned i = 0; i < run_files.size(); i++) {
+        delete run_files[i];
+    }
+    for (vector<string>::iterator it = run_paths.begin(); it != run_paths.end(); it++) {
+        remove(it->c_str());
+    }
+}
+
+bool SortOperator::isHeaderOrder(const vector<SortKey> & sort_keys) {
+    return sort_keys.empty() || (sort_keys.size() == 1 && sort_keys[0].column == 0 && !sort_keys[0].descending);
+}
+
+/**
+ * Store the lower bytes of a value, most significant first, inverted if descending
+ */
+void storeBigEndian(uint64_t value, unsigned bytes, bool descending, char * out) {
+    if (descending) {
+        value = ~value;
+    }
+    for (unsigned i = 0; i < bytes; i++) {
+        out[i] = (char) (value >> (8 * (bytes - 1 - i)));
+    }
+}
+
+/**
+ * @return the size of a value of the column on a record
+ */
+unsigned getValueSize(const ColumnVector & column) {
+    switch (column.type) {
+        case INT32: return sizeof(int32_t);
+        case INT64:
+        case FOREIGN_KEY: return sizeof(int64_t);
+        case FLOAT: return sizeof(float);
+        case DOUBLE: return sizeof(double);
+        case CHAR: return column.width;
+    }
+    return 0;
+}
+
+void SortOperator::setColumns(const Batch & batch) {
+    if (has_columns) {
+        return;
+    }
+    has_columns = true;
+
+    for (unsigned i = 0; i < batch.columns.size(); i++) {
+        columns.push_back(ColumnVector(batch.columns[i].name, batch.columns[i].type, batch.columns[i].width));
+    }
+
+    key_size = sizeof(uint64_t); // the row number
+    for (vector<SortKey>::iterator it = sort_keys.begin(); it != sort_keys.end(); it++) {
+        key_size += getValueSize(columns.at(it->column));
+    }
+    record_size = key_size + sizeof(long long);
+    for (unsigned i = 0; i < columns.size(); i++) {
+        record_size += getValueSize(columns[i]);
+    }
+}
+
+void SortOperator::encodeKey(const Batch & batch, unsigned row, char * record) {
+    for (vector<SortKey>::iterator it = sort_keys.begin(); it != sort_keys.end(); it++) {
+        const ColumnVector & column = batch.columns[it->column];
+        switch (column.type) {
+            case INT32:
+                storeBigEndian((uint32_t) column.int32_values[row] ^ 0x80000000u, sizeof(int32_t), it->descending, record);
+                break;
+            case INT64:
+            case FOREIGN_KEY:
+                storeBigEndian((uint64_t) column.int64_values[row] ^ 0x8000000000000000ULL, sizeof(int64_t), it->descending, record);
+                break;
+            case FLOAT: {
+                uint32_t bits;
+                memcpy(&bits, &column.float_values[row], sizeof(bits));
+                bits = (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+                storeBigEndian(bits, sizeof(float), it->descending, record);
+                break;
+            }
+            case DOUBLE: {
+                uint64_t bits;
+                memcpy(&bits, &column.double_values[row], sizeof(bits));
+                bits = (bits & 0x8000000000000000ULL) ? ~bits : bits | 0x8000000000000000ULL;
+                storeBigEndian(bits, sizeof(double), it->descending, record);
+                break;
+            }
+            case CHAR:
+                memcpy(record, column.getChars(row), column.width);
+                if (it->descending) {
+                    for (unsigned i = 0; i < column.width; i++) {
+                        record[i] = ~record[i];
+                    }
+                }
+                break;
+        }
+        record += getValueSize(column);
+    }
+    storeBigEndian(number_of_rows, sizeof(uint64_t), false, record);
+}
+
+void SortOperator::encodeValues(const Batch & batch, unsigned row, char * record) {
+    record += key_size;
+    memcpy(record, &batch.positions[row], sizeof(long long));
+    record += sizeof(long long);
+
+    for (unsigned i = 0; i < batch.columns.size(); i++) {
+        const ColumnVector & column = batch.columns[i];
+        switch (column.type) {
+            case INT32: memcpy(record, &column.int32_values[row], sizeof(int32_t)); break;
+            case INT64:
+            case FOREIGN_KEY: memcpy(record, &column.int64_values[row], sizeof(int64_t)); break;
+            case FLOAT: memcpy(record, &column.float_values[row], sizeof(float)); break;
+            case DOUBLE: memcpy(record, &column.double_values[row], sizeof(double)); break;
+            case CHAR: memcpy(record, column.getChars(row), column.width); break;
+        }
+        record += getValueSize(column);
+    }
+}
+
+void SortOperator::decodeValues(const char * record, Batch & batch, unsigned row) {
+    record += key_size;
+    memcpy(&batch.positions[row], record, sizeof(long long));
+    record += sizeof(long long);
+
+    for (unsigned i = 0; i < batch.columns.size(); i++) {
+        ColumnVector & column = batch.columns[i];
+        switch (column.type) {
+            case INT32: memcpy(&column.int32_values[row], record, sizeof(int32_t)); break;
+            case INT64:
+            case FOREIGN_KEY: memcpy(&column.int64_values[row], record, sizeof(int64_t)); break;
+            case FLOAT: memcpy(&column.float_values[row], record, sizeof(float)); break;
+            case DOUBLE: memcpy(&column.double_values[row], record, sizeof(double)); break;
+            case CHAR: memcpy(&column.char_values[(size_t) row * column.width], record, column.width); break;
+        }
+        record += getValueSize(column);
+    }
+}
+
+bool SortOperator::isBefore(const char * a, const char * b) const {
+    return memcmp(a, b, key_size) < 0;
+}
+
+void SortOperator::sortRecords() {
+    const char * data = records.empty() ? NULL : &records[0];
+    unsigned size = record_size;
+    unsigned compared_bytes = key_size;
+    auto compare = [data, size, compared_bytes](uint32_t a, uint32_t b) {
+        return memcmp(data + (size_t) a * size, data + (size_t) b * size, compared_bytes) < 0;
+    };
+
+    ThreadPool & pool = ThreadPool::getShared();
+    size_t number_of_chunks = min((size_t) pool.getFairShare(), order.size() / PARALLEL_SORT_ROWS);
+    if (number_of_chunks <= 1) {
+        sort(order.begin(), order.end(), compare);
+        return;
+    }
+
+    //Each chunk is sorted by a task, then each pair of neighbour chunks is merged once both
+    //are sorted, until a single chunk is left. The keys end with the row position, so no two
+    //keys are equal and the result is the same as a sort on a single thread
+    TaskGraph graph(pool);
+    vector<size_t> bounds; // the first record of each chunk, and the end of the last one
+    vector<size_t> tasks; // the task sorting (or merging) each chunk
+    for (size_t i = 0; i <= number_of_chunks; i++) {
+        bounds.push_back(order.size() * i / number_of_chunks);
+    }
+    for (size_t i = 0; i < number_of_chunks; i++) {
+        size_t first = bounds[i], last = bounds[i + 1];
+        tasks.push_back(graph.add([this, first, last, compare]() {
+            sort(order.begin() + first, order.begin() + last, compare);
+        }));
+    }
+    while (tasks.size() > 1) {
+        vector<size_t> merged_bounds;
+        vector<size_t> merged_tasks;
+        for (size_t i = 0; i < tasks.size(); i += 2) {
+            merged_bounds.push_back(bounds[i]);
+            if (i + 1 == tasks.size()) {
+                merged_tasks.push_back(tasks[i]);
+                continue;
+            }
+            size_t first = bounds[i], middle = bounds[i + 1], last = bounds[i + 2];
+            vector<size_t> dependencies;
+            dependencies.push_back(tasks[i]);
+            dependencies.push_back(tasks[i + 1]);
+            merged_tasks.push_back(graph.add([this, first, middle, last, compare]() {
+                inplace_merge(order.begin() + first, order.begin() + middle, order.begin() + last, compare);
+            }, NORMAL_PRIORITY, dependencies));
+        }
+        merged_bounds.push_back(order.size());
+        bounds.swap(merged_bounds);
+        tasks.swap(merged_tasks);
+    }
+    graph.wait();
+}
+
+void SortOperator::updateMemoryPeak() {
+    memory_peak = max(memory_peak, records.capacity() + order.capacity() * sizeof(uint32_t));
+}
+
+size_t SortOperator::getMemoryPeak() const {
+    return memory_peak;
+}
+
+unsigned SortOperator::getNumberOfRuns() const {
+    return run_paths.size();
+}
+
+void SortOperator::spillRun() {
+    updateMemoryPeak();
+    sortRecords();
+
+    //A unique file for each run, even with other processes sorting on the same directory
+    string path = createTempFile("sort");
+    run_paths.push_back(path);
+
+    ofstream file;
+    file.open(path.c_str(), ios::binary | ios::trunc);
+    for (vector<uint32_t>::iterator it = order.begin(); it != order.end(); it++) {
+        file.write(&records[(size_t) *it * record_size], record_size);
+    }
+    file.close();
+
+    records.clear();
+    order.clear();
+}
+
+void SortOperator::consume() {
+    Batch batch;
+    bool top_n = false;
+    size_t max_records = 0;
+
+    while (child->next(batch)) {
+        if (!has_columns) {
+            setColumns(batch);
+            max_records = max(memory_budget / record_size, (size_t) 1);
+            //A record more than the limit, used to encode each new row before comparing
+            top_n = limit >= 0 && (size_t) limit < max_records;
+            if (top_n) {
+                records.resize((size_t) (limit + 1) * record_size);
+            }
+        }
+
+        for (vector<uint32_t>::iterator row = batch.selection.begin(); row != batch.selection.end(); row++) {
+            if (top_n) {
+                //Keep the limit smallest records, with the largest one on the top of the heap
+                char * scratch = &records[(size_t) limit * record_size];
+                encodeKey(batch, *row, scratch);
+                number_of_rows++;
+
+                const char * data = &records[0];
+                unsigned size = record_size;
+                unsigned compared_bytes = key_size;
+                auto compare = [data, size, compared_bytes](uint32_t a, uint32_t b) {
+                    return memcmp(data + (size_t) a * size, data + (size_t) b * size, compared_bytes) < 0;
+                };
+
+                if (order.size() < (size_t) limit) {
+                    char * record = &records[order.size() * record_size];
+                    memcpy(record, scratch, key_size);
+                    encodeValues(batch, *row, record);
+                    order.push_back(order.size());
+                    push_heap(order.begin(), order.end(), compare);
+                } else if (limit > 0 && isBefore(scratch, &records[(size_t) order.front() * record_size])) {
+                    pop_heap(order.begin(), order.end(), compare);
+                    char * record = &records[(size_t) order.back() * record_size];
+                    memcpy(record, scratch, key_size);
+                    encodeValues(batch, *row, record);
+                    push_heap(order.begin(), order.end(), compare);
+                }
+                continue;
+            }
+
+            size_t position = records.size();
+            records.resize(position + record_size);
+            encodeKey(batch, *row, &records[position]);
+            encodeValues(batch, *row, &records[position]);
+            order.push_back(order.size());
+            number_of_rows++;
+
+            if (order.size() >= max_records) {
+                spillRun();
+            }
+        }
+    }
+
+    updateMemoryPeak();
+    if (run_paths.empty()) {
+        sortRecords();
+        return;
+    }
+
+    //Merge the runs, starting with the first record of each one
+    if (!order.empty()) {
+        spillRun();
+    }
+    run_records.resize(run_paths.size(), vector<char>(record_size));
+    for (unsigned run = 0; run < run_paths.size(); run++) {
+        run_files.push_back(new ifstream(run_paths[run].c_str(), ios::binary));
+        if (readRun(run)) {
+            run_heap.push_back(run);
+        }
+    }
+}
+
+bool SortOperator::readRun(unsigned run) {
+    return (bool) run_files[run]->read(&run_records[run][0], record_size);
+}
+
+bool SortOperator::next(Batch & batch) {
+    if (!consumed) {
+        consumed = true;
+        consume();
+    }
+    if (!has_columns || (limit >= 0 && returned >= limit)) {
+        return false;
+    }
+
+    batch.columns = columns;
+    batch.resize(0);
+    batch.positions.clear();
+
+    size_t count = Batch::CAPACITY;
+    if (limit >= 0) {
+        count = min(count, (size_t) (limit - returned));
+    }
+
+    if (run_paths.empty()) {
+        count = min(count, order.size() - output_position);
+        batch.resize(count);
+        for (unsigned row = 0; row < count; row++) {
+            decodeValues(&records[(size_t) order[output_position + row] * record_size], batch, row);
+        }
+        output_position += count;
+    } else {
+        //k-way merge: the run with the smallest current record is on the top of the heap
+        vector<vector<char> > & current = run_records;
+        unsigned compared_bytes = key_size;
+        auto compare = [&current, compared_bytes](unsigned a, unsigned b) {
+            return memcmp(&current[a][0], &current[b][0], compared_bytes) > 0;
+        };
+        make_heap(run_heap.begin(), run_heap.end(), compare);
+
+        batch.resize(count);
+        unsigned row = 0;
+        while (row < count && !run_heap.empty()) {
+            pop_heap(run_heap.begin(), run_heap.end(), compare);
+            unsigned run = run_heap.back();
+            decodeValues(&run_records[run][0], batch, row++);
+            if (readRun(run)) {
+                push_heap(run_heap.begin(), run_heap.end(), compare);
+            } else {
+                run_heap.pop_back();
+            }
+        }
+        batch.resize(row);
+        count = row;
+    }
+
+    returned += count;
+    return count > 0;
+}
+
+#endif //SORTOPERATOR_H
@@ -0,0 +1,322 @@
+#ifndef STAGEDSCAN_H
+#define STAGEDSCAN_H
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include "operators.h"
+#include "ringbuffer.h"
+
+using namespace std;
+
+/**
+ * Scan a table with one thread for each stage, the stages connected by bounded rings of
+ * batches: a reader thread reads and decodes the blocks, the worker threads filter, probe a
+ * hash table and project them, and the consumer (the thread calling next) gets the results.
+ * Each stage works on its batch while the previous one reads the next, and a full ring makes
+ * the previous stage wait (backpressure), so a slow consumer doesn't buffer the whole table
+ * e.g.: | reader | -> ring -> | worker 1, worker 2 | -> ring -> | consumer |
+ *
+ * The batches are returned in the scan order. The stage threads are dedicated threads rather
+ * than tasks of the ThreadPool, since they wait for each other
+ * @see ParallelScanOperator
+ */
+class StagedScanOperator : public Operator {
+private:
+    /**
+     * A batch on its way between two stages. The rows of a read batch may be split in several
+     * output parts, e.g.: by the matches of a probe
+     */
+    struct Chunk {
+        long long sequence; // the position of the read batch on the scan
+        unsigned part;
+        bool last_part;
+        Batch batch;
+
+        Chunk() : sequence(-1), part(0), last_part(true) {}
+    };
+
+    /**
+     * Return the rows of the current read batch of a worker once
+     */
+    class InputOperator : public Operator {
+    private:
+        Batch * input;
+        bool has_input;
+    public:
+        InputOperator(Batch * input) : input(input), has_input(false) {}
+        void reset() { has_input = true; }
+        bool next(Batch & batch);
+    };
+
+    TableScanOperator scan;
+    Expression where;
+    const JoinHashTable * hash_table;
+    int probe_column;
+    vector<int> projection;
+    unsigned number_of_workers;
+
+    MpmcRing<Chunk> read_batches;
+    MpmcRing<Chunk> output_batches;
+    thread reader;
+    vector<thread> workers;
+    atomic<unsigned> running_workers;
+    atomic<bool> stopped;
+    mutex error_mutex;
+    exception_ptr error;
+    bool started;
+
+    map<pair<long long, unsigned>, Chunk> pending; // the parts done before the ones returned next
+    long long next_sequence;
+    unsigned next_part;
+
+    void read();
+    void work();
+
+    /**
+     * Keep the first error and stop the stages
+     */
+    void fail();
+
+public:
+    static const unsigned RING_CAPACITY = 8; // batches between two stages
+
+    /**
+     * @param scan - the blocks (or the row ids) to read and their block filter
+     * @param where - the filter of the rows, bound to the table schema
+     * @param number_of_workers - the threads filtering, probing and projecting the batches
+     * @constructor
+     */
+    StagedScanOperator(const TableScanOperator & scan, const Expression & where, unsigned number_of_workers = 1);
+
+    /**
+     * Stop the stages
+     * @destructor
+     */
+    ~StagedScanOperator();
+
+    /**
+     * Replace each row by its matches on a hash table, before the projection
+     * @see HashJoinProbeOperator
+     */
+    void setProbe(const JoinHashTable * hash_table, int key_column);
+
+    /**
+     * @param projection - the columns returned, or empty to return all of them
+     */
+    void setProjection(const vector<int> & projection);
+
+    bool next(Batch & batch);
+
+    /**
+     * Stop the stages and wait for their threads. The batches not returned yet are discarded
+     */
+    void stop();
+
+    unsigned getNumberOfThreads() const;
+
+    /**
+     * The counters of the reader, once the scan is over or stopped
+     * @see TableScanOperator
+     */
+    long long getRowsRead() const;
+    long long getBlocksRead() const;
+    long long getBlocksSkipped() const;
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+bool StagedScanOperator::InputOperator::next(Batch & batch) {
+    if (!has_input) {
+        return false;
+    }
+    has_input = false;
+    swap(batch, *input);
+    return true;
+}
+
+StagedScanOperator::StagedScanOperator(const TableScanOperator & scan, const Expression & where, unsigned number_of_workers)
+        : scan(scan), where(where), read_batches(RING_CAPACITY), output_batches(RING_CAPACITY) {
+    this->hash_table = NULL;
+    this->probe_column = -1;
+    this->number_of_workers = max(1u, number_of_workers);
+    this->running_workers = 0;
+    this->stopped = false;
+    this->started = false;
+    this->next_sequence = 0;
+    this->next_part = 0;
+}
+
+StagedScanOperator::~StagedScanOperator() {
+    stop();
+}
+
+void StagedScanOperator::setProbe(const JoinHashTable * hash_table, int key_column) {
+    this->hash_table = hash_table;
+    this->probe_column = key_column;
+}
+
+void StagedScanOperator::setProjection(const vector<int> & projection) {
+    this->projection = projection;
+}
+
+void StagedScanOperator::fail() {
+    {
+        unique_lock<mutex> lock(error_mutex);
+        if (!error) {
+            error = current_exception();
+        }
+    }
+    stopped = true;
+    read_batches.close();
+    output_batches.close();
+}
+
+void StagedScanOperator::read() {
+    try {
+        Chunk chunk;
+        for (long long sequence = 0; !stopped && scan.next(chunk.batch); sequence++) {
+            chunk.sequence = sequence;
+            if (!read_batches.push(chunk)) {
+                break;
+            }
+        }
+    } catch (...) {
+        fail();
+    }
+    read_batches.close();
+}
+
+void StagedScanOperator::work() {
+    try {
+        //The steps of the worker, reused for each read batch
+        Batch input;
+        InputOperator input_operator(&input);
+        Operator * output = &input_operator;
+        FilterOperator filter_operator(output, where);
+        if (!where.isAlwaysTrue()) {
+            output = &filter_operator;
+        }
+        unique_ptr<HashJoinProbeOperator> probe_operator;
+        if (hash_table != NULL) {
+            probe_operator.reset(new HashJoinProbeOperator(output, hash_table, probe_column));
+            output = probe_operator.get();
+        }
+        ProjectOperator project_operator(output, projection);
+        if (!projection.empty()) {
+            output = &project_operator;
+        }
+
+        Chunk read_chunk;
+        while (!stopped && read_batches.pop(read_chunk)) {
+            swap(input, read_chunk.batch);
+            input_operator.reset();
+
+            //Every read batch ends with a last part, even an empty one, so the consumer knows
+            //when to go on with the next read batch
+            Chunk chunk;
+            chunk.sequence = read_chunk.sequence;
+            bool has_part = output->next(chunk.batch);
+            if (!has_part) {
+                chunk.batch = Batch();
+                output_batches.push(chunk);
+            }
+            while (has_part) {
+                Chunk next_chunk;
+                next_chunk.sequence = chunk.sequence;
+                next_chunk.part = chunk.part + 1;
+                has_part = output->next(next_chunk.batch);
+                chunk.last_part = !has_part;
+                if (!output_batches.push(chunk)) {
+                    break;
+                }
+                chunk = move(next_chunk);
+            }
+        }
+    } catch (...) {
+        fail();
+    }
+    if (--running_workers == 0) {
+        output_batches.close();
+    }
+}
+
+bool StagedScanOperator::next(Batch & batch) {
+    if (!started) {
+        started = true;
+        running_workers = number_of_workers;
+        reader = thread(&StagedScanOperator::read, this);
+        for (unsigned i = 0; i < number_of_workers; i++) {
+            workers.push_back(thread(&StagedScanOperator::work, this));
+        }
+    }
+
+    while (!stopped) {
+        map<pair<long long, unsigned>, Chunk>::iterator next_chunk = pending.find(make_pair(next_sequence, next_part));
+        if (next_chunk != pending.end()) {
+            Chunk chunk = move(next_chunk->second);
+            pending.erase(next_chunk);
+            if (chunk.last_part) {
+                next_sequence++;
+                next_part = 0;
+            } else {
+                next_part++;
+            }
+            if (chunk.batch.getSelectedCount() == 0) {
+                continue;
+            }
+            batch = move(chunk.batch);
+            return true;
+        }
+
+        Chunk chunk;
+        if (!output_batches.pop(chunk)) {
+            break;
+        }
+        pending[make_pair(chunk.sequence, chunk.part)] = move(chunk);
+    }
+
+    unique_lock<mutex> lock(error_mutex);
+    if (error) {
+        rethrow_exception(error);
+    }
+    return false;
+}
+
+void StagedScanOperator::stop() {
+    stopped = true;
+    read_batches.close();
+    output_batches.close();
+    if (reader.joinable()) {
+        reader.join();
+    }
+    for (vector<thread>::iterator it = workers.begin(); it != workers.end(); it++) {
+        if (it->joinable()) {
+            it->join();
+        }
+    }
+}
+
+unsigned StagedScanOperator::getNumberOfThreads() const {
+    return number_of_workers + 1;
+}
+
+long long StagedScanOperator::getRowsRead() const {
+    return scan.getRowsRead();
+}
+
+long long StagedScanOperator::getBlocksRead() const {
+    return scan.getBlocksRead();
+}
+
+long long StagedScanOperator::getBlocksSkipped() const {
+    return scan.getBlocksSkipped();
+}
+
+#endif //STAGEDSCAN_H
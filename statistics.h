@@ -0,0 +1,412 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "schema.h"
+
+using namespace std;
+
+/**
+ * A HyperLogLog sketch, estimating the number of distinct values added with
+ * 2^HLL_PRECISION registers of one byte, with a standard error of about 1.6%
+ */
+const unsigned HLL_PRECISION = 12;
+const unsigned HLL_REGISTERS = 1 << HLL_PRECISION;
+
+class HyperLogLog {
+private:
+    vector<uint8_t> registers;
+
+    /**
+     * 64 bits FNV-1a hash of the value followed by a final avalanche step
+     */
+    static uint64_t hash(const string & value);
+
+public:
+    /**
+     * @constructor
+     */
+    HyperLogLog();
+
+    void add(const string & value);
+
+    /**
+     * Add the values of another sketch, as if they were added to this one
+     */
+    void merge(const HyperLogLog & other);
+
+    /**
+     * @return the estimated number of distinct values
+     */
+    double estimate() const;
+
+    void write(ostream & stream) const;
+    void read(istream & stream);
+};
+
+/**
+ * The number of buckets of the equi-depth histograms: each bucket holds about the same
+ * number of values
+ */
+const unsigned HISTOGRAM_BUCKETS = 32;
+
+/**
+ * The statistics of a column, over the rows read by Table::analyze and the ones inserted after it
+ */
+struct ColumnStatistics {
+    unsigned long long null_count; // the empty values
+    bool has_range; // false for the CHAR columns, or if every value is null
+    double minimum;
+    double maximum;
+    vector<double> histogram; // the HISTOGRAM_BUCKETS + 1 bounds of the buckets, ascending
+    HyperLogLog distinct_values;
+
+    ColumnStatistics();
+};
+
+/**
+ * The statistics of every column of a table, computed by Table::analyze and used by the
+ * planner to estimate the selectivity of the predicates
+ * e.g.: for age with the histogram | 0 | 18 | 25 | 40 | 90 |, a quarter of the rows have
+ *       an age between 18 and 25
+ *
+ * A sampled Table::analyze reads only some blocks: the null counts are scaled to the whole
+ * table, and a column whose sampled values are (almost) all distinct is assumed to be unique.
+ * Table::insert keeps the counts, ranges and distinct values up to date, the histograms are only
+ * rebuilt by Table::analyze. The statistics are persisted on a file as | number_of_rows |
+ * sampled_rows | number_of_columns | followed by each column
+ */
+class TableStatistics {
+private:
+    string path;
+    vector<SchemaCol> columns;
+    vector<ColumnStatistics> column_statistics;
+    unsigned long long number_of_rows; // the rows of the table when it was analyzed, plus the inserted ones
+    unsigned long long sampled_rows; // the rows actually read
+    bool analyzed;
+    bool dirty;
+
+public:
+    /**
+     * @param path - the file where the statistics are persisted
+     * @param schema_cols - the columns of the table, _id included
+     * @constructor
+     */
+    TableStatistics(string path = "", const vector<SchemaCol> & schema_cols = vector<SchemaCol>());
+
+    /**
+     * @return true if Table::analyze was run (or the statistics were loaded)
+     */
+    bool isAnalyzed() const;
+    unsigned long long getNumberOfRows() const;
+    unsigned long long getSampledRows() const;
+
+    /**
+     * @return the estimated number of empty values of the column on the whole table
+     */
+    double getNullCount(int column_position) const;
+
+    /**
+     * @return the estimated number of distinct values of the column on the whole table
+     */
+    double getDistinctValues(int column_position) const;
+
+    /**
+     * @return false if the column has no range
+     */
+    bool getRange(int column_position, double & minimum, double & maximum) const;
+
+    /**
+     * @return the bounds of the equi-depth histogram, empty if there is none
+     */
+    const vector<double> & getHistogram(int column_position) const;
+
+    /**
+     * Add a row read by Table::analyze or inserted after it
+     * @param row - the values of every column, _id included
+     */
+    void add(const vector<string> & row);
+
+    /**
+     * Add the rows seen by another TableStatistics of the same table, e.g.: the one of another
+     * thread of Table::analyze. The histograms are not merged
+     */
+    void merge(const TableStatistics & other);
+
+    /**
+     * Finish a Table::analyze
+     * @param values - the numeric values read of each column, sorted by this method
+     * @param table_rows - the number of rows of the table, greater than the sampled rows
+     *                     when only some blocks were read
+     */
+    void finish(vector<vector<double> > & values, unsigned long long table_rows);
+
+    /**
+     * Load the statistics from the file, if any
+     * @return false if there is no file or it was written for other columns
+     */
+    bool load();
+
+    /**
+     * Write the statistics to the file, if they were changed since they were loaded
+     */
+    void save();
+
+    /**
+     * Delete the statistics and their file
+     */
+    void drop();
+};
+
+HyperLogLog::HyperLogLog() : registers(HLL_REGISTERS, 0) {
+}
+
+uint64_t HyperLogLog::hash(const string & value) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (string::const_iterator it = value.begin(); it != value.end(); it++) {
+        hash ^= (unsigned char) *it;
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void HyperLogLog::add(const string & value) {
+    uint64_t value_hash = hash(value);
+    unsigned index = value_hash >> (64 - HLL_PRECISION);
+    //The position of the first 1 bit after the index bits, the sentinel bit bounds it
+    uint64_t rest = (value_hash << HLL_PRECISION) | (1ULL << (HLL_PRECISION - 1));
+    uint8_t rank = __builtin_clzll(rest) + 1;
+    registers[index] = max(registers[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog & other) {
+    for (unsigned i = 0; i < HLL_REGISTERS; i++) {
+        registers[i] = max(registers[i], other.registers[i]);
+    }
+}
+
+double HyperLogLog::estimate() const {
+    double sum = 0;
+    unsigned zeros = 0;
+    for (unsigned i = 0; i < HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -registers[i]);
+        zeros += registers[i] == 0;
+    }
+    double m = HLL_REGISTERS;
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        //Linear counting is more precise for the small cardinalities
+        estimate = m * log(m / zeros);
+    }
+    return estimate;
+}
+
+void HyperLogLog::write(ostream & stream) const {
+    stream.write(reinterpret_cast<const char *> (&registers[0]), HLL_REGISTERS);
+}
+
+void HyperLogLog::read(istream & stream) {
+    stream.read(reinterpret_cast<char *> (&registers[0]), HLL_REGISTERS);
+}
+
+ColumnStatistics::ColumnStatistics() : null_count(0), has_range(false), minimum(numeric_limits<double>::infinity()),
+                                       maximum(-numeric_limits<double>::infinity()) {
+}
+
+TableStatistics::TableStatistics(string path, const vector<SchemaCol> & schema_cols) {
+    this->path = path;
+    this->columns = schema_cols;
+    this->column_statistics.resize(schema_cols.size());
+    this->number_of_rows = 0;
+    this->sampled_rows = 0;
+    this->analyzed = false;
+    this->dirty = false;
+}
+
+bool TableStatistics::isAnalyzed() const {
+    return analyzed;
+}
+
+unsigned long long TableStatistics::getNumberOfRows() const {
+    return number_of_rows;
+}
+
+unsigned long long TableStatistics::getSampledRows() const {
+    return sampled_rows;
+}
+
+double TableStatistics::getNullCount(int column_position) const {
+    if (sampled_rows == 0) {
+        return 0;
+    }
+    return (double) column_statistics.at(column_position).null_count * number_of_rows / sampled_rows;
+}
+
+double TableStatistics::getDistinctValues(int column_position) const {
+    double distinct_values = column_statistics.at(column_position).distinct_values.estimate();
+    double non_null_rows = sampled_rows - column_statistics.at(column_position).null_count;
+    if (sampled_rows < number_of_rows && distinct_values >= 0.9 * non_null_rows) {
+        //The values are (almost) unique on the sample, so they are assumed unique on the table
+        distinct_values *= (double) number_of_rows / sampled_rows;
+    }
+    return min(distinct_values, (double) number_of_rows);
+}
+
+bool TableStatistics::getRange(int column_position, double & minimum, double & maximum) const {
+    const ColumnStatistics & column = column_statistics.at(column_position);
+    minimum = column.minimum;
+    maximum = column.maximum;
+    return column.has_range;
+}
+
+const vector<double> & TableStatistics::getHistogram(int column_position) const {
+    return column_statistics.at(column_position).histogram;
+}
+
+void TableStatistics::add(const vector<string> & row) {
+    for (unsigned i = 0; i < columns.size() && i < row.size(); i++) {
+        ColumnStatistics & column = column_statistics[i];
+        const string & value = row[i];
+        if (value.empty()) {
+            column.null_count++;
+            continue;
+        }
+        column.distinct_values.add(columns[i].normalize(value));
+        if (columns[i].type != CHAR) {
+            double number = atof(value.c_str());
+            column.has_range = true;
+            column.minimum = min(column.minimum, number);
+            column.maximum = max(column.maximum, number);
+        }
+    }
+    number_of_rows++;
+    sampled_rows++;
+    dirty = true;
+}
+
+void TableStatistics::merge(const TableStatistics & other) {
+    for (unsigned i = 0; i < column_statistics.size(); i++) {
+        ColumnStatistics & column = column_statistics[i];
+        const ColumnStatistics & other_column = other.column_statistics.at(i);
+        column.null_count += other_column.null_count;
+        column.has_range = column.has_range || other_column.has_range;
+        column.minimum = min(column.minimum, other_column.minimum);
+        column.maximum = max(column.maximum, other_column.maximum);
+        column.distinct_values.merge(other_column.distinct_values);
+    }
+    number_of_rows += other.number_of_rows;
+    sampled_rows += other.sampled_rows;
+    dirty = true;
+}
+
+void TableStatistics::finish(vector<vector<double> > & values, unsigned long long table_rows) {
+    for (unsigned i = 0; i < column_statistics.size() && i < values.size(); i++) {
+        vector<double> & column_values = values[i];
+        vector<double> & histogram = column_statistics[i].histogram;
+        histogram.clear();
+        if (column_values.empty()) {
+            continue;
+        }
+        //The bound b is the value at the quantile b / HISTOGRAM_BUCKETS
+        sort(column_values.begin(), column_values.end());
+        for (unsigned bound = 0; bound <= HISTOGRAM_BUCKETS; bound++) {
+            size_t position = min(column_values.size() - 1, column_values.size() * bound / HISTOGRAM_BUCKETS);
+            histogram.push_back(column_values[position]);
+        }
+        histogram.back() = column_values.back();
+    }
+    number_of_rows = max(table_rows, sampled_rows);
+    analyzed = true;
+    dirty = true;
+}
+
+bool TableStatistics::load() {
+    ifstream file;
+    file.open(path.c_str(), ios::binary);
+    unsigned long long file_rows = 0, file_sampled_rows = 0;
+    unsigned number_of_columns = 0;
+    if (!file.read(reinterpret_cast<char *> (&file_rows), sizeof(file_rows)) ||
+        !file.read(reinterpret_cast<char *> (&file_sampled_rows), sizeof(file_sampled_rows)) ||
+        !file.read(reinterpret_cast<char *> (&number_of_columns), sizeof(number_of_columns)) ||
+        number_of_columns != columns.size()) {
+        return false;
+    }
+
+    vector<ColumnStatistics> file_statistics(number_of_columns);
+    for (vector<ColumnStatistics>::iterator it = file_statistics.begin(); it != file_statistics.end(); it++) {
+        unsigned histogram_size = 0;
+        file.read(reinterpret_cast<char *> (&it->null_count), sizeof(it->null_count));
+        file.read(reinterpret_cast<char *> (&it->has_range), sizeof(it->has_range));
+        file.read(reinterpret_cast<char *> (&it->minimum), sizeof(it->minimum));
+        file.read(reinterpret_cast<char *> (&it->maximum), sizeof(it->maximum));
+        file.read(reinterpret_cast<char *> (&histogram_size), sizeof(histogram_size));
+        if (!file || histogram_size > HISTOGRAM_BUCKETS + 1) {
+            return false;
+        }
+        it->histogram.resize(histogram_size);
+        if (histogram_size > 0) {
+            file.read(reinterpret_cast<char *> (&it->histogram[0]), sizeof(double) * histogram_size);
+        }
+        it->distinct_values.read(file);
+    }
+    if (!file) {
+        return false;
+    }
+
+    column_statistics = file_statistics;
+    number_of_rows = file_rows;
+    sampled_rows = file_sampled_rows;
+    analyzed = true;
+    dirty = false;
+    return true;
+}
+
+void TableStatistics::save() {
+    if (!dirty || !analyzed || path.empty()) {
+        return;
+    }
+    ofstream file;
+    file.open(path.c_str(), ios::binary | ios::trunc);
+    unsigned number_of_columns = columns.size();
+    file.write(reinterpret_cast<const char *> (&number_of_rows), sizeof(number_of_rows));
+    file.write(reinterpret_cast<const char *> (&sampled_rows), sizeof(sampled_rows));
+    file.write(reinterpret_cast<const char *> (&number_of_columns), sizeof(number_of_columns));
+    for (vector<ColumnStatistics>::const_iterator it = column_statistics.begin(); it != column_statistics.end(); it++) {
+        unsigned histogram_size = it->histogram.size();
+        file.write(reinterpret_cast<const char *> (&it->null_count), sizeof(it->null_count));
+        file.write(reinterpret_cast<const char *> (&it->has_range), sizeof(it->has_range));
+        file.write(reinterpret_cast<const char *> (&it->minimum), sizeof(it->minimum));
+        file.write(reinterpret_cast<const char *> (&it->maximum), sizeof(it->maximum));
+        file.write(reinterpret_cast<const char *> (&histogram_size), sizeof(histogram_size));
+        if (histogram_size > 0) {
+            file.write(reinterpret_cast<const char *> (&it->histogram[0]), sizeof(double) * histogram_size);
+        }
+        it->distinct_values.write(file);
+    }
+    file.close();
+    dirty = false;
+}
+
+void TableStatistics::drop() {
+    column_statistics.assign(columns.size(), ColumnStatistics());
+    number_of_rows = 0;
+    sampled_rows = 0;
+    analyzed = false;
+    dirty = false;
+    remove(path.c_str());
+}
+
+#endif //STATISTICS_H
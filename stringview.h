@@ -0,0 +1,130 @@
+#ifndef STRINGVIEW_H
+#define STRINGVIEW_H
+
+#include <string>
+#include <ostream>
+#include <string.h>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+using namespace std;
+
+/**
+ * The bytes of a string kept by something else, e.g.: a CHAR value on a batch of a Cursor.
+ * It's valid as long as the bytes are, and it converts to std::string_view on C++17
+ * e.g.: StringView name = cursor.getStringView(name_column);
+ *       if (name == "Janet") ...
+ */
+class StringView {
+private:
+    const char * bytes;
+    size_t length;
+
+public:
+    /**
+     * An empty view
+     * @constructor
+     */
+    StringView();
+
+    /**
+     * @constructor
+     */
+    StringView(const char * bytes, size_t length);
+
+    /**
+     * @param bytes - a string ending with '\0'
+     * @constructor
+     */
+    StringView(const char * bytes);
+
+    /**
+     * @constructor
+     */
+    StringView(const string & value);
+
+    const char * data() const;
+    size_t size() const;
+    bool empty() const;
+    char operator[](size_t i) const;
+    const char * begin() const;
+    const char * end() const;
+
+    /**
+     * @return a copy of the bytes
+     */
+    string toString() const;
+
+#if __cplusplus >= 201703L
+    operator std::string_view() const;
+#endif
+};
+
+bool operator==(const StringView & a, const StringView & b);
+bool operator!=(const StringView & a, const StringView & b);
+ostream & operator<<(ostream & stream, const StringView & view);
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+StringView::StringView() : bytes(""), length(0) {
+}
+
+StringView::StringView(const char * bytes, size_t length) : bytes(bytes), length(length) {
+}
+
+StringView::StringView(const char * bytes) : bytes(bytes), length(strlen(bytes)) {
+}
+
+StringView::StringView(const string & value) : bytes(value.data()), length(value.size()) {
+}
+
+const char * StringView::data() const {
+    return bytes;
+}
+
+size_t StringView::size() const {
+    return length;
+}
+
+bool StringView::empty() const {
+    return length == 0;
+}
+
+char StringView::operator[](size_t i) const {
+    return bytes[i];
+}
+
+const char * StringView::begin() const {
+    return bytes;
+}
+
+const char * StringView::end() const {
+    return bytes + length;
+}
+
+string StringView::toString() const {
+    return string(bytes, length);
+}
+
+#if __cplusplus >= 201703L
+StringView::operator std::string_view() const {
+    return std::string_view(bytes, length);
+}
+#endif
+
+bool operator==(const StringView & a, const StringView & b) {
+    return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+bool operator!=(const StringView & a, const StringView & b) {
+    return !(a == b);
+}
+
+ostream & operator<<(ostream & stream, const StringView & view) {
+    return stream.write(view.data(), view.size());
+}
+
+#endif //STRINGVIEW_H
@@ -6,13 +6,43 @@
 #include "cursor.h"
 #include "queryable.h"
 #include "join.h"
+#include "predicate.h"
+#include "bloomfilter.h"
+#include "bitmapindex.h"
+#include "operators.h"
+#include "hashaggregate.h"
+#include "sortoperator.h"
+#include "rowlayout.h"
+#include "queryparser.h"
+#include "preparedstatement.h"
+#include "zonemap.h"
+#include "hashindex.h"
+#include "planner.h"
+#include "statistics.h"
+#include "profile.h"
+#include "parallelscan.h"
+#include "pipeline.h"
+#include "admission.h"
+#include "ringbuffer.h"
+#include "stagedscan.h"
+#include "asyncio.h"
+#include "asyncresult.h"
 #include <fstream>
 #include <time.h>
 #include <string.h>
 #include <algorithm>
 #include <utility> //std::pair
+#include <limits>
 #include <stdio.h>
-
+#include <thread>
+
+/**
+ * How the scans of more than one block run
+ */
+enum ExecutionMode {
+    MORSEL_EXECUTION, // the tasks of the pool read, filter and project their own morsels
+    STAGED_EXECUTION  // a reader thread and filter threads, connected by rings
+};
 
 class Table : public Queryable{
 private:
@@ -23,6 +53,20 @@ private:
     string path;
     string header_file_path;
     header_t * header; // _id, registry_position
+    vector<BlockBloomFilter> bloom_filters;
+    vector<BitmapIndex> bitmap_indexes;
+    vector<HashIndex> hash_indexes;
+    ZoneMap zone_map;
+    TableStatistics statistics;
+    const RowKernels * row_kernels; // NULL if no registered layout matches the schema
+    StatementCache statement_cache;
+    AdmissionController * admission_controller; // NULL to run every query at once
+    ExecutionMode execution_mode;
+    AsyncIo * async_io;
+    int data_file; // the table file, opened for reading on the first read
+    mutex data_file_mutex;
+    unsigned io_queue_depth; // the blocks read ahead by a scan
+    unique_ptr<IoCompletionQueue> completion_queue; // of an AsyncIo other than the shared one
 
     friend class TableBenchmark;
 
@@ -30,7 +74,7 @@ private:
      * Save a value to the file using the correct type and size. The file
      * will not be opened nor closed inside this method
      */
-    void convertAndSave(ofstream *file, string * value, SchemaCol * schema_col);
+    void convertAndSave(ostream *file, string * value, SchemaCol * schema_col);
 
     /**
      * Inserts the registry_position on the header file. The insertion will
@@ -39,11 +83,163 @@ private:
      */
     void insertOnHeaderFile(HeaderFile * header_file);
 
+    /**
+     * Write the columns of a row (_id included) to the file, with the row kernels if any
+     */
+    void saveRow(ostream * file, vector<string> & row);
+
+    /**
+     * Write a registry: its header followed by the columns of the row (_id included)
+     */
+    void saveRegistry(ostream * file, vector<string> & row, time_t time_stamp);
+
+    /**
+     * Add a new row (_id included) to the bloom filters, the indexes, the zone map and the statistics
+     */
+    void indexRow(long long _id, vector<string> & row);
+
+    /**
+     * @return the descriptor of the table file, opened for reading if it's not yet
+     */
+    int getDataFile();
+
+    /**
+     * Read the rows of several lists of ids, each list to its batch. The runs of registries
+     * that are contiguous on the table file are read at once, and the reads of all the
+     * lists are submitted together
+     */
+    void readRowLists(const vector<const vector<uint32_t> *> & row_id_lists, const vector<Batch *> & batches);
+
+    /**
+     * Plan the reads of the registries for getRows: the positions are sorted, and the
+     * registries close to each other are read at once
+     * @param row_offsets - filled with the offset of each registry on the buffer
+     */
+    void planRowReads(const vector<long long> & registry_positions, vector<char> & buffer, vector<IoRequest> & requests,
+                      vector<size_t> & row_offsets);
+
+    /**
+     * @return the queue completing the asynchronous reads of the AsyncIo of the table
+     */
+    IoCompletionQueue & getCompletionQueue();
+
     /**
      * Load the table header from the memory
      */
     void loadHeader();
 
+    /**
+     * @return the size of a registry, header included
+     */
+    unsigned getRegistrySize();
+
+    /**
+     * Convert a registry read from the table file to a row
+     * @param registry - points to the beginning of the registry (the RegistryHeader)
+     * @param row - the vector where the _id and the row content are pushed
+     * @see RowKernels::decode
+     */
+    void decodeRow(const char * registry, vector<string> & row);
+
+    /**
+     * Write the bloom filters, bitmap indexes, zone maps and statistics changed since the last
+     * call to their files
+     */
+    void saveIndexes();
+
+    /**
+     * Decode count contiguous registries to the rows first_row to first_row + count - 1
+     * of the batch. Each column is copied by a loop specialized for its type
+     * @see RowKernels::decodeRegistries
+     * @param buffer - points to the beginning of the first registry
+     */
+    void decodeRegistries(const char * buffer, unsigned count, Batch & batch, unsigned first_row);
+
+    /**
+     * Read the values of a column with LOW_PRIORITY tasks of the shared ThreadPool, one for
+     * each block, e.g.: to build an index without delaying the queries
+     * @param first_block - the first block read, the earlier ones are left empty
+     * @return the values of each block
+     */
+    vector<vector<string> > readColumnBlocks(int column_position, long long first_block = 0);
+
+    /**
+     * Evaluate the expression with the bitmap indexes. AND, OR and NOT are evaluated as
+     * bitmap operations. The predicates of an AND on columns without a bitmap index are
+     * ignored, so the result is a superset of the matching rows
+     * @param rows - set to the ids of the rows that may match the expression
+     * @param exact - set to false if some of the rows may not match the expression
+     * @return false if the bitmap indexes can't be used to evaluate the expression
+     */
+    bool lookupBitmapIndexes(const Expression & where, RoaringBitmap & rows, bool & exact);
+
+    /**
+     * Find the rows that may match the _id predicates of the expression (=, <, <=, >, >=
+     * on the _id, alone or in a top level AND), with a binary search on the header
+     * @param first_row - set to the position on the header of the first row that may match
+     * @param end_row - set to the position of the last row that may match + 1
+     * @return false if the expression doesn't restrict the _id
+     */
+    bool getIdRange(const Expression & where, long long & first_row, long long & end_row);
+
+    /**
+     * Add the rows not covered by the zone map yet, e.g.: all of them if the zone map file
+     * is missing. Called when the schema is set, the inserts keep the zone map up to date
+     */
+    void updateZoneMap();
+
+    /**
+     * @return what the zone maps and the indexes tell about the values of each column
+     */
+    vector<ColumnEstimate> getColumnEstimates();
+
+    /**
+     * Run a query with a JOIN. The rows are the ones of this table followed by the ones of the
+     * joined table, whose columns are named table.column (or just column, if no column of this
+     * table has the name)
+     * @param profile - if not NULL, set to what each step of the join did
+     * @throw invalid_argument if the query has a GROUP BY or aggregates
+     */
+    Cursor queryJoin(const SelectStatement & statement, Table * joined_table, OperatorProfile * profile = NULL);
+
+    /**
+     * Run a parsed query, ignoring its EXPLAIN
+     * @param profile - if not NULL, set to what each operator did
+     */
+    Cursor run(const SelectStatement & statement, Table * joined_table, OperatorProfile * profile);
+
+    /**
+     * Wait for the admission controller to admit a query, then run it with the deadline of its
+     * ticket checked by the scans
+     * @see Table::run
+     */
+    Cursor admitAndRun(const SelectStatement & statement, Table * joined_table, OperatorProfile * profile);
+
+    /**
+     * The lines of Table::explain
+     * @param estimate - set to the cost, the rows read and the memory of the whole query
+     */
+    vector<string> plan(const SelectStatement & statement, Table * joined_table, QueryEstimate & estimate);
+
+    /**
+     * @return the position of the select columns, where * and an empty select are all the columns
+     * @param column_names - the names of the returned columns are pushed to it
+     */
+    vector<int> getProjection(vector<string> & select, vector<string> & column_names);
+
+    /**
+     * The access paths of Table::getAccessPaths, restricted to the full scan and the paths of
+     * a type unless all_types is true
+     */
+    vector<AccessPath> findAccessPaths(const Expression & where, bool all_types, AccessPathType type);
+
+    /**
+     * Table::scanBatches once the access path is chosen
+     * @param where - the condition, bound to the table schema
+     */
+    vector<Batch> scanPath(vector<int> & projection, Expression & where, const AccessPath & path, const vector<SortKey> & order_by,
+                           long long limit, long long offset, OperatorProfile * profile);
+
 public:
 
     /**
@@ -59,7 +255,9 @@ public:
     ~Table();
 
     /**
-     * Import the schema using the Schema standard method
+     * Import the schema using the Schema standard method. If a registered row layout
+     * matches the schema, its kernels are used to read and write the rows
+     * @see registerRowLayout
      */
     void importSchema(const string & path);
 
@@ -72,6 +270,159 @@ public:
     Schema getSchema();
     header_t * getHeader();
 
+    /**
+     * @return the kernels of the row layout matching the schema, or NULL if the rows
+     *         are read and written column by column
+     */
+    const RowKernels * getRowKernels();
+
+    /*****************************************
+     ************* BLOCK METHODS *************
+     *****************************************/
+
+    long long getNumberOfBlocks();
+
+    /**
+     * Read the rows of a block. When the registries of the block are contiguous on
+     * the table file (the usual case, since rows are only appended) they are read at once
+     * @see Queryable::readBlock
+     */
+    void readBlock(long long block, vector<vector<string> > & rows, vector<long long> & positions);
+
+    /**
+     * @see Queryable::readBlock
+     */
+    void readBlock(long long block, Batch & batch);
+
+    /**
+     * @see Queryable::readBlocks
+     */
+    void readBlocks(const vector<long long> & blocks, vector<Batch> & batches);
+
+    /**
+     * The runs of registries that are contiguous on the table file are read at once, and
+     * the reads of the runs are submitted together
+     * @see Queryable::readRows
+     */
+    void readRows(const vector<uint32_t> & row_ids, Batch & batch);
+
+    /**
+     * Check the bloom filter of the column, if any. Columns without a bloom filter
+     * always return true
+     * @see Queryable::blockMayContain
+     */
+    bool blockMayContain(int column_position, long long block, const vector<string> & values);
+
+    /**
+     * Check the bloom filter (for = and IN) and the zone map (for comparisons) of the column
+     * @see Queryable::blockMayMatch
+     */
+    bool blockMayMatch(long long block, const Predicate & predicate);
+
+    /**
+     * Keep a bloom filter for each block of the column, used by Table::scan to skip the
+     * blocks that can't match an = or IN predicate, and by the hash join to skip probe
+     * blocks. The filters are persisted on <table>_<column>_bloom.dat and updated by
+     * Table::insert. If the file is missing, the filters are built from the table rows,
+     * and if it does not cover every row, the blocks from its last one on are rebuilt
+     */
+    void addBloomFilter(string column);
+
+    /**
+     * Keep a bitmap index of the column, used by Table::scan to get the matching rows
+     * without reading the whole table. The index is persisted on <table>_<column>_bitmap.dat
+     * and updated by Table::insert. If the file is missing or outdated, the index is built
+     * from the table rows
+     * @see BitmapIndex
+     */
+    void addBitmapIndex(string column);
+
+    /**
+     * Keep a hash index of the column, used by Table::scan to read only the rows of the
+     * values of an = or IN predicate. The index is kept in memory and updated by Table::insert
+     * @see HashIndex
+     */
+    void addHashIndex(string column);
+
+    /**
+     * Estimate the cost of every way of reading the rows that may match the expression:
+     * a full scan, a scan of the blocks not excluded by the zone maps and bloom filters,
+     * a binary search of the _id range on the header, a hash index lookup and a bitmap
+     * index scan, when the indexes exist
+     * @param where - the condition, which must be bound to the table schema
+     * @return the applicable access paths, the full scan first
+     * @see CostModel
+     */
+    vector<AccessPath> getAccessPaths(const Expression & where);
+
+    /**
+     * @return the access path with the lowest cost
+     * @see Table::getAccessPaths
+     */
+    AccessPath chooseAccessPath(const Expression & where);
+
+    /**
+     * Estimate only the access paths of a type, e.g.: to read the rows of a prepared statement
+     * the way its first execution did, without costing the other paths again
+     * @return the cheapest access path of the type, or the full scan if none applies to the expression
+     * @see PreparedStatement
+     */
+    AccessPath getAccessPath(const Expression & where, AccessPathType type);
+
+    /**
+     * Compute the statistics of every column (null count, range, equi-depth histogram and
+     * distinct values), used by the planner to estimate the rows matching a WHERE. The
+     * blocks are split among LOW_PRIORITY tasks of the shared ThreadPool. The statistics are kept up to date
+     * by Table::insert and saved on a file next to the table
+     * @param sample_fraction - the fraction of the blocks to read, e.g.: 0.1 reads one block
+     *                          out of 10, the first one included
+     * @see TableStatistics
+     */
+    void analyze(double sample_fraction = 1);
+
+    TableStatistics & getStatistics();
+
+    /**
+     * Describe how a query would run, one line for each operator from the output to the
+     * table, with the estimated cost (including the cost of the operators below) and the
+     * estimated number of rows, followed by the access paths that were considered
+     * e.g.: Sort points DESC (cost=1520.3 rows=40)
+     *         Filter age > 10 (cost=1200.0 rows=40)
+     *           Zone map scan 1 of 3 blocks (cost=1200.0 rows=1024)
+     * The same lines are returned by query("EXPLAIN SELECT ..."), as a "plan" column
+     */
+    vector<string> explain(const SelectStatement & statement, Table * joined_table = NULL);
+
+    /**
+     * Admit the queries of the table (and its joins) through a controller, shared by the
+     * tables that compete for the same threads and memory. The point lookups run by
+     * Table::execute are never queued
+     * @param admission_controller - NULL to run every query at once
+     * @see AdmissionController
+     */
+    void setAdmissionController(AdmissionController * admission_controller);
+
+    /**
+     * @see ParallelScanOperator
+     * @see StagedScanOperator
+     */
+    void setExecutionMode(ExecutionMode execution_mode);
+
+    /**
+     * @param async_io - reads the table file, AsyncIo::getShared by default
+     */
+    void setAsyncIo(AsyncIo * async_io);
+
+    /**
+     * @param io_queue_depth - the blocks a scan reads ahead, submitted together. 1 to read
+     *                         each block when its rows are needed
+     * @see TableScanOperator::setReadAhead
+     */
+    void setIoQueueDepth(unsigned io_queue_depth);
+    unsigned getIoQueueDepth() const;
+
+    static const unsigned DEFAULT_IO_QUEUE_DEPTH = 4;
+
     /*****************************************
      ************* QUERY METHODS *************
      *****************************************/
@@ -99,28 +450,180 @@ public:
      */
     vector<string> getRowById(long long _id);
 
+    /**
+     * Get the rows of many registries. The positions are sorted, and the registries close
+     * to each other on the file (at most COALESCE_GAP bytes apart) are read at once, so a
+     * list of rows costs a few large reads in the file order instead of a seek for each
+     * row. The reads are submitted together
+     * @return the rows, in the same order as the positions
+     * @see Queryable::getRows
+     */
+    vector<vector<string> > getRows(const vector<long long> & registry_positions);
+
+    static const unsigned COALESCE_GAP = 16 * 1024; // the bytes read in between two registries, rather than a read each
+    static const unsigned MAX_COALESCED_READ = 1024 * 1024;
+
+    /*****************************************
+     ************* ASYNC METHODS *************
+     *****************************************/
+
+    /**
+     * getRowById without waiting for the disk: the read is queued on the IoCompletionQueue
+     * of the table, so the calling thread (e.g.: an event loop) goes on, and the result is
+     * set by the thread of the queue. The table must outlive the results
+     * e.g.: vector<string> row = co_await table.getRowByIdAsync(7);
+     *       table.getRowByIdAsync(7).then([](AsyncResult<vector<string> > row) { ... });
+     * @return the row, empty if there is no row with the _id
+     * @see AsyncResult
+     */
+    AsyncResult<vector<string> > getRowByIdAsync(long long _id);
+
+    /**
+     * getRows without waiting for the disk
+     * @see Table::getRowByIdAsync
+     */
+    AsyncResult<vector<vector<string> > > getRowsAsync(const vector<long long> & registry_positions);
+
+    /**
+     * Run a query (a join included) on the shared ThreadPool, rather than on the calling thread
+     * e.g.: Cursor cursor = co_await table.queryAsync("SELECT name JOIN company ON ...", &company);
+     */
+    AsyncResult<Cursor> queryAsync(const string & statement, Table * joined_table = NULL);
+
 
-    Join join(string thisCollumn, Table* otherTable, string otherCollumn, JoinType join_type, vector<long> *this_table_ids = NULL);
+    /**
+     * @param limit - stop after matching a number of rows, or -1 to match all of them
+     * @throw invalid_argument if the join misses the deadline of the admission controller
+     * @see Join::Join
+     */
+    Join join(string thisCollumn, Table* otherTable, string otherCollumn, JoinType join_type, vector<long> *this_table_ids = NULL,
+              long long limit = -1);
     /**
      * Deletes the table and all its associated files
      */
     void drop();
 
+    /**
+     * Read all the rows matching the expression. When the bitmap indexes can evaluate
+     * the expression only the rows they return are read, otherwise the table is read block
+     * by block, skipping the blocks excluded by the bloom filters. The rows are filtered
+     * and projected a batch at a time
+     * @see Operator
+     * @param projection - the position of the columns to return, in order
+     * @param where - the condition, which is bound to the table schema
+     * @param order_by - the sort columns. Without them, or when ordering by _id, the rows
+     *                   are read in the header order (backwards for a descending _id) and
+     *                   not sorted
+     * @param limit - the number of rows to return, or -1 to return all of them. The scan
+     *                stops reading once the limit is reached
+     * @param offset - the number of rows to skip before the first returned row
+     * @param profile - if not NULL, set to what each operator did
+     * @return the projected rows, in the header order if there is no order_by
+     * @see SortOperator
+     */
+    vector<vector<string> > scan(vector<int> & projection, Expression & where,
+                                 const vector<SortKey> & order_by = vector<SortKey>(), long long limit = -1, long long offset = 0,
+                                 OperatorProfile * profile = NULL);
+
+    /**
+     * The same as scan, but the rows are left in the batches returned by the operators, so
+     * a Cursor reads their values without converting them to strings
+     * @return the projected batches, each one with at least a selected row
+     */
+    vector<Batch> scanBatches(vector<int> & projection, Expression & where,
+                              const vector<SortKey> & order_by = vector<SortKey>(), long long limit = -1, long long offset = 0,
+                              OperatorProfile * profile = NULL);
+
+    /**
+     * Group the rows matching the expression and compute the aggregates of each group.
+     * The blocks are split between the tasks of the shared ThreadPool, each one aggregating its rows
+     * on its own hash table, and the tables are merged at the end
+     * @see HashAggregateOperator
+     * @param group_by - the position of the group columns
+     * @param aggregates - the aggregates, with the position of the aggregated columns
+     * @param where - the condition, which is bound to the table schema
+     * @param order_by - the sort columns, with the positions on the result rows
+     * @param limit - the number of rows to return, or -1 to return all of them
+     * @param offset - the number of rows to skip before the first returned row
+     * @param profile - if not NULL, set to what each operator did
+     * @return one row for each group, with the group columns followed by the aggregates.
+     *         Without group columns there is a single row
+     */
+    vector<vector<string> > aggregate(vector<int> & group_by, vector<Aggregate> & aggregates, Expression & where,
+                                      const vector<SortKey> & order_by = vector<SortKey>(), long long limit = -1,
+                                      long long offset = 0, OperatorProfile * profile = NULL);
+
     /**
      * Perform a query. Note that the string is case insensitive and the FROM clause is omitted
      * because the FROM is for the table instance.
-     * Supported arguments: SELECT, *, WHERE, =, <, >, <=, >=, !=
+     * Supported arguments: SELECT, *, JOIN ... ON, WHERE, =, <, >, <=, >=, !=, <>, AND, OR, NOT, IN, BETWEEN,
+     * LIKE, COUNT, SUM, AVG, MIN, MAX, GROUP BY, ORDER BY, LIMIT, OFFSET. The keywords and the column
+     * names are case insensitive, the values between single quotes are not
+     * @see QueryParser
      * e.g.: query("SELECT * WHERE _id=123") -> returns the only row where the _id is equals to 123
-     * e.g.2: query("select name, age where age > 10 and name='bruno'") -> returns the name and age where
-     *        the age > 10 and the name is equal to bruno (case insensitive)
+     * e.g.2: query("select name, age where age > 10 and (name='Bruno' or name in ('Ana', 'Maria'))")
+     *        -> returns the name and age where the age > 10 and the name is Bruno, Ana or Maria
      * e.g.3: query("SELECT *") -> returns all the columns
+     * e.g.4: query("SELECT company_id, COUNT(*) GROUP BY company_id") -> returns the number of rows
+     *        of each company_id
+     * e.g.5: query("SELECT name ORDER BY points DESC, name LIMIT 10") -> returns the names of the
+     *        10 rows with the most points. The GROUP BY, ORDER BY, LIMIT and OFFSET clauses must
+     *        be the last ones, in this order
+     * e.g.6: query("SELECT * LIMIT 10 OFFSET 20") -> returns the rows 21 to 30, only reading them
+     * e.g.7: person.query("SELECT name, company.name JOIN company ON company_id = company._id", &company)
+     *        -> returns the name of each person with the name of its company
      * @param q - the query on a raw string format
+     * @param joined_table - the table of the JOIN clause, if any
+     * @throw invalid_argument if the query is not valid
      * @return the cursor associated with the query
      */
-    Cursor query(string q);
+    Cursor query(string q, Table * joined_table = NULL);
+
+    /**
+     * Run a parsed query
+     * @see Table::query(string)
+     */
+    Cursor query(const SelectStatement & statement, Table * joined_table = NULL);
+
+    /**
+     * Run a query and describe what each operator did: the wall time, the rows in and out,
+     * the blocks and bytes read by the scans and the memory peak of the sorts and aggregations,
+     * followed by the execution time and the number of rows
+     * e.g.: Project name (time=1.250 ms self=0.010 ms rows in=500 out=500 batches=1)
+     *         Filter age >= 25 (time=1.240 ms self=0.300 ms rows in=952 out=500 batches=1)
+     *           Table scan: Zone map scan ... (... blocks read=1 skipped=2 bytes read=...)
+     * The same lines are returned by query("EXPLAIN ANALYZE SELECT ..."), as a "plan" column
+     * @param json - return a single JSON document instead of the lines, as
+     *               query("EXPLAIN ANALYZE FORMAT JSON SELECT ...")
+     * @see OperatorProfile
+     */
+    vector<string> explainAnalyze(const SelectStatement & statement, Table * joined_table = NULL, bool json = false);
+
+    /**
+     * Parse and plan a query with parameters, marked by ?, to run it many times
+     * e.g.: prepare("SELECT name WHERE _id = ?") -> a point lookup, run with getRowById
+     * e.g.2: prepare("SELECT * WHERE age BETWEEN ? AND ? AND name IN (?, 'bruno')")
+     * @see PreparedStatement
+     * @see Table::query(string)
+     * @throw invalid_argument if the query is not valid
+     */
+    PreparedStatement prepare(string q, Table * joined_table = NULL);
+
+    /**
+     * Run a prepared statement with its bound values
+     * @see PreparedStatement::execute
+     */
+    Cursor execute(PreparedStatement & statement);
+
+    /**
+     * @return the cache of the parsed queries, shared by Table::query(string) and Table::prepare
+     */
+    StatementCache & getStatementCache();
 
     /**
-     * Perform a query
+     * Perform a query. The where vectors have the same size and the i-th condition is
+     * where_args[i] where_comparators[i] where_values[i]. The values of an IN condition
+     * are separated by commas, e.g.: {"name"}, {"in"}, {"bruno,ana"}
      * @see Table::query(string)
      * @return the cursor associated with the query
      */
@@ -130,15 +633,74 @@ public:
             vector<string> & where_comparators,
             vector<string> & where_values);
 
+    /**
+     * Perform a query with aggregates. The select items are group columns or aggregate
+     * calls, e.g.: {"company_id", "count(*)"}, and the results are named after the items
+     * @see Table::query(string)
+     * @throw invalid_argument if a selected column is not on the group_by
+     * @return the cursor associated with the query
+     */
+    Cursor query(
+            vector<string> & select,
+            vector<string> & where_args,
+            vector<string> & where_comparators,
+            vector<string> & where_values,
+            vector<string> & group_by);
+
+    /**
+     * Perform a query with aggregates, sorting and limiting the result. The ORDER BY items
+     * are a column (or a select item, when grouping) followed by an optional direction,
+     * e.g.: {"points desc", "name"}
+     * @param limit - the number of rows to return, or -1 to return all of them
+     * @param offset - the number of rows to skip before the first returned row
+     * @see Table::query(string)
+     * @return the cursor associated with the query
+     */
+    Cursor query(
+            vector<string> & select,
+            vector<string> & where_args,
+            vector<string> & where_comparators,
+            vector<string> & where_values,
+            vector<string> & group_by,
+            vector<string> & order_by,
+            long long limit,
+            long long offset = 0);
+
+    /**
+     * Read a page of a query without GROUP BY, LIMIT and OFFSET. The rows are ordered by the
+     * ORDER BY columns and the _id, so each row has a unique position, and the next page starts
+     * after the last row of the previous one (keyset pagination). Unlike an OFFSET, the rows of
+     * the previous pages are not read again
+     * e.g.: Cursor page = table.queryPage("SELECT name ORDER BY points DESC", 100);
+     *       while (!page.getContinuation().empty()) {
+     *           page = table.queryPage("SELECT name ORDER BY points DESC", 100, page.getContinuation());
+     *       }
+     * @param page_size - the maximum number of rows of the page
+     * @param continuation - the Cursor::getContinuation of the previous page, or empty for the first page
+     * @throw invalid_argument if the query has a GROUP BY, aggregates, a LIMIT or an OFFSET
+     * @return the cursor with the page rows, whose continuation is empty if it is the last page
+     */
+    Cursor queryPage(string q, long long page_size, const string & continuation = "");
+
     /*****************************************
      ********** CONVENIENCE METHODS **********
      *****************************************/
 
     /**
-     * Read a CSV file, convert and export it to a binary file
+     * Read a CSV file, convert and export it to a binary file. The lines go through 4 stages,
+     * each one on its own thread(s) and connected to the next one by a bounded ring of chunks
+     * of lines: read -> parse (on CSV_PARSER_THREADS threads) -> encode -> write. The encoder
+     * gives the _ids in the file order and indexes the rows, and a full ring makes the stages
+     * before it wait
+     * @see MpmcRing
+     * @throw the first exception of a stage, e.g.: a value that can't be converted
      */
     void convertFromCSV(const string & path);
 
+    static const unsigned CSV_CHUNK_LINES = 1024;
+    static const unsigned CSV_RING_CAPACITY = 16; // chunks between two stages
+    static const unsigned CSV_PARSER_THREADS = 2;
+
     /**
      * Print the table binary file (for debugging only)
      * @param number_of_values the number of values to print. If set to -1
@@ -159,6 +721,12 @@ Table::Table(string name)  {
     this->path = name + ".dat";
     this->header_file_path = name + "_h.dat";
     this->header = new header_t();
+    this->row_kernels = findRowKernels(schema.getCols());
+    this->admission_controller = NULL;
+    this->execution_mode = MORSEL_EXECUTION;
+    this->async_io = &AsyncIo::getShared();
+    this->data_file = -1;
+    this->io_queue_depth = DEFAULT_IO_QUEUE_DEPTH;
     loadHeader();
 
     RegistryHeader reg_header;
@@ -168,15 +736,37 @@ Table::Table(string name)  {
 }
 
 Table::~Table() {
+    saveIndexes();
     delete this->header;
+    if (data_file >= 0) {
+        close(data_file);
+    }
 }
 
 void Table::importSchema(const string & path) {
     schema.import(path);
+    row_kernels = findRowKernels(schema.getCols());
+    zone_map = ZoneMap(name + "_zonemap.dat", *schema.getCols());
+    zone_map.load();
+    statistics = TableStatistics(name + "_statistics.dat", *schema.getCols());
+    statistics.load();
+    //The schema size is computed once, before the workers of the scans share the schema
+    getRegistrySize();
+    //The queries only read the zone map, so they can run on several threads at once
+    updateZoneMap();
 }
 
 void Table::setSchema(Schema schema) {
     this->schema = schema;
+    row_kernels = findRowKernels(this->schema.getCols());
+    zone_map = ZoneMap(name + "_zonemap.dat", *this->schema.getCols());
+    zone_map.load();
+    statistics = TableStatistics(name + "_statistics.dat", *this->schema.getCols());
+    statistics.load();
+    //The schema size is computed once, before the workers of the scans share the schema
+    getRegistrySize();
+    //The queries only read the zone map, so they can run on several threads at once
+    updateZoneMap();
 }
 
 Schema Table::getSchema(){
@@ -188,6 +778,10 @@ header_t * Table::getHeader(){
     return this->header;
 }
 
+const RowKernels * Table::getRowKernels() {
+    return row_kernels;
+}
+
 void Table::loadHeader() {
     ifstream file;
     file.open(header_file_path.c_str(), ios::binary);
@@ -205,7 +799,11 @@ void Table::loadHeader() {
     file.close();
 }
 
-void Table::convertAndSave(ofstream *file, string * string_value, SchemaCol *schema_col) {
+unsigned Table::getRegistrySize() {
+    return HEADER_SIZE + schema.getSize();
+}
+
+void Table::convertAndSave(ostream *file, string * string_value, SchemaCol *schema_col) {
     if (schema_col->type == INT32) {
         int value = atoi((*string_value).c_str());
         file->write(reinterpret_cast<char *> (&value), schema_col->getSize());
@@ -213,6 +811,7 @@ void Table::convertAndSave(ofstream *file, string * string_value, SchemaCol *sch
     } else if (schema_col->type == CHAR) {
         char value[schema_col->getSize()];
         strncpy(value, &string_value->c_str()[0], schema_col->getSize());
+        value[schema_col->getSize() - 1] = '\0';
         file->write(reinterpret_cast<char *> (&value), schema_col->getSize());
         // cout << "CHAR " << value << "(" << *string_value << ")" << " | ";
     } else if (schema_col->type == FLOAT) {
@@ -243,18 +842,6 @@ long long Table::insert(vector<string> row) {
     header_file.registry_position = file.tellp(); // Get the current position on the file stream
     insertOnHeaderFile(&header_file);
 
-    //Save the header
-    RegistryHeader header;
-    strncpy(header.table_name, &name.c_str()[0], sizeof(header.table_name));
-    header.registry_size = HEADER_SIZE + schema.getSize();
-    time (& header.time_stamp);
-
-    file.write(header.table_name, sizeof(header.table_name));
-    file.write(reinterpret_cast<char *> (& header.registry_size), sizeof(header.registry_size));
-    file.write(reinterpret_cast<char *> (& header.time_stamp), sizeof(header.time_stamp));
-
-    // cout << "  | " << header.table_name << " " << header.registry_size << " " << header.time_stamp << " | ";
-
     //Push the _id to the row
     string _id_str;
 
@@ -265,22 +852,76 @@ long long Table::insert(vector<string> row) {
     //Insert the _id on the first position so it matches the SchemaCol
     row.insert(row.begin(), _id_str);
 
+    //The _id is also the position of the row on the header
+    indexRow(header_file._id, row);
+
+    time_t time_stamp;
+    time(&time_stamp);
+    saveRegistry(&file, row, time_stamp);
+    // cout << endl;
+
+    file.close();
+
+    return header_file._id;
+}
+
+void Table::saveRegistry(ostream * file, vector<string> & row, time_t time_stamp) {
+    //Save the header
+    RegistryHeader header;
+    strncpy(header.table_name, &name.c_str()[0], sizeof(header.table_name));
+    header.registry_size = HEADER_SIZE + schema.getSize();
+    header.time_stamp = time_stamp;
+
+    file->write(header.table_name, sizeof(header.table_name));
+    file->write(reinterpret_cast<char *> (& header.registry_size), sizeof(header.registry_size));
+    file->write(reinterpret_cast<char *> (& header.time_stamp), sizeof(header.time_stamp));
+
+    // cout << "  | " << header.table_name << " " << header.registry_size << " " << header.time_stamp << " | ";
+
     //Export the table according to the schema
+    saveRow(file, row);
+}
+
+void Table::indexRow(long long _id, vector<string> & row) {
+    vector<SchemaCol>* schema_cols = schema.getCols();
+
+    for (vector<BlockBloomFilter>::iterator it = bloom_filters.begin(); it != bloom_filters.end(); it++) {
+        int column_position = it->getColumnPosition();
+        it->add(_id, schema_cols->at(column_position).normalize(row.at(column_position)));
+    }
+    for (vector<BitmapIndex>::iterator it = bitmap_indexes.begin(); it != bitmap_indexes.end(); it++) {
+        it->add(_id, row.at(it->getColumnPosition()));
+    }
+    for (vector<HashIndex>::iterator it = hash_indexes.begin(); it != hash_indexes.end(); it++) {
+        it->add(_id, row.at(it->getColumnPosition()));
+    }
+    if (zone_map.getNumberOfRows() == (unsigned long long) _id) {
+        zone_map.add(row);
+    }
+    if (statistics.isAnalyzed() && statistics.getNumberOfRows() == (unsigned long long) _id) {
+        statistics.add(row);
+    }
+}
+
+void Table::saveRow(ostream * file, vector<string> & row) {
     vector<SchemaCol>* schema_cols = schema.getCols();
 
+    if (row_kernels != NULL && row.size() == schema_cols->size()) {
+        //Encode the whole row and write it at once
+        vector<char> body(schema.getSize());
+        row_kernels->encode(row, &body[0]);
+        file->write(&body[0], body.size());
+        return;
+    }
+
     int schema_col_position = 0;
 
     for (vector<string>::iterator row_it = row.begin(); row_it != row.end(); row_it++) {
         //Iterate through the row and save the values
         //TODO: Consider the array size
-        convertAndSave(&file, &(*row_it), &schema_cols->at(schema_col_position));
+        convertAndSave(file, &(*row_it), &schema_cols->at(schema_col_position));
         schema_col_position ++;
     }
-    // cout << endl;
-
-    file.close();
-
-    return header_file._id;
 }
 
 void Table::insertOnHeaderFile(HeaderFile * header_file) {
@@ -323,7 +964,7 @@ void Table::print(int number_of_values) {
     int counter = 0;
     while (counter != number_of_values) {
         cout << "headerSize= "<< header->size()<< endl;
-        if (counter == header->size()) {
+        if ((size_t) counter == header->size()) {
             break;
         }
         vector<string> row = getRow(header->at(counter).second);
@@ -339,156 +980,548 @@ void Table::print(int number_of_values) {
     cout << endl;
 }
 
-Cursor Table::query(string q) {
-    //Transform the query to lower case
-    std::transform(q.begin(), q.end(), q.begin(), ::tolower);
-
-    //Store the select arguments.
-    //e.g.: SELECT arg1, arg2
-    vector<string> select;
-
-    //Store the where arguments, values and comparators
-    //e.g.: WHERE arg1 = val1, arg2 > val2,
-    vector<string> where_args;
-    vector<string> where_comparators;
-    vector<string> where_vals;
-
-    //Helper variables to store the parsing state
-    bool parsing_select = false;
-    bool parsing_where = false;
-
-    //Hold if a word is beeing parsed at the moment. If a space ' ' or a comma ',' is
-    //parsed, the variable is set false
-    bool parsing_word = false;
-
-    bool parsing_where_arg = false;
-    bool parsing_where_comparator = false;
-    bool parsing_where_val = false;
-
-    string string_buffer;
+Cursor Table::query(string q, Table * joined_table) {
+    SelectStatement statement = statement_cache.get(q);
+    if (!statement.parameters.empty()) {
+        throw std::invalid_argument("The query has parameters, run it with Table::prepare");
+    }
+    return query(statement, joined_table);
+}
 
-    bool ignore_space = false;
+PreparedStatement Table::prepare(string q, Table * joined_table) {
+    PreparedStatement prepared(this, joined_table, statement_cache.get(q));
+    const SelectStatement & statement = prepared.statement;
 
-    for (string::iterator it = q.begin(); it != q.end(); it++) {
-        char character = (*it);
+    bool has_aggregates = false;
+    for (vector<string>::const_iterator it = statement.select.begin(); it != statement.select.end(); it++) {
+        has_aggregates = has_aggregates || it->find('(') != string::npos;
+    }
 
-        if (character == '\'') {
-            ignore_space = !ignore_space;
-            continue;
+    //WHERE _id = value is a binary search on the header
+    const Predicate & predicate = statement.where.predicate;
+    prepared.point_lookup = !statement.has_join && !has_aggregates && statement.group_by.empty() && statement.offset == 0 &&
+                            statement.limit != 0 && statement.where.type == PREDICATE_EXPRESSION &&
+                            predicate.column == "_id" && predicate.comparator == EQUAL;
+    //The column names are the same as the ones Table::run gives to the cursors
+    vector<string> select(statement.select);
+    if (statement.has_join) {
+        for (vector<string>::iterator it = select.begin(); it != select.end(); it++) {
+            if (*it != "*") {
+                prepared.column_names.push_back(*it);
+                continue;
+            }
+            Table * tables[] = {this, joined_table};
+            for (int i = 0; i < 2 && tables[i] != NULL; i++) {
+                vector<SchemaCol>* schema_cols = tables[i]->schema.getCols();
+                for (vector<SchemaCol>::iterator col = schema_cols->begin(); col != schema_cols->end(); col++) {
+                    prepared.column_names.push_back(tables[i]->name + "." + col->key);
+                }
+            }
+        }
+    } else if (has_aggregates || !statement.group_by.empty()) {
+        prepared.column_names = select.empty() ? statement.group_by : select;
+    } else {
+        prepared.projection = getProjection(select, prepared.column_names);
+        prepared.scan = !statement.explain && !prepared.point_lookup;
+    }
+    if (prepared.scan) {
+        //The values bound later replace the ones of the bound WHERE
+        prepared.statement.where.bind(schema);
+        vector<string> schema_names;
+        vector<SchemaCol>* schema_cols = schema.getCols();
+        for (vector<SchemaCol>::iterator it = schema_cols->begin(); it != schema_cols->end(); it++) {
+            schema_names.push_back(it->key);
+        }
+        for (vector<string>::const_iterator it = statement.order_by.begin(); it != statement.order_by.end(); it++) {
+            prepared.sort_keys.push_back(SortKey::parse(*it, schema_names));
+        }
+    }
+    return prepared;
+}
 
-        } else if (character != ' ' || character != ',') {
-            parsing_word = true;
+Cursor Table::execute(PreparedStatement & prepared) {
+    for (unsigned i = 0; i < prepared.bound.size(); i++) {
+        if (!prepared.bound[i]) {
+            throw std::invalid_argument("The parameter " + to_string(i) + " is not bound");
+        }
+    }
+    //The admitted queries are estimated by Table::plan, which costs every access path
+    if (prepared.scan && admission_controller == NULL) {
+        const SelectStatement & statement = prepared.statement;
+        AccessPath path;
+        if (prepared.has_access_path) {
+            path = getAccessPath(statement.where, prepared.access_path);
+        } else {
+            path = chooseAccessPath(statement.where);
+            prepared.access_path = path.type;
+            prepared.has_access_path = true;
+        }
+        return Cursor(prepared.column_names, scanPath(prepared.projection, prepared.statement.where, path, prepared.sort_keys,
+                                                      statement.limit, statement.offset, NULL));
+    }
+    if (!prepared.point_lookup) {
+        return query(prepared.statement, prepared.joined_table);
+    }
+
+    vector<vector<string> > rows;
+    vector<string> row = getRowById(atoll(prepared.statement.where.predicate.values[0].c_str()));
+    if (!row.empty()) {
+        rows.push_back(vector<string>());
+        rows.back().reserve(prepared.projection.size());
+        for (vector<int>::iterator it = prepared.projection.begin(); it != prepared.projection.end(); it++) {
+            rows.back().push_back(row[*it]);
+        }
+    }
+    return Cursor(prepared.column_names, rows);
+}
+
+StatementCache & Table::getStatementCache() {
+    return statement_cache;
+}
 
+Cursor Table::query(vector<string> & select, vector<string> & where_args, vector<string> & where_comparators, vector<string> & where_values) {
+    vector<string> group_by;
+    return query(select, where_args, where_comparators, where_values, group_by);
+}
+
+Cursor Table::query(vector<string> & select, vector<string> & where_args, vector<string> & where_comparators, vector<string> & where_values,
+                    vector<string> & group_by) {
+    vector<string> order_by;
+    return query(select, where_args, where_comparators, where_values, group_by, order_by, -1);
+}
+
+Cursor Table::query(vector<string> & select, vector<string> & where_args, vector<string> & where_comparators, vector<string> & where_values,
+                    vector<string> & group_by, vector<string> & order_by, long long limit, long long offset) {
+    SelectStatement statement;
+    statement.select = select;
+    statement.group_by = group_by;
+    statement.order_by = order_by;
+    statement.limit = limit;
+    statement.offset = offset;
+
+    vector<Predicate> predicates;
+    for (unsigned i = 0; i < where_args.size(); i++) {
+        Comparator comparator = Predicate::parseComparator(where_comparators.at(i));
+        if (comparator == IN) {
+            predicates.push_back(Predicate(where_args.at(i), comparator, split(where_values.at(i), ',')));
         } else {
-            if (character == ' ' && ignore_space) {
-                parsing_word = true;
+            predicates.push_back(Predicate(where_args.at(i), comparator, where_values.at(i)));
+        }
+    }
+    statement.where = Expression::allOf(predicates);
+
+    return query(statement);
+}
+
+Cursor Table::query(const SelectStatement & statement, Table * joined_table) {
+    if (statement.explain) {
+        vector<string> column_names(1, "plan");
+        vector<vector<string> > rows;
+        vector<string> lines = statement.explain_analyze ? explainAnalyze(statement, joined_table, statement.explain_json) :
+                               explain(statement, joined_table);
+        for (vector<string>::iterator it = lines.begin(); it != lines.end(); it++) {
+            rows.push_back(vector<string>(1, *it));
+        }
+        return Cursor(column_names, rows);
+    }
+    return admitAndRun(statement, joined_table, NULL);
+}
+
+vector<string> Table::explainAnalyze(const SelectStatement & statement, Table * joined_table, bool json) {
+    OperatorProfile profile;
+    double start = Profiler::getWallTime();
+    Cursor cursor = admitAndRun(statement, joined_table, &profile);
+    double seconds = Profiler::getWallTime() - start;
+
+    vector<string> lines;
+    ostringstream summary;
+    summary.setf(ios::fixed);
+    summary.precision(3);
+    if (json) {
+        summary << "{\"execution_time_ms\": " << seconds * 1000 << ", \"rows\": " << cursor.getCount()
+                << ", \"plan\": " << profile.toJson() << "}";
+        lines.push_back(summary.str());
+    } else {
+        profile.toTree(lines);
+        summary << "Execution time: " << seconds * 1000 << " ms, " << cursor.getCount() << " rows";
+        lines.push_back(summary.str());
+    }
+    return lines;
+}
+
+Cursor Table::admitAndRun(const SelectStatement & statement, Table * joined_table, OperatorProfile * profile) {
+    if (admission_controller == NULL) {
+        return run(statement, joined_table, profile);
+    }
+    QueryEstimate estimate;
+    plan(statement, joined_table, estimate);
+    AdmissionTicket ticket = admission_controller->admit(estimate);
+    CancellationScope scope(ticket.getToken());
+    return run(statement, joined_table, profile);
+}
+
+Cursor Table::run(const SelectStatement & statement, Table * joined_table, OperatorProfile * profile) {
+    if (statement.has_join) {
+        if (joined_table == NULL || joined_table->name != statement.join.table) {
+            throw std::invalid_argument("The joined table \"" + statement.join.table + "\" wasn't given");
+        }
+        return queryJoin(statement, joined_table, profile);
+    }
+
+    vector<SchemaCol>* schema_cols = schema.getCols();
+    vector<string> select(statement.select);
+    vector<string> group_by(statement.group_by);
+    const vector<string> & order_by = statement.order_by;
+    Expression where = statement.where;
+    long long limit = statement.limit;
+    long long offset = statement.offset;
+
+    vector<Aggregate> aggregates;
+    for (vector<string>::iterator it = select.begin(); it != select.end(); it++) {
+        Aggregate aggregate(COUNT, -1, *it);
+        if (Aggregate::parse(*it, schema, aggregate)) {
+            aggregates.push_back(aggregate);
+        }
+    }
+
+    if (!aggregates.empty() || !group_by.empty()) {
+        vector<int> group_columns;
+        for (vector<string>::iterator it = group_by.begin(); it != group_by.end(); it++) {
+            group_columns.push_back(schema.getColPosition(*it));
+        }
+
+        //The aggregate rows have the group columns followed by the aggregates
+        vector<int> projection;
+        vector<string> column_names;
+        unsigned aggregate_position = group_by.size();
+        for (vector<string>::iterator it = select.begin(); it != select.end(); it++) {
+            vector<string>::iterator group_column = find(group_by.begin(), group_by.end(), *it);
+            if (group_column != group_by.end()) {
+                projection.push_back(group_column - group_by.begin());
+            } else if (aggregate_position < group_by.size() + aggregates.size() && aggregates[aggregate_position - group_by.size()].name == *it) {
+                projection.push_back(aggregate_position++);
             } else {
-                parsing_word = false;
-            }
-        }
-
-        // Check for the select word
-        if (!parsing_select && !parsing_where) {
-            if (character != ' ') {
-                string_buffer += character;
-            }
-            // cout << string_buffer << endl;
-            if (string_buffer == "select") {
-                parsing_select = true;
-                string_buffer.clear();
-            } else if (string_buffer == "where") {
-                cout << "Changing to WHERE" << endl;
-                parsing_where = true;
-                parsing_where_arg = true;
-                parsing_select = false;
-                string_buffer.clear();
-            }
-        } else if (character != ' ' || ignore_space) {
-            if (parsing_select) {
-                //Ignore spaces
-                if (character == ',') {
-                    //Add the string_buffer to the where_args
-                    where_args.push_back(string_buffer);
-                    cout << string_buffer << endl;
-                    string_buffer.clear();
-                } else {
-                    //If a word is beeing parsed, add the character to the string buffer,
-                    //if not, there are two words separated by a space. In this case, the
-                    //select arguments are finished
-                    if (parsing_word) {
-                        string_buffer += character;
-                    } else {
-                        parsing_select = false;
-                        where_args.push_back(string_buffer);
-                        cout << string_buffer << endl;
-                        string_buffer.clear();
-                    }
-                }
+                throw std::invalid_argument("The column \"" + *it + "\" must be an aggregate or appear in the GROUP BY");
+            }
+            column_names.push_back(*it);
+        }
+        if (select.empty()) {
+            for (unsigned i = 0; i < group_by.size() + aggregates.size(); i++) {
+                projection.push_back(i);
+                column_names.push_back(i < group_by.size() ? group_by[i] : aggregates[i - group_by.size()].name);
+            }
+        }
 
-            } else if (parsing_where) {
-                if (character == ',') {
-                    if (parsing_where_val) {
-                        where_vals.push_back(string_buffer);
-                        cout << "Where value = " << string_buffer << endl;
-                        string_buffer.clear();
-                    }
-                    parsing_where_arg = true;
-                    parsing_where_comparator = false;
-                    parsing_where_val = false;
-                } else if (parsing_word) {
-                    if (parsing_where_arg) {
-                        if (character == '=' || character == '<' || character == '>' || character == '!') {
-                            //The argument was parsed, move to the comparator
-                            parsing_where_arg = false;
-                            parsing_where_comparator = true;
-                            where_args.push_back(string_buffer);
-                            cout << "Where arg = " << string_buffer << endl;
-                            string_buffer.clear();
-                        }
-                    } else if (parsing_where_comparator) {
-                        if (character != '=' || character != '<' || character != '>' || character != '!') {
-                            //The comparator was parsed, move to the where value
-                            parsing_where_comparator = false;
-                            parsing_where_val = true;
-                            where_comparators.push_back(string_buffer);
-                            cout << "Where comparator = " << string_buffer << endl;
-                            string_buffer.clear();
-                        }
-                    }
+        //The groups are sorted by the group columns and the aggregates
+        vector<string> group_names(group_by);
+        for (vector<Aggregate>::iterator it = aggregates.begin(); it != aggregates.end(); it++) {
+            group_names.push_back(it->name);
+        }
+        vector<SortKey> sort_keys;
+        for (vector<string>::const_iterator it = order_by.begin(); it != order_by.end(); it++) {
+            sort_keys.push_back(SortKey::parse(*it, group_names));
+        }
 
-                    string_buffer += character;
-                }
+        vector<vector<string> > groups = aggregate(group_columns, aggregates, where, sort_keys, limit, offset, profile);
+        vector<vector<string> > rows;
+        rows.reserve(groups.size());
+        for (vector<vector<string> >::iterator group = groups.begin(); group != groups.end(); group++) {
+            rows.push_back(vector<string>());
+            for (vector<int>::iterator it = projection.begin(); it != projection.end(); it++) {
+                rows.back().push_back(group->at(*it));
             }
-        } else if (character == ' ') {
-            if (!string_buffer.empty()) {
-                if (parsing_select) {
-                    select.push_back(string_buffer);
-                    cout << "F Select = " << string_buffer << endl;
-                    string_buffer.clear();
-                    parsing_select = false;
-                }
+        }
+        return Cursor(column_names, rows);
+    }
+
+    vector<string> column_names;
+    vector<int> projection = getProjection(select, column_names);
+
+    vector<string> schema_names;
+    for (vector<SchemaCol>::iterator it = schema_cols->begin(); it != schema_cols->end(); it++) {
+        schema_names.push_back(it->key);
+    }
+    vector<SortKey> sort_keys;
+    for (vector<string>::const_iterator it = order_by.begin(); it != order_by.end(); it++) {
+        sort_keys.push_back(SortKey::parse(*it, schema_names));
+    }
+
+    Cursor cursor(column_names, scanBatches(projection, where, sort_keys, limit, offset, profile));
+    return cursor;
+}
+
+Cursor Table::queryJoin(const SelectStatement & statement, Table * joined_table, OperatorProfile * profile) {
+    if (!statement.group_by.empty()) {
+        throw std::invalid_argument("GROUP BY is not supported with a JOIN");
+    }
+
+    //The columns of the joined rows: the ones of this table followed by the ones of the joined table
+    vector<string> names;
+    vector<SchemaType> types;
+    Table * tables[] = {this, joined_table};
+    for (int i = 0; i < 2; i++) {
+        vector<SchemaCol>* schema_cols = tables[i]->schema.getCols();
+        for (vector<SchemaCol>::iterator it = schema_cols->begin(); it != schema_cols->end(); it++) {
+            names.push_back(tables[i]->name + "." + it->key);
+            types.push_back(it->type);
+        }
+    }
+    int this_columns = schema.getCols()->size();
+
+    //A column may be qualified by the table name, otherwise the first table having it is used
+    auto findColumn = [&](const string & column) -> int {
+        for (unsigned i = 0; i < names.size(); i++) {
+            if (strcasecmp(names[i].c_str(), column.c_str()) == 0) {
+                return i;
+            }
+        }
+        for (unsigned i = 0; i < names.size(); i++) {
+            if (names[i].size() > column.size() && names[i][names[i].size() - column.size() - 1] == '.' &&
+                strcasecmp(names[i].c_str() + names[i].size() - column.size(), column.c_str()) == 0) {
+                return i;
             }
         }
+        throw std::invalid_argument("There is no column \"" + column + "\"");
+    };
+
+    int left_column = findColumn(statement.join.left_column);
+    int right_column = findColumn(statement.join.right_column);
+    if (left_column >= this_columns) {
+        swap(left_column, right_column);
+    }
+    if (left_column >= this_columns || right_column < this_columns) {
+        throw std::invalid_argument("The ON condition must compare a column of each table");
     }
-    if (parsing_select) {
-        select.push_back(string_buffer);
-        cout << "Final select = " << string_buffer << endl;
 
-    } else if (parsing_where && parsing_where_val) {
-        where_vals.push_back(string_buffer);
-        cout << "Final where value = " << string_buffer << endl;
+    //The predicates are bound to the joined rows
+    Expression where = statement.where;
+    std::function<void(Expression &)> bindJoined = [&](Expression & expression) {
+        if (expression.type == PREDICATE_EXPRESSION) {
+            if (expression.predicate.column.find('(') != string::npos) {
+                throw std::invalid_argument("Aggregates are not supported with a JOIN");
+            }
+            expression.predicate.column_position = findColumn(expression.predicate.column);
+            expression.predicate.column_type = types[expression.predicate.column_position];
+        }
+        for (vector<Expression>::iterator it = expression.children.begin(); it != expression.children.end(); it++) {
+            bindJoined(*it);
+        }
+    };
+    bindJoined(where);
+
+    vector<SortKey> sort_keys;
+    for (vector<string>::const_iterator it = statement.order_by.begin(); it != statement.order_by.end(); it++) {
+        //e.g.: "points desc" -> "person.points desc"
+        size_t space = it->find(' ');
+        string direction = space == string::npos ? "" : it->substr(space);
+        sort_keys.push_back(SortKey::parse(names[findColumn(it->substr(0, space))] + direction, names));
     }
 
-    return query(select, where_args, where_comparators, where_vals);
+    vector<int> projection;
+    vector<string> column_names;
+    for (vector<string>::const_iterator it = statement.select.begin(); it != statement.select.end(); it++) {
+        if (it->find('(') != string::npos) {
+            throw std::invalid_argument("Aggregates are not supported with a JOIN");
+        }
+        if (*it != "*") {
+            projection.push_back(findColumn(*it));
+            column_names.push_back(*it);
+        } else {
+            for (unsigned i = 0; i < names.size(); i++) {
+                projection.push_back(i);
+                column_names.push_back(names[i]);
+            }
+        }
+    }
+
+    //Without a filter nor a sort, the join can stop after the LIMIT + OFFSET rows
+    long long join_limit = -1;
+    if (statement.limit >= 0 && where.isAlwaysTrue() && sort_keys.empty()) {
+        join_limit = statement.limit + statement.offset;
+    }
+    //The join is not made of operators, so each step is timed as a whole
+    double start = Profiler::getWallTime();
+    Join join(this, schema.getCols()->at(left_column).key, joined_table,
+              joined_table->schema.getCols()->at(right_column - this_columns).key, HASH, NULL, join_limit);
+    const vector<vector<long long> > & result = join.getResult();
+    OperatorProfile join_profile("Hash join on " + statement.join.left_column + " = " + statement.join.right_column);
+    join_profile.seconds = Profiler::getWallTime() - start;
+    join_profile.rows_in = header->size() + joined_table->header->size();
+    join_profile.rows_out = result.size();
+
+    start = Profiler::getWallTime();
+    vector<long long> positions, joined_positions;
+    for (vector<vector<long long> >::const_iterator it = result.begin(); it != result.end(); it++) {
+        positions.push_back(it->at(0));
+        joined_positions.push_back(it->at(1));
+    }
+    vector<vector<string> > joined_rows = getRows(positions);
+    vector<vector<string> > other_rows = joined_table->getRows(joined_positions);
+    vector<vector<string> > rows;
+    for (size_t i = 0; i < joined_rows.size(); i++) {
+        vector<string> & row = joined_rows[i];
+        row.insert(row.end(), other_rows[i].begin(), other_rows[i].end());
+        if (where.matches(row)) {
+            rows.push_back(row);
+        }
+    }
+    OperatorProfile filter_profile("Fetch the joined rows and filter " + statement.where.toString());
+    filter_profile.seconds = join_profile.seconds + Profiler::getWallTime() - start;
+    filter_profile.rows_in = result.size();
+    filter_profile.rows_out = rows.size();
+    filter_profile.bytes_read = result.size() * (getRegistrySize() + joined_table->getRegistrySize());
+    filter_profile.children.push_back(join_profile);
+
+    start = Profiler::getWallTime();
+    stable_sort(rows.begin(), rows.end(), [&](const vector<string> & a, const vector<string> & b) {
+        for (vector<SortKey>::iterator it = sort_keys.begin(); it != sort_keys.end(); it++) {
+            int comparison = Predicate::compare(a[it->column], b[it->column], types[it->column]);
+            if (comparison != 0) {
+                return it->descending ? comparison > 0 : comparison < 0;
+            }
+        }
+        return false;
+    });
+
+    vector<vector<string> > page;
+    for (long long i = statement.offset; i < (long long) rows.size() && (statement.limit < 0 || i < statement.offset + statement.limit); i++) {
+        page.push_back(vector<string>());
+        for (vector<int>::iterator it = projection.begin(); it != projection.end(); it++) {
+            page.back().push_back(rows[i][*it]);
+        }
+    }
+
+    if (profile != NULL) {
+        *profile = OperatorProfile("Sort, limit " + (statement.limit < 0 ? string("all") : to_string(statement.limit)) +
+                                   " offset " + to_string(statement.offset) + " and project");
+        profile->seconds = filter_profile.seconds + Profiler::getWallTime() - start;
+        profile->rows_in = rows.size();
+        profile->rows_out = page.size();
+        profile->children.push_back(filter_profile);
+    }
+    return Cursor(column_names, page);
 }
 
-Cursor Table::query(vector<string> & select, vector<string> & where_args, vector<string> & where_comparators, vector<string> & where_values) {
-    //Store the query result
-    vector<vector <string> > result;
+vector<int> Table::getProjection(vector<string> & select, vector<string> & column_names) {
+    vector<SchemaCol>* schema_cols = schema.getCols();
+
+    //Columns to return, an empty select is the same as SELECT *
+    vector<int> projection;
+    for (vector<string>::iterator it = select.begin(); it != select.end(); it++) {
+        if (*it == "*") {
+            for (unsigned i = 0; i < schema_cols->size(); i++) {
+                projection.push_back(i);
+            }
+        } else {
+            projection.push_back(schema.getColPosition(*it));
+        }
+    }
+    if (projection.empty()) {
+        for (unsigned i = 0; i < schema_cols->size(); i++) {
+            projection.push_back(i);
+        }
+    }
+    for (vector<int>::iterator it = projection.begin(); it != projection.end(); it++) {
+        column_names.push_back(schema_cols->at(*it).key);
+    }
+    return projection;
+}
+
+Cursor Table::queryPage(string q, long long page_size, const string & continuation) {
+    SelectStatement statement = statement_cache.get(q);
+    if (statement.has_join || !statement.group_by.empty() || statement.limit >= 0 || statement.offset > 0) {
+        throw std::invalid_argument("A page query can't have a JOIN, a GROUP BY, a LIMIT or an OFFSET");
+    }
+    vector<string> & select = statement.select;
+    vector<string> & order_by = statement.order_by;
+
+    vector<string> column_names;
+    vector<int> projection = getProjection(select, column_names);
+    for (vector<string>::iterator it = select.begin(); it != select.end(); it++) {
+        Aggregate aggregate(COUNT, -1, *it);
+        if (Aggregate::parse(*it, schema, aggregate)) {
+            throw std::invalid_argument("A page query can't have aggregates");
+        }
+    }
+
+    //The _id makes the order total, so the keyset of a row is unique
+    vector<SchemaCol>* schema_cols = schema.getCols();
+    vector<string> schema_names;
+    for (vector<SchemaCol>::iterator it = schema_cols->begin(); it != schema_cols->end(); it++) {
+        schema_names.push_back(it->key);
+    }
+    vector<SortKey> sort_keys;
+    bool has_id = false;
+    for (vector<string>::iterator it = order_by.begin(); it != order_by.end(); it++) {
+        sort_keys.push_back(SortKey::parse(*it, schema_names));
+        has_id = has_id || sort_keys.back().column == 0;
+    }
+    if (!has_id) {
+        sort_keys.push_back(SortKey(0, false));
+    }
+
+    //The sort columns are returned after the select columns, to build the next continuation
+    size_t number_of_columns = projection.size();
+    for (vector<SortKey>::iterator it = sort_keys.begin(); it != sort_keys.end(); it++) {
+        projection.push_back(it->column);
+    }
+
+    //The continuation is the keyset of the last row: | length:value | length:value | ...
+    vector<string> keyset;
+    size_t position = 0;
+    while (position < continuation.size()) {
+        size_t separator = continuation.find(':', position);
+        if (separator == string::npos) {
+            throw std::invalid_argument("Invalid continuation");
+        }
+        size_t length = atoll(continuation.substr(position, separator - position).c_str());
+        keyset.push_back(continuation.substr(separator + 1, length));
+        position = separator + 1 + length;
+    }
+    if (!keyset.empty() && keyset.size() != sort_keys.size()) {
+        throw std::invalid_argument("The continuation doesn't match the query");
+    }
+
+    //The rows after the keyset (k1, k2, ...) are:
+    //k1 > v1 OR (k1 = v1 AND k2 > v2) OR ... with < for the descending keys
+    vector<Expression> conditions;
+    conditions.push_back(statement.where);
+    if (!keyset.empty()) {
+        vector<Expression> after;
+        for (size_t i = 0; i < sort_keys.size(); i++) {
+            vector<Predicate> equal_keys;
+            for (size_t j = 0; j < i; j++) {
+                equal_keys.push_back(Predicate(schema_cols->at(sort_keys[j].column).key, EQUAL, keyset[j]));
+            }
+            equal_keys.push_back(Predicate(schema_cols->at(sort_keys[i].column).key,
+                                           sort_keys[i].descending ? LESS : GREATER, keyset[i]));
+            after.push_back(Expression::allOf(equal_keys));
+        }
+        conditions.push_back(Expression(OR_EXPRESSION, after));
+    }
+    Expression where(AND_EXPRESSION, conditions);
 
-    //TODO: Make the query method
+    vector<Batch> batches = scanBatches(projection, where, sort_keys, page_size);
+    vector<vector<string> > rows;
+    for (vector<Batch>::iterator it = batches.begin(); it != batches.end(); it++) {
+        it->appendRows(rows);
+    }
 
-    Cursor cursor(schema, result);
+    //The keys are taken from the batch, since the text of a row rounds the doubles
+    string next_continuation;
+    if (!rows.empty() && (long long) rows.size() == page_size) {
+        const Batch & last_batch = batches.back();
+        for (size_t i = number_of_columns; i < last_batch.columns.size(); i++) {
+            string key = last_batch.columns[i].getExactString(last_batch.selection.back());
+            next_continuation += to_string(key.size()) + ":" + key;
+        }
+    }
+    for (vector<vector<string> >::iterator it = rows.begin(); it != rows.end(); it++) {
+        it->resize(number_of_columns);
+    }
+
+    Cursor cursor(column_names, rows);
+    cursor.setContinuation(next_continuation);
     return cursor;
 }
 
@@ -498,83 +1531,196 @@ void Table::convertFromCSV(const string & path) {
     ifstream file;
     file.open(path.c_str());
 
-    if (file.is_open()) {
-        //Header
-        getline(file, line);
+    if (!file.is_open()) {
+        cout << "Unable to open file - " << path << endl;
+        return;
+    }
 
-        //Lines
-        while (getline(file, line)) {
-            vector<string> words = split(line, ',');
+    //Header
+    getline(file, line);
+
+    struct Chunk {
+        long long sequence;
+        vector<string> lines;
+        vector<vector<string> > rows;
+        string registries;
+        header_t header_entries;
+
+        Chunk() : sequence(-1) {}
+    };
+    MpmcRing<Chunk> read_chunks(CSV_RING_CAPACITY); // the reader to the parsers
+    MpmcRing<Chunk> parsed_chunks(CSV_RING_CAPACITY); // the parsers to the encoder
+    SpscRing<Chunk> encoded_chunks(CSV_RING_CAPACITY); // the encoder to the writer
+
+    mutex error_mutex;
+    exception_ptr error;
+    auto fail = [&]() {
+        unique_lock<mutex> lock(error_mutex);
+        if (!error) {
+            error = current_exception();
+        }
+        read_chunks.close();
+        parsed_chunks.close();
+        encoded_chunks.close();
+    };
+
+    vector<thread> parsers;
+    for (unsigned i = 0; i < CSV_PARSER_THREADS; i++) {
+        parsers.push_back(thread([&]() {
+            Chunk chunk;
+            while (read_chunks.pop(chunk)) {
+                chunk.rows.reserve(chunk.lines.size());
+                for (vector<string>::iterator it = chunk.lines.begin(); it != chunk.lines.end(); it++) {
+                    chunk.rows.push_back(split(*it, ','));
+                }
+                chunk.lines.clear();
+                if (!parsed_chunks.push(chunk)) {
+                    break;
+                }
+            }
+        }));
+    }
 
-            // Insert the line on the database
-            insert(words);
+    //The registries are appended after the ones already on the file
+    unsigned registry_size = getRegistrySize();
+    ifstream registries_end(this->path.c_str(), ios::binary | ios::ate);
+    long long registry_position = registries_end.is_open() ? (long long) registries_end.tellg() : 0;
+    registries_end.close();
+    thread encoder([&]() {
+        try {
+            //The chunks are parsed in any order, the rows are encoded in the file order
+            map<long long, Chunk> pending;
+            long long next_sequence = 0;
+            Chunk chunk;
+            time_t time_stamp;
+            time(&time_stamp);
+            while (parsed_chunks.pop(chunk)) {
+                pending[chunk.sequence] = move(chunk);
+                while (!pending.empty() && pending.begin()->first == next_sequence) {
+                    Chunk & ready = pending.begin()->second;
+                    ostringstream registries;
+                    for (vector<vector<string> >::iterator row = ready.rows.begin(); row != ready.rows.end(); row++) {
+                        long long _id = header->size();
+                        row->insert(row->begin(), to_string(_id));
+                        indexRow(_id, *row);
+                        saveRegistry(&registries, *row, time_stamp);
+                        header->push_back(make_pair(_id, registry_position));
+                        ready.header_entries.push_back(header->back());
+                        registry_position += registry_size;
+                    }
+                    ready.rows.clear();
+                    ready.registries = registries.str();
+                    if (!encoded_chunks.push(ready)) {
+                        break;
+                    }
+                    pending.erase(pending.begin());
+                    next_sequence++;
+                }
+            }
+        } catch (...) {
+            fail();
+        }
+        encoded_chunks.close();
+    });
+
+    thread writer([&]() {
+        ofstream registries_file(this->path.c_str(), ios::binary | ios::app);
+        ofstream header_file(header_file_path.c_str(), ios::binary | ios::app);
+        Chunk chunk;
+        while (encoded_chunks.pop(chunk)) {
+            registries_file.write(chunk.registries.data(), chunk.registries.size());
+            for (header_t::iterator it = chunk.header_entries.begin(); it != chunk.header_entries.end(); it++) {
+                header_file.write(reinterpret_cast<char *> (& it->first), sizeof(it->first));
+                header_file.write(reinterpret_cast<char *> (& it->second), sizeof(it->second));
+            }
+        }
+    });
+
+    //Lines, read on this thread
+    Chunk chunk;
+    chunk.sequence = 0;
+    bool reading = true;
+    while (reading) {
+        reading = (bool) getline(file, line);
+        if (reading) {
+            chunk.lines.push_back(line);
+        }
+        if (chunk.lines.size() == CSV_CHUNK_LINES || (!reading && !chunk.lines.empty())) {
+            long long sequence = chunk.sequence;
+            if (!read_chunks.push(chunk)) {
+                break;
+            }
+            chunk = Chunk();
+            chunk.sequence = sequence + 1;
         }
-        file.close();
-    } else {
-        cout << "Unable to open file - " << path << endl;
+    }
+    file.close();
+
+    read_chunks.close();
+    for (vector<thread>::iterator it = parsers.begin(); it != parsers.end(); it++) {
+        it->join();
+    }
+    parsed_chunks.close();
+    encoder.join();
+    writer.join();
+
+    saveIndexes();
+    if (error) {
+        rethrow_exception(error);
     }
 }
 
 vector<string> Table::getRow(long long registry_position) {
-    ifstream file;
-    file.open(path.c_str(), ios::binary);
-
-    // Set the file position
-    file.seekg(registry_position);
+    //Read the whole registry at once
+    vector<char> registry(getRegistrySize());
+    vector<IoRequest> requests(1, IoRequest(getDataFile(), registry_position, &registry[0], registry.size()));
+    async_io->run(requests);
 
-    vector<SchemaCol>* schema_cols = schema.getCols();
     vector<string> row;
+    decodeRow(&registry[0], row);
 
-    //Import the header
-    RegistryHeader header;
-    file.read(header.table_name, sizeof(header.table_name));
-    file.read(reinterpret_cast<char *> (& header.registry_size), sizeof(header.registry_size));
-    file.read(reinterpret_cast<char *> (& header.time_stamp), sizeof(header.time_stamp));
+    return row;
+}
 
-    // cout << "  | " << header.table_name << " " << header.registry_size << " " << header.time_stamp << " | ";
+void Table::decodeRow(const char * registry, vector<string> & row) {
+    if (row_kernels != NULL) {
+        row_kernels->decode(registry, row);
+        return;
+    }
+
+    vector<SchemaCol>* schema_cols = schema.getCols();
 
-    //Read and convert the values from the file
+    //Skip the header
+    // | table_name | registry_size | time_stamp | ROW_COL_1 | ROW_COL_2 | ...
+    const char * cursor = registry + HEADER_SIZE;
+
+    //Convert the values from the registry
     for (vector<SchemaCol>::iterator it = schema_cols->begin(); it != schema_cols->end(); it++) {
         SchemaCol & schema_col = *it;
-        ostringstream stream;
 
+        //The values are formatted without a stream, which is costly to build for each value
         if (schema_col.type == INT32) {
             int value;
-            file.read(reinterpret_cast<char *> (&value), schema_col.getSize());
-            // cout << "INT32 " << value << " | ";
-            stream << value;
+            memcpy(&value, cursor, sizeof(value));
+            row.push_back(to_string(value));
         } else if (schema_col.type == CHAR) {
-            char value[schema_col.getSize()];
-            file.read(reinterpret_cast<char *> (&value), schema_col.getSize());
-            // cout << "CHAR " << value << " | ";
-            stream << value;
+            // The value may fill the whole column without the null terminator
+            row.push_back(string(cursor, strnlen(cursor, schema_col.getSize())));
         } else if (schema_col.type == FLOAT) {
             float value;
-            file.read(reinterpret_cast<char *> (&value), schema_col.getSize());
-            // cout << "FLOAT " << value << " | ";
-            stream << value;
+            memcpy(&value, cursor, sizeof(value));
+            row.push_back(formatDouble(value));
         } else if (schema_col.type == DOUBLE) {
             double value;
-            file.read(reinterpret_cast<char *> (&value), schema_col.getSize());
-            // cout << "DOUBLE " << value << " | ";
-            stream << value;
-        }  else if (schema_col.type == INT64 || schema_col.type == FOREIGN_KEY) {
+            memcpy(&value, cursor, sizeof(value));
+            row.push_back(formatDouble(value));
+        } else {
             long long value;
-            file.read(reinterpret_cast<char *> (&value), schema_col.getSize());
-            // cout << "INT64 " << value << " | ";
-            stream << value;
+            memcpy(&value, cursor, sizeof(value));
+            row.push_back(to_string(value));
         }
-
-        string string_value;
-        string_value = stream.str();
-
-        // Push the value to the line vector
-        row.push_back(string_value);
+        cursor += schema_col.getSize();
     }
-    // cout << endl;
-    file.close();
-
-    return row;
 }
 
 vector<string> Table::getRowById(long long _id) {
@@ -585,6 +1731,9 @@ vector<string> Table::getRowById(long long _id) {
        make_pair(_id, numeric_limits<long long>::min())));
 
     // If the found index is equals to the desired index, the _id was found
+    if ((size_t) idx >= header->size()) {
+        return row;
+    }
     auto pair = header->at(idx);
     if (pair.first == _id) {
         row = getRow(pair.second);
@@ -593,15 +1742,1136 @@ vector<string> Table::getRowById(long long _id) {
     return row;
 }
 
+vector<vector<string> > Table::getRows(const vector<long long> & registry_positions) {
+    vector<char> buffer;
+    vector<IoRequest> requests;
+    vector<size_t> row_offsets;
+    planRowReads(registry_positions, buffer, requests, row_offsets);
+    async_io->run(requests);
+
+    vector<vector<string> > rows(registry_positions.size());
+    for (size_t i = 0; i < rows.size(); i++) {
+        decodeRow(&buffer[row_offsets[i]], rows[i]);
+    }
+    return rows;
+}
+
+void Table::planRowReads(const vector<long long> & registry_positions, vector<char> & buffer, vector<IoRequest> & requests,
+                         vector<size_t> & row_offsets) {
+    requests.clear();
+    row_offsets.assign(registry_positions.size(), 0);
+    if (registry_positions.empty()) {
+        return;
+    }
+    unsigned registry_size = getRegistrySize();
+
+    //The positions in the file order, each one with its place on the result
+    vector<size_t> order(registry_positions.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&registry_positions](size_t a, size_t b) {
+        return registry_positions[a] < registry_positions[b];
+    });
+
+    //Extend a read over the next registry while the bytes in between are few enough
+    struct Read {
+        long long offset;
+        size_t size;
+        size_t buffer_offset;
+    };
+    vector<Read> reads;
+    size_t buffer_size = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        long long position = registry_positions[order[i]];
+        if (!reads.empty()) {
+            Read & last = reads.back();
+            long long end = last.offset + last.size;
+            if (position <= end + COALESCE_GAP && position + registry_size - last.offset <= MAX_COALESCED_READ) {
+                size_t size = max(last.size, (size_t) (position + registry_size - last.offset));
+                buffer_size += size - last.size;
+                last.size = size;
+                row_offsets[order[i]] = last.buffer_offset + (position - last.offset);
+                continue;
+            }
+        }
+        Read read;
+        read.offset = position;
+        read.size = registry_size;
+        read.buffer_offset = buffer_size;
+        reads.push_back(read);
+        buffer_size += registry_size;
+        row_offsets[order[i]] = read.buffer_offset;
+    }
+
+    buffer.resize(buffer_size);
+    int file = getDataFile();
+    for (vector<Read>::iterator it = reads.begin(); it != reads.end(); it++) {
+        requests.push_back(IoRequest(file, it->offset, &buffer[it->buffer_offset], it->size));
+    }
+}
+
+AsyncResult<vector<vector<string> > > Table::getRowsAsync(const vector<long long> & registry_positions) {
+    AsyncResult<vector<vector<string> > > result;
+    shared_ptr<vector<char> > buffer = make_shared<vector<char> >();
+    shared_ptr<vector<size_t> > row_offsets = make_shared<vector<size_t> >();
+    vector<IoRequest> requests;
+    try {
+        planRowReads(registry_positions, *buffer, requests, *row_offsets);
+    } catch (...) {
+        result.setError(current_exception());
+        return result;
+    }
+
+    getCompletionQueue().submit(requests, [this, result, buffer, row_offsets](exception_ptr error) mutable {
+        if (error) {
+            result.setError(error);
+            return;
+        }
+        vector<vector<string> > rows(row_offsets->size());
+        for (size_t i = 0; i < rows.size(); i++) {
+            decodeRow(&buffer->at(row_offsets->at(i)), rows[i]);
+        }
+        result.setValue(move(rows));
+    });
+    return result;
+}
+
+AsyncResult<vector<string> > Table::getRowByIdAsync(long long _id) {
+    AsyncResult<vector<string> > result;
+    header_t::iterator it = lower_bound(header->begin(), header->end(), make_pair(_id, numeric_limits<long long>::min()));
+    if (it == header->end() || it->first != _id) {
+        result.setValue(vector<string>());
+        return result;
+    }
+    getRowsAsync(vector<long long>(1, it->second)).then([result](AsyncResult<vector<vector<string> > > rows) mutable {
+        try {
+            result.setValue(move(rows.get().at(0)));
+        } catch (...) {
+            result.setError(current_exception());
+        }
+    });
+    return result;
+}
+
+AsyncResult<Cursor> Table::queryAsync(const string & statement, Table * joined_table) {
+    AsyncResult<Cursor> result;
+    ThreadPool::getShared().submit([this, statement, joined_table, result]() mutable {
+        try {
+            result.setValue(query(statement, joined_table));
+        } catch (...) {
+            result.setError(current_exception());
+        }
+    });
+    return result;
+}
+
+IoCompletionQueue & Table::getCompletionQueue() {
+    unique_lock<mutex> lock(data_file_mutex);
+    if (async_io == &AsyncIo::getShared()) {
+        return IoCompletionQueue::getShared();
+    }
+    if (!completion_queue || &completion_queue->getAsyncIo() != async_io) {
+        completion_queue.reset(new IoCompletionQueue(*async_io));
+    }
+    return *completion_queue;
+}
+
 void Table::drop() {
+    {
+        unique_lock<mutex> lock(data_file_mutex);
+        if (data_file >= 0) {
+            close(data_file);
+            data_file = -1;
+        }
+    }
     remove(this->path.c_str());
     remove(this->header_file_path.c_str());
     this->header->clear();
+
+    for (vector<BlockBloomFilter>::iterator it = bloom_filters.begin(); it != bloom_filters.end(); it++) {
+        it->drop();
+    }
+    bloom_filters.clear();
+
+    for (vector<BitmapIndex>::iterator it = bitmap_indexes.begin(); it != bitmap_indexes.end(); it++) {
+        it->drop();
+    }
+    bitmap_indexes.clear();
+    hash_indexes.clear();
+    zone_map.drop();
+    statistics.drop();
+}
+
+long long Table::getNumberOfBlocks() {
+    return (header->size() + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+}
+
+void Table::readBlock(long long block, vector<vector<string> > & rows, vector<long long> & positions) {
+    Batch batch;
+    readBlock(block, batch);
+
+    rows.clear();
+    batch.appendRows(rows);
+    positions = batch.positions;
+}
+
+void Table::readBlock(long long block, Batch & batch) {
+    long long first = block * ROWS_PER_BLOCK;
+    long long last = min(first + ROWS_PER_BLOCK, (long long) header->size());
+
+    vector<uint32_t> row_ids;
+    for (long long i = first; i < last; i++) {
+        row_ids.push_back(i);
+    }
+    readRows(row_ids, batch);
+}
+
+void Table::readBlocks(const vector<long long> & blocks, vector<Batch> & batches) {
+    batches.resize(blocks.size());
+    vector<vector<uint32_t> > row_ids(blocks.size());
+    vector<const vector<uint32_t> *> row_id_lists;
+    vector<Batch *> batch_pointers;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        long long first = blocks[i] * ROWS_PER_BLOCK;
+        long long last = min(first + ROWS_PER_BLOCK, (long long) header->size());
+        for (long long row = first; row < last; row++) {
+            row_ids[i].push_back(row);
+        }
+        row_id_lists.push_back(&row_ids[i]);
+        batch_pointers.push_back(&batches[i]);
+    }
+    readRowLists(row_id_lists, batch_pointers);
+}
+
+void Table::readRows(const vector<uint32_t> & row_ids, Batch & batch) {
+    readRowLists(vector<const vector<uint32_t> *>(1, &row_ids), vector<Batch *>(1, &batch));
 }
 
-Join Table::join(string this_collumn_name, Table* other_table, string other_collumn_name, JoinType join_type, vector<long> *this_table_ids) {
+void Table::readRowLists(const vector<const vector<uint32_t> *> & row_id_lists, const vector<Batch *> & batches) {
+    vector<SchemaCol>* schema_cols = schema.getCols();
+    unsigned registry_size = getRegistrySize();
+
+    //The runs of all the lists, each one to its range of a single buffer
+    struct Run {
+        size_t list;
+        unsigned first_row;
+        unsigned count;
+        size_t buffer_offset;
+    };
+    vector<Run> runs;
+    size_t buffer_size = 0;
+    for (size_t list = 0; list < row_id_lists.size(); list++) {
+        const vector<uint32_t> & row_ids = *row_id_lists[list];
+        Batch & batch = *batches[list];
+        if (!batch.hasColumns(schema_cols)) {
+            batch.init(schema_cols);
+        }
+        batch.resize(row_ids.size());
+
+        unsigned i = 0;
+        while (i < row_ids.size()) {
+            //Extend the run while the next registry is right after the previous one
+            unsigned j = i + 1;
+            while (j < row_ids.size() && header->at(row_ids[j]).second == header->at(row_ids[j - 1]).second + registry_size) {
+                j++;
+            }
+            Run run;
+            run.list = list;
+            run.first_row = i;
+            run.count = j - i;
+            run.buffer_offset = buffer_size;
+            runs.push_back(run);
+            buffer_size += (size_t) run.count * registry_size;
+
+            for (unsigned k = i; k < j; k++) {
+                batch.positions[k] = header->at(row_ids[k]).second;
+            }
+            i = j;
+        }
+    }
+    if (runs.empty()) {
+        return;
+    }
+
+    vector<char> buffer(buffer_size);
+    vector<IoRequest> requests;
+    int file = getDataFile();
+    for (vector<Run>::iterator run = runs.begin(); run != runs.end(); run++) {
+        requests.push_back(IoRequest(file, batches[run->list]->positions[run->first_row], &buffer[run->buffer_offset],
+                                     (size_t) run->count * registry_size));
+    }
+    async_io->run(requests);
+
+    for (vector<Run>::iterator run = runs.begin(); run != runs.end(); run++) {
+        decodeRegistries(&buffer[run->buffer_offset], run->count, *batches[run->list], run->first_row);
+    }
+}
+
+int Table::getDataFile() {
+    unique_lock<mutex> lock(data_file_mutex);
+    if (data_file < 0) {
+        data_file = open(path.c_str(), O_RDONLY);
+        if (data_file < 0) {
+            throw std::invalid_argument("Unable to open the table file " + path + ": " + strerror(errno));
+        }
+    }
+    return data_file;
+}
+
+void Table::decodeRegistries(const char * buffer, unsigned count, Batch & batch, unsigned first_row) {
+    if (row_kernels != NULL) {
+        row_kernels->decodeRegistries(buffer, count, batch, first_row);
+        return;
+    }
+
+    vector<SchemaCol>* schema_cols = schema.getCols();
+    unsigned registry_size = getRegistrySize();
+
+    //Skip the header
+    // | table_name | registry_size | time_stamp | ROW_COL_1 | ROW_COL_2 | ...
+    const char * column_start = buffer + HEADER_SIZE;
+
+    for (unsigned column = 0; column < schema_cols->size(); column++) {
+        SchemaCol & schema_col = schema_cols->at(column);
+        ColumnVector & column_vector = batch.columns[column];
+
+        switch (schema_col.type) {
+            case INT32:
+                gatherValues(column_start, count, registry_size, &column_vector.int32_values[first_row]);
+                break;
+            case INT64:
+            case FOREIGN_KEY:
+                gatherValues(column_start, count, registry_size, &column_vector.int64_values[first_row]);
+                break;
+            case FLOAT:
+                gatherValues(column_start, count, registry_size, &column_vector.float_values[first_row]);
+                break;
+            case DOUBLE:
+                gatherValues(column_start, count, registry_size, &column_vector.double_values[first_row]);
+                break;
+            case CHAR:
+                for (unsigned i = 0; i < count; i++) {
+                    memcpy(&column_vector.char_values[(size_t) (first_row + i) * column_vector.width],
+                           column_start + (size_t) i * registry_size, column_vector.width);
+                }
+                break;
+        }
+        column_start += schema_col.getSize();
+    }
+}
+
+bool Table::blockMayContain(int column_position, long long block, const vector<string> & values) {
+    for (vector<BlockBloomFilter>::iterator it = bloom_filters.begin(); it != bloom_filters.end(); it++) {
+        if (it->getColumnPosition() == column_position) {
+            //The filters store the values as read from the file
+            SchemaCol & schema_col = schema.getCols()->at(column_position);
+            vector<string> normalized_values;
+            for (vector<string>::const_iterator value = values.begin(); value != values.end(); value++) {
+                normalized_values.push_back(schema_col.normalize(*value));
+            }
+            return it->mayContainAny(block, normalized_values);
+        }
+    }
+    return true;
+}
+
+bool Table::blockMayMatch(long long block, const Predicate & predicate) {
+    if ((predicate.comparator == EQUAL || predicate.comparator == IN) &&
+        !blockMayContain(predicate.column_position, block, predicate.values)) {
+        return false;
+    }
+    return zone_map.blockMayMatch(block, predicate);
+}
+
+vector<vector<string> > Table::readColumnBlocks(int column_position, long long first_block) {
+    vector<vector<string> > block_values(getNumberOfBlocks());
+
+    //The schema size is computed on the first call, before the tasks share the schema
+    getRegistrySize();
+
+    TaskGraph graph;
+    for (long long block = first_block; block < (long long) block_values.size(); block++) {
+        graph.add([this, block, column_position, &block_values]() {
+            vector<vector<string> > rows;
+            vector<long long> positions;
+            readBlock(block, rows, positions);
+            block_values[block].reserve(rows.size());
+            for (vector<vector<string> >::iterator row = rows.begin(); row != rows.end(); row++) {
+                block_values[block].push_back(row->at(column_position));
+            }
+        }, LOW_PRIORITY);
+    }
+    graph.wait();
+    return block_values;
+}
+
+void Table::addBloomFilter(string column) {
+    int column_position = schema.getColPosition(column);
+    for (vector<BlockBloomFilter>::iterator it = bloom_filters.begin(); it != bloom_filters.end(); it++) {
+        if (it->getColumnPosition() == column_position) {
+            return;
+        }
+    }
+
+    BlockBloomFilter bloom_filter(name + "_" + column + "_bloom.dat", column_position);
+
+    if (!bloom_filter.load() || bloom_filter.getNumberOfRows() > header->size()) {
+        //Missing, unreadable or from a larger table, build the filters from the table rows
+        bloom_filter.drop();
+    }
+
+    if (bloom_filter.getNumberOfRows() < header->size()) {
+        //Rows inserted since the file was saved (e.g.: by another Table instance), the
+        //partly filled last block is rebuilt with the following ones
+        long long first_block = bloom_filter.getNumberOfRows() / ROWS_PER_BLOCK;
+        bloom_filter.truncate(first_block);
+
+        vector<vector<string> > block_values = readColumnBlocks(column_position, first_block);
+        for (long long block = first_block; block < (long long) block_values.size(); block++) {
+            for (long long i = 0; i < (long long) block_values[block].size(); i++) {
+                bloom_filter.add(block * ROWS_PER_BLOCK + i, block_values[block][i]);
+            }
+        }
+        bloom_filter.save();
+    }
+
+    bloom_filters.push_back(bloom_filter);
+}
+
+void Table::addBitmapIndex(string column) {
+    int column_position = schema.getColPosition(column);
+    for (vector<BitmapIndex>::iterator it = bitmap_indexes.begin(); it != bitmap_indexes.end(); it++) {
+        if (it->getColumnPosition() == column_position) {
+            return;
+        }
+    }
+
+    BitmapIndex bitmap_index(name + "_" + column + "_bitmap.dat", column_position, schema.getCols()->at(column_position));
+
+    if (!bitmap_index.load() || bitmap_index.getNumberOfRows() != header->size()) {
+        //Missing or outdated file, build the index from the table rows
+        vector<string> values;
+        vector<vector<string> > block_values = readColumnBlocks(column_position);
+        for (vector<vector<string> >::iterator it = block_values.begin(); it != block_values.end(); it++) {
+            values.insert(values.end(), it->begin(), it->end());
+        }
+        bitmap_index.build(values);
+        bitmap_index.save();
+    }
+
+    bitmap_indexes.push_back(bitmap_index);
+}
+
+void Table::addHashIndex(string column) {
+    int column_position = schema.getColPosition(column);
+    for (vector<HashIndex>::iterator it = hash_indexes.begin(); it != hash_indexes.end(); it++) {
+        if (it->getColumnPosition() == column_position) {
+            return;
+        }
+    }
+
+    HashIndex hash_index(column_position, schema.getCols()->at(column_position));
+    vector<vector<string> > block_values = readColumnBlocks(column_position);
+    for (long long block = 0; block < (long long) block_values.size(); block++) {
+        for (long long i = 0; i < (long long) block_values[block].size(); i++) {
+            hash_index.add(block * ROWS_PER_BLOCK + i, block_values[block][i]);
+        }
+    }
+
+    hash_indexes.push_back(hash_index);
+}
+
+void Table::updateZoneMap() {
+    if (zone_map.getNumberOfRows() > header->size()) {
+        //The file is from a dropped table
+        zone_map.drop();
+    }
+    if (zone_map.getNumberOfRows() == header->size()) {
+        return;
+    }
+
+    vector<vector<string> > rows;
+    vector<long long> positions;
+    for (long long block = zone_map.getNumberOfRows() / ROWS_PER_BLOCK; block < getNumberOfBlocks(); block++) {
+        readBlock(block, rows, positions);
+        for (long long i = 0; i < (long long) rows.size(); i++) {
+            if ((unsigned long long) (block * ROWS_PER_BLOCK + i) >= zone_map.getNumberOfRows()) {
+                zone_map.add(rows.at(i));
+            }
+        }
+    }
+}
+
+void Table::saveIndexes() {
+    for (vector<BlockBloomFilter>::iterator it = bloom_filters.begin(); it != bloom_filters.end(); it++) {
+        it->save();
+    }
+    for (vector<BitmapIndex>::iterator it = bitmap_indexes.begin(); it != bitmap_indexes.end(); it++) {
+        it->save();
+    }
+    zone_map.save();
+    statistics.save();
+}
+
+bool Table::lookupBitmapIndexes(const Expression & where, RoaringBitmap & rows, bool & exact) {
+    if (where.type == PREDICATE_EXPRESSION) {
+        for (vector<BitmapIndex>::iterator it = bitmap_indexes.begin(); it != bitmap_indexes.end(); it++) {
+            if (it->getColumnPosition() == where.predicate.column_position) {
+                rows = it->lookup(where.predicate, exact);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (where.type == NOT_EXPRESSION) {
+        //The complement of a superset is not a superset of the complement
+        RoaringBitmap child_rows;
+        bool child_exact;
+        if (!lookupBitmapIndexes(where.children.at(0), child_rows, child_exact) || !child_exact) {
+            return false;
+        }
+        rows = child_rows.flip(header->size());
+        exact = true;
+        return true;
+    }
+
+    bool found = false;
+    exact = true;
+    for (vector<Expression>::const_iterator it = where.children.begin(); it != where.children.end(); it++) {
+        RoaringBitmap child_rows;
+        bool child_exact;
+
+        if (!lookupBitmapIndexes(*it, child_rows, child_exact)) {
+            if (where.type == OR_EXPRESSION) {
+                //Any row may match the child
+                exact = false;
+                return false;
+            }
+            //Ignoring an AND child keeps a superset of the matching rows
+            exact = false;
+            continue;
+        }
+
+        if (!found) {
+            rows = child_rows;
+        } else if (where.type == AND_EXPRESSION) {
+            rows = rows & child_rows;
+        } else {
+            rows = rows | child_rows;
+        }
+        found = true;
+        exact = exact && child_exact;
+    }
+    return found;
+}
+
+bool Table::getIdRange(const Expression & where, long long & first_row, long long & end_row) {
+    vector<Expression> predicates;
+    if (where.type == PREDICATE_EXPRESSION) {
+        predicates.push_back(where);
+    } else if (where.type == AND_EXPRESSION) {
+        predicates = where.children;
+    }
+
+    //The _id range [first_id, last_id]
+    long long first_id = numeric_limits<long long>::min();
+    long long last_id = numeric_limits<long long>::max();
+    bool found = false;
+    for (vector<Expression>::iterator it = predicates.begin(); it != predicates.end(); it++) {
+        const Predicate & predicate = it->predicate;
+        if (it->type != PREDICATE_EXPRESSION || predicate.column_position != 0) {
+            continue;
+        }
+        long long value = atoll(predicate.values.at(0).c_str());
+        switch (predicate.comparator) {
+            case EQUAL: first_id = max(first_id, value); last_id = min(last_id, value); break;
+            case GREATER: first_id = max(first_id, value + 1); break;
+            case GREATER_EQUAL: first_id = max(first_id, value); break;
+            case LESS: last_id = min(last_id, value - 1); break;
+            case LESS_EQUAL: last_id = min(last_id, value); break;
+            default: continue;
+        }
+        found = true;
+    }
+    if (!found) {
+        return false;
+    }
+
+    //The header is sorted by _id
+    first_row = lower_bound(header->begin(), header->end(), make_pair(first_id, numeric_limits<long long>::min())) - header->begin();
+    end_row = first_id > last_id ? first_row :
+              upper_bound(header->begin(), header->end(), make_pair(last_id, numeric_limits<long long>::max())) - header->begin();
+    end_row = max(first_row, end_row);
+    return true;
+}
+
+vector<ColumnEstimate> Table::getColumnEstimates() {
+    vector<ColumnEstimate> columns(schema.getCols()->size());
+    for (int i = 0; i < (int) columns.size(); i++) {
+        columns[i].has_range = zone_map.getRange(i, columns[i].minimum, columns[i].maximum);
+    }
+    if (!columns.empty()) {
+        //The _id is unique
+        columns[0].distinct_values = header->size();
+    }
+    for (vector<HashIndex>::iterator it = hash_indexes.begin(); it != hash_indexes.end(); it++) {
+        columns[it->getColumnPosition()].distinct_values = it->getNumberOfValues();
+    }
+
+    //The statistics of Table::analyze are more precise than the zone maps, if they are current
+    if (statistics.isAnalyzed() && statistics.getNumberOfRows() == header->size()) {
+        for (int i = 1; i < (int) columns.size(); i++) {
+            double minimum, maximum;
+            if (statistics.getRange(i, minimum, maximum)) {
+                columns[i].has_range = true;
+                columns[i].minimum = minimum;
+                columns[i].maximum = maximum;
+            }
+            columns[i].distinct_values = statistics.getDistinctValues(i);
+            columns[i].histogram = statistics.getHistogram(i);
+        }
+    }
+    return columns;
+}
+
+void Table::analyze(double sample_fraction) {
+    if (sample_fraction <= 0 || sample_fraction > 1) {
+        throw std::invalid_argument("The sample fraction must be in (0, 1]");
+    }
+    long long stride = max(1LL, llround(1 / sample_fraction));
+    long long number_of_blocks = getNumberOfBlocks();
+    long long number_of_tasks = ThreadPool::getShared().getNumberOfThreads();
+    number_of_tasks = max(1LL, min(number_of_tasks, number_of_blocks));
+    vector<SchemaCol> schema_cols = *schema.getCols();
+
+    //The schema size is computed on the first call, before the tasks share the schema
+    getRegistrySize();
+
+    //Each task reads a range of blocks, keeping its own statistics and numeric values. They
+    //are maintenance work, so the queries running meanwhile go first
+    vector<TableStatistics> task_statistics(number_of_tasks, TableStatistics("", schema_cols));
+    vector<vector<vector<double> > > task_values(number_of_tasks, vector<vector<double> >(schema_cols.size()));
+    TaskGraph graph;
+    vector<size_t> reads;
+    for (long long i = 0; i < number_of_tasks; i++) {
+        reads.push_back(graph.add([this, i, stride, number_of_blocks, number_of_tasks, &schema_cols, &task_statistics, &task_values]() {
+            vector<vector<string> > rows;
+            vector<long long> positions;
+            for (long long block = number_of_blocks * i / number_of_tasks; block < number_of_blocks * (i + 1) / number_of_tasks; block++) {
+                if (block % stride != 0) {
+                    continue;
+                }
+                readBlock(block, rows, positions);
+                for (vector<vector<string> >::iterator row = rows.begin(); row != rows.end(); row++) {
+                    task_statistics[i].add(*row);
+                    for (unsigned column = 1; column < schema_cols.size(); column++) {
+                        if (schema_cols[column].type != CHAR && !row->at(column).empty()) {
+                            task_values[i][column].push_back(atof(row->at(column).c_str()));
+                        }
+                    }
+                }
+            }
+        }, LOW_PRIORITY));
+    }
+
+    //Merged once all the blocks are read
+    TableStatistics table_statistics(name + "_statistics.dat", schema_cols);
+    graph.add([this, number_of_tasks, &schema_cols, &task_statistics, &task_values, &table_statistics]() {
+        vector<vector<double> > values(schema_cols.size());
+        for (long long i = 0; i < number_of_tasks; i++) {
+            table_statistics.merge(task_statistics[i]);
+            for (unsigned column = 0; column < schema_cols.size(); column++) {
+                values[column].insert(values[column].end(), task_values[i][column].begin(), task_values[i][column].end());
+            }
+        }
+        table_statistics.finish(values, header->size());
+    }, LOW_PRIORITY, reads);
+    graph.wait();
+
+    statistics = table_statistics;
+    statistics.save();
+}
+
+TableStatistics & Table::getStatistics() {
+    return statistics;
+}
+
+vector<AccessPath> Table::getAccessPaths(const Expression & where) {
+    return findAccessPaths(where, true, FULL_SCAN);
+}
+
+vector<AccessPath> Table::findAccessPaths(const Expression & where, bool all_types, AccessPathType type) {
+    vector<AccessPath> paths;
+    double number_of_rows = header->size();
+    long long number_of_blocks = getNumberOfBlocks();
+
+    AccessPath full_scan(FULL_SCAN, to_string(number_of_blocks) + " blocks");
+    full_scan.rows_read = number_of_rows;
+    full_scan.cost = number_of_rows * (SEQUENTIAL_ROW_COST + FILTER_ROW_COST);
+    full_scan.exact = where.isAlwaysTrue();
+    paths.push_back(full_scan);
+    if (where.isAlwaysTrue()) {
+        return paths;
+    }
+
+    //The blocks excluded by the zone maps and the bloom filters are not read
+    long long matching_blocks = number_of_blocks;
+    if (all_types || type == ZONE_MAP_SCAN) {
+        matching_blocks = 0;
+        for (long long block = 0; block < number_of_blocks; block++) {
+            if (TableScanOperator::blockMayMatch(this, where, block)) {
+                matching_blocks++;
+            }
+        }
+    }
+    if (matching_blocks < number_of_blocks) {
+        AccessPath zone_map_scan(ZONE_MAP_SCAN, to_string(matching_blocks) + " of " + to_string(number_of_blocks) + " blocks");
+        zone_map_scan.rows_read = min(number_of_rows, (double) matching_blocks * ROWS_PER_BLOCK);
+        zone_map_scan.cost = number_of_blocks * BLOCK_CHECK_COST +
+                             zone_map_scan.rows_read * (SEQUENTIAL_ROW_COST + FILTER_ROW_COST);
+        paths.push_back(zone_map_scan);
+    }
+
+    //A small _id range is read row by row, a large one block by block
+    long long first_row, end_row;
+    if ((all_types || type == HEADER_SEARCH) && getIdRange(where, first_row, end_row)) {
+        AccessPath header_search(HEADER_SEARCH, "on _id rows [" + to_string(first_row) + ", " + to_string(end_row) + ")");
+        header_search.rows_read = end_row - first_row;
+        double search_cost = log2(number_of_rows + 1) * SEARCH_STEP_COST;
+        if (end_row - first_row <= ROWS_PER_BLOCK) {
+            header_search.has_row_ids = true;
+            for (long long row = first_row; row < end_row; row++) {
+                header_search.row_ids.push_back(row);
+            }
+            header_search.cost = search_cost + header_search.rows_read * (RANDOM_ROW_COST + FILTER_ROW_COST);
+        } else {
+            header_search.first_block = first_row / ROWS_PER_BLOCK;
+            header_search.last_block = (end_row - 1) / ROWS_PER_BLOCK + 1;
+            double rows_in_blocks = min(number_of_rows, (double) (header_search.last_block - header_search.first_block) * ROWS_PER_BLOCK);
+            header_search.cost = search_cost + rows_in_blocks * (SEQUENTIAL_ROW_COST + FILTER_ROW_COST);
+        }
+        paths.push_back(header_search);
+    }
+
+    //A hash index answers an = or IN predicate, alone or in a top level AND
+    vector<Expression> predicates;
+    if (all_types || type == HASH_INDEX_LOOKUP) {
+        if (where.type == PREDICATE_EXPRESSION) {
+            predicates.push_back(where);
+        } else if (where.type == AND_EXPRESSION) {
+            predicates = where.children;
+        }
+    }
+    for (vector<Expression>::iterator it = predicates.begin(); it != predicates.end(); it++) {
+        if (it->type != PREDICATE_EXPRESSION || !HashIndex::canLookup(it->predicate)) {
+            continue;
+        }
+        for (vector<HashIndex>::iterator index = hash_indexes.begin(); index != hash_indexes.end(); index++) {
+            if (index->getColumnPosition() != it->predicate.column_position) {
+                continue;
+            }
+            AccessPath lookup(HASH_INDEX_LOOKUP, "on " + it->predicate.column);
+            lookup.has_row_ids = true;
+            lookup.row_ids = index->lookup(it->predicate);
+            lookup.rows_read = lookup.row_ids.size();
+            lookup.cost = it->predicate.values.size() * INDEX_PROBE_COST + lookup.rows_read * (RANDOM_ROW_COST + FILTER_ROW_COST);
+            lookup.exact = where.type == PREDICATE_EXPRESSION;
+            paths.push_back(lookup);
+        }
+    }
+
+    RoaringBitmap candidates;
+    bool exact = false;
+    if ((all_types || type == BITMAP_INDEX_SCAN) && lookupBitmapIndexes(where, candidates, exact)) {
+        AccessPath bitmap_scan(BITMAP_INDEX_SCAN, exact ? "" : "with a filter");
+        bitmap_scan.has_row_ids = true;
+        bitmap_scan.row_ids = candidates.toVector();
+        bitmap_scan.rows_read = bitmap_scan.row_ids.size();
+        bitmap_scan.cost = INDEX_PROBE_COST + bitmap_scan.rows_read * (RANDOM_ROW_COST + (exact ? 0 : FILTER_ROW_COST));
+        bitmap_scan.exact = exact;
+        paths.push_back(bitmap_scan);
+    }
+    return paths;
+}
+
+AccessPath Table::chooseAccessPath(const Expression & where) {
+    vector<AccessPath> paths = getAccessPaths(where);
+    AccessPath best = paths.at(0);
+    for (vector<AccessPath>::iterator it = paths.begin() + 1; it != paths.end(); it++) {
+        if (it->cost < best.cost) {
+            best = *it;
+        }
+    }
+    return best;
+}
+
+AccessPath Table::getAccessPath(const Expression & where, AccessPathType type) {
+    vector<AccessPath> paths = findAccessPaths(where, false, type);
+    AccessPath best = paths.at(0);
+    for (vector<AccessPath>::iterator it = paths.begin() + 1; it != paths.end(); it++) {
+        if (it->type == type && (best.type != type || it->cost < best.cost)) {
+            best = *it;
+        }
+    }
+    return best;
+}
+
+vector<vector<string> > Table::scan(vector<int> & projection, Expression & where, const vector<SortKey> & order_by, long long limit,
+                                    long long offset, OperatorProfile * profile) {
+    vector<vector<string> > result;
+    vector<Batch> batches = scanBatches(projection, where, order_by, limit, offset, profile);
+    for (vector<Batch>::iterator it = batches.begin(); it != batches.end(); it++) {
+        it->appendRows(result);
+    }
+    return result;
+}
+
+vector<Batch> Table::scanBatches(vector<int> & projection, Expression & where, const vector<SortKey> & order_by, long long limit,
+                                 long long offset, OperatorProfile * profile) {
+    where.bind(schema);
+    //Only read the rows or the blocks of the cheapest access path
+    return scanPath(projection, where, chooseAccessPath(where), order_by, limit, offset, profile);
+}
+
+vector<Batch> Table::scanPath(vector<int> & projection, Expression & where, const AccessPath & path, const vector<SortKey> & order_by,
+                              long long limit, long long offset, OperatorProfile * profile) {
+    vector<Batch> result;
+    TableScanOperator scan_operator(this);
+    scan_operator.setBlockFilter(where);
+
+    bool exact = path.exact;
+    if (path.has_row_ids) {
+        scan_operator.setRowIds(path.row_ids);
+    } else {
+        scan_operator.setBlockRange(path.first_block, path.last_block);
+    }
+
+    //The rows are read in the _id order, so ordering by _id doesn't need a sort
+    bool header_order = SortOperator::isHeaderOrder(order_by);
+    bool descending = order_by.size() == 1 && order_by[0].column == 0 && order_by[0].descending;
+    if (descending) {
+        scan_operator.setDescending(true);
+        header_order = true;
+    }
+
+    //Without a filter the scan itself stops after the LIMIT + OFFSET rows, otherwise the
+    //LimitOperator stops pulling the batches once the limit is reached
+    long long rows_needed = limit < 0 ? -1 : limit + offset;
+    bool scan_limit = header_order && (exact || where.isAlwaysTrue()) && rows_needed >= 0;
+    if (rows_needed < 0) {
+        //A LIMIT may stop the scan before the blocks read ahead are needed
+        scan_operator.setReadAhead(io_queue_depth);
+    }
+    if (scan_limit) {
+        scan_operator.setRowLimit(rows_needed);
+    }
+
+    //The other scans of more than one block are split between the threads of the pool, each
+    //one filtering its blocks (and projecting them, if there is no sort). The batches are
+    //merged in the header order, so the sort keeps the rows with the same key in the _id order.
+    //The short scans go first, so they don't wait behind the large ones. A staged scan
+    //filters and projects the blocks on other threads than the one reading them instead
+    unique_ptr<ParallelScanOperator> parallel_operator;
+    unique_ptr<StagedScanOperator> staged_operator;
+    vector<int> output_projection(projection);
+    if (!descending && !scan_limit && scan_operator.getNumberOfMorsels() > 1) {
+        //The schema size is computed on the first call, before the tasks share the schema
+        getRegistrySize();
+        vector<int> scan_projection;
+        if (header_order) {
+            scan_projection = projection;
+            for (unsigned i = 0; i < output_projection.size(); i++) {
+                output_projection[i] = i;
+            }
+        }
+        if (execution_mode == STAGED_EXECUTION) {
+            staged_operator.reset(new StagedScanOperator(scan_operator, exact ? Expression() : where));
+            staged_operator->setProjection(scan_projection);
+        } else {
+            parallel_operator.reset(new ParallelScanOperator(scan_operator, exact ? Expression() : where, scan_projection, true, 0,
+                                                             path.rows_read <= SHORT_QUERY_ROWS ? HIGH_PRIORITY : NORMAL_PRIORITY));
+        }
+    }
+
+    Profiler profiler(profile != NULL);
+    Operator * scan_output;
+    if (parallel_operator) {
+        scan_output = profiler.wrap(parallel_operator.get(), "Parallel scan on " + to_string(parallel_operator->getNumberOfThreads()) +
+                                    " threads: " + path.toString());
+    } else if (staged_operator) {
+        scan_output = profiler.wrap(staged_operator.get(), "Staged scan on " + to_string(staged_operator->getNumberOfThreads()) +
+                                    " threads: " + path.toString());
+    } else {
+        scan_output = profiler.wrap(&scan_operator, "Table scan: " + path.toString());
+    }
+    FilterOperator filter_operator(scan_output, exact ? Expression() : where);
+    Operator * filter_output = parallel_operator || staged_operator ? scan_output :
+                               profiler.wrap(&filter_operator, "Filter " + (exact ? Expression() : where).toString(), scan_output);
+    SortOperator sort_operator(filter_output, order_by, rows_needed);
+    string sort_name = "Sort";
+    for (vector<SortKey>::const_iterator it = order_by.begin(); it != order_by.end(); it++) {
+        sort_name += (it == order_by.begin() ? " " : ", ") + schema.getCols()->at(it->column).key + (it->descending ? " desc" : "");
+    }
+    Operator * sort_output = profiler.wrap(&sort_operator, sort_name, filter_output);
+    Operator * limit_input = header_order ? filter_output : sort_output;
+    LimitOperator limit_operator(limit_input, limit, offset);
+    Operator * limit_output = profiler.wrap(&limit_operator, "Limit " + (limit < 0 ? string("all") : to_string(limit)) +
+                                            " offset " + to_string(offset), limit_input);
+    ProjectOperator project_operator(limit_output, output_projection);
+    Operator * project_output = profiler.wrap(&project_operator, "Project", limit_output);
+
+    //The project operator sets the whole batch, so each one is moved to the result
+    Batch batch;
+    while (project_output->next(batch)) {
+        if (!batch.selection.empty()) {
+            result.push_back(std::move(batch));
+            batch = Batch();
+        }
+    }
+
+    if (profiler.isEnabled()) {
+        OperatorProfile * scan_profile = profiler.getProfile(scan_output);
+        if (parallel_operator) {
+            parallel_operator->stop();
+            scan_profile->blocks_read = parallel_operator->getBlocksRead();
+            scan_profile->blocks_skipped = parallel_operator->getBlocksSkipped();
+            scan_profile->bytes_read = parallel_operator->getRowsRead() * getRegistrySize();
+        } else if (staged_operator) {
+            staged_operator->stop();
+            scan_profile->blocks_read = staged_operator->getBlocksRead();
+            scan_profile->blocks_skipped = staged_operator->getBlocksSkipped();
+            scan_profile->bytes_read = staged_operator->getRowsRead() * getRegistrySize();
+        } else {
+            scan_profile->blocks_read = scan_operator.getBlocksRead();
+            scan_profile->blocks_skipped = scan_operator.getBlocksSkipped();
+            scan_profile->bytes_read = scan_operator.getRowsRead() * getRegistrySize();
+        }
+        profiler.getProfile(sort_output)->memory_peak = sort_operator.getMemoryPeak();
+        *profile = profiler.getTree(project_output);
+    }
+    return result;
+}
+
+vector<vector<string> > Table::aggregate(vector<int> & group_by, vector<Aggregate> & aggregates, Expression & where,
+                                         const vector<SortKey> & order_by, long long limit, long long offset,
+                                         OperatorProfile * profile) {
+    vector<vector<string> > result;
+    where.bind(schema);
+
+    AccessPath path = chooseAccessPath(where);
+    bool exact = path.exact;
+    TableScanOperator prototype(this);
+    prototype.setBlockFilter(where);
+    if (path.has_row_ids) {
+        prototype.setRowIds(path.row_ids);
+    } else {
+        prototype.setBlockRange(path.first_block, path.last_block);
+    }
+
+    //The schema size is computed on the first call, before the workers share the schema
+    getRegistrySize();
+
+    //Each worker of the pipeline takes the next block (or batch of the rows given by the
+    //indexes) when it's done with the previous one, and aggregates it on its own table
+    Pipeline pipeline(prototype);
+    pipeline.setFilter(exact ? Expression() : where);
+
+    Profiler profiler(profile != NULL);
+    HashAggregateOperator aggregate_operator(&pipeline, group_by, aggregates);
+    aggregate_operator.setPriority(path.rows_read <= SHORT_QUERY_ROWS ? HIGH_PRIORITY : NORMAL_PRIORITY);
+    Operator * aggregate_output = profiler.wrap(&aggregate_operator, "Hash aggregate");
+    SortOperator sort_operator(aggregate_output, order_by, limit < 0 ? -1 : limit + offset);
+    Operator * sort_output = profiler.wrap(&sort_operator, "Sort", aggregate_output);
+    Operator * limit_input = order_by.empty() ? aggregate_output : sort_output;
+    LimitOperator limit_operator(limit_input, limit, offset);
+    Operator * limit_output = profiler.wrap(&limit_operator, "Limit " + (limit < 0 ? string("all") : to_string(limit)) +
+                                            " offset " + to_string(offset), limit_input);
+    Batch batch;
+    while (limit_output->next(batch)) {
+        batch.appendRows(result);
+    }
+
+    if (profiler.isEnabled()) {
+        //The pipeline isn't an operator, its counters are added below the aggregation
+        OperatorProfile pipeline_profile("Pipeline: " + path.toString() + " filter " + (exact ? Expression() : where).toString() +
+                                         " on " + to_string(pipeline.getPeakWorkers()) + " workers");
+        pipeline_profile.seconds = pipeline.getSeconds();
+        pipeline_profile.rows_out = pipeline.getRowsOut();
+        pipeline_profile.blocks_read = pipeline.getBlocksRead();
+        pipeline_profile.blocks_skipped = pipeline.getBlocksSkipped();
+        pipeline_profile.bytes_read = pipeline.getRowsRead() * getRegistrySize();
+        OperatorProfile * aggregate_profile = profiler.getProfile(aggregate_output);
+        aggregate_profile->rows_in = pipeline_profile.rows_out;
+        aggregate_profile->children.push_back(pipeline_profile);
+        aggregate_profile->memory_peak = aggregate_operator.getMemoryPeak();
+        profiler.getProfile(sort_output)->memory_peak = sort_operator.getMemoryPeak();
+        *profile = profiler.getTree(limit_output);
+    }
+    return result;
+}
+
+vector<string> Table::explain(const SelectStatement & statement, Table * joined_table) {
+    QueryEstimate estimate;
+    return plan(statement, joined_table, estimate);
+}
+
+vector<string> Table::plan(const SelectStatement & statement, Table * joined_table, QueryEstimate & estimate) {
+    //The operators from the table to the output, and the reads below the first one
+    vector<string> operators;
+    vector<string> reads;
+    vector<AccessPath> paths;
+    double cost, rows;
+
+    bool has_aggregates = !statement.group_by.empty();
+    for (vector<string>::const_iterator it = statement.select.begin(); it != statement.select.end(); it++) {
+        has_aggregates = has_aggregates || it->find('(') != string::npos;
+    }
+
+    if (statement.has_join) {
+        if (joined_table == NULL || joined_table->name != statement.join.table) {
+            throw std::invalid_argument("The joined table \"" + statement.join.table + "\" wasn't given");
+        }
+        //Both tables are read whole, the smaller one is the build side
+        double this_rows = header->size();
+        double joined_rows = joined_table->getHeader()->size();
+        reads.push_back("Full scan of " + name + " (cost=" + CostModel::format(this_rows * SEQUENTIAL_ROW_COST) +
+                        " rows=" + CostModel::format(this_rows) + ")");
+        reads.push_back("Full scan of " + joined_table->name + " (cost=" + CostModel::format(joined_rows * SEQUENTIAL_ROW_COST) +
+                        " rows=" + CostModel::format(joined_rows) + ")");
+        cost = (this_rows + joined_rows) * (SEQUENTIAL_ROW_COST + INDEX_PROBE_COST);
+        rows = max(this_rows, joined_rows);
+        estimate.rows_read = this_rows + joined_rows;
+        //The joined rows are fetched before they are filtered
+        estimate.memory = rows * (getRegistrySize() + joined_table->getRegistrySize());
+        operators.push_back("Hash join on " + statement.join.left_column + " = " + statement.join.right_column +
+                            " (cost=" + CostModel::format(cost) + " rows=" + CostModel::format(rows) + ")");
+        if (!statement.where.isAlwaysTrue()) {
+            cost += rows * FILTER_ROW_COST;
+            rows *= CostModel::estimateSelectivity(statement.where, vector<ColumnEstimate>());
+            operators.push_back("Filter " + statement.where.toString() + " (cost=" + CostModel::format(cost) +
+                                " rows=" + CostModel::format(rows) + ")");
+        }
+    } else {
+        Expression where = statement.where;
+        where.bind(schema);
+        paths = getAccessPaths(where);
+        AccessPath path = paths.at(0);
+        for (vector<AccessPath>::iterator it = paths.begin() + 1; it != paths.end(); it++) {
+            if (it->cost < path.cost) {
+                path = *it;
+            }
+        }
+        reads.push_back(path.toString());
+        cost = path.cost;
+        rows = path.rows_read;
+        estimate.rows_read = path.rows_read;
+        if (!path.exact) {
+            rows = min(rows, header->size() * CostModel::estimateSelectivity(where, getColumnEstimates()));
+            operators.push_back("Filter " + where.toString() + " (cost=" + CostModel::format(cost) +
+                                " rows=" + CostModel::format(rows) + ")");
+        }
+        if (has_aggregates) {
+            cost += rows * AGGREGATE_ROW_COST;
+            rows = statement.group_by.empty() ? 1 : max(1.0, rows * DEFAULT_EQUAL_SELECTIVITY);
+            estimate.memory += rows * getRegistrySize();
+            string group_by;
+            for (vector<string>::const_iterator it = statement.group_by.begin(); it != statement.group_by.end(); it++) {
+                group_by += (group_by.empty() ? " by " : ", ") + *it;
+            }
+            operators.push_back("Hash aggregate" + group_by + " (cost=" + CostModel::format(cost) +
+                                " rows=" + CostModel::format(rows) + ")");
+        }
+    }
+
+    //The rows are read in the _id order, so ordering by _id doesn't need a sort
+    bool header_order = !statement.has_join && !has_aggregates && statement.order_by.size() == 1 &&
+                        (statement.order_by[0] == "_id" || statement.order_by[0] == "_id desc");
+    if (!statement.order_by.empty() && !header_order) {
+        cost += rows * log2(rows + 1) * SORT_ROW_COST;
+        estimate.memory += (statement.limit >= 0 ? min(rows, (double) statement.limit + statement.offset) : rows) * getRegistrySize();
+        string order_by;
+        for (vector<string>::const_iterator it = statement.order_by.begin(); it != statement.order_by.end(); it++) {
+            order_by += (order_by.empty() ? "" : ", ") + *it;
+        }
+        operators.push_back("Sort " + order_by + (statement.limit >= 0 ? " top " + to_string(statement.limit + statement.offset) : "") +
+                            " (cost=" + CostModel::format(cost) + " rows=" + CostModel::format(rows) + ")");
+    }
+    if (statement.limit >= 0 || statement.offset > 0) {
+        rows = max(0.0, rows - statement.offset);
+        if (statement.limit >= 0) {
+            rows = min(rows, (double) statement.limit);
+        }
+        operators.push_back("Limit " + (statement.limit >= 0 ? to_string(statement.limit) : "all") + " offset " +
+                            to_string(statement.offset) + " (cost=" + CostModel::format(cost) + " rows=" + CostModel::format(rows) + ")");
+    }
+    string select;
+    for (vector<string>::const_iterator it = statement.select.begin(); it != statement.select.end(); it++) {
+        select += (select.empty() ? "" : ", ") + *it;
+    }
+    operators.push_back("Project " + (select.empty() ? "*" : select) + " (cost=" + CostModel::format(cost) +
+                        " rows=" + CostModel::format(rows) + ")");
+
+    estimate.cost = cost;
+
+    vector<string> lines;
+    for (vector<string>::reverse_iterator it = operators.rbegin(); it != operators.rend(); it++) {
+        lines.push_back(string(2 * lines.size(), ' ') + *it);
+    }
+    for (vector<string>::iterator it = reads.begin(); it != reads.end(); it++) {
+        lines.push_back(string(2 * operators.size(), ' ') + *it);
+    }
+    if (!paths.empty()) {
+        lines.push_back("Access paths considered:");
+        for (vector<AccessPath>::iterator it = paths.begin(); it != paths.end(); it++) {
+            lines.push_back("  " + it->toString());
+        }
+    }
+    return lines;
+}
+
+Join Table::join(string this_collumn_name, Table* other_table, string other_collumn_name, JoinType join_type, vector<long> *this_table_ids,
+                 long long limit) {
+    if (admission_controller == NULL) {
+        return Join(this, this_collumn_name, other_table, other_collumn_name, join_type, this_table_ids, limit);
+    }
+
+    //A nested loop reads the other table once for each row of this one
+    QueryEstimate estimate;
+    double this_rows = join_type == NESTED_INDEX && this_table_ids != NULL ? this_table_ids->size() : header->size();
+    double other_rows = other_table->getHeader()->size();
+    estimate.rows_read = join_type == HASH ? this_rows + other_rows : this_rows * (other_rows + 1);
+    estimate.cost = join_type == HASH ? estimate.rows_read * (SEQUENTIAL_ROW_COST + INDEX_PROBE_COST) :
+                    estimate.rows_read * RANDOM_ROW_COST;
+    estimate.memory = join_type == HASH ? this_rows * 2 * sizeof(long long) : 0;
+    AdmissionTicket ticket = admission_controller->admit(estimate);
+    CancellationScope scope(ticket.getToken());
+    return Join(this, this_collumn_name, other_table, other_collumn_name, join_type, this_table_ids, limit);
+}
+
+void Table::setAdmissionController(AdmissionController * admission_controller) {
+    this->admission_controller = admission_controller;
+}
+
+void Table::setExecutionMode(ExecutionMode execution_mode) {
+    this->execution_mode = execution_mode;
+}
+
+void Table::setAsyncIo(AsyncIo * async_io) {
+    this->async_io = async_io;
+}
+
+void Table::setIoQueueDepth(unsigned io_queue_depth) {
+    this->io_queue_depth = max(1u, io_queue_depth);
+}
+
+unsigned Table::getIoQueueDepth() const {
+    return io_queue_depth;
+}
 
-    return Join(this, this_collumn_name, other_table, other_collumn_name, join_type, this_table_ids);
+Cursor PreparedStatement::execute() {
+    return table->execute(*this);
 }
 
-#endif //TABLE_H
+#endif //TABLE_H
\ No newline at end of file
@@ -61,6 +61,21 @@ public:
       * @return the table rows with the selected ids
       */
      vector<string> hashTableQuery(string _id);
+
+     /**
+      * Perform the same _id query many times with getRowById, with a prepared statement
+      * and with Table::query(string), to compare the overhead of each one
+      * @return the table row with the selected id
+      */
+     vector<string> preparedStatementQuery(string _id);
+
+     /**
+      * Scan the whole table, filtering the rows where _id > min, with a TableScanOperator
+      * and with a ParallelScanOperator on one thread for each core. The times are wall
+      * times, since the Timer adds up the CPU time of all the threads
+      * @return the number of matching rows
+      */
+     long long parallelScanQuery(int min);
      
      /*****************************************
       ********** RANGE QUERY METHODS **********
@@ -114,6 +129,8 @@ void TableBenchmark::runBenchmark() {
     sequentialIndexQuery(_id);
     binaryIndexQuery(_id);
     hashTableQuery(_id);
+    preparedStatementQuery(_id);
+    parallelScanQuery(min);
     
     sequentialFileRangeQuery(min, max);
     sequentialIndexRangeQuery(min, max);
@@ -249,6 +266,67 @@ vector<string> TableBenchmark::binaryIndexQuery(string _id) {
     return row;
 }
 
+vector<string> TableBenchmark::preparedStatementQuery(string _id) {
+    const int ITERATIONS = 10000;
+    long long _id_number = stoll(_id.c_str());
+    vector<string> row;
+
+    cout << "getRowById query x" << ITERATIONS << endl;
+    Timer timer;
+    timer.start();
+    for (int i = 0; i < ITERATIONS; i++) {
+        row = table->getRowById(_id_number);
+    }
+    cout << "Time " << timer.getElapsedTime() << " s" << endl;
+
+    cout << "Prepared statement query x" << ITERATIONS << endl;
+    timer.start();
+    PreparedStatement statement = table->prepare("SELECT * WHERE _id = ?");
+    for (int i = 0; i < ITERATIONS; i++) {
+        statement.bind(0, _id_number);
+        Cursor cursor = statement.execute();
+    }
+    cout << "Time " << timer.getElapsedTime() << " s" << endl;
+
+    cout << "String query x" << ITERATIONS << endl;
+    timer.start();
+    for (int i = 0; i < ITERATIONS; i++) {
+        Cursor cursor = table->query("SELECT * WHERE _id = " + _id);
+    }
+    cout << "Time " << timer.getElapsedTime() << " s" << endl;
+    return row;
+}
+
+long long TableBenchmark::parallelScanQuery(int min) {
+    Expression where(Predicate("_id", GREATER, to_string(min)));
+    Schema schema = table->getSchema();
+    where.bind(schema);
+    long long serial_rows = 0, parallel_rows = 0;
+
+    cout << "Table scan" << endl;
+    double start = Profiler::getWallTime();
+    TableScanOperator scan_operator(table);
+    FilterOperator filter_operator(&scan_operator, where);
+    Batch batch;
+    while (filter_operator.next(batch)) {
+        serial_rows += batch.getSelectedCount();
+    }
+    cout << "Time " << Profiler::getWallTime() - start << " s" << endl;
+
+    cout << "Parallel table scan" << endl;
+    start = Profiler::getWallTime();
+    ParallelScanOperator parallel_operator(TableScanOperator(table), where, vector<int>(), false);
+    while (parallel_operator.next(batch)) {
+        parallel_rows += batch.getSelectedCount();
+    }
+    cout << "Time " << Profiler::getWallTime() - start << " s on " << parallel_operator.getNumberOfThreads() << " threads" << endl;
+
+    if (serial_rows != parallel_rows) {
+        cout << "The scans returned " << serial_rows << " and " << parallel_rows << " rows" << endl;
+    }
+    return parallel_rows;
+}
+
 /*****************************************
  ********** RANGE QUERY METHODS **********
  *****************************************/
@@ -266,6 +344,7 @@ vector<vector<string> > TableBenchmark::sequentialFileRangeQuery(int min, int ma
     vector<SchemaCol>* schema_cols = table->schema.getCols();
     
     bool found = false;
+    vector<long long> registry_positions;
     
     while (file.good()) {
         //Import the header
@@ -286,7 +365,7 @@ vector<vector<string> > TableBenchmark::sequentialFileRangeQuery(int min, int ma
             break;
         }
         if (found) {
-            rows.push_back(table->getRow((long long) file.tellg() - table->HEADER_SIZE - sizeof(row_id)));
+            registry_positions.push_back((long long) file.tellg() - table->HEADER_SIZE - sizeof(row_id));
         }
         // Go to the next registry
         // The current position is right after the _id
@@ -298,6 +377,7 @@ vector<vector<string> > TableBenchmark::sequentialFileRangeQuery(int min, int ma
     }
     
     file.close();
+    rows = table->getRows(registry_positions);
     
     if (rows.size() > 0) {
         cout << "Found" << endl;
@@ -314,6 +394,7 @@ vector<vector<string> > TableBenchmark::sequentialIndexRangeQuery(int min, int m
     
     vector<vector<string> > rows;
     bool found = false;
+    vector<long long> registry_positions;
     for (header_t::iterator it = table->header->begin(); it != table->header->end(); it++) {
         // compare the _id
         // cout << it->second << endl;
@@ -326,9 +407,10 @@ vector<vector<string> > TableBenchmark::sequentialIndexRangeQuery(int min, int m
         }
         if (found) {
             // cout << "Found " << _id << endl;
-            rows.push_back(table->getRow(it->second));
+            registry_positions.push_back(it->second);
         }
     }
+    rows = table->getRows(registry_positions);
     
     cout << "Found" << endl;
     cout << "Time " << timer.getElapsedTime() << " s" << endl;
@@ -382,12 +464,14 @@ vector<vector<string> > TableBenchmark::bPlusTreeRangeQuery(int min, int max) {
     //Search the b+ tree
     tree.search_range(&key_1, key_2, values, size);
     
+    vector<long long> registry_positions;
     for (int i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
         if (values[i] == -1) {
             break;
         }
-        rows.push_back(table->getRow(values[i]));
+        registry_positions.push_back(values[i]);
     }
+    rows = table->getRows(registry_positions);
 
     if (rows.size() > 0) {
         cout << "Found" << endl;
@@ -410,13 +494,14 @@ vector<vector<string> > TableBenchmark::binaryIndexRangeQuery(int min, int max)
     int idx = distance(table->header->begin(), lower_bound(table->header->begin(),table->header->end(), 
        make_pair((long long) min, numeric_limits<long long>::min())));
     bool found = false;
+    vector<long long> registry_positions;
     
     // If the found index is equals to the desired index, the _id was found
     auto pair = table->header->at(idx);
     if (pair.first == min) {
         found = true;
         while (pair.first >= min && pair.first <= max) {
-            rows.push_back(table->getRow(pair.second));
+            registry_positions.push_back(pair.second);
             if (idx < table->header->size()) {
                 idx++;
                 pair = table->header->at(idx);
@@ -424,6 +509,8 @@ vector<vector<string> > TableBenchmark::binaryIndexRangeQuery(int min, int max)
         }
     }
     
+    rows = table->getRows(registry_positions);
+    
     if (found) {
         cout << "Found" << endl;
         cout << "Time " << timer.getElapsedTime() << " s" << endl;
@@ -1,5 +1,7 @@
 #include "catch.hpp"
 #include "../table.h"
+#include "../queryserver.h"
+#include "../queryclient.h"
 
 TEST_CASE("A table should have a one-to-one relation") {
     GIVEN("Two related tables") {
@@ -52,4 +54,2372 @@ TEST_CASE("A table should have a one-to-one relation") {
             }
         }
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("A bloom filter should skip the blocks that can't match") {
+    GIVEN("A table with a bloom filter on a column") {
+        Schema person_schema;
+        person_schema.addCol("last_name", CHAR, 20);
+        person_schema.addCol("age", INT32);
+
+        Table person_table("bloom_person");
+        person_table.setSchema(person_schema);
+
+        for (int i = 0; i < 3 * ROWS_PER_BLOCK; i++) {
+            vector<string> row;
+            row.push_back("name_" + std::to_string(i));
+            row.push_back(std::to_string(i % 50));
+            person_table.insert(row);
+        }
+        person_table.addBloomFilter("last_name");
+
+        THEN("The filters must not have false negatives") {
+            REQUIRE(person_table.blockMayContain(1, 0, vector<string>(1, "name_10")));
+            REQUIRE(person_table.blockMayContain(1, 2, vector<string>(1, "name_3000")));
+            REQUIRE_FALSE(person_table.blockMayContain(1, 1, vector<string>(1, "missing")));
+        }
+
+        WHEN("The table is queried by the filtered column") {
+            vector<string> select(1, "_id");
+            vector<string> where_args(1, "last_name");
+            vector<string> where_comparators(1, "in");
+            vector<string> where_values(1, "name_7,name_2050");
+
+            Cursor cursor = person_table.query(select, where_args, where_comparators, where_values);
+
+            THEN("Only the matching rows are returned") {
+                REQUIRE(cursor.getCount() == 2);
+                cursor.moveToFirst();
+                REQUIRE(cursor.getString("_id") == "7");
+                cursor.moveToNext();
+                REQUIRE(cursor.getString(0) == "2050");
+            }
+
+            THEN("The block without any of the values is not read") {
+                Cursor plan = person_table.query("EXPLAIN ANALYZE SELECT _id WHERE last_name IN ('name_7', 'name_2050')");
+                string scan_line;
+                for (plan.moveToFirst(); !plan.isAfterLast(); plan.moveToNext()) {
+                    if (plan.getString("plan").find("blocks read=") != string::npos) {
+                        scan_line = plan.getString("plan");
+                    }
+                }
+                REQUIRE(scan_line.find("blocks read=2 skipped=1") != string::npos);
+            }
+        }
+
+        WHEN("The table is joined with a hash join") {
+            Schema age_schema;
+            age_schema.addCol("age", INT32);
+            Table age_table("bloom_age");
+            age_table.setSchema(age_schema);
+            age_table.insert(vector<string>(1, "7"));
+            age_table.insert(vector<string>(1, "49"));
+
+            Join hash_join = age_table.join("age", &person_table, "age", JoinType::HASH);
+            Join nested_join = age_table.join("age", &person_table, "age", JoinType::NESTED);
+
+            THEN("The result is the same as the nested loop join") {
+                REQUIRE(hash_join.getNumberOfRows() == nested_join.getNumberOfRows());
+                REQUIRE(hash_join.getNumberOfRows() == 2 * (3 * ROWS_PER_BLOCK / 50 + 1) - 1);
+            }
+            age_table.drop();
+        }
+
+        person_table.drop();
+    }
+}
+
+TEST_CASE("A bloom filter saved before some inserts should cover the new rows once reopened") {
+    GIVEN("A table of 100 rows with a bloom filter, and a row inserted by another instance after it's closed") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        Table("bloom_stale").drop();
+        {
+            Table table("bloom_stale");
+            table.setSchema(schema);
+            for (int i = 0; i < 100; i++) {
+                table.insert(vector<string>(1, "name_" + std::to_string(i)));
+            }
+            table.addBloomFilter("name");
+        }
+        {
+            Table table("bloom_stale");
+            table.setSchema(schema);
+            table.insert(vector<string>(1, "late"));
+        }
+
+        WHEN("The table is reopened with the bloom filter") {
+            Table table("bloom_stale");
+            table.setSchema(schema);
+            table.addBloomFilter("name");
+
+            THEN("The row inserted later is found") {
+                REQUIRE(table.query("SELECT * WHERE name = 'late'").getCount() == 1);
+                REQUIRE(table.query("SELECT * WHERE name = 'name_99'").getCount() == 1);
+            }
+            table.drop();
+        }
+    }
+}
+
+TEST_CASE("Roaring bitmaps should behave as sets of row ids") {
+    GIVEN("An array container and a bitmap container") {
+        RoaringBitmap sparse;
+        RoaringBitmap dense;
+        for (uint32_t i = 0; i < 200000; i += 7) {
+            sparse.add(i);
+        }
+        for (uint32_t i = 0; i < 70000; i++) {
+            if (i % 3 == 0) {
+                dense.add(i);
+            }
+        }
+
+        THEN("AND, OR and NOT match the set operations") {
+            unsigned long long both = 0, any = 0, only_sparse = 0;
+            for (uint32_t i = 0; i < 200000; i++) {
+                bool in_sparse = i % 7 == 0;
+                bool in_dense = i < 70000 && i % 3 == 0;
+                both += in_sparse && in_dense;
+                any += in_sparse || in_dense;
+                only_sparse += in_sparse && !in_dense;
+            }
+            REQUIRE((sparse & dense).getCardinality() == both);
+            REQUIRE((sparse | dense).getCardinality() == any);
+            REQUIRE(sparse.andNot(dense).getCardinality() == only_sparse);
+            REQUIRE(dense.flip(200000).getCardinality() == 200000 - dense.getCardinality());
+            REQUIRE((sparse & dense).contains(21));
+            REQUIRE_FALSE((sparse & dense).contains(7));
+        }
+
+        THEN("The AVX2 word operations give the words of the scalar ones") {
+            vector<uint64_t> a(RoaringBitmap::BITMAP_WORDS), b(RoaringBitmap::BITMAP_WORDS);
+            uint64_t state = 88172645463325252ULL;
+            for (unsigned i = 0; i < RoaringBitmap::BITMAP_WORDS; i++) {
+                state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+                a[i] = state;
+                state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+                b[i] = i % 5 == 0 ? 0 : state;
+            }
+
+            const BitmapKernels & scalar = getScalarBitmapKernels();
+            const BitmapKernels & avx2 = getAvx2BitmapKernels() != NULL ? *getAvx2BitmapKernels() : getBitmapKernels();
+            vector<uint64_t> expected(RoaringBitmap::BITMAP_WORDS), result(RoaringBitmap::BITMAP_WORDS);
+            scalar.andWords(&a[0], &b[0], &expected[0]);
+            avx2.andWords(&a[0], &b[0], &result[0]);
+            REQUIRE(expected == result);
+            scalar.orWords(&a[0], &b[0], &expected[0]);
+            avx2.orWords(&a[0], &b[0], &result[0]);
+            REQUIRE(expected == result);
+            scalar.andNotWords(&a[0], &b[0], &expected[0]);
+            avx2.andNotWords(&a[0], &b[0], &result[0]);
+            REQUIRE(expected == result);
+        }
+    }
+}
+
+TEST_CASE("Bitmap indexes should return the same rows as a full scan") {
+    GIVEN("A table with bitmap indexes on a CHAR and on a high cardinality INT32 column") {
+        Schema person_schema;
+        person_schema.addCol("name", CHAR, 20);
+        person_schema.addCol("points", INT32);
+        person_schema.addCol("age", INT32);
+
+        Table indexed_table("bitmap_person");
+        indexed_table.setSchema(person_schema);
+
+        const char * names[] = {"bruno", "ana", "maria"};
+        for (int i = 0; i < 2000; i++) {
+            vector<string> row;
+            row.push_back(names[i % 3]);
+            row.push_back(std::to_string((i * 37) % 1000 - 500));
+            row.push_back(std::to_string(i % 80));
+            indexed_table.insert(row);
+        }
+        indexed_table.addBitmapIndex("name");
+        indexed_table.addBitmapIndex("points");
+
+        WHEN("The where clause combines indexed and not indexed columns") {
+            vector<Expression> or_children;
+            or_children.push_back(Expression(Predicate("name", EQUAL, "bruno")));
+            or_children.push_back(Expression(Predicate("points", LESS, "-250")));
+
+            vector<Expression> not_child(1, Expression(Predicate("name", EQUAL, "ana")));
+
+            vector<Expression> and_children;
+            and_children.push_back(Expression(OR_EXPRESSION, or_children));
+            and_children.push_back(Expression(NOT_EXPRESSION, not_child));
+            and_children.push_back(Expression(Predicate("age", GREATER, "10")));
+            Expression where(AND_EXPRESSION, and_children);
+
+            vector<int> projection(1, 0);
+            vector<vector<string> > indexed_result = indexed_table.scan(projection, where);
+
+            THEN("The result is the one of a row by row evaluation") {
+                long long expected = 0;
+                for (int i = 0; i < 2000; i++) {
+                    bool is_bruno = i % 3 == 0;
+                    bool is_ana = i % 3 == 1;
+                    int points = (i * 37) % 1000 - 500;
+                    if ((is_bruno || points < -250) && !is_ana && i % 80 > 10) {
+                        expected++;
+                    }
+                }
+                REQUIRE(indexed_result.size() == expected);
+            }
+        }
+
+        indexed_table.drop();
+    }
+}
+
+TEST_CASE("The vectorized operators should filter and aggregate batches") {
+    GIVEN("A table spanning several batches") {
+        Schema schema;
+        schema.addCol("name", CHAR, 10);
+        schema.addCol("points", INT32);
+        schema.addCol("score", DOUBLE);
+
+        Table table("vectorized_person");
+        table.setSchema(schema);
+        for (int i = 0; i < 2500; i++) {
+            vector<string> row;
+            row.push_back(i % 2 == 0 ? "even" : "odd");
+            row.push_back(std::to_string(i % 200 - 100));
+            row.push_back(std::to_string(i / 2.0));
+            table.insert(row);
+        }
+
+        WHEN("The rows are filtered and aggregated") {
+            vector<Expression> children;
+            children.push_back(Expression(Predicate("points", GREATER, "-50")));
+            children.push_back(Expression(Predicate("points", LESS, "100")));
+            children.push_back(Expression(Predicate("name", EQUAL, "even")));
+            Expression where(AND_EXPRESSION, children);
+            where.bind(schema);
+
+            TableScanOperator scan(&table);
+            FilterOperator filter(&scan, where);
+
+            vector<Aggregate> aggregates;
+            aggregates.push_back(Aggregate(COUNT, -1, "count(*)"));
+            aggregates.push_back(Aggregate(SUM, 2, "sum(points)"));
+            aggregates.push_back(Aggregate(MAX, 3, "max(score)"));
+            aggregates.push_back(Aggregate(MIN, 1, "min(name)"));
+            AggregateOperator aggregate(&filter, aggregates);
+
+            Batch batch;
+            REQUIRE(aggregate.next(batch));
+
+            THEN("The aggregates are the ones of a row by row computation") {
+                long long count = 0, sum = 0;
+                double max_score = 0;
+                for (int i = 0; i < 2500; i++) {
+                    int points = i % 200 - 100;
+                    if (points > -50 && points < 100 && i % 2 == 0) {
+                        count++;
+                        sum += points;
+                        max_score = max(max_score, i / 2.0);
+                    }
+                }
+                REQUIRE(batch.size == 1);
+                REQUIRE(batch.columns[0].int64_values[0] == count);
+                REQUIRE(batch.columns[1].int64_values[0] == sum);
+                REQUIRE(batch.columns[2].double_values[0] == max_score);
+                REQUIRE(batch.columns[3].getString(0) == "even");
+                REQUIRE_FALSE(aggregate.next(batch));
+            }
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("The SIMD kernels should select the same rows as the scalar ones") {
+    GIVEN("Columns of every type") {
+        const unsigned count = 1000; // not a multiple of the lanes
+        vector<int32_t> int32_values;
+        vector<int64_t> int64_values;
+        vector<double> double_values;
+        vector<char> char_values(count * 16, '\0');
+        for (unsigned i = 0; i < count; i++) {
+            int32_values.push_back((int) (i * 7919) % 300 - 150);
+            int64_values.push_back(int32_values.back() * 100000000LL);
+            double_values.push_back(int32_values.back() / 7.0);
+            strcpy(&char_values[i * 16], i % 3 == 0 ? "bruno alves" : (i % 3 == 1 ? "bruno" : "ana"));
+        }
+
+        const SimdKernels & scalar = getScalarKernels();
+        const SimdKernels & fastest = getSimdKernels();
+        vector<uint64_t> expected((count + 63) / 64);
+        vector<uint64_t> result((count + 63) / 64);
+
+        THEN("Every comparison gives the same bitmap") {
+            for (int comparator = EQUAL; comparator <= GREATER_EQUAL; comparator++) {
+                scalar.compareInt32(&int32_values[0], count, (Comparator) comparator, 10, &expected[0]);
+                fastest.compareInt32(&int32_values[0], count, (Comparator) comparator, 10, &result[0]);
+                REQUIRE(expected == result);
+
+                scalar.compareInt64(&int64_values[0], count, (Comparator) comparator, 1000000000LL, &expected[0]);
+                fastest.compareInt64(&int64_values[0], count, (Comparator) comparator, 1000000000LL, &result[0]);
+                REQUIRE(expected == result);
+            }
+
+            scalar.rangeDouble(&double_values[0], count, -5, false, 10, true, &expected[0]);
+            fastest.rangeDouble(&double_values[0], count, -5, false, 10, true, &result[0]);
+            REQUIRE(expected == result);
+
+            scalar.matchChars(&char_values[0], count, 16, "bruno", 6, &expected[0]);
+            fastest.matchChars(&char_values[0], count, 16, "bruno", 6, &result[0]);
+            REQUIRE(expected == result);
+
+            fastest.matchChars(&char_values[0], count, 16, "bruno", 5, &result[0]);
+            vector<uint32_t> selection;
+            for (unsigned i = 0; i < count; i++) {
+                selection.push_back(i);
+            }
+            selectBitmap(&result[0], selection);
+            REQUIRE(selection.size() == 667);
+        }
+
+        THEN("The CHAR kernel matches every prefix of the values, whatever their width") {
+            const char * patterns[] = {"b", "br", "bru", "brun", "bruno", "bruno\0", "bruno a", "bruno al",
+                                       "bruno alv", "bruno alves", "bruno alves\0", "ana\0", "x"};
+            const unsigned lengths[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 12, 4, 1};
+            const unsigned widths[] = {12, 16, 40};
+            for (unsigned w = 0; w < 3; w++) {
+                unsigned width = widths[w];
+                vector<char> values(count * width, '\0');
+                for (unsigned i = 0; i < count; i++) {
+                    strcpy(&values[i * width], i % 3 == 0 ? "bruno alves" : (i % 3 == 1 ? "bruno" : "ana"));
+                }
+                bool same_bitmaps = true;
+                for (unsigned p = 0; p < 13; p++) {
+                    scalar.matchChars(&values[0], count, width, patterns[p], lengths[p], &expected[0]);
+                    fastest.matchChars(&values[0], count, width, patterns[p], lengths[p], &result[0]);
+                    same_bitmaps = same_bitmaps && expected == result;
+                }
+                REQUIRE(same_bitmaps);
+            }
+        }
+    }
+}
+
+TEST_CASE("A registered row layout should read and write the same rows as the generic code") {
+    GIVEN("Two tables with the same schema, one of them using the layout kernels") {
+        Schema schema;
+        schema.addCol("points", INT32);
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("score", DOUBLE);
+        schema.addCol("company", FOREIGN_KEY);
+
+        Table generic_table("layout_generic");
+        generic_table.setSchema(schema);
+        REQUIRE(generic_table.getRowKernels() == NULL);
+
+        registerRowLayout<SchemaLayout<LayoutCol<INT32>, LayoutCol<CHAR, 20>, LayoutCol<DOUBLE>, LayoutCol<FOREIGN_KEY> > >("layout_test");
+
+        Table layout_table("layout_specialized");
+        layout_table.setSchema(schema);
+        REQUIRE(layout_table.getRowKernels() != NULL);
+
+        for (int i = 0; i < 1500; i++) {
+            vector<string> row;
+            stringstream points, score, company;
+            points << i % 200 - 100;
+            score << i / 3.0;
+            company << i * 1000000007LL;
+            row.push_back(points.str());
+            row.push_back(i % 2 == 0 ? "bruno" : "a name longer than the twenty chars");
+            row.push_back(score.str());
+            row.push_back(company.str());
+            generic_table.insert(row);
+            layout_table.insert(row);
+        }
+
+        THEN("The rows are the same") {
+            REQUIRE(generic_table.getRowById(0) == layout_table.getRowById(0));
+            REQUIRE(generic_table.getRowById(1499) == layout_table.getRowById(1499));
+            REQUIRE(layout_table.getRowById(1).at(2) == "a name longer than t");
+
+            vector<int> projection;
+            for (int i = 0; i < 5; i++) {
+                projection.push_back(i);
+            }
+            Expression where(Predicate("points", GREATER, "50"));
+            vector<vector<string> > generic_rows = generic_table.scan(projection, where);
+            REQUIRE(generic_rows.size() == 7 * 49);
+            REQUIRE(generic_rows == layout_table.scan(projection, where));
+        }
+
+        THEN("The columns of two registries are compared by type") {
+            const RowKernels * kernels = layout_table.getRowKernels();
+            vector<char> a(kernels->registry_size), b(kernels->registry_size);
+            vector<string> row_a, row_b;
+            row_a.push_back("1"); row_a.push_back("-5"); row_a.push_back("bruno"); row_a.push_back("2.5"); row_a.push_back("7");
+            row_b.push_back("2"); row_b.push_back("10"); row_b.push_back("ana"); row_b.push_back("2.5"); row_b.push_back("7");
+            kernels->encode(row_a, &a[REGISTRY_HEADER_SIZE]);
+            kernels->encode(row_b, &b[REGISTRY_HEADER_SIZE]);
+
+            REQUIRE(kernels->compare(&a[0], &b[0], 0) < 0);
+            REQUIRE(kernels->compare(&a[0], &b[0], 1) < 0);
+            REQUIRE(kernels->compare(&a[0], &b[0], 2) > 0);
+            REQUIRE(kernels->compare(&a[0], &b[0], 3) == 0);
+            REQUIRE(kernels->compare(&a[0], &b[0], 4) == 0);
+        }
+
+        generic_table.drop();
+        layout_table.drop();
+        getRowKernelsRegistry().pop_back();
+    }
+}
+
+TEST_CASE("The hash aggregation should group the rows, spilling the groups over the budget") {
+    GIVEN("A table with 3000 rows on 300 companies") {
+        Schema schema;
+        schema.addCol("company", FOREIGN_KEY);
+        schema.addCol("points", INT32);
+        schema.addCol("name", CHAR, 10);
+
+        Table table("aggregate_test");
+        table.setSchema(schema);
+
+        map<long long, long long> counts, sums;
+        map<long long, string> min_names;
+        for (int i = 0; i < 3000; i++) {
+            long long company = (i * 7) % 300;
+            stringstream company_str, points_str, name_str;
+            company_str << company;
+            points_str << i % 50 - 20;
+            name_str << "n" << i;
+            vector<string> row;
+            row.push_back(company_str.str());
+            row.push_back(points_str.str());
+            row.push_back(name_str.str());
+            table.insert(row);
+
+            counts[company]++;
+            sums[company] += i % 50 - 20;
+            min_names[company] = min_names.count(company) ? min(min_names[company], name_str.str()) : name_str.str();
+        }
+
+        vector<int> group_columns(1, 1);
+        vector<Aggregate> aggregates;
+        aggregates.push_back(Aggregate(COUNT, -1, "count(*)"));
+        aggregates.push_back(Aggregate(SUM, 2, "sum(points)"));
+        aggregates.push_back(Aggregate(MIN, 3, "min(name)"));
+
+        WHEN("Three threads aggregate a third of the blocks each, with room for 10 groups") {
+            vector<TableScanOperator> scans(3, TableScanOperator(&table));
+            vector<Operator *> children;
+            for (int i = 0; i < 3; i++) {
+                scans[i].setBlockRange(i, i + 1);
+                children.push_back(&scans[i]);
+            }
+            HashAggregateOperator aggregate(children, group_columns, aggregates, 10 * 200);
+
+            map<long long, long long> result_counts, result_sums;
+            map<long long, string> result_min_names;
+            Batch batch;
+            while (aggregate.next(batch)) {
+                REQUIRE(batch.columns.size() == 4);
+                for (unsigned row = 0; row < batch.size; row++) {
+                    long long company = batch.columns[0].int64_values[row];
+                    REQUIRE(result_counts.count(company) == 0);
+                    result_counts[company] = batch.columns[1].int64_values[row];
+                    result_sums[company] = batch.columns[2].int64_values[row];
+                    result_min_names[company] = batch.columns[3].getString(row);
+                }
+            }
+
+            THEN("Each group is returned once, with the same aggregates") {
+                REQUIRE(result_counts == counts);
+                REQUIRE(result_sums == sums);
+                REQUIRE(result_min_names == min_names);
+            }
+        }
+
+        WHEN("The aggregates are queried") {
+            Cursor cursor = table.query("SELECT count(*), company, sum(points) WHERE points > -1 GROUP BY company");
+            Cursor total = table.query("select count(*), max(points), avg(points)");
+
+            THEN("The columns are in the select order") {
+                REQUIRE(cursor.getCount() == 300 * 30 / 50);
+                REQUIRE(cursor.getColumnIndex("company") == 1);
+
+                long long rows = 0;
+                for (cursor.moveToFirst(); !cursor.isAfterLast(); cursor.moveToNext()) {
+                    rows += atoll(cursor.getString("count(*)").c_str());
+                }
+                REQUIRE(rows == 3000 * 30 / 50);
+
+                total.moveToFirst();
+                REQUIRE(total.getCount() == 1);
+                REQUIRE(total.getString("count(*)") == "3000");
+                REQUIRE(total.getString("max(points)") == "29");
+                REQUIRE(total.getString("avg(points)") == "4.5");
+            }
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("The sort operator should order the rows on memory, on disk and on a top-N heap") {
+    GIVEN("A table with 3000 rows") {
+        Schema schema;
+        schema.addCol("points", INT32);
+        schema.addCol("score", DOUBLE);
+        schema.addCol("name", CHAR, 10);
+
+        Table table("sort_test");
+        table.setSchema(schema);
+
+        //The expected order: points ascending, then score descending, then the _id
+        vector<pair<pair<int, double>, long long> > expected;
+        for (int i = 0; i < 3000; i++) {
+            int points = (i * 37) % 101 - 50;
+            double score = ((i * 13) % 7 - 3) / 2.0;
+            stringstream points_str, score_str, name_str;
+            points_str << points;
+            score_str << score;
+            name_str << "n" << (i * 7) % 3000;
+            vector<string> row;
+            row.push_back(points_str.str());
+            row.push_back(score_str.str());
+            row.push_back(name_str.str());
+            table.insert(row);
+            expected.push_back(make_pair(make_pair(points, -score), (long long) i));
+        }
+        sort(expected.begin(), expected.end());
+
+        vector<SortKey> sort_keys;
+        sort_keys.push_back(SortKey(1));
+        sort_keys.push_back(SortKey(2, true));
+
+        //Run the sort over the whole table and return the _ids
+        struct {
+            vector<long long> operator()(Table & table, vector<SortKey> & sort_keys, long long limit, size_t memory_budget) {
+                TableScanOperator scan(&table);
+                SortOperator sort_operator(&scan, sort_keys, limit, memory_budget);
+                vector<long long> ids;
+                Batch batch;
+                while (sort_operator.next(batch)) {
+                    for (vector<uint32_t>::iterator it = batch.selection.begin(); it != batch.selection.end(); it++) {
+                        ids.push_back(batch.columns[0].int64_values[*it]);
+                    }
+                }
+                return ids;
+            }
+        } sortIds;
+
+        THEN("The in memory sort, the external sort and the top-N give the same order") {
+            vector<long long> expected_ids;
+            for (unsigned i = 0; i < expected.size(); i++) {
+                expected_ids.push_back(expected[i].second);
+            }
+
+            REQUIRE(sortIds(table, sort_keys, -1, SortOperator::DEFAULT_MEMORY_BUDGET) == expected_ids);
+            //About 200 rows per run
+            REQUIRE(sortIds(table, sort_keys, -1, 200 * 50) == expected_ids);
+            REQUIRE(sortIds(table, sort_keys, 25, SortOperator::DEFAULT_MEMORY_BUDGET) ==
+                    vector<long long>(expected_ids.begin(), expected_ids.begin() + 25));
+            REQUIRE(sortIds(table, sort_keys, 1500, 200 * 50) ==
+                    vector<long long>(expected_ids.begin(), expected_ids.begin() + 1500));
+        }
+
+        THEN("The queries are sorted by any column, and by the header order for the _id") {
+            Cursor names = table.query("SELECT name ORDER BY name DESC LIMIT 3");
+            REQUIRE(names.getCount() == 3);
+            names.moveToFirst();
+            REQUIRE(names.getString("name") == "n999");
+            names.moveToNext();
+            REQUIRE(names.getString("name") == "n998");
+
+            Cursor last = table.query("SELECT _id, points ORDER BY _id DESC LIMIT 1500");
+            REQUIRE(last.getCount() == 1500);
+            last.moveToFirst();
+            REQUIRE(last.getString("_id") == "2999");
+
+            Cursor groups = table.query("SELECT points, count(*) WHERE score > 0 GROUP BY points ORDER BY count(*) DESC, points LIMIT 2");
+            REQUIRE(groups.getCount() == 2);
+            groups.moveToFirst();
+            long long first_count = atoll(groups.getString("count(*)").c_str());
+            groups.moveToNext();
+            REQUIRE(first_count >= atoll(groups.getString("count(*)").c_str()));
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("LIMIT and OFFSET should stop the scans and joins early, and pages should cover the whole result") {
+    GIVEN("A table with 3000 rows") {
+        Schema schema;
+        schema.addCol("points", INT32);
+        schema.addCol("name", CHAR, 10);
+
+        Table table("limit_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 3000; i++) {
+            vector<string> row;
+            row.push_back(std::to_string((i * 37) % 101));
+            row.push_back("n" + std::to_string(i % 7));
+            table.insert(row);
+        }
+
+        THEN("The rows after the offset are returned, in the header order") {
+            Cursor rows = table.query("SELECT _id LIMIT 10 OFFSET 1020");
+            REQUIRE(rows.getCount() == 10);
+            rows.moveToFirst();
+            REQUIRE(rows.getString("_id") == "1020");
+
+            Cursor last = table.query("SELECT _id ORDER BY _id DESC LIMIT 5 OFFSET 2");
+            REQUIRE(last.getCount() == 5);
+            last.moveToFirst();
+            REQUIRE(last.getString("_id") == "2997");
+
+            Cursor range = table.query("SELECT _id WHERE _id > 2047 and points < 50 LIMIT 1000");
+            range.moveToFirst();
+            REQUIRE(atoll(range.getString("_id").c_str()) > 2047);
+
+            Cursor sorted = table.query("SELECT points ORDER BY points DESC LIMIT 3 OFFSET 1");
+            REQUIRE(sorted.getCount() == 3);
+            sorted.moveToFirst();
+            REQUIRE(sorted.getString("points") == "100");
+        }
+
+        THEN("A join stops at the limit") {
+            Join join = table.join("points", &table, "points", JoinType::HASH, NULL, 100);
+            REQUIRE(join.getNumberOfRows() == 100);
+        }
+
+        THEN("The pages have all the rows of the query, in order") {
+            Cursor expected = table.query("SELECT _id, name WHERE points > 10 ORDER BY name DESC");
+
+            vector<string> ids;
+            Cursor page = table.queryPage("SELECT _id, name WHERE points > 10 ORDER BY name DESC", 700);
+            while (true) {
+                REQUIRE(page.getCount() <= 700);
+                for (page.moveToFirst(); !page.isAfterLast(); page.moveToNext()) {
+                    ids.push_back(page.getString("_id"));
+                }
+                if (page.getContinuation().empty()) {
+                    break;
+                }
+                page = table.queryPage("SELECT _id, name WHERE points > 10 ORDER BY name DESC", 700, page.getContinuation());
+            }
+
+            REQUIRE(ids.size() == expected.getCount());
+            expected.moveToFirst();
+            for (size_t i = 0; i < ids.size(); i++, expected.moveToNext()) {
+                REQUIRE(ids[i] == expected.getString("_id"));
+            }
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("The pages of a query sorted by a DOUBLE should have every row exactly once") {
+    GIVEN("A table of doubles that are the same with 6 significant digits") {
+        Schema schema;
+        schema.addCol("points", DOUBLE);
+        schema.addCol("ratio", FLOAT);
+        Table table("page_double_test");
+        table.drop();
+        table.setSchema(schema);
+        for (int i = 0; i < 3000; i++) {
+            vector<string> row;
+            row.push_back(std::to_string(1200000 + (i * 7919) % 3000 * 0.013));
+            row.push_back(std::to_string(0.5 + (i % 100) * 0.0000013));
+            table.insert(row);
+        }
+
+        THEN("Paging by the DOUBLE and by the FLOAT reaches the end with each row once") {
+            const char * queries[] = {"SELECT _id ORDER BY points", "SELECT _id ORDER BY points DESC", "SELECT _id ORDER BY ratio, points"};
+            for (int q = 0; q < 3; q++) {
+                vector<int> times_returned(3000, 0);
+                int number_of_pages = 0;
+                Cursor page = table.queryPage(queries[q], 100);
+                while (number_of_pages++ < 100) {
+                    for (page.moveToFirst(); !page.isAfterLast(); page.moveToNext()) {
+                        times_returned.at(page.getInt64(0))++;
+                    }
+                    if (page.getContinuation().empty()) {
+                        break;
+                    }
+                    page = table.queryPage(queries[q], 100, page.getContinuation());
+                }
+                REQUIRE(number_of_pages == 31);
+                REQUIRE(times_returned == vector<int>(3000, 1));
+            }
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("The query parser should build the whole WHERE tree and keep the case of the literals") {
+    GIVEN("A person table and a company table") {
+        Schema company_schema;
+        company_schema.addCol("name", CHAR, 20);
+        Table company("parser_company");
+        company.setSchema(company_schema);
+        company.insert(vector<string>(1, "Acme"));
+        company.insert(vector<string>(1, "Globex"));
+
+        Schema person_schema;
+        person_schema.addCol("name", CHAR, 20);
+        person_schema.addCol("age", INT32);
+        person_schema.addCol("company_id", FOREIGN_KEY);
+        Table person("parser_person");
+        person.setSchema(person_schema);
+        const char * names[] = {"Bruno", "bruno", "Ana", "Maria", "O'Neil"};
+        for (int i = 0; i < 5; i++) {
+            vector<string> row;
+            row.push_back(names[i]);
+            row.push_back(std::to_string(20 + i * 10));
+            row.push_back(std::to_string(i % 2));
+            person.insert(row);
+        }
+
+        THEN("The statement has every clause") {
+            SelectStatement statement = QueryParser("SELECT name, COUNT(*) WHERE NOT (age < 10 OR name IN ('A', 'b')) "
+                                                    "GROUP BY name ORDER BY count(*) DESC LIMIT 5 OFFSET 1").parse();
+            REQUIRE(statement.select == vector<string>({"name", "count(*)"}));
+            REQUIRE(statement.where.type == NOT_EXPRESSION);
+            REQUIRE(statement.where.children[0].type == OR_EXPRESSION);
+            REQUIRE(statement.where.children[0].children[1].predicate.values == vector<string>({"A", "b"}));
+            REQUIRE(statement.group_by == vector<string>(1, "name"));
+            REQUIRE(statement.order_by == vector<string>(1, "count(*) desc"));
+            REQUIRE(statement.limit == 5);
+            REQUIRE(statement.offset == 1);
+
+            REQUIRE_THROWS(QueryParser("SELECT name WHERE age >").parse());
+            REQUIRE_THROWS(QueryParser("SELECT name WHERE name = 'bruno").parse());
+            REQUIRE_THROWS(QueryParser("SELECT name LIMIT 10 WHERE age > 1").parse());
+        }
+
+        THEN("The quoted values are case sensitive") {
+            REQUIRE(person.query("SELECT name WHERE name = 'Bruno'").getCount() == 1);
+            REQUIRE(person.query("select name where name = 'bruno' or name = 'O''Neil'").getCount() == 2);
+            REQUIRE(person.query("SELECT * WHERE age BETWEEN 30 AND 50 AND NOT name = 'Ana'").getCount() == 2);
+            REQUIRE(person.query("SELECT * WHERE (age >= 60 OR age <= 20) AND name NOT IN ('Bruno')").getCount() == 1);
+        }
+
+        THEN("The JOIN returns the columns of both tables") {
+            Cursor cursor = person.query("SELECT name, parser_company.name JOIN parser_company ON company_id = parser_company._id "
+                                         "WHERE age > 20 ORDER BY age DESC", &company);
+            REQUIRE(cursor.getCount() == 4);
+            cursor.moveToFirst();
+            REQUIRE(cursor.getString("name") == "O'Neil");
+            REQUIRE(cursor.getString("parser_company.name") == "Acme");
+            cursor.moveToNext();
+            REQUIRE(cursor.getString("parser_company.name") == "Globex");
+
+            REQUIRE_THROWS(person.query("SELECT name JOIN parser_company ON company_id = parser_company._id"));
+        }
+
+        THEN("The columns named with capitals are found by the lowercased identifiers") {
+            Schema mixed_schema;
+            mixed_schema.addCol("FirstName", CHAR, 20);
+            mixed_schema.addCol("Age", INT32);
+            Table mixed("parser_mixed");
+            mixed.setSchema(mixed_schema);
+            for (int i = 0; i < 5; i++) {
+                vector<string> row;
+                row.push_back(names[i]);
+                row.push_back(std::to_string(20 + i * 10));
+                mixed.insert(row);
+            }
+
+            Cursor cursor = mixed.query("SELECT FirstName, Age WHERE Age > 30 ORDER BY Age DESC");
+            REQUIRE(cursor.getCount() == 3);
+            cursor.moveToFirst();
+            REQUIRE(cursor.getString(0) == "O'Neil");
+            REQUIRE(cursor.getInt32(1) == 60);
+            REQUIRE(mixed.query("SELECT age, COUNT(*) WHERE firstname = 'Ana' GROUP BY AGE").getCount() == 1);
+            mixed.drop();
+        }
+
+        person.drop();
+        company.drop();
+    }
+}
+
+TEST_CASE("A prepared statement should run with the bound values without parsing the query again") {
+    GIVEN("A table with 100 rows") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        Table table("prepared_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 100; i++) {
+            vector<string> row;
+            row.push_back(i % 2 == 0 ? "Even" : "Odd");
+            row.push_back(std::to_string(i));
+            table.insert(row);
+        }
+
+        THEN("A point lookup returns the row of each _id") {
+            PreparedStatement lookup = table.prepare("SELECT age, name WHERE _id = ?");
+            REQUIRE(lookup.isPointLookup());
+            REQUIRE(lookup.getNumberOfParameters() == 1);
+            REQUIRE_THROWS(lookup.execute());
+
+            for (int i = 0; i < 100; i += 7) {
+                lookup.bind(0, i);
+                Cursor cursor = lookup.execute();
+                REQUIRE(cursor.getCount() == 1);
+                cursor.moveToFirst();
+                REQUIRE(cursor.getString("age") == std::to_string(i));
+            }
+            lookup.bind(0, 1000);
+            REQUIRE(lookup.execute().getCount() == 0);
+        }
+
+        THEN("The parameters can be anywhere on the WHERE") {
+            PreparedStatement range = table.prepare("SELECT _id WHERE age BETWEEN ? AND ? AND (name = ? OR _id IN (?, 99))");
+            REQUIRE_FALSE(range.isPointLookup());
+            REQUIRE(range.getNumberOfParameters() == 4);
+            range.bind(0, 10);
+            range.bind(1, 20);
+            range.bind(2, "Odd");
+            range.bind(3, 12);
+            REQUIRE(range.execute().getCount() == 6);
+            range.bind(2, "odd");
+            REQUIRE(range.execute().getCount() == 1);
+        }
+
+        THEN("The same query, with other spaces or case, is parsed once") {
+            StatementCache & cache = table.getStatementCache();
+            long long misses = cache.getMisses();
+            table.query("SELECT name WHERE age > 50");
+            table.query("select name   where AGE>50");
+            table.query("SELECT name WHERE age > 50");
+            REQUIRE(cache.getMisses() == misses + 1);
+            REQUIRE(table.query("select name where age > 98").getCount() == 1);
+            REQUIRE(cache.getMisses() == misses + 2);
+            REQUIRE_THROWS(table.query("SELECT name WHERE age > ?"));
+        }
+
+        THEN("A scan keeps the access path of its first execution and reads the rows of the new values on it") {
+            table.addHashIndex("name");
+            PreparedStatement by_name = table.prepare("SELECT _id, age WHERE name = ? ORDER BY age DESC LIMIT 3");
+            REQUIRE_FALSE(by_name.isPointLookup());
+            const char * names[] = {"Odd", "Even", "None", "Even"};
+            for (int i = 0; i < 4; i++) {
+                by_name.bind(0, string(names[i]));
+                Cursor prepared = by_name.execute();
+                Cursor queried = table.query("SELECT _id, age WHERE name = '" + string(names[i]) + "' ORDER BY age DESC LIMIT 3");
+                REQUIRE(prepared.getCount() == queried.getCount());
+                prepared.moveToFirst();
+                queried.moveToFirst();
+                for (long long row = 0; row < prepared.getCount(); row++, prepared.moveToNext(), queried.moveToNext()) {
+                    REQUIRE(prepared.getString("_id") == queried.getString("_id"));
+                    REQUIRE(prepared.getString("age") == queried.getString("age"));
+                }
+            }
+            Expression where(Predicate("name", EQUAL, "Odd"));
+            where.bind(schema);
+            AccessPath lookup = table.getAccessPath(where, HASH_INDEX_LOOKUP);
+            REQUIRE(lookup.type == HASH_INDEX_LOOKUP);
+            REQUIRE(lookup.row_ids.size() == 50);
+            REQUIRE(table.getAccessPath(where, HEADER_SEARCH).type == FULL_SCAN);
+        }
+
+        THEN("A full cache evicts the least recently used statement") {
+            StatementCache cache(2);
+            cache.get("select name where age > 1");
+            cache.get("select name where age > 2");
+            cache.get("select name where age > 1");
+            cache.get("select name where age > 3");
+            long long misses = cache.getMisses();
+            cache.get("select name where age > 1");
+            REQUIRE(cache.getMisses() == misses);
+            cache.get("select name where age > 2");
+            REQUIRE(cache.getMisses() == misses + 1);
+        }
+
+        THEN("Several threads share a cache while it evicts its statements") {
+            StatementCache cache(8);
+            vector<thread> threads;
+            vector<int> wrong_statements(4, 0);
+            for (int t = 0; t < 4; t++) {
+                threads.push_back(thread([&cache, &wrong_statements, t]() {
+                    for (int i = 0; i < 2000; i++) {
+                        int age = (i * 7 + t) % 20;
+                        SelectStatement statement = cache.get("SELECT name WHERE age > " + std::to_string(age));
+                        if (statement.where.predicate.values.at(0) != std::to_string(age)) {
+                            wrong_statements[t]++;
+                        }
+                    }
+                }));
+            }
+            for (vector<thread>::iterator it = threads.begin(); it != threads.end(); it++) {
+                it->join();
+            }
+            REQUIRE(wrong_statements == vector<int>(4, 0));
+            REQUIRE(cache.getHits() + cache.getMisses() == 8000);
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("The planner should choose the cheapest access path and EXPLAIN should show it") {
+    GIVEN("A table with 3000 rows, a hash index, a bitmap index and the ages sorted by _id") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        schema.addCol("score", INT32);
+        Table table("planner_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 3000; i++) {
+            vector<string> row;
+            row.push_back("n" + std::to_string(i % 500));
+            row.push_back(std::to_string(i / 100));
+            row.push_back(std::to_string(i % 7));
+            table.insert(row);
+        }
+        table.addHashIndex("name");
+        table.addBitmapIndex("score");
+        Schema table_schema = table.getSchema();
+
+        THEN("Each WHERE is read by the access path with the lowest cost") {
+            const char * queries[] = {"SELECT * WHERE _id = 5", "SELECT * WHERE name = 'n7'", "SELECT * WHERE score = 3",
+                                      "SELECT * WHERE age >= 25", "SELECT * WHERE age > 5"};
+            AccessPathType types[] = {HEADER_SEARCH, HASH_INDEX_LOOKUP, BITMAP_INDEX_SCAN, ZONE_MAP_SCAN, FULL_SCAN};
+            long long counts[] = {1, 6, 429, 500, 2400};
+            for (int i = 0; i < 5; i++) {
+                Expression where = QueryParser(queries[i]).parse().where;
+                where.bind(table_schema);
+                REQUIRE(table.chooseAccessPath(where).type == types[i]);
+                REQUIRE(table.query(queries[i]).getCount() == counts[i]);
+            }
+            REQUIRE(table.query("SELECT _id WHERE name = 'n7' AND age > 20").getCount() == 1);
+        }
+
+        THEN("The zone maps follow the inserted rows") {
+            vector<string> row;
+            row.push_back("new");
+            row.push_back("100");
+            row.push_back("0");
+            table.insert(row);
+            REQUIRE(table.query("SELECT * WHERE age >= 100").getCount() == 1);
+            REQUIRE(table.query("SELECT * WHERE name = 'new'").getCount() == 1);
+        }
+
+        THEN("EXPLAIN returns the operators and the access paths with their costs") {
+            Cursor cursor = table.query("EXPLAIN SELECT name WHERE age >= 25 ORDER BY name LIMIT 5");
+            vector<string> lines;
+            for (cursor.moveToFirst(); !cursor.isAfterLast(); cursor.moveToNext()) {
+                lines.push_back(cursor.getString("plan"));
+            }
+            REQUIRE(lines.size() == 8);
+            REQUIRE(lines[0].find("Project name (cost=") == 0);
+            REQUIRE(lines[1].find("  Limit 5 offset 0") == 0);
+            REQUIRE(lines[2].find("    Sort name top 5") == 0);
+            REQUIRE(lines[3].find("      Filter age >= 25") == 0);
+            REQUIRE(lines[4].find("        Zone map scan 1 of 3 blocks (cost=") == 0);
+            REQUIRE(lines[5] == "Access paths considered:");
+            REQUIRE(lines[6].find("  Full scan 3 blocks (cost=3600 rows=3000)") == 0);
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("ANALYZE should estimate the distinct values and the skewed distributions of the columns") {
+    GIVEN("A table with 3000 rows, 90% of the points below 10") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("points", INT32);
+        Table table("statistics_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 3000; i++) {
+            vector<string> row;
+            row.push_back(i % 10 == 0 ? "" : "n" + std::to_string(i % 500));
+            row.push_back(std::to_string(i < 2700 ? i % 10 : 1000 + i));
+            table.insert(row);
+        }
+        Schema table_schema = table.getSchema();
+
+        THEN("A full ANALYZE counts the nulls and estimates the distinct values and the quantiles") {
+            table.analyze();
+            TableStatistics & statistics = table.getStatistics();
+            REQUIRE(statistics.isAnalyzed());
+            REQUIRE(statistics.getNumberOfRows() == 3000);
+            REQUIRE(statistics.getNullCount(1) == 300);
+            REQUIRE(std::abs(statistics.getDistinctValues(0) - 3000) < 150);
+            REQUIRE(std::abs(statistics.getDistinctValues(1) - 450) < 25);
+
+            double minimum, maximum;
+            REQUIRE(statistics.getRange(2, minimum, maximum));
+            REQUIRE(minimum == 0);
+            REQUIRE(maximum == 3999);
+            REQUIRE_FALSE(statistics.getRange(1, minimum, maximum));
+
+            //A uniform range would put almost every value above 10
+            ColumnEstimate points;
+            points.has_range = true;
+            points.minimum = minimum;
+            points.maximum = maximum;
+            REQUIRE(CostModel::estimateFractionBelow(points, 10) < 0.01);
+            points.histogram = statistics.getHistogram(2);
+            REQUIRE(points.histogram.size() == HISTOGRAM_BUCKETS + 1);
+            REQUIRE(std::abs(CostModel::estimateFractionBelow(points, 10) - 0.9) < 0.05);
+
+            TableStatistics loaded("statistics_test_statistics.dat", *table_schema.getCols());
+            REQUIRE(loaded.load());
+            REQUIRE(loaded.getNumberOfRows() == 3000);
+            REQUIRE(loaded.getHistogram(2) == statistics.getHistogram(2));
+            REQUIRE(loaded.getDistinctValues(1) == statistics.getDistinctValues(1));
+        }
+
+        THEN("A sampled ANALYZE scales the counts and the inserts keep the statistics current") {
+            table.analyze(0.5);
+            TableStatistics & statistics = table.getStatistics();
+            REQUIRE(statistics.getSampledRows() == 1024 + 952);
+            REQUIRE(statistics.getNumberOfRows() == 3000);
+            REQUIRE(std::abs(statistics.getDistinctValues(0) - 3000) < 150);
+
+            vector<string> row;
+            row.push_back("new");
+            row.push_back("5000");
+            table.insert(row);
+            double minimum, maximum;
+            REQUIRE(statistics.getNumberOfRows() == 3001);
+            REQUIRE(statistics.getRange(2, minimum, maximum));
+            REQUIRE(maximum == 5000);
+            REQUIRE_THROWS(table.analyze(0));
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("EXPLAIN ANALYZE should report the rows, blocks and memory of each operator") {
+    GIVEN("A table with 3000 rows, the ages sorted by _id, and a table joined to it") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        Table table("profile_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 3000; i++) {
+            vector<string> row;
+            row.push_back("n" + std::to_string(i % 500));
+            row.push_back(std::to_string(i / 100));
+            table.insert(row);
+        }
+        Schema group_schema;
+        group_schema.addCol("age", INT32);
+        Table group_table("profile_group");
+        group_table.setSchema(group_schema);
+        for (int i = 0; i < 3; i++) {
+            group_table.insert(vector<string>(1, std::to_string(i)));
+        }
+
+        THEN("The tree has one line for each operator, from the output to the scan") {
+            Cursor cursor = table.query("EXPLAIN ANALYZE SELECT name WHERE age >= 25 ORDER BY name LIMIT 5");
+            vector<string> lines;
+            for (cursor.moveToFirst(); !cursor.isAfterLast(); cursor.moveToNext()) {
+                lines.push_back(cursor.getString("plan"));
+            }
+            REQUIRE(lines.size() == 5);
+            REQUIRE(lines[0].find("Project (time=") == 0);
+            REQUIRE(lines[0].find("rows in=5 out=5") != string::npos);
+            REQUIRE(lines[2].find("    Sort name (time=") == 0);
+            REQUIRE(lines[2].find("rows in=500 out=5") != string::npos);
+            REQUIRE(lines[2].find("memory peak=") != string::npos);
+            REQUIRE(lines[3].find("      Parallel scan on ") == 0);
+            REQUIRE(lines[3].find("threads: Zone map scan 1 of 3 blocks") != string::npos);
+            REQUIRE(lines[3].find("out=500 batches=1 blocks read=1 skipped=2") != string::npos);
+            REQUIRE(lines[4].find("Execution time: ") == 0);
+            REQUIRE(lines[4].find(" ms, 5 rows") != string::npos);
+        }
+
+        THEN("The JSON document has the same operators, including the threads of an aggregation") {
+            Cursor cursor = table.query("EXPLAIN ANALYZE FORMAT JSON SELECT age, COUNT(*) GROUP BY age");
+            REQUIRE(cursor.getCount() == 1);
+            cursor.moveToFirst();
+            string json = cursor.getString("plan");
+            REQUIRE(json.find("{\"execution_time_ms\": ") == 0);
+            REQUIRE(json.find("\"rows\": 30, \"plan\": {\"operator\": \"Limit all offset 0\"") != string::npos);
+            REQUIRE(json.find("{\"operator\": \"Hash aggregate\"") != string::npos);
+            REQUIRE(json.find("\"rows_out\": 3000") != string::npos);
+            REQUIRE_THROWS(table.query("EXPLAIN ANALYZE FORMAT XML SELECT *"));
+        }
+
+        THEN("A join reports its steps") {
+            Cursor cursor = table.query("EXPLAIN ANALYZE SELECT name JOIN profile_group ON age = profile_group.age", &group_table);
+            REQUIRE(cursor.getCount() == 4);
+            cursor.moveToFirst();
+            REQUIRE(cursor.getString("plan").find("rows in=300 out=300") != string::npos);
+            cursor.moveToNext();
+            cursor.moveToNext();
+            REQUIRE(cursor.getString("plan").find("    Hash join on age = profile_group.age") == 0);
+        }
+
+        table.drop();
+        group_table.drop();
+    }
+}
+
+TEST_CASE("A parallel scan should return the rows of a serial scan, in order or as they are ready") {
+    GIVEN("A table with 3000 rows, the ages sorted by _id") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        Table table("parallel_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 3000; i++) {
+            vector<string> row;
+            row.push_back("n" + std::to_string(i));
+            row.push_back(std::to_string(i / 100));
+            table.insert(row);
+        }
+        Schema table_schema = table.getSchema();
+
+        vector<vector<string> > serial_rows;
+        TableScanOperator serial_scan(&table);
+        Batch batch;
+        while (serial_scan.next(batch)) {
+            batch.appendRows(serial_rows);
+        }
+        REQUIRE(serial_rows.size() == 3000);
+
+        THEN("An ordered scan returns the same rows in the same order") {
+            vector<vector<string> > rows;
+            ParallelScanOperator parallel_scan(TableScanOperator(&table), Expression(), vector<int>(), true, 3);
+            REQUIRE(parallel_scan.getNumberOfThreads() == 3);
+            while (parallel_scan.next(batch)) {
+                batch.appendRows(rows);
+            }
+            REQUIRE(rows == serial_rows);
+            REQUIRE(parallel_scan.getRowsRead() == 3000);
+            REQUIRE(parallel_scan.getBlocksRead() == 3);
+        }
+
+        THEN("An unordered scan returns the same rows, the filtered and projected ones only") {
+            Expression where(Predicate("age", LESS, "12"));
+            where.bind(table_schema);
+            TableScanOperator scan(&table);
+            scan.setBlockFilter(where);
+            vector<int> projection(1, table_schema.getColPosition("name"));
+            ParallelScanOperator parallel_scan(scan, where, projection, false, 4);
+            REQUIRE(parallel_scan.getNumberOfThreads() == 3);
+
+            vector<vector<string> > rows;
+            while (parallel_scan.next(batch)) {
+                REQUIRE(batch.columns.size() == 1);
+                batch.appendRows(rows);
+            }
+            REQUIRE(rows.size() == 1200);
+            sort(rows.begin(), rows.end());
+            vector<vector<string> > expected;
+            for (int i = 0; i < 1200; i++) {
+                expected.push_back(vector<string>(1, serial_rows[i][1]));
+            }
+            sort(expected.begin(), expected.end());
+            REQUIRE(rows == expected);
+            REQUIRE(parallel_scan.getBlocksRead() == 2);
+            REQUIRE(parallel_scan.getBlocksSkipped() == 1);
+        }
+
+        THEN("The scan can stop after the first batch, and a scan of the row ids reads their batches") {
+            TableScanOperator scan(&table);
+            vector<uint32_t> row_ids;
+            for (uint32_t i = 0; i < 3000; i += 2) {
+                row_ids.push_back(i);
+            }
+            scan.setRowIds(row_ids);
+            ParallelScanOperator parallel_scan(scan, Expression(), vector<int>(), true, 2);
+            REQUIRE(parallel_scan.next(batch));
+            REQUIRE(batch.getSelectedCount() == (unsigned) Batch::CAPACITY);
+            parallel_scan.stop();
+            REQUIRE_FALSE(parallel_scan.next(batch));
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("The thread pool should run the task graphs by priority, and cancel them") {
+    GIVEN("A pool with a single thread, kept busy until the tasks are queued") {
+        ThreadPool pool(1);
+        mutex order_mutex;
+        vector<string> order;
+        atomic<bool> released(false);
+        pool.submit([&released]() {
+            while (!released) {
+                this_thread::yield();
+            }
+        });
+
+        THEN("The high priority tasks run first, and the tasks of a graph after their dependencies") {
+            TaskGraph graph(pool);
+            size_t scan = graph.add([&]() { unique_lock<mutex> lock(order_mutex); order.push_back("scan"); }, LOW_PRIORITY);
+            size_t merge = graph.add([&]() { unique_lock<mutex> lock(order_mutex); order.push_back("merge"); }, HIGH_PRIORITY,
+                                     vector<size_t>(1, scan));
+            graph.add([&]() { unique_lock<mutex> lock(order_mutex); order.push_back("lookup"); }, HIGH_PRIORITY);
+            graph.add([&]() { unique_lock<mutex> lock(order_mutex); order.push_back("output"); }, NORMAL_PRIORITY,
+                      vector<size_t>(1, merge));
+            size_t last = graph.add([]() {});
+            REQUIRE(last == 4);
+            REQUIRE_THROWS(graph.add([]() {}, NORMAL_PRIORITY, vector<size_t>(1, 5)));
+            graph.run();
+            released = true;
+            REQUIRE_THROWS(graph.add([]() {}));
+            graph.wait();
+
+            REQUIRE(order.size() == 4);
+            REQUIRE(order[0] == "lookup");
+            REQUIRE(order[1] == "scan");
+            REQUIRE(order[2] == "merge");
+            REQUIRE(order[3] == "output");
+        }
+
+        THEN("A task throwing cancels the tasks not started yet, and the error is rethrown") {
+            TaskGraph graph(pool);
+            size_t failing = graph.add([]() { throw std::invalid_argument("failed"); });
+            graph.add([&]() { order.push_back("dependent"); }, NORMAL_PRIORITY, vector<size_t>(1, failing));
+            graph.run();
+            released = true;
+            REQUIRE_THROWS(graph.wait());
+            REQUIRE(graph.isCancelled());
+            REQUIRE(order.empty());
+
+            CancellationToken token;
+            token.cancel();
+            atomic<int> runs(0);
+            pool.submit([&runs]() { runs++; }, NORMAL_PRIORITY, token);
+            TaskGraph last(pool);
+            last.add([&runs]() { runs += 10; });
+            last.wait();
+            REQUIRE(runs == 10);
+        }
+    }
+
+    GIVEN("A pool with several threads") {
+        ThreadPool pool(4);
+        REQUIRE(pool.getNumberOfThreads() == 4);
+
+        THEN("The tasks submitted by tasks are stolen by the other threads, and a task can wait for them") {
+            atomic<long long> sum(0);
+            atomic<bool> on_workers(true);
+            TaskGraph graph(pool);
+            for (int i = 0; i < 8; i++) {
+                graph.add([&pool, &sum, &on_workers, i]() {
+                    on_workers = on_workers && pool.isWorkerThread();
+                    TaskGraph children(pool);
+                    for (int j = 0; j < 100; j++) {
+                        children.add([&sum, i, j]() { sum += i * 100 + j; });
+                    }
+                    children.wait();
+                });
+            }
+            graph.wait();
+            REQUIRE(sum == 799 * 800 / 2);
+            REQUIRE(on_workers);
+            REQUIRE_FALSE(pool.isWorkerThread());
+        }
+    }
+}
+
+TEST_CASE("The pipelines should share the threads and return the rows of the serial operators") {
+    GIVEN("A table with 3000 rows, the ages sorted by _id, and a table with one row for each age") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        Table table("pipeline_test");
+        table.setSchema(schema);
+        Table ages("pipeline_ages_test");
+        ages.setSchema(schema);
+        for (int i = 0; i < 3000; i++) {
+            vector<string> row;
+            row.push_back("n" + std::to_string(i));
+            row.push_back(std::to_string(i / 100));
+            table.insert(row);
+            if (i % 100 == 0) {
+                ages.insert(row);
+            }
+        }
+        Schema table_schema = table.getSchema();
+        int name_column = table_schema.getColPosition("name");
+        int age_column = table_schema.getColPosition("age");
+        ThreadPool pool(4);
+
+        vector<vector<string> > serial_rows;
+        TableScanOperator serial_scan(&table);
+        Batch batch;
+        while (serial_scan.next(batch)) {
+            batch.appendRows(serial_rows);
+        }
+
+        THEN("The queries running at the same time share the threads of the pool") {
+            REQUIRE(pool.getFairShare() == 4);
+            pool.beginQuery();
+            pool.beginQuery();
+            REQUIRE(pool.getFairShare() == 2);
+            pool.beginQuery();
+            REQUIRE(pool.getFairShare() == 2);
+            for (int i = 0; i < 3; i++) {
+                pool.endQuery();
+            }
+            REQUIRE(pool.getFairShare() == 4);
+        }
+
+        THEN("A pipeline filters and projects the morsels, gathered in the order of the serial scan") {
+            Expression where(Predicate("age", LESS, "12"));
+            where.bind(table_schema);
+            TableScanOperator scan(&table);
+            scan.setBlockFilter(where);
+            Pipeline pipeline(scan, 3, pool);
+            pipeline.setFilter(where);
+            pipeline.setProjection(vector<int>(1, name_column));
+            REQUIRE(pipeline.getMaxWorkers() == 3);
+            REQUIRE_THROWS(pipeline.run(vector<PipelineSink *>(1)));
+
+            vector<CollectSink> sinks(3);
+            vector<CollectSink *> collected;
+            vector<PipelineSink *> sink_pointers;
+            for (int i = 0; i < 3; i++) {
+                collected.push_back(&sinks[i]);
+                sink_pointers.push_back(&sinks[i]);
+            }
+            pipeline.run(sink_pointers);
+            vector<Batch> batches;
+            CollectSink::gather(collected, batches);
+            vector<vector<string> > rows;
+            for (unsigned i = 0; i < batches.size(); i++) {
+                batches[i].appendRows(rows);
+            }
+
+            REQUIRE(rows.size() == 1200);
+            for (int i = 0; i < 1200; i++) {
+                REQUIRE(rows[i][0] == serial_rows[i][name_column]);
+            }
+            REQUIRE(pipeline.getRowsOut() == 1200);
+            REQUIRE(pipeline.getBlocksRead() == 2);
+            REQUIRE(pipeline.getBlocksSkipped() == 1);
+            REQUIRE(pipeline.getPeakWorkers() >= 1);
+            REQUIRE(pipeline.getPeakWorkers() <= 3);
+        }
+
+        THEN("A pipeline with a row limit returns the first morsels only") {
+            TableScanOperator scan(&table);
+            vector<uint32_t> row_ids;
+            for (uint32_t i = 0; i < 3000; i++) {
+                row_ids.push_back(i);
+            }
+            scan.setRowIds(row_ids);
+            Pipeline pipeline(scan, 1, pool);
+            pipeline.setRowLimit(10);
+            CollectSink sink;
+            pipeline.run(vector<PipelineSink *>(1, &sink));
+            vector<Batch> batches;
+            CollectSink::gather(vector<CollectSink *>(1, &sink), batches);
+            REQUIRE(batches.size() == 1);
+            REQUIRE(batches[0].getSelectedCount() == (unsigned) Batch::CAPACITY);
+            REQUIRE(pipeline.getRowsRead() == (long long) Batch::CAPACITY);
+        }
+
+        THEN("An aggregation of a pipeline merges the tables of its workers") {
+            Pipeline pipeline(TableScanOperator(&table), 0, pool);
+            vector<Aggregate> aggregates;
+            aggregates.push_back(Aggregate(COUNT, -1, "count(*)"));
+            aggregates.push_back(Aggregate(MIN, name_column, "min(name)"));
+            HashAggregateOperator aggregate(&pipeline, vector<int>(1, age_column), aggregates);
+            vector<vector<string> > rows;
+            while (aggregate.next(batch)) {
+                batch.appendRows(rows);
+            }
+            REQUIRE(rows.size() == 30);
+            sort(rows.begin(), rows.end(), [](const vector<string> & a, const vector<string> & b) {
+                return atoi(a[0].c_str()) < atoi(b[0].c_str());
+            });
+            for (int i = 0; i < 30; i++) {
+                REQUIRE(rows[i][0] == std::to_string(i));
+                REQUIRE(rows[i][1] == "100");
+                REQUIRE(rows[i][2] == "n" + std::to_string(i * 100));
+            }
+        }
+
+        THEN("A hash join builds and probes with pipelines, matching in the order of the probe rows") {
+            header_t * header = table.getHeader();
+            Join join(&table, "age", &ages, "age", JoinType::HASH);
+            const vector<vector<long long> > & result = join.getResult();
+            REQUIRE(result.size() == 3000);
+            for (int i = 0; i < 3000; i++) {
+                REQUIRE(result[i][0] == header->at(i).second);
+                REQUIRE(result[i][1] == ages.getHeader()->at(i / 100).second);
+            }
+
+            Join limited_join(&table, "age", &ages, "age", JoinType::HASH, NULL, 150);
+            REQUIRE(limited_join.getNumberOfRows() == 150);
+            REQUIRE(limited_join.getResult()[149][0] == header->at(149).second);
+        }
+
+        table.drop();
+        ages.drop();
+    }
+}
+
+TEST_CASE("The admission controller should queue the expensive queries and cancel them at their deadline") {
+    QueryEstimate cheap;
+    cheap.cost = 10;
+    QueryEstimate expensive;
+    expensive.cost = 1e9;
+    expensive.memory = 600;
+
+    GIVEN("A controller running one expensive query at a time, with 1000 bytes to grant") {
+        AdmissionController controller(1, 1000);
+        REQUIRE(controller.classify(cheap) == CHEAP_QUERY);
+        REQUIRE(controller.classify(expensive) == EXPENSIVE_QUERY);
+
+        THEN("The cheap queries run while the expensive ones wait for a slot, in arrival order") {
+            AdmissionTicket first = controller.admit(expensive);
+            REQUIRE(first.getMemoryGrant() == 600);
+            REQUIRE(first.getPriority() == NORMAL_PRIORITY);
+            REQUIRE(controller.getGrantedMemory() == 600);
+
+            atomic<bool> second_admitted(false);
+            thread second([&]() {
+                AdmissionTicket ticket = controller.admit(expensive);
+                second_admitted = true;
+            });
+            while (controller.getQueuedQueries() == 0) {
+                this_thread::yield();
+            }
+
+            AdmissionTicket lookup = controller.admit(cheap);
+            REQUIRE(lookup.getQueryClass() == CHEAP_QUERY);
+            REQUIRE(lookup.getPriority() == HIGH_PRIORITY);
+            REQUIRE(controller.getRunningQueries(CHEAP_QUERY) == 1);
+            REQUIRE_FALSE(second_admitted);
+
+            first.release();
+            second.join();
+            REQUIRE(second_admitted);
+            REQUIRE(controller.getQueuedQueries() == 0);
+            REQUIRE(controller.getRunningQueries(EXPENSIVE_QUERY) == 0);
+            REQUIRE(controller.getGrantedMemory() == 0);
+        }
+
+        THEN("A query queued past its deadline is rejected, and a token past its deadline is cancelled") {
+            controller.setQueryTimeout(0.02);
+            AdmissionTicket first = controller.admit(expensive);
+            REQUIRE_THROWS(controller.admit(expensive));
+            REQUIRE(controller.getQueuedQueries() == 0);
+            REQUIRE(first.getToken().isExpired());
+
+            CancellationToken token;
+            token.setDeadline(3600);
+            REQUIRE_FALSE(token.isCancelled());
+            token.cancel();
+            REQUIRE(token.isCancelled());
+            REQUIRE_FALSE(token.isExpired());
+        }
+    }
+
+    GIVEN("A table of 3000 rows") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        Table table("admission_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 3000; i++) {
+            vector<string> row;
+            row.push_back("n" + std::to_string(i));
+            row.push_back(std::to_string(i / 100));
+            table.insert(row);
+        }
+
+        THEN("The scans stop once the token of their query is cancelled") {
+            CancellationToken token;
+            CancellationScope scope(token);
+            TableScanOperator scan(&table);
+            Batch batch;
+            REQUIRE(scan.next(batch));
+            token.cancel();
+            REQUIRE_THROWS(scan.next(batch));
+            REQUIRE_THROWS(table.query("SELECT COUNT(*)"));
+        }
+
+        THEN("The queries of an admitted table run until their deadline, point lookups included") {
+            AdmissionController controller(1);
+            table.setAdmissionController(&controller);
+            REQUIRE(table.query("SELECT name WHERE _id = 7").getCount() == 1);
+            REQUIRE(table.query("SELECT COUNT(*) GROUP BY age").getCount() == 30);
+            REQUIRE(controller.getRunningQueries(EXPENSIVE_QUERY) == 0);
+
+            controller.setQueryTimeout(0.05);
+            REQUIRE_THROWS(table.join("age", &table, "age", NESTED));
+            REQUIRE(controller.getRunningQueries(EXPENSIVE_QUERY) == 0);
+            table.setAdmissionController(NULL);
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("The rings should pass the values between the stages in order, and the staged scans should match the morsels") {
+    GIVEN("Rings of 5 slots, rounded up to 8") {
+        SpscRing<int> spsc(5);
+        MpmcRing<int> mpmc(5);
+        REQUIRE(spsc.getCapacity() == 8);
+        REQUIRE(mpmc.getCapacity() == 8);
+
+        THEN("A full ring refuses the values and an empty one has none, until it's closed") {
+            for (int i = 0; i < 8; i++) {
+                REQUIRE(spsc.tryPush(i));
+                REQUIRE(mpmc.tryPush(i));
+            }
+            int value = 8;
+            REQUIRE_FALSE(spsc.tryPush(value));
+            REQUIRE_FALSE(mpmc.tryPush(value));
+            for (int i = 0; i < 8; i++) {
+                REQUIRE(spsc.pop(value));
+                REQUIRE(value == i);
+                REQUIRE(mpmc.pop(value));
+                REQUIRE(value == i);
+            }
+            REQUIRE_FALSE(spsc.tryPop(value));
+            spsc.close();
+            mpmc.close();
+            REQUIRE_FALSE(spsc.pop(value));
+            REQUIRE_FALSE(mpmc.pop(value));
+            REQUIRE_FALSE(spsc.push(value));
+        }
+
+        THEN("The producers wait for the consumers, and every value is popped once") {
+            long long spsc_sum = 0;
+            bool spsc_ordered = true;
+            thread consumer([&]() {
+                int value, expected = 0;
+                while (spsc.pop(value)) {
+                    spsc_ordered = spsc_ordered && value == expected++;
+                    spsc_sum += value;
+                }
+            });
+            for (int i = 0; i < 10000; i++) {
+                int value = i;
+                spsc.push(value);
+            }
+            spsc.close();
+            consumer.join();
+            REQUIRE(spsc_ordered);
+            REQUIRE(spsc_sum == 10000LL * 9999 / 2);
+
+            vector<long long> sums(3, 0);
+            vector<thread> producers, consumers;
+            for (int p = 0; p < 3; p++) {
+                producers.push_back(thread([&mpmc, p]() {
+                    for (int i = p; i < 9000; i += 3) {
+                        int value = i;
+                        mpmc.push(value);
+                    }
+                }));
+                consumers.push_back(thread([&mpmc, &sums, p]() {
+                    int value;
+                    while (mpmc.pop(value)) {
+                        sums[p] += value;
+                    }
+                }));
+            }
+            for (int p = 0; p < 3; p++) {
+                producers[p].join();
+            }
+            mpmc.close();
+            for (int p = 0; p < 3; p++) {
+                consumers[p].join();
+            }
+            REQUIRE(sums[0] + sums[1] + sums[2] == 9000LL * 8999 / 2);
+        }
+    }
+
+    GIVEN("A CSV file of 3000 rows and a table with the same rows inserted one by one") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        Table inserted("staged_inserted_test");
+        inserted.setSchema(schema);
+        ofstream csv("staged_test.csv");
+        csv << "name,age" << endl;
+        for (int i = 0; i < 3000; i++) {
+            vector<string> row;
+            row.push_back("n" + std::to_string(i));
+            row.push_back(std::to_string(i / 100));
+            inserted.insert(row);
+            csv << row[0] << "," << row[1] << endl;
+        }
+        csv.close();
+        Table converted("staged_converted_test");
+        converted.setSchema(schema);
+        converted.convertFromCSV("staged_test.csv");
+
+        THEN("The converted table has the rows of the inserts, with the same _ids") {
+            Cursor expected = inserted.query("SELECT _id, name, age");
+            Cursor cursor = converted.query("SELECT _id, name, age");
+            REQUIRE(cursor.getCount() == 3000);
+            bool same_rows = true;
+            for (expected.moveToFirst(), cursor.moveToFirst(); !cursor.isAfterLast(); expected.moveToNext(), cursor.moveToNext()) {
+                for (int column = 0; column < 3; column++) {
+                    same_rows = same_rows && cursor.getString(column) == expected.getString(column);
+                }
+            }
+            REQUIRE(same_rows);
+            REQUIRE(converted.query("SELECT name WHERE age = 12").getCount() == 100);
+        }
+
+        THEN("A staged scan returns the rows of the morsels, in the same order") {
+            Cursor expected = converted.query("SELECT name WHERE age >= 7 AND age < 25");
+            converted.setExecutionMode(STAGED_EXECUTION);
+            Cursor cursor = converted.query("SELECT name WHERE age >= 7 AND age < 25");
+            REQUIRE(cursor.getCount() == 1800);
+            bool same_rows = true;
+            for (expected.moveToFirst(), cursor.moveToFirst(); !cursor.isAfterLast(); expected.moveToNext(), cursor.moveToNext()) {
+                same_rows = same_rows && cursor.getString("name") == expected.getString("name");
+            }
+            REQUIRE(same_rows);
+
+            Cursor plan = converted.query("EXPLAIN ANALYZE SELECT name WHERE age >= 7");
+            bool staged_scan = false;
+            for (plan.moveToFirst(); !plan.isAfterLast(); plan.moveToNext()) {
+                staged_scan = staged_scan || plan.getString("plan").find("Staged scan on 2 threads: ") != string::npos;
+            }
+            REQUIRE(staged_scan);
+            converted.setExecutionMode(MORSEL_EXECUTION);
+        }
+
+        inserted.drop();
+        converted.drop();
+        remove("staged_test.csv");
+    }
+}
+
+TEST_CASE("The asynchronous I/O should read the same bytes with io_uring and the threads, and the scans should read ahead") {
+    GIVEN("A file written by the requests of each AsyncIo") {
+        vector<unique_ptr<AsyncIo> > backends;
+        backends.push_back(unique_ptr<AsyncIo>(AsyncIo::create(4)));
+        backends.push_back(unique_ptr<AsyncIo>(AsyncIo::create(4, false)));
+        REQUIRE(backends[1]->getName() == "pread on 4 threads");
+
+        THEN("The reads return the bytes written, with more requests than the queue depth") {
+            for (size_t backend = 0; backend < backends.size(); backend++) {
+                AsyncIo & io = *backends[backend];
+                REQUIRE(io.getQueueDepth() >= 4);
+                int fd = open("async_io_test.dat", O_RDWR | O_CREAT | O_TRUNC, 0644);
+                REQUIRE(fd >= 0);
+
+                vector<char> written(64 * 512);
+                for (size_t i = 0; i < written.size(); i++) {
+                    written[i] = (char) (i * 7 + backend);
+                }
+                vector<IoRequest> writes;
+                for (int i = 0; i < 64; i++) {
+                    writes.push_back(IoRequest(fd, i * 512, &written[i * 512], 512, true));
+                }
+                io.run(writes);
+
+                //The blocks are read in another order than the file order
+                vector<char> read(written.size());
+                vector<IoRequest> reads;
+                for (int i = 0; i < 64; i++) {
+                    int block = (i * 37) % 64;
+                    reads.push_back(IoRequest(fd, block * 512, &read[block * 512], 512));
+                }
+                io.run(reads);
+                REQUIRE(read == written);
+
+                vector<IoRequest> past_end(1, IoRequest(fd, written.size() - 100, &read[0], 512));
+                REQUIRE_THROWS(io.run(past_end));
+                vector<IoRequest> closed_file(1, IoRequest(-1, 0, &read[0], 512));
+                REQUIRE_THROWS(io.run(closed_file));
+                close(fd);
+            }
+            remove("async_io_test.dat");
+        }
+    }
+
+    GIVEN("A table with 5000 rows") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        Table table("async_io_table_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 5000; i++) {
+            vector<string> row;
+            row.push_back("n" + std::to_string(i));
+            row.push_back(std::to_string(i % 90));
+            table.insert(row);
+        }
+
+        THEN("The blocks read together, and the rows read by id, are the rows of each block") {
+            vector<long long> blocks;
+            blocks.push_back(4);
+            blocks.push_back(1);
+            blocks.push_back(2);
+            vector<Batch> batches;
+            table.readBlocks(blocks, batches);
+            REQUIRE(batches.size() == 3);
+            REQUIRE(batches[0].size == 5000 - 4 * 1024);
+            for (size_t i = 0; i < blocks.size(); i++) {
+                Batch batch;
+                table.readBlock(blocks[i], batch);
+                vector<vector<string> > expected, rows;
+                batch.appendRows(expected);
+                batches[i].appendRows(rows);
+                REQUIRE(rows == expected);
+                REQUIRE(batches[i].positions == batch.positions);
+            }
+            REQUIRE(table.getRow(table.getHeader()->at(3000).second)[1] == "n3000");
+        }
+
+        THEN("A descending scan returns the same rows reading one block or 8 blocks at a time") {
+            unique_ptr<AsyncIo> threaded_io(AsyncIo::create(2, false));
+            table.setAsyncIo(threaded_io.get());
+            table.setIoQueueDepth(1);
+            Cursor expected = table.query("SELECT _id, name WHERE age < 10 ORDER BY _id DESC");
+            table.setIoQueueDepth(8);
+            REQUIRE(table.getIoQueueDepth() == 8);
+            Cursor cursor = table.query("SELECT _id, name WHERE age < 10 ORDER BY _id DESC");
+            REQUIRE(cursor.getCount() == expected.getCount());
+            bool same_rows = true;
+            for (expected.moveToFirst(), cursor.moveToFirst(); !cursor.isAfterLast(); expected.moveToNext(), cursor.moveToNext()) {
+                same_rows = same_rows && cursor.getString("name") == expected.getString("name");
+            }
+            REQUIRE(same_rows);
+            cursor.moveToFirst();
+            REQUIRE(cursor.getString("name") == "n4959");
+            table.setAsyncIo(&AsyncIo::getShared());
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("getRows should return the rows of getRow in the order of the positions") {
+    GIVEN("A table with 3000 rows") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        Table table("get_rows_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 3000; i++) {
+            vector<string> row;
+            row.push_back("n" + std::to_string(i));
+            row.push_back(std::to_string(i / 100));
+            table.insert(row);
+        }
+        header_t * header = table.getHeader();
+
+        THEN("The positions far apart, close to each other and repeated are read once, in any order") {
+            vector<long long> positions;
+            for (int i = 0; i < 500; i++) {
+                positions.push_back(header->at((i * 7919) % 3000).second);
+            }
+            positions.push_back(header->at(2999).second);
+            positions.push_back(header->at(0).second);
+            positions.push_back(header->at(0).second);
+            positions.push_back(header->at(1).second);
+
+            vector<vector<string> > rows = table.getRows(positions);
+            REQUIRE(rows.size() == positions.size());
+            bool same_rows = true;
+            for (size_t i = 0; i < positions.size(); i++) {
+                same_rows = same_rows && rows[i] == table.getRow(positions[i]);
+            }
+            REQUIRE(same_rows);
+            REQUIRE(rows[0][1] == "n0");
+            REQUIRE(rows[1][1] == "n1919");
+            REQUIRE(rows[500][1] == "n2999");
+            REQUIRE(table.getRows(vector<long long>()).empty());
+        }
+
+        THEN("A join fetches the rows of both tables with getRows") {
+            Schema ages_schema;
+            ages_schema.addCol("age", INT32);
+            ages_schema.addCol("label", CHAR, 10);
+            Table ages("get_rows_ages_test");
+            ages.setSchema(ages_schema);
+            for (int i = 29; i >= 0; i--) {
+                vector<string> row;
+                row.push_back(std::to_string(i));
+                row.push_back("a" + std::to_string(i));
+                ages.insert(row);
+            }
+            Cursor cursor = table.query("SELECT name, get_rows_ages_test.label JOIN get_rows_ages_test ON age = get_rows_ages_test.age", &ages);
+            REQUIRE(cursor.getCount() == 3000);
+            bool matching_rows = true;
+            for (cursor.moveToFirst(); !cursor.isAfterLast(); cursor.moveToNext()) {
+                matching_rows = matching_rows && cursor.getString(1) == "a" + std::to_string(atoi(cursor.getString(0).c_str() + 1) / 100);
+            }
+            REQUIRE(matching_rows);
+            ages.drop();
+        }
+
+        table.drop();
+    }
+}
+
+#ifdef HAS_COROUTINES
+/**
+ * The name of a row, awaiting its read
+ */
+AsyncResult<string> getNameAsync(Table & table, long long _id) {
+    vector<string> row = co_await table.getRowByIdAsync(_id);
+    co_return row.empty() ? string() : row.at(1);
+}
+#endif
+
+TEST_CASE("The asynchronous lookups and queries should return the rows of the blocking ones") {
+    GIVEN("A table with 3000 rows") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        Table table("async_query_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 3000; i++) {
+            vector<string> row;
+            row.push_back("n" + std::to_string(i));
+            row.push_back(std::to_string(i / 100));
+            table.insert(row);
+        }
+
+        THEN("Thousands of lookups in flight complete on the thread of the queue") {
+            vector<AsyncResult<vector<string> > > results;
+            atomic<int> callbacks(0);
+            for (int i = 0; i < 3000; i++) {
+                results.push_back(table.getRowByIdAsync((i * 7919) % 3000));
+                results.back().then([&callbacks](AsyncResult<vector<string> > result) { callbacks++; });
+            }
+            bool same_rows = true;
+            for (int i = 0; i < 3000; i++) {
+                same_rows = same_rows && results[i].get() == table.getRowById((i * 7919) % 3000);
+            }
+            REQUIRE(same_rows);
+            while (callbacks < 3000) {
+                this_thread::yield();
+            }
+            REQUIRE(table.getRowByIdAsync(5000).get().empty());
+
+            vector<long long> positions;
+            positions.push_back(table.getHeader()->at(2000).second);
+            positions.push_back(table.getHeader()->at(10).second);
+            vector<vector<string> > rows = table.getRowsAsync(positions).get();
+            REQUIRE(rows.size() == 2);
+            REQUIRE(rows[0][1] == "n2000");
+            REQUIRE(rows[1][1] == "n10");
+        }
+
+        THEN("A query runs on the pool, and its errors are rethrown by get") {
+            AsyncResult<Cursor> cursor = table.queryAsync("SELECT name WHERE age = 12");
+            REQUIRE(cursor.get().getCount() == 100);
+            REQUIRE_THROWS(table.queryAsync("SELECT unknown_column").get());
+
+            unique_ptr<AsyncIo> threaded_io(AsyncIo::create(2, false));
+            table.setAsyncIo(threaded_io.get());
+            REQUIRE(table.getRowByIdAsync(42).get().at(1) == "n42");
+            table.setAsyncIo(&AsyncIo::getShared());
+        }
+
+        THEN("Many queries run at once, each one parsed and planned on its own task") {
+            vector<AsyncResult<Cursor> > cursors;
+            for (int i = 0; i < 200; i++) {
+                cursors.push_back(table.queryAsync("SELECT name WHERE age = " + std::to_string(i % 40)));
+            }
+            bool same_counts = true;
+            for (int i = 0; i < 200; i++) {
+                same_counts = same_counts && cursors[i].get().getCount() == (i % 40 < 30 ? 100 : 0);
+            }
+            REQUIRE(same_counts);
+        }
+
+#ifdef HAS_COROUTINES
+        THEN("A coroutine awaits the lookups") {
+            REQUIRE(getNameAsync(table, 1234).get() == "n1234");
+            REQUIRE(getNameAsync(table, 5000).get() == "");
+        }
+#endif
+
+        table.drop();
+    }
+}
+
+TEST_CASE("The query server should return the results of the queries on its tables") {
+    GIVEN("A server on a Unix socket and on a TCP port") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        Table table("query_server_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 500; i++) {
+            vector<string> row;
+            row.push_back("n" + std::to_string(i));
+            row.push_back(std::to_string(i % 50));
+            table.insert(row);
+        }
+
+        QueryServer server;
+        server.addTable("people", &table);
+        server.setMaxRequestSize(64 * 1024);
+        server.listenUnix("query_server_test.sock");
+        int port = server.listenTcp();
+        server.start();
+
+        THEN("The clients get the rows of the queries, and the errors of the failed ones") {
+            QueryClient unix_client;
+            unix_client.connectUnix("query_server_test.sock");
+            QueryClient tcp_client;
+            tcp_client.connectTcp("127.0.0.1", port);
+            unix_client.ping();
+
+            Cursor expected = table.query("SELECT name, age WHERE age = 7");
+            Cursor cursor = unix_client.query("people", "SELECT name, age WHERE age = 7");
+            REQUIRE(cursor.getCount() == 10);
+            REQUIRE(cursor.getColumnNames() == expected.getColumnNames());
+            bool same_rows = true;
+            for (; !cursor.isAfterLast(); cursor.moveToNext(), expected.moveToNext()) {
+                same_rows = same_rows && cursor.getString("name") == expected.getString("name") &&
+                            cursor.getString("age") == "7";
+            }
+            REQUIRE(same_rows);
+            REQUIRE(tcp_client.query("people", "SELECT name WHERE _id = 42").getString("name") == "n42");
+
+            REQUIRE_THROWS(unix_client.query("nobody", "SELECT name"));
+            REQUIRE_THROWS(unix_client.query("people", "SELECT unknown_column"));
+            //The connection is still usable after an error
+            unix_client.ping();
+            REQUIRE(server.getQueriesServed() == 3);
+        }
+
+        THEN("Several clients query at once, and a client leaving with a query running is dropped") {
+            int raw_socket = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address;
+            memset(&address, 0, sizeof(address));
+            address.sin_family = AF_INET;
+            address.sin_port = htons(port);
+            inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+            REQUIRE(connect(raw_socket, (sockaddr *) &address, sizeof(address)) == 0);
+            sendFrame(raw_socket, encodeQuery("people", "", "SELECT name"));
+            close(raw_socket);
+
+            atomic<bool> same_rows(true);
+            vector<thread> clients;
+            for (int i = 0; i < 4; i++) {
+                clients.push_back(thread([&, i]() {
+                    try {
+                        QueryClient client;
+                        if (i % 2 == 0) {
+                            client.connectUnix("query_server_test.sock");
+                        } else {
+                            client.connectTcp("127.0.0.1", port);
+                        }
+                        for (int j = 0; j < 50; j++) {
+                            int _id = (i * 50 + j * 7) % 500;
+                            Cursor cursor = client.query("people", "SELECT name WHERE _id = " + std::to_string(_id));
+                            if (cursor.getCount() != 1 || cursor.getString(0) != "n" + std::to_string(_id)) {
+                                same_rows = false;
+                            }
+                        }
+                    } catch (...) {
+                        same_rows = false;
+                    }
+                }));
+            }
+            for (vector<thread>::iterator it = clients.begin(); it != clients.end(); it++) {
+                it->join();
+            }
+            REQUIRE(same_rows);
+            REQUIRE(server.getQueriesServed() >= 200);
+        }
+
+        THEN("The requests sent at once are answered in order, and a request too large closes its connection") {
+            int raw_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un address;
+            memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            strcpy(address.sun_path, "query_server_test.sock");
+            REQUIRE(connect(raw_socket, (sockaddr *) &address, sizeof(address)) == 0);
+            string requests;
+            for (int i = 0; i < 200; i++) {
+                requests += i % 2 == 0 ? MessageWriter(PING_MESSAGE).finish() :
+                            encodeQuery("people", "", "SELECT name WHERE _id = " + std::to_string(i));
+            }
+            sendFrame(raw_socket, requests);
+            int wrong_responses = 0;
+            for (int i = 0; i < 200; i++) {
+                string message = receiveFrame(raw_socket);
+                MessageReader reader(message);
+                if (reader.readType() != (i % 2 == 0 ? PONG_MESSAGE : RESULT_MESSAGE)) {
+                    wrong_responses++;
+                } else if (i % 2 == 1 && decodeResult(message).getString(0) != "n" + std::to_string(i)) {
+                    wrong_responses++;
+                }
+            }
+            REQUIRE(wrong_responses == 0);
+
+            //Only the length of the request is sent, the server doesn't wait for its bytes
+            uint32_t length = 1 << 20;
+            string too_large(FRAME_LENGTH_SIZE, '\0');
+            for (size_t i = 0; i < FRAME_LENGTH_SIZE; i++) {
+                too_large[i] = (char) (length >> (8 * i));
+            }
+            sendFrame(raw_socket, too_large);
+            string error = receiveFrame(raw_socket);
+            REQUIRE(MessageReader(error).readType() == ERROR_MESSAGE);
+            REQUIRE_THROWS(receiveFrame(raw_socket));
+            close(raw_socket);
+
+            QueryClient client;
+            client.connectUnix("query_server_test.sock");
+            REQUIRE(client.query("people", "SELECT name WHERE _id = 3").getString(0) == "n3");
+        }
+
+        THEN("Eight clients run scans and aggregates at once on the same table") {
+            vector<int> wrong_results(8, 0);
+            vector<thread> clients;
+            for (int i = 0; i < 8; i++) {
+                clients.push_back(thread([&, i]() {
+                    try {
+                        QueryClient client;
+                        client.connectUnix("query_server_test.sock");
+                        for (int j = 0; j < 30; j++) {
+                            int age = (i * 30 + j) % 50;
+                            Cursor scan = client.query("people", "SELECT name WHERE age = " + std::to_string(age));
+                            Cursor groups = client.query("people", "SELECT age, count(*) WHERE age < " + std::to_string(age + 1) + " GROUP BY age");
+                            if (scan.getCount() != 10 || groups.getCount() != age + 1) {
+                                wrong_results[i]++;
+                            }
+                        }
+                    } catch (...) {
+                        wrong_results[i]++;
+                    }
+                }));
+            }
+            for (vector<thread>::iterator it = clients.begin(); it != clients.end(); it++) {
+                it->join();
+            }
+            REQUIRE(wrong_results == vector<int>(8, 0));
+        }
+
+        server.stop();
+        table.drop();
+    }
+}
+
+TEST_CASE("A serialized cursor should return the same values in a fraction of the bytes") {
+    GIVEN("A cursor of numbers, sorted groups, a few distinct names and strings like numbers") {
+        vector<string> column_names;
+        column_names.push_back("_id");
+        column_names.push_back("group");
+        column_names.push_back("city");
+        column_names.push_back("score");
+        column_names.push_back("code");
+        column_names.push_back("flag");
+        const char * cities[] = {"Lisbon", "Porto", "Braga", "Faro", "Coimbra"};
+        vector<vector<string> > rows;
+        size_t text_bytes = 0;
+        for (int i = 0; i < 10000; i++) {
+            vector<string> row;
+            row.push_back(std::to_string(i));
+            row.push_back("group " + std::to_string(i / 1000));
+            row.push_back(cities[(i * 7) % 5]);
+            row.push_back(formatDouble(i * 0.25 - 100));
+            row.push_back(i % 2 == 0 ? "007" : "42");
+            row.push_back(i % 3 == 0 ? "" : "x");
+            for (vector<string>::iterator it = row.begin(); it != row.end(); it++) {
+                text_bytes += 4 + it->size();
+            }
+            rows.push_back(row);
+        }
+        Cursor cursor(column_names, rows);
+        cursor.setContinuation("7:n9999");
+
+        THEN("The deserialized cursor reads the same values from the bytes") {
+            string bytes = cursor.serialize();
+            REQUIRE(bytes.size() < text_bytes / 2);
+
+            Cursor copy = Cursor::deserialize(bytes);
+            REQUIRE(copy.getCount() == 10000);
+            REQUIRE(copy.getColumnNames() == column_names);
+            REQUIRE(copy.getContinuation() == "7:n9999");
+            bool same_values = true;
+            long long row = 0;
+            for (copy.moveToFirst(); !copy.isAfterLast(); copy.moveToNext(), row++) {
+                for (int i = 0; i < (int) column_names.size(); i++) {
+                    same_values = same_values && copy.getString(i) == rows[row][i];
+                }
+            }
+            REQUIRE(same_values);
+            REQUIRE(row == 10000);
+            REQUIRE(copy.serialize() == bytes);
+
+            ColumnarResult result(make_shared<const string>(bytes));
+            REQUIRE(result.getColumnType(0) == INT64);
+            REQUIRE(result.getColumnType(1) == CHAR);
+            REQUIRE(result.getColumnType(3) == DOUBLE);
+            REQUIRE(result.getColumnType(4) == CHAR);
+            REQUIRE(result.getInt64(4097, 0) == 4097);
+            REQUIRE(result.getDouble(8, 3) == -98);
+            REQUIRE_THROWS(result.getInt64(0, 2));
+        }
+
+        THEN("Truncated or foreign bytes are rejected") {
+            string bytes = cursor.serialize();
+            REQUIRE_THROWS(Cursor::deserialize(bytes.substr(0, bytes.size() - 1)));
+            REQUIRE_THROWS(Cursor::deserialize(bytes.substr(0, 30)));
+            REQUIRE_THROWS(Cursor::deserialize(string("not a result at all")));
+
+            Cursor empty(column_names, vector<vector<string> >());
+            REQUIRE(Cursor::deserialize(empty.serialize()).getCount() == 0);
+        }
+    }
+}
+
+TEST_CASE("The serialized rows of a scan should keep the types and the exact values of the columns") {
+    GIVEN("A table with a column of each type") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        schema.addCol("big", INT64);
+        schema.addCol("ratio", FLOAT);
+        schema.addCol("balance", DOUBLE);
+        Table("columnar_types_test").drop();
+        Table table("columnar_types_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 5000; i++) {
+            vector<string> row;
+            row.push_back(i % 2 == 0 ? "007" : "n" + std::to_string(i));
+            row.push_back(std::to_string(i % 90 - 45));
+            row.push_back(std::to_string(i * 10000000000LL));
+            row.push_back(i == 0 ? "0.1000000015" : std::to_string(i) + ".25");
+            row.push_back(i == 0 ? "1.23456789" : std::to_string(i % 7));
+            table.insert(row);
+        }
+
+        THEN("The numbers come back without being rounded to their text") {
+            Cursor cursor = table.query("SELECT name, age, big, ratio, balance");
+            string bytes = cursor.serialize();
+            ColumnarResult result(make_shared<const string>(bytes));
+            REQUIRE(result.getCount() == 5000);
+            REQUIRE(result.getColumnType(0) == CHAR);
+            REQUIRE(result.getColumnType(1) == INT32);
+            REQUIRE(result.getColumnType(2) == INT64);
+            REQUIRE(result.getColumnType(3) == FLOAT);
+            REQUIRE(result.getColumnType(4) == DOUBLE);
+            REQUIRE(result.getDouble(0, 4) == 1.23456789);
+            REQUIRE(result.getDouble(0, 3) == (double) 0.1000000015f);
+            REQUIRE(result.getString(0, 0) == "007");
+            REQUIRE(result.getInt64(4999, 2) == 49990000000000LL);
+
+            bool same_values = true;
+            long long row = 0;
+            for (cursor.moveToFirst(); !cursor.isAfterLast(); cursor.moveToNext(), row++) {
+                for (int i = 0; i < 5; i++) {
+                    same_values = same_values && result.getString(row, i) == cursor.getString(i);
+                }
+                same_values = same_values && result.getInt64(row, 1) == cursor.getInt32(1);
+            }
+            REQUIRE(same_values);
+        }
+        table.drop();
+    }
+}
+
+TEST_CASE("The typed getters of a cursor should return the values of getString") {
+    GIVEN("A table with integers, doubles and names") {
+        Schema schema;
+        schema.addCol("name", CHAR, 20);
+        schema.addCol("age", INT32);
+        schema.addCol("balance", DOUBLE);
+        schema.addCol("big", INT64);
+        schema.addCol("ratio", FLOAT);
+        schema.addCol("precise", DOUBLE);
+        Table("typed_cursor_test").drop();
+        Table table("typed_cursor_test");
+        table.setSchema(schema);
+        for (int i = 0; i < 5000; i++) {
+            vector<string> row;
+            row.push_back("n" + std::to_string(i));
+            row.push_back(std::to_string(i % 90));
+            row.push_back(std::to_string(i) + ".5");
+            row.push_back(std::to_string(i * 10000000000LL));
+            row.push_back(i == 0 ? "0.1000000015" : "0.5");
+            row.push_back(i == 0 ? "1.23456789" : "2");
+            table.insert(row);
+        }
+
+        THEN("The cursors of the scans, the strings and the serialized rows agree") {
+            PreparedStatement statement = table.prepare("SELECT big, name, balance, age WHERE age < ? ORDER BY balance DESC");
+            statement.bind(0, 30);
+            int name = statement.getColumnIndex("name");
+            int age = statement.getColumnIndex("age");
+            int balance = statement.getColumnIndex("balance");
+            int big = statement.getColumnIndex("big");
+            REQUIRE(name == 1);
+            REQUIRE(big == 0);
+            REQUIRE_THROWS(statement.getColumnIndex("missing"));
+
+            Cursor cursor = statement.execute();
+            REQUIRE(cursor.getCount() == 1680);
+            REQUIRE(cursor.getColumnIndex("balance") == balance);
+            vector<vector<string> > rows;
+            for (cursor.moveToFirst(); !cursor.isAfterLast(); cursor.moveToNext()) {
+                vector<string> row;
+                for (int i = 0; i < 4; i++) {
+                    row.push_back(cursor.getString(i));
+                }
+                rows.push_back(row);
+            }
+            REQUIRE(rows.front()[1] == "n4979");
+            Cursor strings(cursor.getColumnNames(), rows);
+            Cursor copy = Cursor::deserialize(cursor.serialize());
+
+            Cursor * cursors[] = {&cursor, &strings, &copy};
+            for (int c = 0; c < 3; c++) {
+                bool same_values = true;
+                long long row = 0;
+                for (cursors[c]->moveToFirst(); !cursors[c]->isAfterLast(); cursors[c]->moveToNext(), row++) {
+                    same_values = same_values && cursors[c]->getStringView(name) == rows[row][name];
+                    same_values = same_values && std::to_string(cursors[c]->getInt32(age)) == rows[row][age];
+                    same_values = same_values && std::to_string(cursors[c]->getInt64("big")) == rows[row][big];
+                    same_values = same_values && cursors[c]->getDouble(balance) == atof(rows[row][balance].c_str());
+                    same_values = same_values && cursors[c]->getStringView(age) == rows[row][age];
+                }
+                REQUIRE(same_values);
+                REQUIRE(row == 1680);
+            }
+
+            cursor.moveToFirst();
+            strings.moveToFirst();
+            REQUIRE_THROWS(cursor.getInt64(name));
+            REQUIRE_THROWS(strings.getInt64(name));
+            REQUIRE_THROWS(strings.getInt64(balance));
+            REQUIRE_THROWS(cursor.getInt32(big));
+            REQUIRE_THROWS(cursor.getDouble("name"));
+            REQUIRE_THROWS(cursor.getStringView("missing"));
+            REQUIRE(cursor.getInt32(age) == 29);
+            while (!cursor.isAfterLast()) {
+                cursor.moveToNext();
+            }
+            REQUIRE_THROWS(cursor.getInt32(age));
+        }
+
+        THEN("A deserialized cursor returns the inserted numbers, not their text") {
+            Cursor cursor = table.query("SELECT ratio, precise, age WHERE big = 0");
+            Cursor copy = Cursor::deserialize(cursor.serialize());
+            Cursor * cursors[] = {&cursor, &copy};
+            for (int c = 0; c < 2; c++) {
+                REQUIRE(cursors[c]->getCount() == 1);
+                cursors[c]->moveToFirst();
+                REQUIRE(cursors[c]->getFloat("ratio") == 0.1000000015f);
+                REQUIRE(cursors[c]->getDouble("ratio") == (double) 0.1000000015f);
+                REQUIRE(cursors[c]->getDouble("precise") == 1.23456789);
+                REQUIRE(cursors[c]->getFloat("precise") == (float) 1.23456789);
+                REQUIRE(cursors[c]->getInt32("age") == 0);
+                REQUIRE(cursors[c]->getString("precise") == "1.23457");
+            }
+        }
+
+        THEN("An empty result has no rows to read") {
+            Cursor cursor = table.query("SELECT name WHERE age > 100");
+            REQUIRE(cursor.getCount() == 0);
+            cursor.moveToFirst();
+            REQUIRE(cursor.isAfterLast());
+            cursor.moveToNext();
+            REQUIRE(cursor.isAfterLast());
+            REQUIRE(Cursor::deserialize(cursor.serialize()).getCount() == 0);
+        }
+
+        table.drop();
+    }
+}
+
+TEST_CASE("An arena should hand out aligned memory until it's released at once") {
+    GIVEN("An arena with small chunks") {
+        Arena arena(256);
+
+        THEN("The allocations are aligned, don't overlap and are released by reset") {
+            vector<pair<char *, size_t> > blocks;
+            bool aligned = true;
+            for (size_t i = 1; i < 200; i++) {
+                size_t alignment = (size_t) 1 << (i % 5);
+                char * block = (char *) arena.allocate(i, alignment);
+                aligned = aligned && (uintptr_t) block % alignment == 0;
+                memset(block, (int) i, i);
+                blocks.push_back(make_pair(block, i));
+            }
+            REQUIRE(aligned);
+            bool intact = true;
+            for (size_t i = 0; i < blocks.size(); i++) {
+                for (size_t j = 0; j < blocks[i].second; j++) {
+                    intact = intact && blocks[i].first[j] == (char) blocks[i].second;
+                }
+            }
+            REQUIRE(intact);
+            REQUIRE(arena.getBytesAllocated() == 199 * 200 / 2);
+            REQUIRE(arena.getBytesReserved() >= arena.getBytesAllocated());
+
+            arena.reset();
+            REQUIRE(arena.getBytesAllocated() == 0);
+            REQUIRE(arena.getBytesReserved() == 0);
+        }
+
+        THEN("The containers with an ArenaAllocator keep their values on the arena") {
+            typedef ArenaAllocator<pair<const long long, long long> > Allocator;
+            unordered_multimap<long long, long long, hash<long long>, equal_to<long long>, Allocator> map(0, hash<long long>(), equal_to<long long>(),
+                                                                                                    Allocator(&arena));
+            for (long long i = 0; i < 10000; i++) {
+                map.insert(make_pair(i % 100, i));
+            }
+            REQUIRE(map.size() == 10000);
+            REQUIRE(map.count(42) == 100);
+            REQUIRE(arena.getBytesAllocated() >= 10000 * 2 * sizeof(long long));
+        }
+
+        THEN("A size that overflows is refused instead of wrapping around") {
+            ArenaAllocator<long long> allocator(&arena);
+            REQUIRE_THROWS(allocator.allocate(numeric_limits<size_t>::max() / 4));
+            REQUIRE_THROWS(arena.allocate(numeric_limits<size_t>::max() - 2, 8));
+            REQUIRE(arena.getBytesAllocated() == 0);
+        }
+    }
+
+    GIVEN("A join hash table built from a batch") {
+        Batch batch;
+        batch.columns.push_back(ColumnVector("key", INT64));
+        batch.resize(1000);
+        for (unsigned i = 0; i < 1000; i++) {
+            batch.columns[0].int64_values[i] = i % 10;
+            batch.positions[i] = i;
+        }
+        JoinHashTable table(true);
+        table.add(batch, 0);
+
+        THEN("Its copy, on an arena of its own, finds the same rows") {
+            JoinHashTable copy(table);
+            vector<long long> matches, copy_matches;
+            table.probe(batch.columns[0], 3, matches);
+            copy.probe(batch.columns[0], 3, copy_matches);
+            REQUIRE(matches.size() == 100);
+            REQUIRE(copy_matches == matches);
+            REQUIRE(copy.getKeys() == table.getKeys());
+        }
+    }
+
+    THEN("The numbers are formatted as by an ostream") {
+        double values[] = {0, -0.5, 0.1, 1.0 / 3, 123456789, 1e20, 2.5e-7, -98, 4979.5};
+        bool same_text = true;
+        for (unsigned i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            ostringstream stream;
+            stream << values[i];
+            same_text = same_text && formatDouble(values[i]) == stream.str();
+        }
+        REQUIRE(same_text);
+        REQUIRE(formatDouble(0.1f) == "0.1");
+    }
+}
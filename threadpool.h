@@ -0,0 +1,648 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <exception>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * The order in which the queued tasks are taken: every HIGH_PRIORITY task queued anywhere
+ * on the pool runs before the NORMAL_PRIORITY ones, e.g.: the morsels of a small scan are
+ * not queued behind the blocks of an ANALYZE
+ */
+enum TaskPriority {
+    HIGH_PRIORITY,   // short queries
+    NORMAL_PRIORITY, // the scans and aggregations of the other queries
+    LOW_PRIORITY     // maintenance, e.g.: ANALYZE and the index builds
+};
+
+const unsigned NUMBER_OF_PRIORITIES = 3;
+
+/**
+ * A flag shared by the tasks of a query, the copies of a token are all cancelled together.
+ * The queued tasks of a cancelled token don't run, the running ones may check it to stop early.
+ * A token with a deadline is cancelled once the deadline passed
+ */
+class CancellationToken {
+private:
+    struct State {
+        atomic<bool> cancelled;
+        atomic<bool> expired; // cancelled by the deadline
+        bool has_deadline;
+        chrono::steady_clock::time_point deadline;
+
+        State() : cancelled(false), expired(false), has_deadline(false) {}
+    };
+
+    shared_ptr<State> state;
+    static thread_local const CancellationToken * current; // @see CancellationScope
+
+    friend class CancellationScope;
+
+public:
+    /**
+     * @constructor
+     */
+    CancellationToken();
+
+    void cancel();
+
+    /**
+     * Cancel the token once a number of seconds passed, e.g.: the deadline of a query. It must
+     * be set before the token is shared with other threads
+     */
+    void setDeadline(double seconds);
+
+    bool isCancelled() const;
+
+    /**
+     * @return true if the token was cancelled by its deadline
+     */
+    bool isExpired() const;
+
+    /**
+     * Check the token cooperatively, e.g.: before reading each block of a scan
+     * @throw invalid_argument if the token is cancelled
+     */
+    void throwIfCancelled() const;
+
+    /**
+     * @return the token of the query run by the current thread, or a token never cancelled
+     * @see CancellationScope
+     */
+    static CancellationToken getCurrent();
+};
+
+/**
+ * Make a token the one of the query run by the current thread, until the scope ends. The
+ * operators created meanwhile (e.g.: the table scans) check it
+ * e.g.: CancellationScope scope(ticket.getToken());
+ *       Cursor cursor = run(statement, joined_table, NULL);
+ */
+class CancellationScope {
+private:
+    CancellationToken token;
+    const CancellationToken * previous;
+
+    CancellationScope(const CancellationScope &);
+    CancellationScope & operator=(const CancellationScope &);
+
+public:
+    /**
+     * @constructor
+     */
+    CancellationScope(const CancellationToken & token);
+
+    /**
+     * Restore the token of the enclosing scope
+     * @destructor
+     */
+    ~CancellationScope();
+};
+
+/**
+ * A fixed number of threads running the tasks submitted to them. Each thread has its own
+ * deques of tasks, one for each priority: the tasks submitted by a task are pushed to the
+ * back of the deque of its thread and taken from the back (the most recent first, while its
+ * data is in the cache). A thread without tasks steals from the front of the deques of the
+ * other threads, starting from a random one. The tasks submitted from outside the pool are
+ * queued on shared deques
+ * e.g.: ThreadPool::getShared().submit([&]() { readBlock(0, rows, positions); }, LOW_PRIORITY);
+ */
+class ThreadPool {
+private:
+    struct Task {
+        function<void()> run;
+        CancellationToken token;
+    };
+
+    struct Worker {
+        mutex deque_mutex;
+        deque<Task> tasks[NUMBER_OF_PRIORITIES];
+        minstd_rand random;
+    };
+
+    vector<unique_ptr<Worker> > workers;
+    vector<thread> threads;
+    mutex pool_mutex;
+    condition_variable task_available;
+    deque<Task> submitted[NUMBER_OF_PRIORITIES]; // from outside the pool, guarded by pool_mutex
+    long long pending_tasks; // queued and not taken yet, guarded by pool_mutex
+    bool stopping;
+    atomic<unsigned> running_queries;
+
+    ThreadPool(const ThreadPool &);
+    ThreadPool & operator=(const ThreadPool &);
+
+    /**
+     * @return the index of the worker running on the current thread, or -1 if it's not a
+     *         thread of this pool
+     */
+    int getCurrentWorker() const;
+
+    /**
+     * Take a task of the priority from the own deque of the worker, or from the shared
+     * deque, or else steal it from another worker
+     * @param worker - the index of the worker, or -1 if not a thread of the pool
+     */
+    bool take(int worker, unsigned priority, Task & task);
+
+    /**
+     * Take the task with the highest priority
+     */
+    bool takeAny(int worker, Task & task);
+
+    /**
+     * Run the tasks until the pool is destroyed
+     */
+    void work(unsigned worker);
+
+public:
+    /**
+     * @param number_of_threads - 0 for one thread for each core
+     * @constructor
+     */
+    ThreadPool(unsigned number_of_threads = 0);
+
+    /**
+     * Run the tasks already queued and stop the threads
+     * @destructor
+     */
+    ~ThreadPool();
+
+    /**
+     * @return the pool shared by all the tables, with one thread for each core
+     */
+    static ThreadPool & getShared();
+
+    unsigned getNumberOfThreads() const;
+
+    /**
+     * Queue a task. The task must not throw, and it should not wait for other tasks
+     * @param token - the task is dropped if the token is cancelled before it runs
+     */
+    void submit(function<void()> task, TaskPriority priority = NORMAL_PRIORITY, CancellationToken token = CancellationToken());
+
+    /**
+     * Run one queued task on the current thread, e.g.: while a task of the pool waits for
+     * other tasks, so the pool can't run out of threads
+     * @return false if there was no task
+     */
+    bool runPendingTask();
+
+    /**
+     * @return true if the current thread is one of the threads of the pool
+     */
+    bool isWorkerThread() const;
+
+    /**
+     * Count a parallel query (e.g.: a pipeline) running on the pool, until ThreadPool::endQuery
+     */
+    void beginQuery();
+    void endQuery();
+
+    /**
+     * The degree of parallelism of each query, so the running queries share the threads
+     * evenly, e.g.: 3 threads each for 2 queries on 6 threads, then 6 once one of them is done.
+     * The queries check it between morsels, growing or shrinking their number of tasks
+     * @return at least 1
+     */
+    unsigned getFairShare() const;
+};
+
+/**
+ * A group of tasks where some tasks only start after others are done, e.g.: the threads
+ * of an ANALYZE each read a range of blocks, and a last task merges their statistics
+ * TaskGraph graph;
+ * size_t read = graph.add([&]() { ... });
+ * graph.add([&]() { ... }, LOW_PRIORITY, vector<size_t>(1, read));
+ * graph.run();
+ * graph.wait();
+ *
+ * When a task throws, the graph is cancelled: the tasks not started yet don't run, and
+ * TaskGraph::wait rethrows the first exception
+ */
+class TaskGraph {
+private:
+    struct Node {
+        function<void()> run;
+        TaskPriority priority;
+        vector<size_t> dependents;
+        size_t remaining_dependencies;
+    };
+
+    ThreadPool & pool;
+    vector<Node> nodes;
+    CancellationToken token;
+    mutex graph_mutex;
+    condition_variable finished;
+    size_t finished_nodes;
+    bool started;
+    exception_ptr error;
+
+    TaskGraph(const TaskGraph &);
+    TaskGraph & operator=(const TaskGraph &);
+
+    /**
+     * Run a task, then submit the dependents it was the last dependency of
+     */
+    void runNode(size_t node);
+
+    /**
+     * Wait for every task, running the tasks of the pool meanwhile if on a thread of the pool
+     */
+    void waitAll();
+
+public:
+    /**
+     * @constructor
+     */
+    TaskGraph(ThreadPool & pool = ThreadPool::getShared());
+
+    /**
+     * Cancel the tasks not started yet and wait for the running ones
+     * @destructor
+     */
+    ~TaskGraph();
+
+    /**
+     * Add a task, before TaskGraph::run
+     * @param dependencies - the tasks that must be done before, as returned by TaskGraph::add
+     * @return the id of the task
+     */
+    size_t add(function<void()> task, TaskPriority priority = NORMAL_PRIORITY, const vector<size_t> & dependencies = vector<size_t>());
+
+    /**
+     * Submit the tasks without dependencies to the pool
+     */
+    void run();
+
+    /**
+     * Wait for all the tasks to be done or cancelled
+     * @throw the first exception thrown by a task
+     */
+    void wait();
+
+    /**
+     * The tasks not started yet won't run. The running tasks may check the token to stop early
+     */
+    void cancel();
+
+    bool isCancelled() const;
+    CancellationToken getToken() const;
+};
+
+/*****************************************
+ ************ IMPLEMENTATIONS ************
+ *****************************************/
+
+thread_local const CancellationToken * CancellationToken::current = NULL;
+
+CancellationToken::CancellationToken() : state(make_shared<State>()) {
+}
+
+void CancellationToken::cancel() {
+    state->cancelled.store(true);
+}
+
+void CancellationToken::setDeadline(double seconds) {
+    state->has_deadline = true;
+    state->deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<double>(seconds));
+}
+
+bool CancellationToken::isCancelled() const {
+    if (state->cancelled.load()) {
+        return true;
+    }
+    if (state->has_deadline && chrono::steady_clock::now() >= state->deadline) {
+        state->expired.store(true);
+        state->cancelled.store(true);
+        return true;
+    }
+    return false;
+}
+
+bool CancellationToken::isExpired() const {
+    return isCancelled() && state->expired.load();
+}
+
+void CancellationToken::throwIfCancelled() const {
+    if (isCancelled()) {
+        throw std::invalid_argument(isExpired() ? "The query missed its deadline" : "The query was cancelled");
+    }
+}
+
+CancellationToken CancellationToken::getCurrent() {
+    return current != NULL ? *current : CancellationToken();
+}
+
+CancellationScope::CancellationScope(const CancellationToken & token) : token(token) {
+    this->previous = CancellationToken::current;
+    CancellationToken::current = &this->token;
+}
+
+CancellationScope::~CancellationScope() {
+    CancellationToken::current = previous;
+}
+
+ThreadPool::ThreadPool(unsigned number_of_threads) {
+    if (number_of_threads == 0) {
+        number_of_threads = max(1u, thread::hardware_concurrency());
+    }
+    this->pending_tasks = 0;
+    this->stopping = false;
+    this->running_queries = 0;
+
+    for (unsigned i = 0; i < number_of_threads; i++) {
+        workers.push_back(unique_ptr<Worker>(new Worker()));
+        workers.back()->random.seed(i + 1);
+    }
+    for (unsigned i = 0; i < number_of_threads; i++) {
+        threads.push_back(thread(&ThreadPool::work, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        unique_lock<mutex> lock(pool_mutex);
+        stopping = true;
+    }
+    task_available.notify_all();
+    for (unsigned i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+}
+
+ThreadPool & ThreadPool::getShared() {
+    static ThreadPool shared_pool;
+    return shared_pool;
+}
+
+unsigned ThreadPool::getNumberOfThreads() const {
+    return threads.size();
+}
+
+int ThreadPool::getCurrentWorker() const {
+    thread::id current = this_thread::get_id();
+    for (unsigned i = 0; i < threads.size(); i++) {
+        if (threads[i].get_id() == current) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool ThreadPool::isWorkerThread() const {
+    return getCurrentWorker() >= 0;
+}
+
+void ThreadPool::submit(function<void()> task, TaskPriority priority, CancellationToken token) {
+    Task queued;
+    queued.run = task;
+    queued.token = token;
+
+    int worker = getCurrentWorker();
+    if (worker >= 0) {
+        unique_lock<mutex> lock(workers[worker]->deque_mutex);
+        workers[worker]->tasks[priority].push_back(queued);
+    }
+    {
+        unique_lock<mutex> lock(pool_mutex);
+        if (worker < 0) {
+            submitted[priority].push_back(queued);
+        }
+        pending_tasks++;
+    }
+    task_available.notify_one();
+}
+
+bool ThreadPool::take(int worker, unsigned priority, Task & task) {
+    if (worker >= 0) {
+        unique_lock<mutex> lock(workers[worker]->deque_mutex);
+        deque<Task> & own = workers[worker]->tasks[priority];
+        if (!own.empty()) {
+            task = move(own.back());
+            own.pop_back();
+            return true;
+        }
+    }
+    {
+        unique_lock<mutex> lock(pool_mutex);
+        if (!submitted[priority].empty()) {
+            task = move(submitted[priority].front());
+            submitted[priority].pop_front();
+            return true;
+        }
+    }
+
+    //Steal the oldest task of another worker, the random start spreads the thieves
+    unsigned start = worker >= 0 ? workers[worker]->random() % workers.size() : 0;
+    for (unsigned i = 0; i < workers.size(); i++) {
+        unsigned victim = (start + i) % workers.size();
+        if ((int) victim == worker) {
+            continue;
+        }
+        unique_lock<mutex> lock(workers[victim]->deque_mutex);
+        deque<Task> & stolen = workers[victim]->tasks[priority];
+        if (!stolen.empty()) {
+            task = move(stolen.front());
+            stolen.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::takeAny(int worker, Task & task) {
+    for (unsigned priority = 0; priority < NUMBER_OF_PRIORITIES; priority++) {
+        if (take(worker, priority, task)) {
+            unique_lock<mutex> lock(pool_mutex);
+            pending_tasks--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::runPendingTask() {
+    Task task;
+    if (!takeAny(getCurrentWorker(), task)) {
+        return false;
+    }
+    if (!task.token.isCancelled()) {
+        task.run();
+    }
+    return true;
+}
+
+void ThreadPool::work(unsigned worker) {
+    Task task;
+    while (true) {
+        if (takeAny(worker, task)) {
+            if (!task.token.isCancelled()) {
+                task.run();
+            }
+            task = Task();
+            continue;
+        }
+
+        //A pending task may be on its way to a deque, so check again until there are none
+        unique_lock<mutex> lock(pool_mutex);
+        if (pending_tasks == 0) {
+            if (stopping) {
+                return;
+            }
+            task_available.wait(lock, [this]() { return stopping || pending_tasks > 0; });
+        }
+    }
+}
+
+void ThreadPool::beginQuery() {
+    running_queries++;
+}
+
+void ThreadPool::endQuery() {
+    running_queries--;
+}
+
+unsigned ThreadPool::getFairShare() const {
+    unsigned queries = max(1u, running_queries.load());
+    return max(1u, (getNumberOfThreads() + queries - 1) / queries);
+}
+
+TaskGraph::TaskGraph(ThreadPool & pool) : pool(pool) {
+    this->finished_nodes = 0;
+    this->started = false;
+}
+
+TaskGraph::~TaskGraph() {
+    cancel();
+    if (started) {
+        waitAll();
+    }
+}
+
+size_t TaskGraph::add(function<void()> task, TaskPriority priority, const vector<size_t> & dependencies) {
+    if (started) {
+        throw std::invalid_argument("A task can't be added to a graph already running");
+    }
+    Node node;
+    node.run = task;
+    node.priority = priority;
+    node.remaining_dependencies = dependencies.size();
+    for (vector<size_t>::const_iterator it = dependencies.begin(); it != dependencies.end(); it++) {
+        //Only the tasks added before, so there are no cycles
+        if (*it >= nodes.size()) {
+            throw std::invalid_argument("A task can only depend on the tasks added before it");
+        }
+        nodes[*it].dependents.push_back(nodes.size());
+    }
+    nodes.push_back(node);
+    return nodes.size() - 1;
+}
+
+void TaskGraph::run() {
+    if (started) {
+        throw std::invalid_argument("The graph is already running");
+    }
+    started = true;
+    if (nodes.empty()) {
+        return;
+    }
+    //The tasks without dependencies are found before any of them runs: a task done meanwhile
+    //would leave its dependents without dependencies too, and they would be submitted twice
+    vector<size_t> roots;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].remaining_dependencies == 0) {
+            roots.push_back(i);
+        }
+    }
+    for (vector<size_t>::iterator it = roots.begin(); it != roots.end(); it++) {
+        size_t root = *it;
+        pool.submit([this, root]() { runNode(root); }, nodes[root].priority);
+    }
+}
+
+void TaskGraph::runNode(size_t node) {
+    if (!token.isCancelled()) {
+        try {
+            nodes[node].run();
+        } catch (...) {
+            unique_lock<mutex> lock(graph_mutex);
+            if (!error) {
+                error = current_exception();
+            }
+            token.cancel();
+        }
+    }
+
+    //The dependents of a cancelled task are also cancelled, they still run to be counted
+    vector<size_t> ready;
+    unique_lock<mutex> lock(graph_mutex);
+    for (vector<size_t>::iterator it = nodes[node].dependents.begin(); it != nodes[node].dependents.end(); it++) {
+        if (--nodes[*it].remaining_dependencies == 0) {
+            ready.push_back(*it);
+        }
+    }
+    for (vector<size_t>::iterator it = ready.begin(); it != ready.end(); it++) {
+        size_t dependent = *it;
+        pool.submit([this, dependent]() { runNode(dependent); }, nodes[dependent].priority);
+    }
+    //Notified with the lock held, the graph may be destroyed as soon as it's released
+    finished_nodes++;
+    finished.notify_all();
+}
+
+void TaskGraph::waitAll() {
+    bool worker_thread = pool.isWorkerThread();
+    unique_lock<mutex> lock(graph_mutex);
+    while (finished_nodes < nodes.size()) {
+        if (worker_thread) {
+            //Help the pool instead of holding one of its threads
+            lock.unlock();
+            bool ran = pool.runPendingTask();
+            lock.lock();
+            if (!ran && finished_nodes < nodes.size()) {
+                finished.wait_for(lock, chrono::milliseconds(1));
+            }
+        } else {
+            finished.wait(lock);
+        }
+    }
+}
+
+void TaskGraph::wait() {
+    if (!started) {
+        run();
+    }
+    waitAll();
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+void TaskGraph::cancel() {
+    token.cancel();
+}
+
+bool TaskGraph::isCancelled() const {
+    return token.isCancelled();
+}
+
+CancellationToken TaskGraph::getToken() const {
+    return token;
+}
+
+#endif //THREADPOOL_H
@@ -5,6 +5,12 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -31,6 +37,49 @@ vector<string> split(const string &s, char delim) {
     return elems;
 }
 
+/**
+ * Remove the spaces at the beginning and at the end of a string
+ * e.g.: trim("  points desc ") will return "points desc"
+ */
+string trim(const string &s) {
+    size_t first = s.find_first_not_of(' ');
+    if (first == string::npos) {
+        return "";
+    }
+    return s.substr(first, s.find_last_not_of(' ') - first + 1);
+}
+
+/**
+ * @return the text of a float or a double, the same as written by an ostream with the default
+ *         format (6 significant digits), without building a stream for each value
+ * e.g.: formatDouble(0.25) will return "0.25" and formatDouble(1e20) will return "1e+20"
+ */
+string formatDouble(double value) {
+    char text[32];
+    int size = snprintf(text, sizeof(text), "%g", value);
+    return string(text, size);
+}
+
+/**
+ * Create an empty file only used by the caller, e.g.: a run of a sort. The file is created by
+ * mkstemp on the directory of the TMPDIR environment variable (or /tmp), so neither another
+ * process nor the files left by a crashed run share its name
+ * e.g.: createTempFile("sort") will return "/tmp/naivedb_sort_Xa8kP2"
+ * @throw invalid_argument if the file can't be created
+ */
+string createTempFile(const string & prefix) {
+    const char * directory = getenv("TMPDIR");
+    string path = string(directory != NULL && directory[0] != '\0' ? directory : "/tmp") + "/naivedb_" + prefix + "_XXXXXX";
+    vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    int fd = mkstemp(&name[0]);
+    if (fd < 0) {
+        throw std::invalid_argument("Unable to create a file like " + path + ": " + strerror(errno));
+    }
+    close(fd);
+    return string(&name[0]);
+}
+
 /**
  * Print a 1D vector
  */
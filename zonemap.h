@@ -0,0 +1,225 @@
+#ifndef ZONEMAP_H
+#define ZONEMAP_H
+
+#include <fstream>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include "schema.h"
+#include "predicate.h"
+#include "queryable.h"
+
+using namespace std;
+
+/**
+ * The minimum and maximum value of each numeric column on each block of ROWS_PER_BLOCK
+ * rows of a table. A block whose range doesn't overlap the range of a predicate can be
+ * skipped without reading it, e.g.: for | block 0: points [0, 50] | block 1: points [40, 90] |
+ * only the block 1 may have rows where points > 60
+ *
+ * The CHAR columns have no range and never exclude a block. The zone map is persisted on a
+ * file as | number_of_rows | number_of_columns | followed by the min and max of each column
+ * for each block, and extended by Table::insert
+ */
+class ZoneMap {
+private:
+    string path;
+    vector<SchemaType> types;
+    unsigned long long number_of_rows;
+    vector<vector<double> > minimums; // [block][column]
+    vector<vector<double> > maximums;
+    bool dirty;
+
+public:
+    /**
+     * @param path - the file where the zone map is persisted
+     * @param schema_cols - the columns of the table, _id included
+     * @constructor
+     */
+    ZoneMap(string path = "", const vector<SchemaCol> & schema_cols = vector<SchemaCol>());
+
+    /**
+     * @return the number of rows covered, the rows 0 to number_of_rows - 1
+     */
+    unsigned long long getNumberOfRows() const;
+    long long getNumberOfBlocks() const;
+
+    /**
+     * @return true if the column has a range, i.e. it is numeric
+     */
+    bool hasRange(int column_position) const;
+
+    /**
+     * Extend the zone map with the next row, whose index must be getNumberOfRows()
+     * @param row - the values of every column, _id included
+     */
+    void add(const vector<string> & row);
+
+    /**
+     * @return false if no row of the block can match the predicate. A block not covered
+     *         by the zone map may match
+     */
+    bool blockMayMatch(long long block, const Predicate & predicate) const;
+
+    /**
+     * Get the range of a column on the whole table
+     * @return false if the column has no range or the table is empty
+     */
+    bool getRange(int column_position, double & minimum, double & maximum) const;
+
+    /**
+     * Load the zone map from the file, if any
+     * @return false if there is no file or it was written for other columns
+     */
+    bool load();
+
+    /**
+     * Write the zone map to the file, if it was changed since it was loaded
+     */
+    void save();
+
+    /**
+     * Delete the zone map and its file
+     */
+    void drop();
+};
+
+ZoneMap::ZoneMap(string path, const vector<SchemaCol> & schema_cols) {
+    this->path = path;
+    for (vector<SchemaCol>::const_iterator it = schema_cols.begin(); it != schema_cols.end(); it++) {
+        types.push_back(it->type);
+    }
+    this->number_of_rows = 0;
+    this->dirty = false;
+}
+
+unsigned long long ZoneMap::getNumberOfRows() const {
+    return number_of_rows;
+}
+
+long long ZoneMap::getNumberOfBlocks() const {
+    return minimums.size();
+}
+
+bool ZoneMap::hasRange(int column_position) const {
+    return column_position >= 0 && column_position < (int) types.size() && types[column_position] != CHAR;
+}
+
+void ZoneMap::add(const vector<string> & row) {
+    long long block = number_of_rows / ROWS_PER_BLOCK;
+    if ((long long) minimums.size() <= block) {
+        minimums.push_back(vector<double>(types.size(), numeric_limits<double>::infinity()));
+        maximums.push_back(vector<double>(types.size(), -numeric_limits<double>::infinity()));
+    }
+    for (unsigned column = 0; column < types.size() && column < row.size(); column++) {
+        if (types[column] != CHAR) {
+            double value = atof(row[column].c_str());
+            minimums[block][column] = min(minimums[block][column], value);
+            maximums[block][column] = max(maximums[block][column], value);
+        }
+    }
+    number_of_rows++;
+    dirty = true;
+}
+
+bool ZoneMap::blockMayMatch(long long block, const Predicate & predicate) const {
+    if (block >= (long long) minimums.size() || !hasRange(predicate.column_position) || predicate.values.empty()) {
+        return true;
+    }
+    double minimum = minimums[block][predicate.column_position];
+    double maximum = maximums[block][predicate.column_position];
+
+    switch (predicate.comparator) {
+        case EQUAL: {
+            double value = atof(predicate.values[0].c_str());
+            return value >= minimum && value <= maximum;
+        }
+        case IN:
+            for (vector<string>::const_iterator it = predicate.values.begin(); it != predicate.values.end(); it++) {
+                double value = atof(it->c_str());
+                if (value >= minimum && value <= maximum) {
+                    return true;
+                }
+            }
+            return false;
+        case LESS: return minimum < atof(predicate.values[0].c_str());
+        case LESS_EQUAL: return minimum <= atof(predicate.values[0].c_str());
+        case GREATER: return maximum > atof(predicate.values[0].c_str());
+        case GREATER_EQUAL: return maximum >= atof(predicate.values[0].c_str());
+        default: return true;
+    }
+}
+
+bool ZoneMap::getRange(int column_position, double & minimum, double & maximum) const {
+    if (!hasRange(column_position) || minimums.empty()) {
+        return false;
+    }
+    minimum = numeric_limits<double>::infinity();
+    maximum = -numeric_limits<double>::infinity();
+    for (size_t block = 0; block < minimums.size(); block++) {
+        minimum = min(minimum, minimums[block][column_position]);
+        maximum = max(maximum, maximums[block][column_position]);
+    }
+    return true;
+}
+
+bool ZoneMap::load() {
+    minimums.clear();
+    maximums.clear();
+    number_of_rows = 0;
+    dirty = false;
+
+    ifstream file;
+    file.open(path.c_str(), ios::binary);
+    unsigned long long file_rows = 0;
+    unsigned number_of_columns = 0;
+    if (!file.read(reinterpret_cast<char *> (&file_rows), sizeof(file_rows)) ||
+        !file.read(reinterpret_cast<char *> (&number_of_columns), sizeof(number_of_columns)) ||
+        number_of_columns != types.size()) {
+        return false;
+    }
+
+    long long number_of_blocks = (file_rows + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+    for (long long block = 0; block < number_of_blocks; block++) {
+        vector<double> block_minimums(types.size()), block_maximums(types.size());
+        if (!file.read(reinterpret_cast<char *> (&block_minimums[0]), sizeof(double) * types.size()) ||
+            !file.read(reinterpret_cast<char *> (&block_maximums[0]), sizeof(double) * types.size())) {
+            minimums.clear();
+            maximums.clear();
+            return false;
+        }
+        minimums.push_back(block_minimums);
+        maximums.push_back(block_maximums);
+    }
+    number_of_rows = file_rows;
+    return true;
+}
+
+void ZoneMap::save() {
+    if (!dirty || path.empty()) {
+        return;
+    }
+    ofstream file;
+    file.open(path.c_str(), ios::binary | ios::trunc);
+    unsigned number_of_columns = types.size();
+    file.write(reinterpret_cast<const char *> (&number_of_rows), sizeof(number_of_rows));
+    file.write(reinterpret_cast<const char *> (&number_of_columns), sizeof(number_of_columns));
+    for (size_t block = 0; block < minimums.size(); block++) {
+        file.write(reinterpret_cast<const char *> (&minimums[block][0]), sizeof(double) * types.size());
+        file.write(reinterpret_cast<const char *> (&maximums[block][0]), sizeof(double) * types.size());
+    }
+    file.close();
+    dirty = false;
+}
+
+void ZoneMap::drop() {
+    minimums.clear();
+    maximums.clear();
+    number_of_rows = 0;
+    dirty = false;
+    remove(path.c_str());
+}
+
+#endif //ZONEMAP_H